@@ -1,8 +1,23 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../include/lexer.h"
 #include "../include/parser.h"
 #include "../include/semantic.h"
+#include "../include/serialize.h"
+#include "../include/cache.h"
+#include "../include/dump.h"
+#include "../include/cfg.h"
+#include "../include/pass.h"
+#include "../include/bytecode.h"
+#include "../include/vm.h"
+#include "../include/super.h"
+#include "../include/peephole.h"
+#include "../include/regalloc.h"
+#include "../include/codegen.h"
+#include "../include/jit.h"
+#include "../include/tier.h"
+#include "../include/elfobj.h"
 
 // External processing functions
 extern void proc_test_file(const char* filename);
@@ -13,10 +28,197 @@ int main(int argc, char* argv[]) {
     const char* default_files[] = {
         "../test/input_valid.txt",
         "../test/input_invalid.txt",
-        "../test/input_semantic_error.txt"
+        "../test/input_semantic_error.txt",
+        "../test/input_fold.txt"
     };
     
-    if (argc < 2) {
+    // Leading options:
+    //   -j N                 threads the parser and semantic analyzer may use
+    //   --check              only report diagnostics and per-phase status
+    //   --cache DIR          reuse --check results for unchanged sources
+    //   --cache-size BYTES   size bound for the cache directory
+    //   --passes LIST        IR optimization pipeline, e.g. simplify,dce (or none)
+    //   --dispatch NAME      interpreter dispatch for --run: switch or threaded
+    //   --engine NAME        execution engine for --run: vm (default), jit or tiered
+    //   --tier-calls N       calls after which the tiered engine compiles a function
+    //   --tier-loops N       backward jumps after which it compiles the function looping
+    //   --tier-log           report what the tiered engine compiles, and when, on stderr
+    //   --super SET          superinstructions to select: selected, none or all
+    //   --peephole on|off    bytecode peephole optimizer (on by default)
+    //   --regalloc on|off    register allocation for -S (on by default)
+    int first_file = 1;
+    int check_only = 0;
+    const char* cache_dir = NULL;
+    long cache_size = CACHE_DEFAULT_MAX_BYTES;
+    while (first_file < argc) {
+        if (strcmp(argv[first_file], "-j") == 0 && first_file + 1 < argc) {
+            set_parser_threads(atoi(argv[first_file + 1]));
+            set_semantic_threads(atoi(argv[first_file + 1]));
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--check") == 0) {
+            check_only = 1;
+            first_file++;
+        } else if (strcmp(argv[first_file], "--cache") == 0 && first_file + 1 < argc) {
+            cache_dir = argv[first_file + 1];
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--cache-size") == 0 && first_file + 1 < argc) {
+            cache_size = atol(argv[first_file + 1]);
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--passes") == 0 && first_file + 1 < argc) {
+            set_pass_pipeline(argv[first_file + 1]);
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--dispatch") == 0 && first_file + 1 < argc) {
+            if (!set_vm_dispatch(argv[first_file + 1])) {
+                printf("Error: Unknown or unavailable dispatch %s (expected switch or threaded)\n",
+                       argv[first_file + 1]);
+                return 1;
+            }
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--engine") == 0 && first_file + 1 < argc) {
+            if (!set_engine(argv[first_file + 1])) {
+                printf("Error: Unknown engine %s (expected vm, jit or tiered)\n", argv[first_file + 1]);
+                return 1;
+            }
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--tier-calls") == 0 && first_file + 1 < argc) {
+            set_tier_thresholds(atoi(argv[first_file + 1]), tier_loop_threshold());
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--tier-loops") == 0 && first_file + 1 < argc) {
+            set_tier_thresholds(tier_call_threshold(), atoi(argv[first_file + 1]));
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--tier-log") == 0) {
+            set_tier_log(1);
+            first_file++;
+        } else if (strcmp(argv[first_file], "--super") == 0 && first_file + 1 < argc) {
+            if (!set_super_mode(argv[first_file + 1])) {
+                printf("Error: Unknown superinstruction set %s (expected selected, none or all)\n",
+                       argv[first_file + 1]);
+                return 1;
+            }
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--peephole") == 0 && first_file + 1 < argc) {
+            if (strcmp(argv[first_file + 1], "on") != 0 && strcmp(argv[first_file + 1], "off") != 0) {
+                printf("Error: Unknown peephole setting %s (expected on or off)\n", argv[first_file + 1]);
+                return 1;
+            }
+            set_peephole(strcmp(argv[first_file + 1], "on") == 0);
+            first_file += 2;
+        } else if (strcmp(argv[first_file], "--regalloc") == 0 && first_file + 1 < argc) {
+            if (strcmp(argv[first_file + 1], "on") != 0 && strcmp(argv[first_file + 1], "off") != 0) {
+                printf("Error: Unknown regalloc setting %s (expected on or off)\n", argv[first_file + 1]);
+                return 1;
+            }
+            set_regalloc(strcmp(argv[first_file + 1], "on") == 0);
+            first_file += 2;
+        } else {
+            break;
+        }
+    }
+    
+    // "--emit-ast OUT SOURCE" saves the tokens and AST, "--dump-ast FILE" prints a saved AST
+    if (argc > first_file + 2 && strcmp(argv[first_file], "--emit-ast") == 0) {
+        return emit_ast_file(argv[first_file + 2], argv[first_file + 1]) ? 0 : 1;
+    }
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--dump-ast") == 0) {
+        return dump_ast_file(argv[first_file + 1]) ? 0 : 1;
+    }
+    
+    // "--dump FORMAT SOURCE" writes the tokens and AST as text, json or binary
+    if (argc > first_file + 2 && strcmp(argv[first_file], "--dump") == 0) {
+        DumpFormat format;
+        if (!parse_dump_format(argv[first_file + 1], &format)) {
+            printf("Error: Unknown dump format %s (expected text, json or binary)\n", argv[first_file + 1]);
+            return 1;
+        }
+        dump_source_file(argv[first_file + 2], format);
+        return 0;
+    }
+    
+    // "--cfg SOURCE" prints each function's control-flow graph and dominators
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--cfg") == 0) {
+        proc_cfg_file(argv[first_file + 1]);
+        return 0;
+    }
+    
+    // "--ir SOURCE" prints the optimized SSA form and per-pass timing
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--ir") == 0) {
+        proc_ir_file(argv[first_file + 1]);
+        return 0;
+    }
+    
+    // "--bytecode SOURCE" prints the compiled bytecode
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--bytecode") == 0) {
+        proc_bytecode_file(argv[first_file + 1]);
+        return 0;
+    }
+    
+    // "-S SOURCE [OUT]" writes x86-64 assembly (to stdout without OUT); link it with runtime/runtime.c
+    if (argc > first_file + 1 && strcmp(argv[first_file], "-S") == 0) {
+        return proc_assembly_file(argv[first_file + 1], argc > first_file + 2 ? argv[first_file + 2] : NULL) ? 0 : 1;
+    }
+    
+    // "-c SOURCE [OUT]" writes an ELF object (SOURCE's base name with .o without OUT); link it with runtime/runtime.c
+    if (argc > first_file + 1 && strcmp(argv[first_file], "-c") == 0) {
+        return proc_object_file(argv[first_file + 1], argc > first_file + 2 ? argv[first_file + 2] : NULL) ? 0 : 1;
+    }
+    
+    // "--exe SOURCE [OUT]" writes a static executable (a.out without OUT) that needs no runtime library
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--exe") == 0) {
+        return proc_executable_file(argv[first_file + 1], argc > first_file + 2 ? argv[first_file + 2] : NULL) ? 0 : 1;
+    }
+    
+    // "--regalloc-stats SOURCE..." reports, per function, the values kept in registers and those spilled
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--regalloc-stats") == 0) {
+        proc_regalloc_files(argc - first_file - 1, argv + first_file + 1);
+        return 0;
+    }
+    
+    // "--run SOURCE" executes the program; niam's result is the exit status
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--run") == 0) {
+        return proc_execute_file(argv[first_file + 1]);
+    }
+    
+    // "--bench SOURCE..." runs each program without output and reports instructions/second
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--bench") == 0) {
+        proc_bench_files(argc - first_file - 1, argv + first_file + 1);
+        return 0;
+    }
+    
+    // "--profile SOURCE..." reports the hottest opcode sequences and the dispatches superinstructions save
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--profile") == 0) {
+        proc_profile_files(argc - first_file - 1, argv + first_file + 1);
+        return 0;
+    }
+    
+    // "--peephole-stats SOURCE..." reports what the bytecode peephole optimizer removes
+    if (argc > first_file + 1 && strcmp(argv[first_file], "--peephole-stats") == 0) {
+        proc_peephole_files(argc - first_file - 1, argv + first_file + 1);
+        return 0;
+    }
+    
+    // "--gen-super OUT SOURCE..." regenerates the superinstruction list from a profile of the sources
+    if (argc > first_file + 2 && strcmp(argv[first_file], "--gen-super") == 0) {
+        return proc_gen_super(argv[first_file + 1], argc - first_file - 2, argv + first_file + 2) ? 0 : 1;
+    }
+    
+    // "--reparse OLD NEW" parses OLD, then reparses only what changed in NEW
+    if (argc > first_file + 2 && strcmp(argv[first_file], "--reparse") == 0) {
+        proc_reparse_files(argv[first_file + 1], argv[first_file + 2]);
+        return 0;
+    }
+    
+    if (check_only) {
+        if (cache_dir) {
+            cache_open(cache_dir, cache_size, argv[0]);
+        }
+        for (int i = first_file; i < argc; i++) {
+            proc_check_file(argv[i]);
+        }
+        cache_close();
+        return 0;
+    }
+    
+    if (argc <= first_file) {
         printf("No files specified, running all test files...\n");
         
         // Process syntax analysis on valid and invalid files
@@ -24,13 +226,14 @@ int main(int argc, char* argv[]) {
         proc_test_file(default_files[0]);
         proc_test_file(default_files[1]);
         
-        // Process semantic analysis on valid and semantic error files
+        // Process semantic analysis on valid, semantic error and folding files
         printf("\n===== SEMANTIC ANALYSIS =====\n");
         proc_semantic_file(default_files[0]);
         proc_semantic_file(default_files[2]);
+        proc_semantic_file(default_files[3]);
     } else {
         // Process each file specified as arguments
-        for (int i = 1; i < argc; i++) {
+        for (int i = first_file; i < argc; i++) {
             // Run both syntax and semantic analysis
             proc_test_file(argv[i]);
             proc_semantic_file(argv[i]);
@@ -38,4 +241,4 @@ int main(int argc, char* argv[]) {
     }
     
     return 0;
-}
\ No newline at end of file
+}
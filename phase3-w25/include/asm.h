@@ -0,0 +1,67 @@
+/* asm.h */
+#ifndef ASM_H
+#define ASM_H
+
+// In-house x86-64 assembler for the AT&T syntax the code generator emits
+// (codegen.h): the integer, SSE2 scalar and control-flow instructions it
+// uses, labels, and the .text/.rodata/.bss directives. The JIT loads what it
+// produces straight into memory; elfobj.h writes it to ELF files.
+
+typedef enum {
+    ASM_TEXT,
+    ASM_RODATA,
+    ASM_BSS,
+    ASM_SECTION_COUNT
+} AsmSection;
+
+typedef struct {
+    char* name;
+    int section;               // AsmSection, or -1 if not defined here
+    int offset;                // Within its section
+    int size;                  // From .size (0 if not given)
+    int global;                // Named by .globl
+    int function;              // Typed @function
+} AsmSymbol;
+
+// A 32-bit field patched at link time to S + addend - P, where S is the
+// symbol's address (for GOTPCREL, that of a slot holding it) and P the
+// field's
+typedef enum {
+    ASM_RELOC_PC32,            // Data reference, %rip-relative
+    ASM_RELOC_PLT32,           // Call or jump to a function
+    ASM_RELOC_GOTPCREL         // Load of the symbol's address from its GOT slot
+} AsmRelocType;
+
+typedef struct {
+    int section;               // Section holding the field
+    int offset;                // Of the field within it
+    int symbol;
+    AsmRelocType type;
+    int addend;
+} AsmReloc;
+
+typedef struct {
+    unsigned char* bytes[ASM_SECTION_COUNT]; // NULL for .bss, which is only a size
+    int size[ASM_SECTION_COUNT];
+    int capacity[ASM_SECTION_COUNT];
+    int align[ASM_SECTION_COUNT];
+    AsmSymbol* symbols;
+    int symbol_count;
+    int symbol_capacity;
+    AsmReloc* relocs;          // What assembly could not resolve itself
+    int reloc_count;
+    int reloc_capacity;
+    char error[160];           // Why assembly failed
+} AsmUnit;
+
+// Assemble 'source' into 'unit'. Branches to labels in the same section are
+// resolved; references across sections or to undefined symbols are left as
+// relocations. Returns 0, with the reason in unit->error, on anything
+// outside the supported subset.
+int assemble(const char* source, AsmUnit* unit);
+void free_asm_unit(AsmUnit* unit);
+
+// Index of a symbol, or -1
+int asm_find_symbol(const AsmUnit* unit, const char* name);
+
+#endif /* ASM_H */
@@ -0,0 +1,163 @@
+/* bytecode.h */
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <stdint.h>
+#include "ir.h"
+
+// Register-machine opcodes, specialized by operand type from the IR's
+// static types so handlers never inspect a value. Registers are numbered per
+// call frame.
+typedef enum {
+    BC_LOADK,                  // R[a] = K[b]
+    BC_MOVE,                   // R[a] = R[b]
+    BC_LOADG,                  // R[a] = G[b]
+    BC_STOREG,                 // G[b] = R[a]
+    BC_ADDI,                   // R[a] = R[b] op R[c] on ints (wrapping), for BC_ADDI..BC_DIVI
+    BC_SUBI,
+    BC_MULI,
+    BC_DIVI,
+    BC_ADDF,                   // Likewise on floats
+    BC_SUBF,
+    BC_MULF,
+    BC_DIVF,
+    BC_EQI,                    // R[a] = R[b] op R[c] as an int, comparing ints
+    BC_NEI,
+    BC_LTI,
+    BC_LEI,
+    BC_GTI,
+    BC_GEI,
+    BC_EQF,                    // Likewise comparing floats
+    BC_NEF,
+    BC_LTF,
+    BC_LEF,
+    BC_GTF,
+    BC_GEF,
+    BC_AND,                    // Ints
+    BC_OR,
+    BC_ITOF,                   // R[a] = op R[b]
+    BC_FTOI,
+    BC_FACT,
+    BC_CALL,                   // R[a] = function b, called with its arguments in R[c]...
+    BC_PRINTI,                 // tnirp R[a], an int
+    BC_PRINTF,                 // A float
+    BC_PRINTS,                 // A string
+    BC_JUMP,                   // Go to target
+    BC_JUMPIF,                 // Go to target if int R[a] is non-zero
+    BC_JUMPIFNOT,              // Go to target if it is zero
+    BC_RETURN,                 // Return int R[a]
+
+    // Superinstructions (see super.h), fusing a constant load into its use
+    // or a comparison into the branch on it. Branch targets are in c.
+    BC_ADDIK,                  // R[a] = R[b] op K[c] on ints, for BC_ADDIK..BC_DIVIK
+    BC_SUBIK,
+    BC_MULIK,
+    BC_DIVIK,
+    BC_ADDFK,                  // Likewise on floats
+    BC_SUBFK,
+    BC_MULFK,
+    BC_DIVFK,
+    BC_JEQI,                   // Go to c if int R[a] op R[b], for BC_JEQI..BC_JGEI
+    BC_JNEI,
+    BC_JLTI,
+    BC_JLEI,
+    BC_JGTI,
+    BC_JGEI,
+    BC_JEQIK,                  // Go to c if int R[a] op K[b], for BC_JEQIK..BC_JGEIK
+    BC_JNEIK,
+    BC_JLTIK,
+    BC_JLEIK,
+    BC_JGTIK,
+    BC_JGEIK,
+    BC_OPCODE_COUNT
+} BCOpcode;
+
+// One instruction; jumps keep their target in b (low half) and c (high half)
+typedef struct {
+    uint16_t op;
+    uint16_t a;
+    uint16_t b;
+    uint16_t c;
+} BCInstr;
+
+#define BC_TARGET(instr) ((uint32_t)(instr).b | ((uint32_t)(instr).c << 16))
+
+// Fused compare-and-branch instructions, whose target is c alone
+#define BC_IS_FUSED_BRANCH(op) ((op) >= BC_JEQI && (op) <= BC_JGEIK)
+
+// Largest register, constant, global or function number an operand can hold
+#define BC_MAX_OPERAND 0xFFFF
+
+// A register, constant or global: one untagged 64-bit slot. The opcode
+// reading it says which member holds the value.
+typedef union {
+    int i;
+    double f;
+    const char* s;
+} Value;
+
+// Constant types, kept for the listing and for freeing strings
+typedef enum {
+    VAL_INT,
+    VAL_FLOAT,
+    VAL_STR
+} ValueTag;
+
+typedef struct {
+    char* name;
+    int param_count;           // Arguments arrive in registers 0..param_count-1
+    int register_count;        // Frame size
+    BCInstr* code;
+    int* lines;                // Source line of each instruction
+    int* block_start;          // First instruction of each IR block (-1 if dead)
+    int block_count;
+    int code_count;
+    int code_capacity;
+    Value* constants;          // Strings are owned by the function
+    ValueTag* constant_tags;
+    int constant_count;
+    int constant_capacity;
+} BCFunction;
+
+typedef struct {
+    BCFunction* functions;
+    int function_count;
+    int global_count;
+    int main_function;         // Index of niam (-1 if none)
+    int init_function;         // Index of the top-level statements (-1 if none)
+} BCProgram;
+
+// Translate optimized SSA into bytecode (phis become moves on the incoming
+// edges); NULL, with a message, if a function exceeds the operand limits
+BCProgram* compile_bytecode(const IRProgram* program);
+void free_bytecode(BCProgram* program);
+
+// The register compile_bytecode gives each value of 'ir', by value number
+// (-1 for none); returns how many it uses. Native code entering a call the
+// interpreter is running (tier.h) finds the values there.
+int bc_value_registers(const IRFunction* ir, int* registers);
+
+// Branch target of a jump or fused branch (-1 for other instructions), and
+// its replacement
+int bc_jump_target(const BCInstr* instr);
+void bc_set_jump_target(BCInstr* instr, int target);
+
+// Registers an instruction reads: up to two in reads[] (the count is
+// returned), plus for a call its arguments R[c..c+*range_count)
+int bc_reads(const BCProgram* program, const BCInstr* instr, int reads[2], int* range_count);
+
+// Register an instruction writes, or -1
+int bc_writes(const BCInstr* instr);
+
+// Delete the instructions flagged in 'removed', renumbering jump targets;
+// a jump to a deleted instruction lands on the next one kept
+void bc_remove_instructions(BCFunction* function, const char* removed);
+
+const char* bc_op_name(BCOpcode op);
+void print_bytecode_function(const BCFunction* function);
+void print_bytecode_program(const BCProgram* program);
+
+// Compile a file through the IR pipeline and print its bytecode
+void proc_bytecode_file(const char* filename);
+
+#endif /* BYTECODE_H */
@@ -0,0 +1,32 @@
+/* cache.h */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+
+#define CACHE_FORMAT_VERSION 2
+#define CACHE_DEFAULT_MAX_BYTES (64L * 1024 * 1024)
+
+// Final status of each phase for one source file
+typedef struct {
+    int lexical_errors;      // Error tokens produced by the lexer
+    int parse_errors;        // Parse errors reported
+    int semantic_errors;     // Semantic errors reported
+    int semantic_valid;      // analyze_semantics result
+} CheckResult;
+
+// Cache counters reported at the end of a run
+typedef struct {
+    int hits;
+    int misses;
+    int evictions;
+    int stores;
+} CacheStats;
+
+// Cache functions
+void cache_open(const char* directory, long max_bytes, const char* program_path);
+void cache_close(void);
+uint64_t hash_bytes(const void* data, size_t length, uint64_t seed);
+void proc_check_file(const char* filename);
+
+#endif /* CACHE_H */
@@ -0,0 +1,76 @@
+/* cfg.h */
+#ifndef CFG_H
+#define CFG_H
+
+#include "parser.h"
+
+// How control leaves a basic block
+typedef enum {
+    CFG_JUMP,                  // One successor
+    CFG_BRANCH,                // Successor 0 if 'value' is true, successor 1 if false
+    CFG_RETURN,                // Return 'value' (NULL when the body falls off its end)
+    CFG_EXIT                   // The function's single exit block
+} CFGEnd;
+
+// A straight-line run of statements. Edges live in the CFG's shared edge
+// array: successors at [succ, succ + succ_count), predecessors likewise.
+typedef struct {
+    int first;                 // First statement, index into cfg->statements
+    int count;                 // Number of statements
+    CFGEnd end;                // How control leaves the block
+    ASTNode* value;            // Branch condition or returned expression
+    int line;                  // Line of the branch or return
+    int succ;
+    int succ_count;
+    int pred;
+    int pred_count;
+    int idom;                  // Immediate dominator (-1 for the entry and unreachable blocks)
+    int rpo;                   // Position in reverse postorder (-1 if unreachable)
+    int dom_children;          // Dominator tree children at cfg->dom_tree[dom_children..]
+    int dom_child_count;
+    int dom_pre;               // Dominator tree preorder/postorder numbers
+    int dom_post;
+    int loop_depth;            // Number of natural loops containing the block
+    int frontier;              // Dominance frontier at cfg->frontiers[frontier..], once computed
+    int frontier_count;
+} BasicBlock;
+
+// Control-flow graph of one function body
+typedef struct {
+    ASTNode* function;         // The AST_FUNCTION_DECL (or program) it was built from
+    BasicBlock* blocks;
+    int block_count;
+    ASTNode** statements;      // Straight-line statements, grouped by block
+    int statement_count;
+    int* edges;                // Successor lists, then predecessor lists
+    int edge_count;            // Number of edges (each is stored twice)
+    int* order;                // Reachable blocks in reverse postorder
+    int reachable;             // Length of order
+    int* dom_tree;             // Dominator tree child lists
+    int* frontiers;            // Dominance frontier lists (NULL until computed)
+    int entry;                 // Always block 0
+    int exit;                  // Block 1 (-1 for graphs built from an edge list)
+} CFG;
+
+// Successor/predecessor i of block b
+#define CFG_SUCC(cfg, b, i) ((cfg)->edges[(cfg)->blocks[b].succ + (i)])
+#define CFG_PRED(cfg, b, i) ((cfg)->edges[(cfg)->blocks[b].pred + (i)])
+
+// Build the CFG of a checked function declaration (or, given the program
+// root, of the top-level statements), with dominators and loop depths
+CFG* build_cfg(ASTNode* function);
+void free_cfg(CFG* cfg);
+
+// Same analyses for a graph given as edges from[i] -> to[i], entry block 0
+CFG* build_cfg_from_edges(int block_count, const int* from, const int* to, int edge_count);
+
+// Fill in the dominance frontier lists
+void cfg_dominance_frontiers(CFG* cfg);
+
+// Does block a dominate block b? (Unreachable blocks dominate nothing.)
+int cfg_dominates(const CFG* cfg, int a, int b);
+
+void print_cfg(const CFG* cfg);
+void proc_cfg_file(const char* filename);
+
+#endif /* CFG_H */
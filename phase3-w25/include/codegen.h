@@ -0,0 +1,45 @@
+/* codegen.h */
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include <stdio.h>
+#include "ir.h"
+
+typedef struct {
+    int depth_limit;           // Calls nested this deep are a "stack overflow" runtime
+                               // error, as in the VM (0: unchecked)
+    const char* functions;     // Translate only the functions flagged here, by number, and
+                               // leave out main (NULL: all of them, and main)
+    int external_data;         // Leave bc_globals and bc_depth undefined and reach them
+                               // through @GOTPCREL, so the loader can supply them
+    int entries;               // Add the entry points tiered execution uses (below)
+    size_t stack_size;         // Have main run the program on a stack this large, through
+                               // bc_run_main (runtime.h) (0: on main's own stack)
+} CodegenOptions;
+
+// Translate optimized SSA into x86-64 GNU assembly (AT&T syntax, System V
+// calling convention). Int and string values live in the registers the
+// allocator (regalloc.h) gives them, the rest in stack slots; phis become
+// moves on the incoming edges. The output defines main, which runs the
+// top-level statements, then niam, and exits with niam's result. tnirp,
+// conversions and runtime errors call runtime/runtime.c, which the program
+// is linked with:
+//   gcc prog.s runtime/runtime.c -pthread -o prog
+// Returns 0, with a message, if a function cannot be translated. options
+// may be NULL for the defaults.
+//
+// With options->entries, each function N translated also gets entry points
+// for the interpreter (tier.h), both returning N's result:
+//   int bc_enter_N(const Value* args)  calls N with args[0..param_count)
+//   int bc_osr_N_B(Value* frame)       finishes a call of N the interpreter
+//                                      is running, from the header B of a
+//                                      loop, reading each live value from
+//                                      the register the bytecode compiler
+//                                      gave it (bc_value_registers)
+int emit_assembly(IRProgram* program, const CodegenOptions* options, FILE* out);
+
+// Compile a file through the IR pipeline to assembly in 'output' (stdout if
+// NULL); returns 1 on success
+int proc_assembly_file(const char* filename, const char* output);
+
+#endif /* CODEGEN_H */
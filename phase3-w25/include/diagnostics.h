@@ -0,0 +1,23 @@
+/* diagnostics.h */
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stddef.h>
+
+// Growable text buffer that holds captured diagnostic output
+typedef struct DiagBuffer {
+    char* data;              // Captured text (not NUL-terminated)
+    size_t length;           // Bytes used
+    size_t capacity;         // Bytes allocated
+    struct DiagBuffer* previous; // Capture this one interrupted, restored at its end
+} DiagBuffer;
+
+// Diagnostic output functions
+void diag_printf(const char* format, ...);
+void diag_write(DiagBuffer* buffer, const char* data, size_t length);
+void diag_capture_begin(DiagBuffer* buffer);
+void diag_capture_end(void);
+void diag_buffer_flush(DiagBuffer* buffer);
+void diag_buffer_free(DiagBuffer* buffer);
+
+#endif /* DIAGNOSTICS_H */
@@ -0,0 +1,44 @@
+/* dump.h */
+#ifndef DUMP_H
+#define DUMP_H
+
+#include "tokens.h"
+#include "parser.h"
+#include "diagnostics.h"
+
+// Output formats for token and AST dumps
+typedef enum {
+    DUMP_TEXT,                 // The human-readable format print_token/print_ast use
+    DUMP_JSON,                 // One JSON object per line
+    DUMP_BINARY                // Compact record stream, see below
+} DumpFormat;
+
+// Binary stream: DUMP_MAGIC, a version byte, then records. Every number is
+// an unsigned LEB128 varint and every string is a varint length plus bytes.
+//   'T' type error line column offset lexeme     one token
+//   'N' type children line column static_type slot+1 depth+1 lexeme
+//                                                one AST node, in preorder;
+//                                                children bit 0 = has left,
+//                                                bit 1 = has right; slot and
+//                                                depth are 0 when unresolved
+//   'E'                                          end of stream
+#define DUMP_MAGIC "BWCDUMP"   // 7 bytes, no terminator
+#define DUMP_VERSION 2
+
+// Start writing the buffer to stdout once it holds this many bytes
+#define DUMP_FLUSH_BYTES (64 * 1024)
+
+// Kind-name tables
+const char* token_kind_name(TokenType type);
+const char* ast_kind_name(ASTNodeType type);
+int parse_dump_format(const char* name, DumpFormat* format);
+
+// Dumpers append to 'out' and flush it to stdout whenever it grows large
+void dump_lexical_error(DiagBuffer* out, ErrorType error, int line, const char* lexeme);
+void dump_token(DiagBuffer* out, const Token* token, DumpFormat format);
+void dump_tokens(DiagBuffer* out, const Token* tokens, int count, DumpFormat format);
+void dump_ast_label(DiagBuffer* out, ASTNodeType type, const char* lexeme);
+void dump_ast(DiagBuffer* out, const ASTNode* root, int level, DumpFormat format);
+void dump_source_file(const char* filename, DumpFormat format);
+
+#endif /* DUMP_H */
@@ -0,0 +1,35 @@
+/* elfobj.h */
+#ifndef ELFOBJ_H
+#define ELFOBJ_H
+
+#include "asm.h"
+
+// ELF64 output for the native backend, straight from an assembled unit
+// (asm.h), with no external assembler or linker.
+//
+// A relocatable object has .text, .rodata and .bss, a symbol table and the
+// relocations asm.c left: calls to the runtime library (R_X86_64_PLT32)
+// and %rip-relative references to the other sections (R_X86_64_PC32).
+// It links like the output of -S:
+//   gcc prog.o runtime/runtime.c -pthread -o prog
+//
+// An executable is static and needs nothing at run time: the program is
+// assembled together with a small built-in runtime (the functions of
+// runtime/runtime.c on Linux system calls) whose _start runs main on a
+// stack as deep as the VM allows.
+
+// Write 'unit' as a relocatable object; returns 0, with the reason in
+// 'error', on failure
+int write_elf_object(const AsmUnit* unit, const char* filename, char* error, int error_size);
+
+// Link 'unit', which must define _start and everything it uses, at fixed
+// addresses and write it as an executable
+int write_elf_executable(AsmUnit* unit, const char* filename, char* error, int error_size);
+
+// Compile a file through the native backend to an object (OUTPUT defaults
+// to the source's base name with .o) or a static executable (a.out);
+// return 1 on success
+int proc_object_file(const char* filename, const char* output);
+int proc_executable_file(const char* filename, const char* output);
+
+#endif /* ELFOBJ_H */
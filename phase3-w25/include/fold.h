@@ -0,0 +1,22 @@
+/* fold.h */
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "parser.h"
+
+// What constant folding did to a tree
+typedef struct {
+    int folded;                // Operator and factorial nodes replaced by a literal
+    int propagated;            // Identifier uses replaced by a constant value
+    int removed;               // AST nodes freed
+    int division_by_zero;      // Divisions whose divisor folded to zero, left unfolded
+} FoldStats;
+
+// Fold constant expressions in a semantically checked tree (needs the
+// slot/type annotations). It runs on the way to the CFG and IR, not as part
+// of the checks, so the dumps and serialized trees keep the source's shape.
+// A division by a folded zero is kept as it is: it may sit in code that
+// never runs, and otherwise fails at run time.
+void fold_constants(ASTNode* ast, FoldStats* stats);
+
+#endif /* FOLD_H */
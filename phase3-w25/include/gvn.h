@@ -0,0 +1,14 @@
+/* gvn.h */
+#ifndef GVN_H
+#define GVN_H
+
+#include "ir.h"
+
+// Dominator-based global value numbering. A computation with the same
+// operation and operand values as one in a dominating block is replaced by
+// the earlier result. Loads of a global reuse the last value loaded or
+// stored along straight-line paths until a call may have changed it.
+// *changes counts the instructions eliminated.
+int gvn_pass(IRFunction* function, int* changes);
+
+#endif /* GVN_H */
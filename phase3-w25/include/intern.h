@@ -0,0 +1,25 @@
+/* intern.h */
+#ifndef INTERN_H
+#define INTERN_H
+
+// Interned string table: every distinct string gets a small dense id
+typedef struct {
+    char* chars;             // All strings, NUL-separated
+    int chars_used;          // Bytes used in chars
+    int chars_capacity;      // Bytes allocated for chars
+    int* offsets;            // id -> offset of the string in chars
+    unsigned int* hashes;    // id -> hash of the string
+    int count;               // Number of interned strings
+    int capacity;            // Allocated ids
+    int* slots;              // Open-addressing hash slots holding id + 1 (0 = empty)
+    int slot_count;          // Number of slots (power of two)
+} StringTable;
+
+// String table functions
+StringTable* intern_create(void);
+int intern_string(StringTable* table, const char* name);
+int intern_find(const StringTable* table, const char* name);
+const char* intern_name(const StringTable* table, int id);
+void intern_free(StringTable* table);
+
+#endif /* INTERN_H */
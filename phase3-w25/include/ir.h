@@ -0,0 +1,138 @@
+/* ir.h */
+#ifndef IR_H
+#define IR_H
+
+#include "parser.h"
+#include "cfg.h"
+
+// Value types
+typedef enum {
+    IR_VOID,
+    IR_INT,                    // 32-bit wrapping integer
+    IR_FLOAT,                  // double
+    IR_STR                     // String literal (only printed)
+} IRType;
+
+// Operations. Arithmetic and comparisons take operands of one type (the
+// lowering inserts conversions); comparisons and logic produce an int.
+typedef enum {
+    IR_CONST,                  // imm
+    IR_PARAM,                  // Parameter 'index'
+    IR_LOAD,                   // Read global 'index'
+    IR_STORE,                  // Write args[0] to global 'index'
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_EQ,
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_GT,
+    IR_GE,
+    IR_AND,                    // Both ints non-zero
+    IR_OR,                     // Either int non-zero
+    IR_ITOF,                   // Int to float
+    IR_FTOI,                   // Float to int, truncating
+    IR_FACT,                   // lairotcaf(args[0])
+    IR_CALL,                   // Call function 'index' with args
+    IR_PRINT,                  // tnirp args[0]
+    IR_PHI,                    // args[i] flows in from the block's predecessor i
+    IR_COPY,                   // args[0]
+    IR_GET,                    // Read local 'index'; only before SSA construction
+    IR_SET,                    // Write args[0] to local 'index'; likewise
+    IR_JUMP,                   // To the block's only successor
+    IR_BRANCH,                 // To successor 0 if args[0] is non-zero, else successor 1
+    IR_RETURN                  // Return args[0]
+} IROp;
+
+// One instruction; instructions that produce a value are that value
+typedef struct IRInstr {
+    IROp op;
+    IRType type;               // Result type (IR_VOID if none)
+    int id;                    // Value number, unique within the function
+    int block;                 // Block holding the instruction
+    int line;                  // Source line
+    int index;                 // Parameter, global, local or callee number
+    union {
+        int i;
+        double f;
+        const char* s;
+    } imm;                     // IR_CONST value
+    int arg_count;
+    struct IRInstr** args;
+    struct IRInstr* replacement; // Value to use instead, set by passes (or NULL)
+} IRInstr;
+
+// A basic block: phis first, then straight-line code, then one terminator
+typedef struct {
+    IRInstr** code;
+    int count;
+    int capacity;
+    int* preds;                // Predecessor blocks, in phi argument order
+    int pred_count;
+    int pred_capacity;
+    int succ[2];               // Successors (a branch's true target first)
+    int succ_count;
+    int dead;                  // Removed by a pass; has no code or edges
+} IRBlock;
+
+// Instructions and operand lists come from per-function arena chunks
+typedef struct IRChunk {
+    struct IRChunk* next;
+    size_t used;
+    size_t size;
+    char data[];
+} IRChunk;
+
+// Analyses a pass may keep valid (see pass.h)
+#define IR_ANALYSIS_DOMINATORS 1   // Dominator tree, frontiers and loop depths
+#define IR_ANALYSIS_USES       2   // Use counts
+#define IR_ANALYSIS_ALL        3
+
+typedef struct IRFunction {
+    const char* name;
+    int line;
+    int param_count;
+    int local_count;           // Variable slots (before SSA construction)
+    IRBlock* blocks;           // Block 0 is the entry
+    int block_count;
+    int value_count;           // Value numbers handed out
+    IRChunk* arena;
+    struct IRInstr* undefined[4]; // Per type, the zero that unset variables read as
+    CFG* dominators;           // Cached analyses (NULL when not valid)
+    int* use_counts;
+} IRFunction;
+
+typedef struct {
+    IRFunction** functions;
+    int function_count;
+    int global_count;          // Global variable slots
+    int main_function;         // Index of niam (-1 if none)
+    int init_function;         // Index of the top-level statements (-1 if none)
+} IRProgram;
+
+// Lower a semantically valid AST into SSA form
+IRProgram* lower_program(ASTNode* ast);
+void free_ir_program(IRProgram* program);
+void print_ir_function(const IRFunction* function);
+void print_ir_program(const IRProgram* program);
+const char* ir_op_name(IROp op);
+
+// Building blocks for passes
+IRInstr* ir_new_instr(IRFunction* function, IROp op, IRType type, int arg_count);
+IRInstr* ir_const_int(IRFunction* function, int value);
+IRInstr* ir_const_float(IRFunction* function, double value);
+void ir_insert(IRFunction* function, int block, int position, IRInstr* instr);
+IRInstr* ir_resolve(IRInstr* value);
+int ir_apply_replacements(IRFunction* function);
+void ir_remove_edge(IRFunction* function, int from, int to);
+void ir_remove_block(IRFunction* function, int block);
+int ir_has_side_effects(const IRInstr* instr);
+
+// Cached analyses; passes report what they kept valid with ir_invalidate
+CFG* ir_dominators(IRFunction* function);
+const int* ir_use_counts(IRFunction* function);
+void ir_invalidate(IRFunction* function, int kept);
+
+#endif /* IR_H */
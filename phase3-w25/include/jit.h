@@ -0,0 +1,84 @@
+/* jit.h */
+#ifndef JIT_H
+#define JIT_H
+
+#include <stddef.h>
+#include "ir.h"
+#include "asm.h"
+
+// Native code needs an x86-64 host (the backend's target) and Linux for the
+// mappings and thread stacks it runs in. Elsewhere jit_compile and jit_load
+// always fail, so --engine jit and tiered run everything in the interpreter.
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_NATIVE 1
+#else
+#define JIT_NATIVE 0
+#endif
+
+// Engines for --run
+typedef enum {
+    ENGINE_VM,                 // Bytecode interpreter (vm.h)
+    ENGINE_JIT,                // Native code, generated in memory
+    ENGINE_TIERED              // The interpreter, then native code for what runs hot (tier.h)
+} ExecutionEngine;
+
+// Select the engine by name ("vm", "jit" or "tiered"); 0 if unknown
+int set_engine(const char* name);
+
+// An address generated code may refer to by name, besides the runtime
+// library's functions
+typedef struct {
+    const char* name;
+    void* address;
+} JitSymbol;
+
+// An assembled unit loaded into one mapping: code, then read-only data,
+// then writable data. Pages are writable while they are filled and only
+// then made executable, never both.
+typedef struct {
+    unsigned char* memory;
+    size_t size;
+    size_t section_base[ASM_SECTION_COUNT]; // Where each section starts in memory
+} JitCode;
+
+// Load 'unit', linking what it uses but does not define against the
+// runtime library and 'symbols'; returns 0, with the reason in 'error', if
+// something stays undefined
+int jit_load(const AsmUnit* unit, const JitSymbol* symbols, int symbol_count, JitCode* code, char* error,
+             int error_size);
+
+// Address of a symbol the loaded unit defines, or NULL
+void* jit_symbol_address(const JitCode* code, const AsmUnit* unit, const char* name);
+void jit_unload(JitCode* code);
+
+// A program translated by the native backend (codegen.h), assembled in
+// memory (asm.h) and loaded
+typedef struct {
+    JitCode code;
+    size_t stack_size;         // Enough for the deepest calls the VM allows
+    int (*entry)(void);        // main: the top-level statements, then niam
+} JitProgram;
+
+// Compile to machine code; returns 0, with the reason in 'error', for
+// anything the backend or the assembler does not support
+int jit_compile(IRProgram* program, JitProgram* jit, char* error, int error_size);
+
+// Stack the native code for 'program' needs: enough for the deepest calls
+// the VM allows
+size_t jit_stack_size(const IRProgram* program);
+
+// Call function(argument) on a fresh stack of 'stack_size' bytes; returns
+// its result
+int jit_call(size_t stack_size, int (*function)(void*), void* argument);
+
+// Run the top-level statements, then niam, on a stack of jit->stack_size;
+// returns niam's result (a runtime error exits with status 1, as --run does)
+int jit_run(const JitProgram* jit);
+void jit_free(JitProgram* jit);
+
+// Compile and run a file with the selected engine; returns the process exit
+// status. The JIT falls back to the interpreter, with a note, for programs
+// it cannot compile.
+int proc_execute_file(const char* filename);
+
+#endif /* JIT_H */
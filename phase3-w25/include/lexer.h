@@ -10,5 +10,7 @@ void print_token(Token token);
 void print_error(ErrorType error, int line, const char* lexeme);
 void reset_lexer(void);
 void clear_error_state(void);
+void report_lexical_error(Token token);
+void defer_lexical_errors(int defer);
 
 #endif /* LEXER_H */
\ No newline at end of file
@@ -46,13 +46,45 @@ typedef struct ASTNode {
     Token token;               // Token associated with this node
     struct ASTNode* left;      // Left child
     struct ASTNode* right;     // Right child
-    // TODO: Add more fields if needed
+    // Filled in by semantic analysis
+    int slot;                  // Slot of the resolved symbol (-1 if none)
+    int static_type;           // Type of the value (TokenType, TOKEN_ERROR if unknown)
+    int scope_depth;           // Scope level of the resolved symbol (-1 if none)
 } ASTNode;
 
+// Token buffer filled by one lexer pass over the source
+typedef struct {
+    Token* tokens;             // Every token the lexer produced, ending with EOF
+    int count;                 // Number of tokens
+    int capacity;              // Allocated slots
+} TokenBuffer;
+
+// Text edit: bytes [start, old_end) of the old source became [start, new_end) of the new one
+typedef struct {
+    int start;
+    int old_end;
+    int new_end;
+} TextEdit;
+
+// What an incremental reparse did
+typedef struct {
+    int reused_items;          // Top-level items kept from the old AST
+    int reparsed_items;        // Top-level items parsed again
+    int full_reparse;          // 1 if the whole source had to be parsed
+} ReparseStats;
+
 // Parser functions
 void parser_init(const char* input);
 ASTNode* parse(void);
+void set_parser_threads(int count);
+const TokenBuffer* get_token_buffer(void);
+int get_parse_error_count(void);
+char* read_source_file(const char* filename);
+ASTNode* reparse_incremental(ASTNode* old_ast, const TokenBuffer* old_tokens, const char* new_source,
+                             TextEdit edit, ReparseStats* stats);
+void proc_reparse_files(const char* old_file, const char* new_file);
 void print_ast(ASTNode* node, int level);
+void print_ast_label(ASTNodeType type, const char* lexeme);
 void free_ast(ASTNode* node);
 void print_token_stream(const char* input);
 void proc_test_file(const char* filename);
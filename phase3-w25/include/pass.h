@@ -0,0 +1,60 @@
+/* pass.h */
+#ifndef PASS_H
+#define PASS_H
+
+#include "ir.h"
+#include "fold.h"
+
+// An optimization pass over one function. 'run' adds the number of
+// instructions or blocks it changed to *changes and returns the analyses
+// (IR_ANALYSIS_*) it left valid; the manager drops the rest.
+typedef struct {
+    const char* name;
+    const char* description;
+    int (*run)(IRFunction* function, int* changes);
+} IRPass;
+
+// One step of a pipeline, with its totals over every function
+typedef struct {
+    const IRPass* pass;
+    double seconds;
+    long changes;
+} PassStep;
+
+typedef struct {
+    PassStep* steps;
+    int count;
+    char** function_names;     // Functions run over, in order
+    long* function_changes;    // Changes of step s in function f at [f * count + s]
+    int function_count;
+    int function_capacity;
+    FoldStats folding;         // What constant folding did before lowering
+} PassManager;
+
+// Pipeline used when none is given
+#define DEFAULT_PASS_PIPELINE "sccp,simplify,gvn,dce"
+
+const IRPass* find_pass(const char* name);
+
+// Set up a comma-separated pipeline ("none" for no passes); returns 0 and
+// reports the name if a pass is unknown
+int pass_manager_init(PassManager* manager, const char* pipeline);
+void pass_manager_run(PassManager* manager, IRProgram* program);
+
+// Constant folding's totals, per-pass timing and totals, then the changes
+// each step made per function
+void pass_manager_report(const PassManager* manager);
+void pass_manager_free(PassManager* manager);
+
+// Pipeline for the driver modes (NULL = default)
+void set_pass_pipeline(const char* pipeline);
+const char* get_pass_pipeline(void);
+
+// Parse, check, fold and lower a file and run the pipeline (manager may be
+// NULL); NULL if the file has errors, which are reported on stderr
+IRProgram* compile_file_to_ir(const char* filename, PassManager* manager);
+
+// Same, then print the IR and the per-pass timing
+void proc_ir_file(const char* filename);
+
+#endif /* PASS_H */
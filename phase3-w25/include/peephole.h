@@ -0,0 +1,37 @@
+/* peephole.h */
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "bytecode.h"
+
+// Rewrites the peephole optimizer applies, one per pattern-table row
+typedef enum {
+    PEEP_SELF_MOVE,            // move rA, rA
+    PEEP_DEAD_TEMPORARY,       // A side-effect-free write nothing reads
+    PEEP_JUMP_THREAD,          // A jump to a jump (or to a return)
+    PEEP_JUMP_TO_NEXT,         // A jump to the instruction after it
+    PEEP_JUMP_OVER_JUMP,       // A branch around an unconditional jump
+    PEEP_JUMP_TO_BRANCH,       // A jump to a branch back to just after the jump
+    PEEP_UNREACHABLE,          // Code after a jump or return no jump reaches
+    PEEP_STORE_LOAD,           // storeg gX, rA; loadg rB, gX
+    PEEP_LOAD_LOAD,            // loadg rA, gX; loadg rB, gX
+    PEEP_LOAD_STORE,           // loadg rA, gX; storeg gX, rA
+    PEEP_STORE_STORE,          // storeg gX, rA; storeg gX, rB
+    PEEP_COALESCE_MOVE,        // A temporary written only to be moved
+    PEEP_PATTERN_COUNT
+} PeepholePattern;
+
+// Turn the optimizer compile_bytecode runs last on or off (it is on)
+void set_peephole(int enabled);
+int peephole_enabled(void);
+
+// Rewrite each function over a sliding window until no pattern applies.
+// Returns the instructions removed; adds each pattern's applications to
+// hits[] unless it is NULL.
+int peephole_program(BCProgram* program, int hits[PEEP_PATTERN_COUNT]);
+
+// Compile each file without and with the optimizer and report bytecode size,
+// instructions executed and how often each pattern applied
+void proc_peephole_files(int count, char* filenames[]);
+
+#endif /* PEEPHOLE_H */
@@ -0,0 +1,45 @@
+/* regalloc.h */
+#ifndef REGALLOC_H
+#define REGALLOC_H
+
+#include <stdint.h>
+#include "ir.h"
+
+// General-purpose registers the allocator hands out. The code generator
+// keeps %rax, %rcx, %rdx and the argument registers for itself. The first
+// five are callee-saved; the last two are not, so only values that are
+// not live across a call get them.
+#define RA_REGISTER_COUNT 7
+#define RA_CALLEE_SAVED 5
+
+// Where each value of a function lives
+typedef struct {
+    int* registers;            // By value number: register number, or -1 for its stack slot
+    int candidates;            // Int and string values competing for registers
+    int spilled;               // Candidates left in stack slots
+    int used;                  // Bit r set if register r holds some value
+    uint64_t* live_in;         // Values live into each block (phis aside): a bit set of
+                               // 'words' words per block
+    int words;
+} RegAllocation;
+
+// Turn allocation on or off for the native backend (it is on); when off,
+// every value stays in its stack slot
+void set_regalloc(int enabled);
+int regalloc_enabled(void);
+
+// Compute live intervals over the function laid out in block order and
+// assign registers by linear scan. When registers run out, the interval
+// with the lowest spill cost (uses and definitions weighted by 10 per
+// enclosing loop) stays on the stack.
+void allocate_registers(IRFunction* function, RegAllocation* allocation);
+void free_allocation(RegAllocation* allocation);
+
+// Register name at 32 or 64 bits
+const char* ra_register_name(int reg, int bits);
+
+// Compile each file and report, per function, the values competing for
+// registers and how many were spilled
+void proc_regalloc_files(int count, char* filenames[]);
+
+#endif /* REGALLOC_H */
@@ -0,0 +1,21 @@
+/* runtime.h */
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stddef.h>
+
+// Runtime library of native code (runtime/runtime.c): linked with programs
+// compiled by -S, and into the compiler for the JIT
+
+void bc_print_int(int value);
+void bc_print_float(double value);
+void bc_print_str(const char* value);
+int bc_float_to_int(double value);
+int bc_factorial(int n);
+void bc_runtime_error(int line, const char* function, const char* message);
+
+// main of a -S program: run 'program' on a new stack of 'stack_size' bytes
+// and return its result
+int bc_run_main(int (*program)(void), size_t stack_size);
+
+#endif /* RUNTIME_H */
@@ -0,0 +1,14 @@
+/* sccp.h */
+#ifndef SCCP_H
+#define SCCP_H
+
+#include "ir.h"
+
+// Sparse conditional constant propagation (Wegman-Zadeck). Values are
+// only evaluated along edges found to be executable, so a branch on a
+// constant condition keeps one successor and the blocks only the other
+// one reached (dead esle arms and loop bodies, code after nruter) are
+// deleted. *changes counts the instructions eliminated.
+int sccp_pass(IRFunction* function, int* changes);
+
+#endif /* SCCP_H */
@@ -3,6 +3,7 @@
 #define SEMANTIC_H
 
 #include "parser.h"
+#include "intern.h"
 
 // Define semantic error types
 typedef enum {
@@ -15,20 +16,43 @@ typedef enum {
     SEM_ERROR_SEMANTIC_ERROR
 } SemanticErrorType;
 
-// Symbol structure for symbol table
+// Symbol structure for symbol table (name is an id in the table's names)
 typedef struct Symbol {
-    char name[100];          // Variable name
+    int name_id;             // Interned variable name
     int type;                // Data type (using TokenType for types)
     int scope_level;         // Scope nesting level
     int line_declared;       // Line where declared
     int is_initialized;      // Has been assigned a value?
-    struct Symbol* next;     // For linked list implementation
+    int slot;                // Global index at scope 0, else index within the function
+    struct Symbol* next;     // Next older symbol still in scope (or next free slot)
+    struct Symbol* shadowed; // Symbol this one hides (same name, outer scope)
 } Symbol;
 
-// Symbol table structure
-typedef struct {
-    Symbol* head;            // First symbol in the table
+// Symbols are carved out of fixed-size slabs owned by the table
+#define SYMBOL_SLAB_SIZE 256
+
+typedef struct SymbolSlab {
+    struct SymbolSlab* next;             // Previously filled slab
+    Symbol symbols[SYMBOL_SLAB_SIZE];
+} SymbolSlab;
+
+// Symbol table structure: a stack of the symbols in scope, plus for each
+// name id a stack of the symbols visible under that name, innermost first
+typedef struct SymbolTable {
+    Symbol* head;            // Newest symbol in scope
     int current_scope;       // Current scope level
+    StringTable* names;      // Name -> id
+    Symbol** innermost;      // id -> innermost visible symbol with that name
+    int name_capacity;       // Slots allocated in innermost
+    Symbol** scope_marks;    // Scope level -> head when that scope was entered
+    int mark_capacity;       // Slots allocated in scope_marks
+    SymbolSlab* slabs;       // Newest slab first
+    int slab_used;           // Symbols handed out from the newest slab
+    Symbol* free_symbols;    // Slots released by exited scopes
+    int global_slots;        // Slots handed out at scope 0
+    int local_slots;         // Slots handed out in the current function
+    const struct SymbolTable* globals; // Read-only global scope to fall back on (or NULL)
+    int visible_globals;     // Only globals with a smaller slot are visible
 } SymbolTable;
 
 // Symbol table functions
@@ -41,11 +65,15 @@ void exit_scope(SymbolTable* table);
 void remove_symbols_in_current_scope(SymbolTable* table);
 void free_symbol_table(SymbolTable* table);
 void print_symbol_table(SymbolTable* table);
+const char* symbol_name(SymbolTable* table, Symbol* symbol);
 
 // Semantic analysis functions
 int analyze_semantics(ASTNode* ast);
 void semantic_error(SemanticErrorType error, const char* name, int line);
 void proc_semantic_file(const char* filename);
+void set_semantic_verbose(int verbose);
+void set_semantic_threads(int threads);
+int get_semantic_error_count(void);
 
 // Helper functions for semantic analysis
 int check_program(ASTNode* node, SymbolTable* table);
@@ -59,6 +87,7 @@ int check_if_statement(ASTNode* node, SymbolTable* table);
 int check_while_statement(ASTNode* node, SymbolTable* table);
 int check_repeat_until_statement(ASTNode* node, SymbolTable* table);
 int check_function_declaration(ASTNode* node, SymbolTable* table);
+int check_function_body(ASTNode* node, SymbolTable* table);
 int check_return_statement(ASTNode* node, SymbolTable* table);
 int check_factorial(ASTNode* node, SymbolTable* table);
 
@@ -0,0 +1,75 @@
+/* serialize.h */
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "parser.h"
+
+// On-disk format: header, then token, node, string offset and string data
+// sections. All references are section indices or file offsets, so the
+// file can be mapped and used in place.
+#define AST_FILE_MAGIC "BWCAST\0"    // 8 bytes including the terminator
+#define AST_FILE_VERSION 1
+#define AST_FILE_BYTE_ORDER 0x01020304u
+#define AST_FILE_NONE (-1)           // Missing child or string
+
+// File header (offsets are from the start of the file)
+typedef struct {
+    char magic[8];             // AST_FILE_MAGIC
+    uint32_t version;          // AST_FILE_VERSION
+    uint32_t byte_order;       // AST_FILE_BYTE_ORDER as written by the host
+    uint32_t file_size;        // Total bytes, for truncation checks
+    uint32_t token_count;      // Token buffer records
+    uint32_t token_offset;
+    uint32_t node_count;       // AST node records
+    uint32_t node_offset;
+    uint32_t string_count;     // Interned lexemes
+    uint32_t string_offset;    // string_count offsets into the string data
+    uint32_t string_data_offset;
+    uint32_t string_data_size;
+    int32_t root;              // Root node index or AST_FILE_NONE
+} AstFileHeader;
+
+// Token record (lexeme is a string id)
+typedef struct {
+    int32_t type;
+    int32_t lexeme;
+    int32_t line;
+    int32_t column;
+    int32_t error;
+    int32_t recovery;
+} AstFileToken;
+
+// AST node record (children are node indices)
+typedef struct {
+    int32_t type;
+    int32_t left;
+    int32_t right;
+    AstFileToken token;
+} AstFileNode;
+
+// A loaded file; every pointer points into the mapped image
+typedef struct {
+    void* base;                // Start of the image
+    size_t size;               // Image size in bytes
+    int mapped;                // 1 if base came from mmap, 0 if from malloc
+    const AstFileHeader* header;
+    const AstFileToken* tokens;
+    const AstFileNode* nodes;
+    const uint32_t* string_offsets;
+    const char* strings;
+} AstFile;
+
+// Serialization functions
+int write_ast_file(const char* path, const TokenBuffer* tokens, ASTNode* root);
+AstFile* load_ast_file(const char* path);
+void close_ast_file(AstFile* file);
+const char* ast_file_string(const AstFile* file, int32_t id);
+void print_ast_file(const AstFile* file, int32_t node, int level);
+
+// Save a source's tokens and AST, or print a saved AST; return 1 on success
+int emit_ast_file(const char* source_file, const char* output_file);
+int dump_ast_file(const char* filename);
+
+#endif /* SERIALIZE_H */
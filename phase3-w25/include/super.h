@@ -0,0 +1,30 @@
+/* super.h */
+#ifndef SUPER_H
+#define SUPER_H
+
+#include "bytecode.h"
+
+// Which superinstructions the bytecode compiler selects: the ones listed in
+// the generated superinstructions.h, none, or the whole catalog
+typedef enum {
+    SUPER_SELECTED,
+    SUPER_NONE,
+    SUPER_ALL
+} SuperMode;
+
+// Pick the mode by name ("selected", "none" or "all"); 0 if unknown
+int set_super_mode(const char* name);
+
+// Rewrite a compiled program to use the superinstructions the current mode
+// enables; returns the number of instructions fused away
+int select_superinstructions(BCProgram* program);
+
+// Run each file under the profiler and report the hottest opcode pairs and
+// triples, and the dispatches the selected superinstructions save
+void proc_profile_files(int count, char* filenames[]);
+
+// Profile the files with each catalog superinstruction alone and write the
+// ones that save dispatches, hottest first, to 'output' (superinstructions.h)
+int proc_gen_super(const char* output, int count, char* filenames[]);
+
+#endif /* SUPER_H */
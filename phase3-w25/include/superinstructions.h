@@ -0,0 +1,21 @@
+/* superinstructions.h */
+// Generated by "compiler.exe --gen-super"; regenerate with "make superinstructions".
+// Superinstructions the bytecode compiler selects, hottest first, with the
+// dispatches each saved on its own over a 36104639-dispatch corpus:
+//   ../benchmarks/countdown.txt
+//   ../benchmarks/fib.txt
+//   ../benchmarks/floats.txt
+//   ../benchmarks/nested.txt
+//   ../test/input_valid.txt
+SUPER(BC_SUBIK, 6121392)
+SUPER(BC_JLEI, 6000022)
+SUPER(BC_JLEIK, 6000022)
+SUPER(BC_MULIK, 3000001)
+SUPER(BC_JGEIK, 944287)
+SUPER(BC_JGEI, 843786)
+SUPER(BC_ADDIK, 350500)
+SUPER(BC_MULFK, 100000)
+SUPER(BC_DIVFK, 100000)
+SUPER(BC_JGTIK, 12)
+SUPER(BC_JGTI, 6)
+SUPER(BC_DIVIK, 1)
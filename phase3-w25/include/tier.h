@@ -0,0 +1,27 @@
+/* tier.h */
+#ifndef TIER_H
+#define TIER_H
+
+// Tiered execution (--engine tiered). Everything starts in the bytecode
+// interpreter, which counts the calls to each function and the backward
+// jumps taken in it. A function that reaches either threshold is compiled
+// to native code, together with the functions it may call that are not
+// compiled yet, so native code only ever calls native code. Calls the
+// interpreter makes to it from then on run natively, and a call the
+// interpreter is still running switches over at its next backward jump,
+// entering native code at the loop header (on-stack replacement).
+#define TIER_DEFAULT_CALLS 1000
+#define TIER_DEFAULT_LOOPS 10000
+
+// Calls and backward jumps after which a function is compiled
+void set_tier_thresholds(int calls, int loops);
+int tier_call_threshold(void);
+int tier_loop_threshold(void);
+
+// Report each compilation and each switch into native code on stderr
+void set_tier_log(int enabled);
+
+// Compile and run a file tiered; returns the process exit status
+int proc_tiered_file(const char* filename);
+
+#endif /* TIER_H */
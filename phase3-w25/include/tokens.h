@@ -102,6 +102,7 @@ typedef struct {
     int column;             // Column number in source file 
     ErrorType error;        // Error type if any
     RecoveryMode recovery;  // Recovery mode if error 
+    int offset;             // Byte offset of the token in the source
 } Token;
 
 #endif /* TOKENS_H */
\ No newline at end of file
@@ -0,0 +1,77 @@
+/* vm.h */
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+
+// Limits of one run
+#define VM_STACK_SIZE (1 << 20)    // Registers across all live frames
+#define VM_MAX_FRAMES 100000       // Call depth
+
+// Dispatch: one shared switch, or GCC computed gotos threading each handler
+// to the next. Define VM_SWITCH_ONLY to build without the threaded loop.
+typedef enum {
+    VM_DISPATCH_SWITCH,
+    VM_DISPATCH_THREADED
+} VMDispatch;
+
+#if defined(__GNUC__) && !defined(VM_SWITCH_ONLY)
+#define VM_HAS_THREADED 1
+#else
+#define VM_HAS_THREADED 0
+#endif
+
+// Select the dispatch for vm_run by name ("switch" or "threaded"); 0 if
+// it is unknown or not built in
+int set_vm_dispatch(const char* name);
+
+// Counters from one run
+typedef struct {
+    long long executed;        // Instructions executed
+    long long calls;           // Function calls made
+} VMStats;
+
+// Executed opcodes, and adjacent pairs and triples of them, by opcode
+// number: pairs[first * BC_OPCODE_COUNT + second], triples likewise
+typedef struct {
+    long long ops[BC_OPCODE_COUNT];
+    long long pairs[BC_OPCODE_COUNT * BC_OPCODE_COUNT];
+    long long triples[BC_OPCODE_COUNT * BC_OPCODE_COUNT * BC_OPCODE_COUNT];
+} VMProfile;
+
+// Run the top-level statements, then niam. Returns 1 and niam's result in
+// *result (0 without niam), or 0 after reporting a runtime error. 'quiet'
+// suppresses tnirp output. stats may be NULL.
+int vm_run(const BCProgram* program, int quiet, VMStats* stats, int* result);
+
+// Same, quietly, adding what executes to *profile
+int vm_profile(const BCProgram* program, VMProfile* profile, VMStats* stats);
+
+// Hooks tiered execution (tier.h) runs the interpreter with. At each call,
+// call() may run 'function' natively on the arguments at 'args'; at each
+// backward jump, back_edge() may run the rest of the current call of
+// 'function' natively from instruction 'target', given its registers. Both
+// return 1, with the result in *result, if they did. 'depth' is the number
+// of interpreter frames under the call 'function' runs in, which counts
+// toward VM_MAX_FRAMES.
+typedef struct {
+    void* context;
+    int (*call)(void* context, int function, int depth, Value* args, Value* result);
+    int (*back_edge)(void* context, int function, int depth, int target, Value* frame, Value* result);
+} VMTierHooks;
+
+// vm_run, with the hooks and on 'globals' (which native code shares)
+int vm_run_tiered(const BCProgram* program, Value* globals, const VMTierHooks* hooks, int* result);
+
+// Parse, check, optimize and compile a file to bytecode (NULL on errors)
+BCProgram* compile_file_to_bytecode(const char* filename);
+
+// Compile and run a file; returns the process exit status (niam's result,
+// or 1 on a compile or runtime error)
+int proc_run_file(const char* filename);
+
+// Run each file repeatedly without output under each dispatch built in and
+// report instructions/second and cycles per instruction
+void proc_bench_files(int count, char* filenames[]);
+
+#endif /* VM_H */
@@ -0,0 +1,93 @@
+/* runtime.c */
+// Runtime library for programs compiled with "compiler.exe -S". Link it with
+// the generated assembly: gcc prog.s runtime/runtime.c -pthread -o prog
+// The JIT calls the same functions. Output and errors match the bytecode VM's.
+// Executables written by --exe carry an assembly version of this file
+// (src/elfobj/runtime.inc); keep the two in step.
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "../include/runtime.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+void bc_print_int(int value) {
+    printf("%d\n", value);
+}
+
+void bc_print_float(double value) {
+    printf("%g\n", value);
+}
+
+void bc_print_str(const char* value) {
+    printf("%s\n", value);
+}
+
+// Float to int, truncating and saturating (NaN is 0)
+int bc_float_to_int(double value) {
+    if (value != value) return 0;
+    if (value >= 2147483647.0) return INT_MAX;
+    if (value <= -2147483648.0) return INT_MIN;
+    return (int)value;
+}
+
+// lairotcaf, wrapping like 32-bit ints
+int bc_factorial(int n) {
+    unsigned int result = 1;
+    for (int k = 2; k <= n; k++) result *= (unsigned int)k;
+    return (int)result;
+}
+
+void bc_runtime_error(int line, const char* function, const char* message) {
+    fflush(stdout);
+    fprintf(stderr, "Runtime error at line %d in %s: %s\n", line, function, message);
+    exit(1);
+}
+
+#if defined(__linux__)
+typedef struct {
+    int (*program)(void);
+    int result;
+} MainCall;
+
+static void* main_thread(void* arg) {
+    MainCall* call = arg;
+    call->result = call->program();
+    return NULL;
+}
+
+int bc_run_main(int (*program)(void), size_t stack_size) {
+    // Reserved, not committed, like the JIT's stack, with a guard page below
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (stack_size + page - 1) / page * page + page;
+    unsigned char* stack = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                -1, 0);
+    MainCall call = {program, 0};
+    pthread_attr_t attr;
+    pthread_t thread;
+    if (stack == MAP_FAILED || pthread_attr_init(&attr) != 0) {
+        fprintf(stderr, "Error: Cannot reserve a stack for native code\n");
+        exit(1);
+    }
+    mprotect(stack, page, PROT_NONE);
+    pthread_attr_setstack(&attr, stack + page, size - page);
+    if (pthread_create(&thread, &attr, main_thread, &call) != 0) {
+        fprintf(stderr, "Error: Cannot start native code\n");
+        exit(1);
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    munmap(stack, size);
+    return call.result;
+}
+#else
+// Elsewhere the program runs on the caller's stack
+int bc_run_main(int (*program)(void), size_t stack_size) {
+    (void)stack_size;
+    return program();
+}
+#endif
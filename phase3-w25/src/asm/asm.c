@@ -0,0 +1,906 @@
+/* asm.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "../../include/asm.h"
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed in the assembler\n");
+    exit(1);
+}
+
+// Longest symbol name accepted
+#define ASM_NAME_MAX 64
+
+typedef enum {
+    OPERAND_REGISTER,
+    OPERAND_IMMEDIATE,
+    OPERAND_MEMORY,
+    OPERAND_LABEL              // Branch or call target
+} OperandKind;
+
+typedef struct {
+    OperandKind kind;
+    int reg;                   // Register: number 0-15
+    int bits;                  // Register: 8, 32 or 64, or 128 for %xmm
+    long long imm;             // Immediate
+    int base;                  // Memory: base register, or -1 for %rip
+    int disp;                  // Memory: displacement (added to symbol, if any)
+    int indirect;              // Label: '*' before a register (call *%rax)
+    int got;                   // Memory: sym@GOTPCREL(%rip), the symbol's GOT slot
+    char symbol[ASM_NAME_MAX]; // Memory (%rip only) or label; "" if none
+} Operand;
+
+// One instruction as it is encoded, before it is placed in its section
+typedef struct {
+    unsigned char bytes[16];
+    int length;
+    int field;                 // Offset of a 32-bit field referring to 'symbol', or -1
+    char symbol[ASM_NAME_MAX];
+    int symbol_addend;         // Displacement from the symbol
+    AsmRelocType type;
+} Encoding;
+
+typedef struct {
+    AsmUnit* unit;
+    int section;               // Current section, or -1 inside one this assembler ignores
+    int line;
+} Assembler;
+
+static int fail(Assembler* as, const char* format, ...) {
+    if (!as->unit->error[0]) {
+        int n = snprintf(as->unit->error, sizeof(as->unit->error), "line %d: ", as->line);
+        va_list args;
+        va_start(args, format);
+        vsnprintf(as->unit->error + n, sizeof(as->unit->error) - n, format, args);
+        va_end(args);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Sections and symbols
+
+static void grow(AsmUnit* unit, int section, int extra) {
+    if (unit->size[section] + extra > unit->capacity[section]) {
+        int capacity = unit->capacity[section] ? unit->capacity[section] : 256;
+        while (capacity < unit->size[section] + extra) capacity *= 2;
+        unit->bytes[section] = realloc(unit->bytes[section], capacity);
+        if (!unit->bytes[section]) out_of_memory();
+        unit->capacity[section] = capacity;
+    }
+}
+
+static void append(AsmUnit* unit, int section, const void* bytes, int length) {
+    if (section == ASM_BSS) {
+        unit->size[section] += length;
+        return;
+    }
+    grow(unit, section, length);
+    if (bytes) {
+        memcpy(unit->bytes[section] + unit->size[section], bytes, length);
+    } else {
+        memset(unit->bytes[section] + unit->size[section], 0, length);
+    }
+    unit->size[section] += length;
+}
+
+int asm_find_symbol(const AsmUnit* unit, const char* name) {
+    for (int i = 0; i < unit->symbol_count; i++) {
+        if (strcmp(unit->symbols[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int symbol(AsmUnit* unit, const char* name) {
+    int found = asm_find_symbol(unit, name);
+    if (found >= 0) return found;
+    if (unit->symbol_count == unit->symbol_capacity) {
+        unit->symbol_capacity = unit->symbol_capacity ? unit->symbol_capacity * 2 : 32;
+        unit->symbols = realloc(unit->symbols, unit->symbol_capacity * sizeof(AsmSymbol));
+        if (!unit->symbols) out_of_memory();
+    }
+    AsmSymbol* s = &unit->symbols[unit->symbol_count];
+    memset(s, 0, sizeof(*s));
+    s->name = strdup(name);
+    if (!s->name) out_of_memory();
+    s->section = -1;
+    return unit->symbol_count++;
+}
+
+static void add_reloc(AsmUnit* unit, int section, int offset, int sym, AsmRelocType type, int addend) {
+    if (unit->reloc_count == unit->reloc_capacity) {
+        unit->reloc_capacity = unit->reloc_capacity ? unit->reloc_capacity * 2 : 64;
+        unit->relocs = realloc(unit->relocs, unit->reloc_capacity * sizeof(AsmReloc));
+        if (!unit->relocs) out_of_memory();
+    }
+    AsmReloc r = {section, offset, sym, type, addend};
+    unit->relocs[unit->reloc_count++] = r;
+}
+
+// ---------------------------------------------------------------------------
+// Operands
+
+static const char* names64[8] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi"};
+static const char* names32[8] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+static const char* names8[8] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil"};
+
+// Register by name (without '%'): sets number and width, 0 if unknown
+static int parse_register(const char* name, int* number, int* bits) {
+    for (int r = 0; r < 8; r++) {
+        if (strcmp(name, names64[r]) == 0) { *number = r; *bits = 64; return 1; }
+        if (strcmp(name, names32[r]) == 0) { *number = r; *bits = 32; return 1; }
+        if (strcmp(name, names8[r]) == 0) { *number = r; *bits = 8; return 1; }
+    }
+    char* end;
+    if (name[0] == 'r' && isdigit((unsigned char)name[1])) {
+        long r = strtol(name + 1, &end, 10);
+        if (r < 8 || r > 15) return 0;
+        *number = (int)r;
+        if (*end == '\0') { *bits = 64; return 1; }
+        if (strcmp(end, "d") == 0) { *bits = 32; return 1; }
+        if (strcmp(end, "b") == 0) { *bits = 8; return 1; }
+        return 0;
+    }
+    if (strncmp(name, "xmm", 3) == 0 && isdigit((unsigned char)name[3])) {
+        long r = strtol(name + 3, &end, 10);
+        if (*end || r > 15) return 0;
+        *number = (int)r;
+        *bits = 128;
+        return 1;
+    }
+    return 0;
+}
+
+static int parse_symbol_name(Assembler* as, const char* text, int length, char* name) {
+    if (length <= 0 || length >= ASM_NAME_MAX) {
+        return fail(as, "bad symbol '%.*s'", length, text);
+    }
+    for (int i = 0; i < length; i++) {
+        char c = text[i];
+        if (!(isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$')) {
+            return fail(as, "bad symbol '%.*s'", length, text);
+        }
+    }
+    memcpy(name, text, length);
+    name[length] = '\0';
+    return 1;
+}
+
+static int parse_number(const char* text, long long* value) {
+    char* end;
+    if (*text == '-') {
+        *value = strtoll(text, &end, 0);
+    } else {
+        *value = (long long)strtoull(text, &end, 0);
+    }
+    return end != text && *end == '\0';
+}
+
+static int parse_operand(Assembler* as, char* text, Operand* op) {
+    memset(op, 0, sizeof(*op));
+    if (text[0] == '%') {
+        op->kind = OPERAND_REGISTER;
+        if (!parse_register(text + 1, &op->reg, &op->bits)) return fail(as, "unknown register %s", text);
+        return 1;
+    }
+    if (text[0] == '$') {
+        op->kind = OPERAND_IMMEDIATE;
+        if (!parse_number(text + 1, &op->imm)) return fail(as, "bad immediate %s", text);
+        return 1;
+    }
+    if (text[0] == '*') {
+        if (!parse_operand(as, text + 1, op) || op->kind != OPERAND_REGISTER || op->bits != 64) {
+            return fail(as, "bad indirect target %s", text);
+        }
+        op->kind = OPERAND_LABEL;
+        op->indirect = 1;
+        return 1;
+    }
+
+    char* paren = strchr(text, '(');
+    if (!paren) {
+        // A branch target; calls through the PLT name it sym@PLT
+        op->kind = OPERAND_LABEL;
+        char* at = strchr(text, '@');
+        int length = at ? (int)(at - text) : (int)strlen(text);
+        if (at && strcmp(at, "@PLT") != 0) return fail(as, "unsupported symbol suffix %s", at);
+        return parse_symbol_name(as, text, length, op->symbol);
+    }
+
+    // disp(%base), sym[+-disp](%rip) or sym@GOTPCREL(%rip)
+    op->kind = OPERAND_MEMORY;
+    char* close = strchr(paren, ')');
+    if (!close || close[1] != '\0' || paren[1] != '%') return fail(as, "unsupported memory operand %s", text);
+    *close = '\0';
+    int bits;
+    if (strcmp(paren + 2, "rip") == 0) {
+        op->base = -1;
+    } else if (!parse_register(paren + 2, &op->base, &bits) || bits != 64) {
+        return fail(as, "bad base register in %s", text);
+    }
+    *paren = '\0';
+    if (text[0] && !isdigit((unsigned char)text[0]) && text[0] != '-') {
+        char* sign = text + strcspn(text, "+-@");
+        if (!parse_symbol_name(as, text, (int)(sign - text), op->symbol)) return 0;
+        text = sign;
+        if (strncmp(text, "@GOTPCREL", 9) == 0) {
+            op->got = 1;
+            text += 9;
+        } else if (*text == '@') {
+            return fail(as, "unsupported symbol suffix %s", text);
+        }
+        if (*text == '+') text++;
+    }
+    if (text[0]) {
+        long long disp;
+        if (!parse_number(text, &disp) || disp < INT32_MIN || disp > INT32_MAX) {
+            return fail(as, "bad displacement %s", text);
+        }
+        op->disp = (int)disp;
+    }
+    if (op->symbol[0] && op->base != -1) {
+        return fail(as, "symbol %s needs %%rip-relative addressing", op->symbol);
+    }
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Encoding
+
+static void put(Encoding* e, int byte) {
+    e->bytes[e->length++] = (unsigned char)byte;
+}
+
+static void put32(Encoding* e, long long value) {
+    for (int i = 0; i < 4; i++) put(e, (int)((value >> (8 * i)) & 0xff));
+}
+
+static int fits8(long long v) {
+    return v >= -128 && v <= 127;
+}
+
+static int fits32(long long v) {
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+// %spl..%dil are only reachable with a REX prefix (without one, those
+// numbers mean %ah..%bh)
+static int needs_rex(const Operand* op) {
+    return op && op->kind == OPERAND_REGISTER && op->bits == 8 && op->reg >= 4 && op->reg < 8;
+}
+
+// [prefix] [REX] opcode ModRM [SIB] [displacement] for an instruction whose
+// ModRM reg field is 'reg' (a register or an opcode extension) and whose
+// r/m operand is 'rm'. 'prefix' is 0 or a legacy prefix (0x66, 0xf2).
+static void encode(Encoding* e, int prefix, int wide, const unsigned char* opcode, int opcode_length,
+                   int reg, const Operand* rm, int force_rex) {
+    int rm_number = rm->kind == OPERAND_REGISTER ? rm->reg : (rm->base >= 0 ? rm->base : 0);
+    int rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm_number & 8) ? 1 : 0);
+    if (prefix) put(e, prefix);
+    if (rex != 0x40 || force_rex) put(e, rex);
+    for (int i = 0; i < opcode_length; i++) put(e, opcode[i]);
+
+    if (rm->kind == OPERAND_REGISTER) {
+        put(e, 0xc0 | ((reg & 7) << 3) | (rm->reg & 7));
+        return;
+    }
+    if (rm->base < 0) {
+        put(e, ((reg & 7) << 3) | 5);
+        if (rm->symbol[0]) {
+            e->field = e->length;
+            strcpy(e->symbol, rm->symbol);
+            e->symbol_addend = rm->disp;
+            e->type = rm->got ? ASM_RELOC_GOTPCREL : ASM_RELOC_PC32;
+        }
+        put32(e, rm->symbol[0] ? 0 : rm->disp);
+        return;
+    }
+    int low = rm->base & 7;
+    int mod = rm->disp == 0 && low != 5 ? 0 : (fits8(rm->disp) ? 1 : 2);
+    put(e, (mod << 6) | ((reg & 7) << 3) | low);
+    if (low == 4) put(e, 0x24);
+    if (mod == 1) put(e, rm->disp & 0xff);
+    if (mod == 2) put32(e, rm->disp);
+}
+
+static void encode1(Encoding* e, int prefix, int wide, int opcode, int reg, const Operand* rm, int force_rex) {
+    unsigned char op = (unsigned char)opcode;
+    encode(e, prefix, wide, &op, 1, reg, rm, force_rex);
+}
+
+static void encode2(Encoding* e, int prefix, int wide, int opcode, int reg, const Operand* rm, int force_rex) {
+    unsigned char op[2] = {0x0f, (unsigned char)opcode};
+    encode(e, prefix, wide, op, 2, reg, rm, force_rex);
+}
+
+static void branch(Encoding* e, const char* target) {
+    e->field = e->length;
+    strcpy(e->symbol, target);
+    e->symbol_addend = 0;
+    e->type = ASM_RELOC_PLT32;
+    put32(e, 0);
+}
+
+typedef enum {
+    KIND_MOV, KIND_MOVABS, KIND_ALU, KIND_TEST, KIND_IMUL, KIND_UNARY, KIND_LEA, KIND_MOVZB,
+    KIND_SETCC, KIND_JCC, KIND_JMP, KIND_CALL, KIND_PUSH, KIND_POP, KIND_PLAIN,
+    KIND_MOVSD, KIND_SSE, KIND_UCOMISD, KIND_CVTSI2SD, KIND_CVTSD2SI
+} MnemonicKind;
+
+typedef struct {
+    const char* name;
+    MnemonicKind kind;
+    int bits;                  // Operand size (0 where it does not apply)
+    int code;                  // ALU group, ModRM extension, opcode or condition
+} Mnemonic;
+
+static const Mnemonic mnemonics[] = {
+    {"movb", KIND_MOV, 8, 0}, {"movl", KIND_MOV, 32, 0}, {"movq", KIND_MOV, 64, 0},
+    {"movabsq", KIND_MOVABS, 64, 0},
+    {"addb", KIND_ALU, 8, 0}, {"addl", KIND_ALU, 32, 0}, {"addq", KIND_ALU, 64, 0},
+    {"orb", KIND_ALU, 8, 1}, {"orl", KIND_ALU, 32, 1}, {"orq", KIND_ALU, 64, 1},
+    {"andb", KIND_ALU, 8, 4}, {"andl", KIND_ALU, 32, 4}, {"andq", KIND_ALU, 64, 4},
+    {"subb", KIND_ALU, 8, 5}, {"subl", KIND_ALU, 32, 5}, {"subq", KIND_ALU, 64, 5},
+    {"xorb", KIND_ALU, 8, 6}, {"xorl", KIND_ALU, 32, 6}, {"xorq", KIND_ALU, 64, 6},
+    {"cmpb", KIND_ALU, 8, 7}, {"cmpl", KIND_ALU, 32, 7}, {"cmpq", KIND_ALU, 64, 7},
+    {"testb", KIND_TEST, 8, 0}, {"testl", KIND_TEST, 32, 0}, {"testq", KIND_TEST, 64, 0},
+    {"imull", KIND_IMUL, 32, 0}, {"imulq", KIND_IMUL, 64, 0},
+    {"notl", KIND_UNARY, 32, 2}, {"negl", KIND_UNARY, 32, 3}, {"negq", KIND_UNARY, 64, 3},
+    {"divl", KIND_UNARY, 32, 6}, {"idivl", KIND_UNARY, 32, 7}, {"idivq", KIND_UNARY, 64, 7},
+    {"leaq", KIND_LEA, 64, 0},
+    {"movzbl", KIND_MOVZB, 32, 0}, {"movzbq", KIND_MOVZB, 64, 0},
+    {"jmp", KIND_JMP, 0, 0}, {"call", KIND_CALL, 0, 0},
+    {"pushq", KIND_PUSH, 64, 0}, {"popq", KIND_POP, 64, 0},
+    {"cltd", KIND_PLAIN, 0, 0x99}, {"cqto", KIND_PLAIN, 0, 0x4899}, {"leave", KIND_PLAIN, 0, 0xc9}, {"ret", KIND_PLAIN, 0, 0xc3},
+    {"nop", KIND_PLAIN, 0, 0x90}, {"syscall", KIND_PLAIN, 0, 0x0f05},
+    {"movsd", KIND_MOVSD, 0, 0},
+    {"addsd", KIND_SSE, 0, 0x58}, {"mulsd", KIND_SSE, 0, 0x59}, {"subsd", KIND_SSE, 0, 0x5c},
+    {"divsd", KIND_SSE, 0, 0x5e}, {"sqrtsd", KIND_SSE, 0, 0x51},
+    {"ucomisd", KIND_UCOMISD, 0, 0},
+    {"cvtsi2sdl", KIND_CVTSI2SD, 32, 0}, {"cvtsi2sdq", KIND_CVTSI2SD, 64, 0},
+    {"cvttsd2si", KIND_CVTSD2SI, 32, 0x2c}, {"cvttsd2siq", KIND_CVTSD2SI, 64, 0x2c},
+    {"cvtsd2si", KIND_CVTSD2SI, 32, 0x2d}, {"cvtsd2siq", KIND_CVTSD2SI, 64, 0x2d},
+};
+
+// Condition codes by suffix, with the usual aliases
+static const struct {
+    const char* name;
+    int code;
+} conditions[] = {
+    {"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+    {"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+    {"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+    {"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15},
+};
+
+static int condition(const char* suffix) {
+    for (size_t i = 0; i < sizeof(conditions) / sizeof(conditions[0]); i++) {
+        if (strcmp(suffix, conditions[i].name) == 0) return conditions[i].code;
+    }
+    return -1;
+}
+
+static int lookup_mnemonic(const char* name, Mnemonic* found) {
+    for (size_t i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i++) {
+        if (strcmp(name, mnemonics[i].name) == 0) {
+            *found = mnemonics[i];
+            return 1;
+        }
+    }
+    if (name[0] == 'j' && condition(name + 1) >= 0) {
+        Mnemonic m = {name, KIND_JCC, 0, condition(name + 1)};
+        *found = m;
+        return 1;
+    }
+    if (strncmp(name, "set", 3) == 0 && condition(name + 3) >= 0) {
+        Mnemonic m = {name, KIND_SETCC, 8, condition(name + 3)};
+        *found = m;
+        return 1;
+    }
+    return 0;
+}
+
+static int is_gpr(const Operand* op, int bits) {
+    return op->kind == OPERAND_REGISTER && op->bits == bits;
+}
+
+static int is_xmm(const Operand* op) {
+    return op->kind == OPERAND_REGISTER && op->bits == 128;
+}
+
+static int is_rm(const Operand* op, int bits) {
+    return is_gpr(op, bits) || op->kind == OPERAND_MEMORY;
+}
+
+static int is_xmm_or_memory(const Operand* op) {
+    return is_xmm(op) || op->kind == OPERAND_MEMORY;
+}
+
+// Encode one instruction; AT&T order, so the destination is the last operand
+static int encode_instruction(Assembler* as, const Mnemonic* m, Operand* ops, int count, Encoding* e) {
+    Operand* src = count > 0 ? &ops[0] : NULL;
+    Operand* dest = count > 0 ? &ops[count - 1] : NULL;
+    int bits = m->bits;
+    int wide = bits == 64;
+    int force_rex = (src && needs_rex(src)) || (dest && needs_rex(dest));
+    int expected = m->kind == KIND_PLAIN ? 0 :
+                   (m->kind == KIND_UNARY || m->kind == KIND_SETCC || m->kind == KIND_JCC || m->kind == KIND_JMP ||
+                    m->kind == KIND_CALL || m->kind == KIND_PUSH || m->kind == KIND_POP) ? 1 : 2;
+    if (count != expected && !(m->kind == KIND_IMUL && count == 3)) {
+        return fail(as, "%s takes %d operands", m->name, expected);
+    }
+
+    switch (m->kind) {
+        case KIND_MOV:
+            if (wide && is_xmm(dest) && is_gpr(src, 64)) {
+                encode2(e, 0x66, 1, 0x6e, dest->reg, src, 0);
+            } else if (wide && is_xmm(src) && is_gpr(dest, 64)) {
+                encode2(e, 0x66, 1, 0x7e, src->reg, dest, 0);
+            } else if (src->kind == OPERAND_IMMEDIATE && is_rm(dest, bits)) {
+                if (bits == 8) {
+                    encode1(e, 0, 0, 0xc6, 0, dest, force_rex);
+                    put(e, (int)(src->imm & 0xff));
+                } else {
+                    if (wide ? !fits32(src->imm) : (src->imm < INT32_MIN || src->imm > UINT32_MAX)) {
+                        return fail(as, "immediate out of range for %s", m->name);
+                    }
+                    encode1(e, 0, wide, 0xc7, 0, dest, 0);
+                    put32(e, src->imm);
+                }
+            } else if (is_gpr(src, bits) && is_rm(dest, bits)) {
+                encode1(e, 0, wide, bits == 8 ? 0x88 : 0x89, src->reg, dest, force_rex);
+            } else if (src->kind == OPERAND_MEMORY && is_gpr(dest, bits)) {
+                encode1(e, 0, wide, bits == 8 ? 0x8a : 0x8b, dest->reg, src, force_rex);
+            } else {
+                return fail(as, "bad operands for %s", m->name);
+            }
+            break;
+        case KIND_MOVABS: {
+            if (src->kind != OPERAND_IMMEDIATE || !is_gpr(dest, 64)) return fail(as, "bad operands for movabsq");
+            put(e, 0x48 | ((dest->reg & 8) ? 1 : 0));
+            put(e, 0xb8 + (dest->reg & 7));
+            unsigned long long value = (unsigned long long)src->imm;
+            for (int i = 0; i < 8; i++) put(e, (int)((value >> (8 * i)) & 0xff));
+            break;
+        }
+        case KIND_ALU:
+            if (src->kind == OPERAND_IMMEDIATE && is_rm(dest, bits)) {
+                if (bits == 8) {
+                    encode1(e, 0, 0, 0x80, m->code, dest, force_rex);
+                    put(e, (int)(src->imm & 0xff));
+                } else if (fits8(src->imm)) {
+                    encode1(e, 0, wide, 0x83, m->code, dest, 0);
+                    put(e, (int)(src->imm & 0xff));
+                } else if (fits32(src->imm) || (!wide && src->imm >= 0 && src->imm <= UINT32_MAX)) {
+                    encode1(e, 0, wide, 0x81, m->code, dest, 0);
+                    put32(e, src->imm);
+                } else {
+                    return fail(as, "immediate out of range for %s", m->name);
+                }
+            } else if (is_gpr(src, bits) && is_rm(dest, bits)) {
+                encode1(e, 0, wide, m->code * 8 + (bits == 8 ? 0 : 1), src->reg, dest, force_rex);
+            } else if (src->kind == OPERAND_MEMORY && is_gpr(dest, bits)) {
+                encode1(e, 0, wide, m->code * 8 + (bits == 8 ? 2 : 3), dest->reg, src, force_rex);
+            } else {
+                return fail(as, "bad operands for %s", m->name);
+            }
+            break;
+        case KIND_TEST:
+            if (src->kind == OPERAND_IMMEDIATE && is_rm(dest, bits)) {
+                encode1(e, 0, wide, bits == 8 ? 0xf6 : 0xf7, 0, dest, force_rex);
+                if (bits == 8) put(e, (int)(src->imm & 0xff)); else put32(e, src->imm);
+            } else if (is_gpr(src, bits) && is_rm(dest, bits)) {
+                encode1(e, 0, wide, bits == 8 ? 0x84 : 0x85, src->reg, dest, force_rex);
+            } else {
+                return fail(as, "bad operands for %s", m->name);
+            }
+            break;
+        case KIND_IMUL:
+            if (count == 3) {
+                if (src->kind != OPERAND_IMMEDIATE || !fits32(src->imm) || !is_rm(&ops[1], bits) || !is_gpr(dest, bits)) {
+                    return fail(as, "bad operands for %s", m->name);
+                }
+                encode1(e, 0, wide, fits8(src->imm) ? 0x6b : 0x69, dest->reg, &ops[1], 0);
+                if (fits8(src->imm)) put(e, (int)(src->imm & 0xff)); else put32(e, src->imm);
+            } else if (is_rm(src, bits) && is_gpr(dest, bits)) {
+                encode2(e, 0, wide, 0xaf, dest->reg, src, 0);
+            } else {
+                return fail(as, "bad operands for %s", m->name);
+            }
+            break;
+        case KIND_UNARY:
+            if (!is_rm(dest, bits)) return fail(as, "bad operand for %s", m->name);
+            encode1(e, 0, wide, 0xf7, m->code, dest, 0);
+            break;
+        case KIND_LEA:
+            if (src->kind != OPERAND_MEMORY || !is_gpr(dest, 64)) return fail(as, "bad operands for leaq");
+            encode1(e, 0, 1, 0x8d, dest->reg, src, 0);
+            break;
+        case KIND_MOVZB:
+            if (!is_rm(src, 8) || !is_gpr(dest, bits)) return fail(as, "bad operands for %s", m->name);
+            encode2(e, 0, wide, 0xb6, dest->reg, src, needs_rex(src));
+            break;
+        case KIND_SETCC:
+            if (!is_rm(dest, 8)) return fail(as, "bad operand for %s", m->name);
+            encode2(e, 0, 0, 0x90 + m->code, 0, dest, force_rex);
+            break;
+        case KIND_JCC:
+            if (dest->kind != OPERAND_LABEL || dest->indirect) return fail(as, "bad target for %s", m->name);
+            put(e, 0x0f);
+            put(e, 0x80 + m->code);
+            branch(e, dest->symbol);
+            break;
+        case KIND_JMP:
+        case KIND_CALL:
+            if (dest->kind != OPERAND_LABEL) return fail(as, "bad target for %s", m->name);
+            if (dest->indirect) {
+                Operand target = *dest;
+                target.kind = OPERAND_REGISTER;
+                encode1(e, 0, 0, 0xff, m->kind == KIND_CALL ? 2 : 4, &target, 0);
+            } else {
+                put(e, m->kind == KIND_CALL ? 0xe8 : 0xe9);
+                branch(e, dest->symbol);
+            }
+            break;
+        case KIND_PUSH:
+            if (is_gpr(dest, 64)) {
+                if (dest->reg & 8) put(e, 0x41);
+                put(e, 0x50 + (dest->reg & 7));
+            } else if (dest->kind == OPERAND_IMMEDIATE && fits32(dest->imm)) {
+                if (fits8(dest->imm)) {
+                    put(e, 0x6a);
+                    put(e, (int)(dest->imm & 0xff));
+                } else {
+                    put(e, 0x68);
+                    put32(e, dest->imm);
+                }
+            } else if (dest->kind == OPERAND_MEMORY) {
+                encode1(e, 0, 0, 0xff, 6, dest, 0);
+            } else {
+                return fail(as, "bad operand for pushq");
+            }
+            break;
+        case KIND_POP:
+            if (!is_gpr(dest, 64)) return fail(as, "bad operand for popq");
+            if (dest->reg & 8) put(e, 0x41);
+            put(e, 0x58 + (dest->reg & 7));
+            break;
+        case KIND_PLAIN:
+            if (m->code > 0xff) put(e, m->code >> 8);
+            put(e, m->code & 0xff);
+            break;
+        case KIND_MOVSD:
+            if (is_xmm_or_memory(src) && is_xmm(dest)) {
+                encode2(e, 0xf2, 0, 0x10, dest->reg, src, 0);
+            } else if (is_xmm(src) && dest->kind == OPERAND_MEMORY) {
+                encode2(e, 0xf2, 0, 0x11, src->reg, dest, 0);
+            } else {
+                return fail(as, "bad operands for movsd");
+            }
+            break;
+        case KIND_SSE:
+        case KIND_UCOMISD:
+            if (!is_xmm_or_memory(src) || !is_xmm(dest)) return fail(as, "bad operands for %s", m->name);
+            if (m->kind == KIND_SSE) {
+                encode2(e, 0xf2, 0, m->code, dest->reg, src, 0);
+            } else {
+                encode2(e, 0x66, 0, 0x2e, dest->reg, src, 0);
+            }
+            break;
+        case KIND_CVTSI2SD:
+            if (!is_rm(src, bits) || !is_xmm(dest)) return fail(as, "bad operands for %s", m->name);
+            encode2(e, 0xf2, wide, 0x2a, dest->reg, src, 0);
+            break;
+        case KIND_CVTSD2SI:
+            if (is_gpr(dest, 64)) wide = 1;
+            if (!is_xmm_or_memory(src) || !is_gpr(dest, wide ? 64 : 32)) return fail(as, "bad operands for %s", m->name);
+            encode2(e, 0xf2, wide, m->code, dest->reg, src, 0);
+            break;
+    }
+    return 1;
+}
+
+// Place an encoded instruction at the end of the current section, keeping
+// its symbolic field as a relocation for now
+static void place(Assembler* as, const Encoding* e) {
+    AsmUnit* unit = as->unit;
+    int at = unit->size[as->section];
+    append(unit, as->section, e->bytes, e->length);
+    if (e->field >= 0) {
+        // The processor adds the field to the address of the next instruction
+        add_reloc(unit, as->section, at + e->field, symbol(unit, e->symbol), e->type,
+                  e->symbol_addend - (e->length - e->field));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Lines
+
+static char* trim(char* s) {
+    while (isspace((unsigned char)*s)) s++;
+    char* end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1])) *--end = '\0';
+    return s;
+}
+
+// Cut a '#' comment, leaving string literals alone
+static void strip_comment(char* line) {
+    int quoted = 0;
+    for (char* c = line; *c; c++) {
+        if (quoted && *c == '\\' && c[1]) {
+            c++;
+        } else if (*c == '"') {
+            quoted = !quoted;
+        } else if (*c == '#' && !quoted) {
+            *c = '\0';
+            return;
+        }
+    }
+}
+
+static int need_section(Assembler* as) {
+    if (as->section < 0) return fail(as, "code or data outside .text, .rodata and .bss");
+    return 1;
+}
+
+static int emit_bytes(Assembler* as, const void* bytes, int length) {
+    if (!need_section(as)) return 0;
+    if (as->section == ASM_BSS && bytes) return fail(as, "initialized data in .bss");
+    append(as->unit, as->section, bytes, length);
+    return 1;
+}
+
+static int directive_string(Assembler* as, char* args) {
+    if (args[0] != '"') return fail(as, "expected a string");
+    char* buffer = malloc(strlen(args) + 1);
+    if (!buffer) out_of_memory();
+    int length = 0;
+    char* c = args + 1;
+    while (*c && *c != '"') {
+        if (*c != '\\') {
+            buffer[length++] = *c++;
+            continue;
+        }
+        c++;
+        if (*c >= '0' && *c <= '7') {
+            int value = 0;
+            for (int i = 0; i < 3 && *c >= '0' && *c <= '7'; i++) value = value * 8 + (*c++ - '0');
+            buffer[length++] = (char)value;
+        } else {
+            switch (*c) {
+                case 'n': buffer[length++] = '\n'; break;
+                case 't': buffer[length++] = '\t'; break;
+                case 'r': buffer[length++] = '\r'; break;
+                case '\0': free(buffer); return fail(as, "unterminated string");
+                default: buffer[length++] = *c; break;
+            }
+            c++;
+        }
+    }
+    if (*c != '"' || *trim(c + 1)) {
+        free(buffer);
+        return fail(as, "unterminated string");
+    }
+    buffer[length++] = '\0';
+    int ok = emit_bytes(as, buffer, length);
+    free(buffer);
+    return ok;
+}
+
+// .byte/.long/.quad with a list of numbers
+static int directive_data(Assembler* as, char* args, int size) {
+    for (char* item = strtok(args, ","); item; item = strtok(NULL, ",")) {
+        long long value;
+        if (!parse_number(trim(item), &value)) return fail(as, "bad number %s", item);
+        unsigned char bytes[8];
+        for (int i = 0; i < size; i++) bytes[i] = (unsigned char)((unsigned long long)value >> (8 * i));
+        if (!emit_bytes(as, bytes, size)) return 0;
+    }
+    return 1;
+}
+
+static int directive(Assembler* as, char* name, char* args) {
+    AsmUnit* unit = as->unit;
+    if (strcmp(name, ".text") == 0) {
+        as->section = ASM_TEXT;
+    } else if (strcmp(name, ".bss") == 0) {
+        as->section = ASM_BSS;
+    } else if (strcmp(name, ".section") == 0) {
+        char* comma = strchr(args, ',');
+        if (comma) *comma = '\0';
+        args = trim(args);
+        if (strcmp(args, ".text") == 0) {
+            as->section = ASM_TEXT;
+        } else if (strcmp(args, ".rodata") == 0) {
+            as->section = ASM_RODATA;
+        } else if (strcmp(args, ".bss") == 0) {
+            as->section = ASM_BSS;
+        } else if (strncmp(args, ".note", 5) == 0) {
+            as->section = -1;
+        } else {
+            return fail(as, "unsupported section %s", args);
+        }
+    } else if (strcmp(name, ".globl") == 0 || strcmp(name, ".global") == 0) {
+        char sym[ASM_NAME_MAX];
+        if (!parse_symbol_name(as, args, (int)strlen(args), sym)) return 0;
+        int index = symbol(unit, sym);
+        unit->symbols[index].global = 1;
+    } else if (strcmp(name, ".type") == 0) {
+        char* comma = strchr(args, ',');
+        if (!comma) return fail(as, "bad .type");
+        *comma = '\0';
+        char sym[ASM_NAME_MAX];
+        char* kind = trim(comma + 1);
+        args = trim(args);
+        if (!parse_symbol_name(as, args, (int)strlen(args), sym)) return 0;
+        int index = symbol(unit, sym);
+        unit->symbols[index].function = strcmp(kind, "@function") == 0;
+    } else if (strcmp(name, ".size") == 0) {
+        // Only "name, .-name", after the symbol's last byte
+        char* comma = strchr(args, ',');
+        if (!comma) return fail(as, "bad .size");
+        *comma = '\0';
+        char* expression = trim(comma + 1);
+        int index = asm_find_symbol(unit, trim(args));
+        if (index < 0 || strncmp(expression, ".-", 2) != 0 || strcmp(expression + 2, trim(args)) != 0 ||
+            unit->symbols[index].section != as->section) {
+            return fail(as, "unsupported .size");
+        }
+        unit->symbols[index].size = unit->size[as->section] - unit->symbols[index].offset;
+    } else if (strcmp(name, ".align") == 0 || strcmp(name, ".p2align") == 0) {
+        long long value;
+        if (!need_section(as) || !parse_number(args, &value) || value < 0 || value > 4096) {
+            return fail(as, "bad %s", name);
+        }
+        int align = name[1] == 'p' ? 1 << value : (int)value;
+        if (align <= 0 || (align & (align - 1))) return fail(as, "bad %s", name);
+        if (align > unit->align[as->section]) unit->align[as->section] = align;
+        while (unit->size[as->section] % align) {
+            unsigned char fill = as->section == ASM_TEXT ? 0x90 : 0;
+            append(unit, as->section, &fill, 1);
+        }
+    } else if (strcmp(name, ".zero") == 0 || strcmp(name, ".skip") == 0) {
+        long long value;
+        if (!parse_number(args, &value) || value < 0 || value > (1 << 28)) return fail(as, "bad %s", name);
+        return emit_bytes(as, NULL, (int)value);
+    } else if (strcmp(name, ".string") == 0 || strcmp(name, ".asciz") == 0) {
+        return directive_string(as, args);
+    } else if (strcmp(name, ".byte") == 0) {
+        return directive_data(as, args, 1);
+    } else if (strcmp(name, ".long") == 0) {
+        return directive_data(as, args, 4);
+    } else if (strcmp(name, ".quad") == 0) {
+        return directive_data(as, args, 8);
+    } else {
+        return fail(as, "unsupported directive %s", name);
+    }
+    return 1;
+}
+
+static int define_label(Assembler* as, const char* name) {
+    if (!need_section(as)) return 0;
+    AsmUnit* unit = as->unit;
+    int index = symbol(unit, name);
+    if (unit->symbols[index].section >= 0) return fail(as, "%s is defined twice", name);
+    unit->symbols[index].section = as->section;
+    unit->symbols[index].offset = unit->size[as->section];
+    return 1;
+}
+
+static int instruction(Assembler* as, char* name, char* args) {
+    Mnemonic m;
+    if (!lookup_mnemonic(name, &m)) return fail(as, "unsupported instruction %s", name);
+    if (!need_section(as)) return 0;
+    if (as->section != ASM_TEXT) return fail(as, "instruction outside .text");
+
+    // Split the operands at top-level commas
+    Operand ops[3];
+    int count = 0;
+    char* start = args;
+    int depth = 0;
+    for (char* c = args;; c++) {
+        if (*c == '(') depth++;
+        if (*c == ')') depth--;
+        if ((*c == ',' && depth == 0) || *c == '\0') {
+            int last = *c == '\0';
+            *c = '\0';
+            char* text = trim(start);
+            if (*text) {
+                if (count == 3) return fail(as, "too many operands");
+                if (!parse_operand(as, text, &ops[count++])) return 0;
+            } else if (!last || count > 0) {
+                return fail(as, "missing operand");
+            }
+            if (last) break;
+            start = c + 1;
+        }
+    }
+
+    Encoding e;
+    memset(&e, 0, sizeof(e));
+    e.field = -1;
+    if (!encode_instruction(as, &m, ops, count, &e)) return 0;
+    place(as, &e);
+    return 1;
+}
+
+static int assemble_line(Assembler* as, char* line) {
+    strip_comment(line);
+    char* s = trim(line);
+    // Labels, possibly followed by more on the line
+    for (;;) {
+        int length = 0;
+        while (s[length] && (isalnum((unsigned char)s[length]) || s[length] == '_' || s[length] == '.' ||
+                             s[length] == '$')) {
+            length++;
+        }
+        if (length == 0 || s[length] != ':') break;
+        s[length] = '\0';
+        if (!define_label(as, s)) return 0;
+        s = trim(s + length + 1);
+    }
+    if (!*s) return 1;
+
+    char* args = s + strcspn(s, " \t");
+    if (*args) *args++ = '\0';
+    args = trim(args);
+    if (s[0] == '.') return directive(as, s, args);
+    return instruction(as, s, args);
+}
+
+// Patch references within a section; keep the rest as relocations
+static int resolve(Assembler* as) {
+    AsmUnit* unit = as->unit;
+    int kept = 0;
+    for (int i = 0; i < unit->reloc_count; i++) {
+        AsmReloc r = unit->relocs[i];
+        const AsmSymbol* s = &unit->symbols[r.symbol];
+        if (s->section == r.section && r.type != ASM_RELOC_GOTPCREL) {
+            long long value = (long long)s->offset + r.addend - r.offset;
+            if (!fits32(value)) return fail(as, "reference to %s out of range", s->name);
+            unsigned char* field = unit->bytes[r.section] + r.offset;
+            for (int b = 0; b < 4; b++) field[b] = (unsigned char)((unsigned long long)value >> (8 * b));
+        } else if (s->section < 0 && strncmp(s->name, ".L", 2) == 0) {
+            as->line = 0;
+            return fail(as, "undefined label %s", s->name);
+        } else {
+            unit->relocs[kept++] = r;
+        }
+    }
+    unit->reloc_count = kept;
+    return 1;
+}
+
+int assemble(const char* source, AsmUnit* unit) {
+    memset(unit, 0, sizeof(*unit));
+    for (int s = 0; s < ASM_SECTION_COUNT; s++) unit->align[s] = 1;
+    unit->align[ASM_TEXT] = 16;
+    Assembler as = {unit, ASM_TEXT, 0};
+
+    const char* p = source;
+    while (*p) {
+        const char* end = p + strcspn(p, "\n");
+        char* line = malloc(end - p + 1);
+        if (!line) out_of_memory();
+        memcpy(line, p, end - p);
+        line[end - p] = '\0';
+        as.line++;
+        int ok = assemble_line(&as, line);
+        free(line);
+        if (!ok) return 0;
+        p = *end ? end + 1 : end;
+    }
+    return resolve(&as);
+}
+
+void free_asm_unit(AsmUnit* unit) {
+    for (int s = 0; s < ASM_SECTION_COUNT; s++) free(unit->bytes[s]);
+    for (int i = 0; i < unit->symbol_count; i++) free(unit->symbols[i].name);
+    free(unit->symbols);
+    free(unit->relocs);
+    memset(unit, 0, sizeof(*unit));
+}
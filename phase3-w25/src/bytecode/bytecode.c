@@ -0,0 +1,663 @@
+/* bytecode.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/bytecode.h"
+#include "../../include/ir.h"
+#include "../../include/pass.h"
+#include "../../include/super.h"
+#include "../../include/peephole.h"
+
+// A pending register move on a control-flow edge
+typedef struct {
+    int dest;
+    int source;
+} Move;
+
+// Per-function compilation state
+typedef struct {
+    const IRProgram* program;
+    const IRFunction* ir;
+    BCFunction* function;
+    int* registers;            // Register of each value, by value number (-1 if none)
+    int scratch;               // Breaks cycles among phi moves
+    int arg_base;              // Outgoing arguments are placed from here up
+    int* fixups;               // Jumps to patch: instruction, target block pairs
+    int fixup_count;
+    int fixup_capacity;
+    Move* moves;
+    int move_capacity;
+    int failed;
+} Compiler;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for bytecode\n");
+    exit(1);
+}
+
+static int emit(Compiler* compiler, BCOpcode op, int a, int b, int c, int line) {
+    BCFunction* function = compiler->function;
+    if (function->code_count == function->code_capacity) {
+        function->code_capacity = function->code_capacity ? function->code_capacity * 2 : 64;
+        function->code = realloc(function->code, function->code_capacity * sizeof(BCInstr));
+        function->lines = realloc(function->lines, function->code_capacity * sizeof(int));
+        if (!function->code || !function->lines) out_of_memory();
+    }
+    BCInstr* instr = &function->code[function->code_count];
+    instr->op = (uint16_t)op;
+    instr->a = (uint16_t)a;
+    instr->b = (uint16_t)b;
+    instr->c = (uint16_t)c;
+    function->lines[function->code_count] = line;
+    return function->code_count++;
+}
+
+int bc_jump_target(const BCInstr* instr) {
+    if (instr->op == BC_JUMP || instr->op == BC_JUMPIF || instr->op == BC_JUMPIFNOT) {
+        return (int)BC_TARGET(*instr);
+    }
+    if (BC_IS_FUSED_BRANCH(instr->op)) {
+        return instr->c;
+    }
+    return -1;
+}
+
+void bc_set_jump_target(BCInstr* instr, int target) {
+    if (BC_IS_FUSED_BRANCH(instr->op)) {
+        instr->c = (uint16_t)target;
+        return;
+    }
+    instr->b = (uint16_t)(target & 0xFFFF);
+    instr->c = (uint16_t)((unsigned int)target >> 16);
+}
+
+int bc_reads(const BCProgram* program, const BCInstr* instr, int reads[2], int* range_count) {
+    *range_count = 0;
+    switch (instr->op) {
+        case BC_LOADK: case BC_LOADG: case BC_JUMP:
+            return 0;
+        case BC_MOVE: case BC_ITOF: case BC_FTOI: case BC_FACT:
+        case BC_ADDIK: case BC_SUBIK: case BC_MULIK: case BC_DIVIK:
+        case BC_ADDFK: case BC_SUBFK: case BC_MULFK: case BC_DIVFK:
+            reads[0] = instr->b;
+            return 1;
+        case BC_STOREG: case BC_PRINTI: case BC_PRINTF: case BC_PRINTS:
+        case BC_JUMPIF: case BC_JUMPIFNOT: case BC_RETURN:
+        case BC_JEQIK: case BC_JNEIK: case BC_JLTIK: case BC_JLEIK: case BC_JGTIK: case BC_JGEIK:
+            reads[0] = instr->a;
+            return 1;
+        case BC_JEQI: case BC_JNEI: case BC_JLTI: case BC_JLEI: case BC_JGTI: case BC_JGEI:
+            reads[0] = instr->a;
+            reads[1] = instr->b;
+            return 2;
+        case BC_CALL:
+            *range_count = program->functions[instr->b].param_count;
+            return 0;
+        default:
+            reads[0] = instr->b;
+            reads[1] = instr->c;
+            return 2;
+    }
+}
+
+int bc_writes(const BCInstr* instr) {
+    switch (instr->op) {
+        case BC_STOREG: case BC_PRINTI: case BC_PRINTF: case BC_PRINTS:
+        case BC_JUMP: case BC_JUMPIF: case BC_JUMPIFNOT: case BC_RETURN:
+            return -1;
+        default:
+            return BC_IS_FUSED_BRANCH(instr->op) ? -1 : instr->a;
+    }
+}
+
+// Delete flagged instructions; jumps to one land on the next kept instruction
+void bc_remove_instructions(BCFunction* function, const char* removed) {
+    int* position = malloc((function->code_count + 1) * sizeof(int));
+    if (!position) out_of_memory();
+    int kept = 0;
+    for (int pc = 0; pc < function->code_count; pc++) {
+        position[pc] = kept;
+        kept += !removed[pc];
+    }
+    position[function->code_count] = kept;
+
+    kept = 0;
+    for (int pc = 0; pc < function->code_count; pc++) {
+        if (removed[pc]) {
+            continue;
+        }
+        BCInstr instr = function->code[pc];
+        int target = bc_jump_target(&instr);
+        if (target >= 0) {
+            bc_set_jump_target(&instr, position[target]);
+        }
+        function->code[kept] = instr;
+        function->lines[kept] = function->lines[pc];
+        kept++;
+    }
+    for (int b = 0; b < function->block_count; b++) {
+        if (function->block_start[b] >= 0) function->block_start[b] = position[function->block_start[b]];
+    }
+    function->code_count = kept;
+    free(position);
+}
+
+// Jump (or conditional jump on register 'a') to the start of an IR block
+static void emit_jump(Compiler* compiler, BCOpcode op, int a, int block, int line) {
+    int pc = emit(compiler, op, a, 0, 0, line);
+    if (compiler->fixup_count + 2 > compiler->fixup_capacity) {
+        compiler->fixup_capacity = compiler->fixup_capacity ? compiler->fixup_capacity * 2 : 64;
+        compiler->fixups = realloc(compiler->fixups, compiler->fixup_capacity * sizeof(int));
+        if (!compiler->fixups) out_of_memory();
+    }
+    compiler->fixups[compiler->fixup_count++] = pc;
+    compiler->fixups[compiler->fixup_count++] = block;
+}
+
+static int same_constant(ValueTag tag, const Value* a, const Value* b) {
+    if (tag == VAL_STR) return strcmp(a->s, b->s) == 0;
+    if (tag == VAL_FLOAT) return memcmp(&a->f, &b->f, sizeof(double)) == 0;
+    return a->i == b->i;
+}
+
+// Constant pool index of a value, adding it if new
+static int add_constant(Compiler* compiler, ValueTag tag, Value value) {
+    BCFunction* function = compiler->function;
+    for (int k = 0; k < function->constant_count; k++) {
+        if (function->constant_tags[k] == tag && same_constant(tag, &function->constants[k], &value)) {
+            return k;
+        }
+    }
+    if (function->constant_count > BC_MAX_OPERAND) {
+        compiler->failed = 1;
+        return 0;
+    }
+    if (function->constant_count == function->constant_capacity) {
+        function->constant_capacity = function->constant_capacity ? function->constant_capacity * 2 : 16;
+        function->constants = realloc(function->constants, function->constant_capacity * sizeof(Value));
+        function->constant_tags = realloc(function->constant_tags, function->constant_capacity * sizeof(ValueTag));
+        if (!function->constants || !function->constant_tags) out_of_memory();
+    }
+    // The slot is copied whole, so clear what the member leaves unset
+    Value slot;
+    memset(&slot, 0, sizeof(slot));
+    if (tag == VAL_STR) {
+        char* copy = malloc(strlen(value.s) + 1);
+        if (!copy) out_of_memory();
+        strcpy(copy, value.s);
+        slot.s = copy;
+    } else if (tag == VAL_FLOAT) {
+        slot.f = value.f;
+    } else {
+        slot.i = value.i;
+    }
+    function->constants[function->constant_count] = slot;
+    function->constant_tags[function->constant_count] = tag;
+    return function->constant_count++;
+}
+
+static int constant_of(Compiler* compiler, const IRInstr* instr) {
+    Value value;
+    if (instr->type == IR_FLOAT) {
+        value.f = instr->imm.f;
+        return add_constant(compiler, VAL_FLOAT, value);
+    }
+    if (instr->type == IR_STR) {
+        value.s = instr->imm.s;
+        return add_constant(compiler, VAL_STR, value);
+    }
+    value.i = instr->imm.i;
+    return add_constant(compiler, VAL_INT, value);
+}
+
+static int zero_constant(Compiler* compiler) {
+    Value value;
+    value.i = 0;
+    return add_constant(compiler, VAL_INT, value);
+}
+
+static int reg(Compiler* compiler, const IRInstr* value) {
+    int r = compiler->registers[value->id];
+    if (r < 0) {
+        compiler->failed = 1;
+        return 0;
+    }
+    return r;
+}
+
+int bc_value_registers(const IRFunction* ir, int* registers) {
+    int next = ir->param_count;
+    for (int v = 0; v < ir->value_count; v++) {
+        registers[v] = -1;
+    }
+    for (int b = 0; b < ir->block_count; b++) {
+        const IRBlock* block = &ir->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        for (int i = 0; i < block->count; i++) {
+            const IRInstr* instr = block->code[i];
+            if (instr->op == IR_PARAM) {
+                registers[instr->id] = instr->index;
+            } else if (instr->type != IR_VOID) {
+                registers[instr->id] = next++;
+            }
+        }
+    }
+    return next;
+}
+
+// Give every value a register: parameters keep their argument registers,
+// everything else gets its own. Then one scratch register and the area
+// outgoing call arguments are placed in.
+static void assign_registers(Compiler* compiler) {
+    const IRFunction* ir = compiler->ir;
+    int next = bc_value_registers(ir, compiler->registers);
+    int max_args = 0;
+    for (int b = 0; b < ir->block_count; b++) {
+        const IRBlock* block = &ir->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        for (int i = 0; i < block->count; i++) {
+            const IRInstr* instr = block->code[i];
+            if (instr->op == IR_CALL) {
+                int args = instr->arg_count;
+                if (instr->index >= 0 && compiler->program->functions[instr->index]->param_count > args) {
+                    args = compiler->program->functions[instr->index]->param_count;
+                }
+                if (args > max_args) max_args = args;
+            }
+        }
+    }
+    compiler->scratch = next++;
+    compiler->arg_base = next;
+    compiler->function->register_count = next + max_args;
+    if (compiler->function->register_count > BC_MAX_OPERAND + 1) {
+        compiler->failed = 1;
+    }
+}
+
+// Moves feeding the phis of 'to' along the edge from 'from', ordered so no
+// source is overwritten before it is read
+static void emit_edge_moves(Compiler* compiler, int from, int to, int line) {
+    const IRBlock* target = &compiler->ir->blocks[to];
+    int pred = 0;
+    while (pred < target->pred_count && target->preds[pred] != from) pred++;
+    if (pred == target->pred_count) {
+        return;
+    }
+
+    int count = 0;
+    for (int i = 0; i < target->count && target->code[i]->op == IR_PHI; i++) {
+        if (count == compiler->move_capacity) {
+            compiler->move_capacity = compiler->move_capacity ? compiler->move_capacity * 2 : 16;
+            compiler->moves = realloc(compiler->moves, compiler->move_capacity * sizeof(Move));
+            if (!compiler->moves) out_of_memory();
+        }
+        const IRInstr* phi = target->code[i];
+        Move move = {reg(compiler, phi), reg(compiler, phi->args[pred])};
+        if (move.dest != move.source) {
+            compiler->moves[count++] = move;
+        }
+    }
+
+    Move* moves = compiler->moves;
+    while (count > 0) {
+        int ready = -1;
+        for (int m = 0; m < count && ready < 0; m++) {
+            int read = 0;
+            for (int n = 0; n < count; n++) {
+                if (n != m && moves[n].source == moves[m].dest) {
+                    read = 1;
+                    break;
+                }
+            }
+            if (!read) ready = m;
+        }
+        if (ready < 0) {
+            // Only cycles are left: park one destination's value in scratch
+            int dest = moves[0].dest;
+            emit(compiler, BC_MOVE, compiler->scratch, dest, 0, line);
+            for (int n = 0; n < count; n++) {
+                if (moves[n].source == dest) moves[n].source = compiler->scratch;
+            }
+            ready = 0;
+        }
+        emit(compiler, BC_MOVE, moves[ready].dest, moves[ready].source, 0, line);
+        moves[ready] = moves[--count];
+    }
+}
+
+static int has_edge_moves(Compiler* compiler, int from, int to) {
+    const IRBlock* target = &compiler->ir->blocks[to];
+    int pred = 0;
+    while (pred < target->pred_count && target->preds[pred] != from) pred++;
+    if (pred == target->pred_count) {
+        return 0;
+    }
+    for (int i = 0; i < target->count && target->code[i]->op == IR_PHI; i++) {
+        if (reg(compiler, target->code[i]) != reg(compiler, target->code[i]->args[pred])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Go from block 'from' to 'to' after the edge's moves, falling through
+// when 'to' is laid out next
+static void emit_edge(Compiler* compiler, int from, int to, int next, int line) {
+    emit_edge_moves(compiler, from, to, line);
+    if (to != next) {
+        emit_jump(compiler, BC_JUMP, 0, to, line);
+    }
+}
+
+// The opcode for an arithmetic, comparison or logic instruction, chosen by
+// the type of its operands (the lowering made both the same)
+static BCOpcode binary_opcode(const IRInstr* instr) {
+    int is_float = instr->args[0]->type == IR_FLOAT;
+    if (instr->op >= IR_ADD && instr->op <= IR_DIV) {
+        return (is_float ? BC_ADDF : BC_ADDI) + (instr->op - IR_ADD);
+    }
+    if (instr->op >= IR_EQ && instr->op <= IR_GE) {
+        return (is_float ? BC_EQF : BC_EQI) + (instr->op - IR_EQ);
+    }
+    return instr->op == IR_AND ? BC_AND : BC_OR;
+}
+
+static void compile_instr(Compiler* compiler, int b, const IRInstr* instr, int next) {
+    const IRBlock* block = &compiler->ir->blocks[b];
+    int line = instr->line;
+    switch (instr->op) {
+        case IR_CONST:
+            emit(compiler, BC_LOADK, reg(compiler, instr), constant_of(compiler, instr), 0, line);
+            break;
+        case IR_PARAM:
+        case IR_PHI:
+            break;
+        case IR_LOAD:
+            emit(compiler, BC_LOADG, reg(compiler, instr), instr->index, 0, line);
+            break;
+        case IR_STORE:
+            emit(compiler, BC_STOREG, reg(compiler, instr->args[0]), instr->index, 0, line);
+            break;
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR:
+            emit(compiler, binary_opcode(instr), reg(compiler, instr),
+                 reg(compiler, instr->args[0]), reg(compiler, instr->args[1]), line);
+            break;
+        case IR_ITOF: case IR_FTOI: case IR_FACT:
+            emit(compiler, BC_ITOF + (instr->op - IR_ITOF), reg(compiler, instr),
+                 reg(compiler, instr->args[0]), 0, line);
+            break;
+        case IR_COPY:
+            emit(compiler, BC_MOVE, reg(compiler, instr), reg(compiler, instr->args[0]), 0, line);
+            break;
+        case IR_CALL: {
+            int params = instr->index >= 0 ? compiler->program->functions[instr->index]->param_count : 0;
+            for (int a = 0; a < instr->arg_count; a++) {
+                emit(compiler, BC_MOVE, compiler->arg_base + a, reg(compiler, instr->args[a]), 0, line);
+            }
+            // Parameters the call leaves out start as 0
+            for (int a = instr->arg_count; a < params; a++) {
+                emit(compiler, BC_LOADK, compiler->arg_base + a, zero_constant(compiler), 0, line);
+            }
+            if (instr->index < 0) {
+                compiler->failed = 1;
+            }
+            emit(compiler, BC_CALL, reg(compiler, instr), instr->index, compiler->arg_base, line);
+            break;
+        }
+        case IR_PRINT: {
+            IRType type = instr->args[0]->type;
+            BCOpcode op = type == IR_FLOAT ? BC_PRINTF : type == IR_STR ? BC_PRINTS : BC_PRINTI;
+            emit(compiler, op, reg(compiler, instr->args[0]), 0, 0, line);
+            break;
+        }
+        case IR_JUMP:
+            emit_edge(compiler, b, block->succ[0], next, line);
+            break;
+        case IR_BRANCH: {
+            int condition = reg(compiler, instr->args[0]);
+            int yes = block->succ[0];
+            int no = block->succ_count > 1 ? block->succ[1] : yes;
+            int yes_moves = has_edge_moves(compiler, b, yes);
+            int no_moves = has_edge_moves(compiler, b, no);
+            if (!no_moves && (yes_moves || yes == next)) {
+                emit_jump(compiler, BC_JUMPIFNOT, condition, no, line);
+                emit_edge(compiler, b, yes, next, line);
+            } else if (!yes_moves) {
+                emit_jump(compiler, BC_JUMPIF, condition, yes, line);
+                emit_edge(compiler, b, no, next, line);
+            } else {
+                int skip = emit(compiler, BC_JUMPIFNOT, condition, 0, 0, line);
+                emit_edge_moves(compiler, b, yes, line);
+                emit_jump(compiler, BC_JUMP, 0, yes, line);
+                bc_set_jump_target(&compiler->function->code[skip], compiler->function->code_count);
+                emit_edge(compiler, b, no, next, line);
+            }
+            break;
+        }
+        case IR_RETURN:
+            emit(compiler, BC_RETURN, reg(compiler, instr->args[0]), 0, 0, line);
+            break;
+        default:
+            compiler->failed = 1;
+            break;
+    }
+}
+
+static int compile_function(const IRProgram* program, const IRFunction* ir, BCFunction* function) {
+    Compiler compiler;
+    memset(&compiler, 0, sizeof(compiler));
+    compiler.program = program;
+    compiler.ir = ir;
+    compiler.function = function;
+    compiler.registers = malloc((ir->value_count + 1) * sizeof(int));
+    function->block_start = malloc((ir->block_count + 1) * sizeof(int));
+    if (!compiler.registers || !function->block_start) out_of_memory();
+    function->block_count = ir->block_count;
+
+    function->name = malloc(strlen(ir->name) + 1);
+    if (!function->name) out_of_memory();
+    strcpy(function->name, ir->name);
+    function->param_count = ir->param_count;
+    assign_registers(&compiler);
+
+    for (int b = 0; b < ir->block_count; b++) {
+        const IRBlock* block = &ir->blocks[b];
+        function->block_start[b] = -1;
+        if (block->dead) {
+            continue;
+        }
+        int next = b + 1;
+        while (next < ir->block_count && ir->blocks[next].dead) next++;
+
+        function->block_start[b] = function->code_count;
+        for (int i = 0; i < block->count; i++) {
+            compile_instr(&compiler, b, block->code[i], next);
+        }
+        // A block without a terminator (nothing lowers one) still leaves
+        const IRInstr* last = block->count ? block->code[block->count - 1] : NULL;
+        if (!last || (last->op != IR_JUMP && last->op != IR_BRANCH && last->op != IR_RETURN)) {
+            if (block->succ_count > 0) {
+                emit_edge(&compiler, b, block->succ[0], next, ir->line);
+            } else {
+                int zero = compiler.scratch;
+                emit(&compiler, BC_LOADK, zero, zero_constant(&compiler), 0, ir->line);
+                emit(&compiler, BC_RETURN, zero, 0, 0, ir->line);
+            }
+        }
+    }
+
+    for (int f = 0; f < compiler.fixup_count; f += 2) {
+        bc_set_jump_target(&function->code[compiler.fixups[f]], function->block_start[compiler.fixups[f + 1]]);
+    }
+
+    if (compiler.failed) {
+        fprintf(stderr, "Error: function %s is too large for bytecode\n", ir->name);
+    }
+    free(compiler.registers);
+    free(compiler.fixups);
+    free(compiler.moves);
+    return !compiler.failed;
+}
+
+BCProgram* compile_bytecode(const IRProgram* ir) {
+    BCProgram* program = calloc(1, sizeof(BCProgram));
+    if (!program) out_of_memory();
+    program->function_count = ir->function_count;
+    program->global_count = ir->global_count;
+    program->main_function = ir->main_function;
+    program->init_function = ir->init_function;
+    program->functions = calloc(ir->function_count + 1, sizeof(BCFunction));
+    if (!program->functions) out_of_memory();
+
+    int ok = ir->global_count <= BC_MAX_OPERAND + 1 && ir->function_count <= BC_MAX_OPERAND + 1;
+    for (int f = 0; f < ir->function_count && ok; f++) {
+        ok = compile_function(ir, ir->functions[f], &program->functions[f]);
+    }
+    if (!ok) {
+        free_bytecode(program);
+        return NULL;
+    }
+    select_superinstructions(program);
+    if (peephole_enabled()) {
+        peephole_program(program, NULL);
+    }
+    return program;
+}
+
+void free_bytecode(BCProgram* program) {
+    if (!program) {
+        return;
+    }
+    for (int f = 0; f < program->function_count; f++) {
+        BCFunction* function = &program->functions[f];
+        for (int k = 0; k < function->constant_count; k++) {
+            if (function->constant_tags[k] == VAL_STR) {
+                free((char*)function->constants[k].s);
+            }
+        }
+        free(function->name);
+        free(function->code);
+        free(function->lines);
+        free(function->block_start);
+        free(function->constants);
+        free(function->constant_tags);
+    }
+    free(program->functions);
+    free(program);
+}
+
+// Opcode names as the listing prints them
+static const char* op_names[BC_OPCODE_COUNT] = {
+    [BC_LOADK] = "loadk", [BC_MOVE] = "move", [BC_LOADG] = "loadg", [BC_STOREG] = "storeg",
+    [BC_ADDI] = "addi", [BC_SUBI] = "subi", [BC_MULI] = "muli", [BC_DIVI] = "divi",
+    [BC_ADDF] = "addf", [BC_SUBF] = "subf", [BC_MULF] = "mulf", [BC_DIVF] = "divf",
+    [BC_EQI] = "eqi", [BC_NEI] = "nei", [BC_LTI] = "lti", [BC_LEI] = "lei",
+    [BC_GTI] = "gti", [BC_GEI] = "gei", [BC_EQF] = "eqf", [BC_NEF] = "nef",
+    [BC_LTF] = "ltf", [BC_LEF] = "lef", [BC_GTF] = "gtf", [BC_GEF] = "gef",
+    [BC_AND] = "and", [BC_OR] = "or", [BC_ITOF] = "itof", [BC_FTOI] = "ftoi",
+    [BC_FACT] = "fact", [BC_CALL] = "call", [BC_PRINTI] = "printi", [BC_PRINTF] = "printf",
+    [BC_PRINTS] = "prints", [BC_JUMP] = "jmp", [BC_JUMPIF] = "jmpif", [BC_JUMPIFNOT] = "jmpifnot",
+    [BC_RETURN] = "ret", [BC_ADDIK] = "addik", [BC_SUBIK] = "subik", [BC_MULIK] = "mulik",
+    [BC_DIVIK] = "divik", [BC_ADDFK] = "addfk", [BC_SUBFK] = "subfk", [BC_MULFK] = "mulfk",
+    [BC_DIVFK] = "divfk", [BC_JEQI] = "jeqi", [BC_JNEI] = "jnei", [BC_JLTI] = "jlti",
+    [BC_JLEI] = "jlei", [BC_JGTI] = "jgti", [BC_JGEI] = "jgei", [BC_JEQIK] = "jeqik",
+    [BC_JNEIK] = "jneik", [BC_JLTIK] = "jltik", [BC_JLEIK] = "jleik", [BC_JGTIK] = "jgtik",
+    [BC_JGEIK] = "jgeik"
+};
+
+const char* bc_op_name(BCOpcode op) {
+    return op < BC_OPCODE_COUNT && op_names[op] ? op_names[op] : "?";
+}
+
+static void print_constant(ValueTag tag, const Value* value) {
+    switch (tag) {
+        case VAL_INT: printf("%d", value->i); break;
+        case VAL_FLOAT: printf("%.17g", value->f); break;
+        case VAL_STR: printf("\"%s\"", value->s); break;
+    }
+}
+
+void print_bytecode_function(const BCFunction* function) {
+    printf("function %s: %d param(s), %d register(s), %d instruction(s)\n", function->name,
+           function->param_count, function->register_count, function->code_count);
+    for (int pc = 0; pc < function->code_count; pc++) {
+        BCInstr instr = function->code[pc];
+        printf("  %4d  %-9s", pc, bc_op_name(instr.op));
+        switch (instr.op) {
+            case BC_LOADK:
+                printf(" r%d, k%d  ; ", instr.a, instr.b);
+                print_constant(function->constant_tags[instr.b], &function->constants[instr.b]);
+                break;
+            case BC_MOVE: case BC_ITOF: case BC_FTOI: case BC_FACT:
+                printf(" r%d, r%d", instr.a, instr.b);
+                break;
+            case BC_LOADG:
+                printf(" r%d, g%d", instr.a, instr.b);
+                break;
+            case BC_STOREG:
+                printf(" g%d, r%d", instr.b, instr.a);
+                break;
+            case BC_CALL:
+                printf(" r%d, f%d, r%d", instr.a, instr.b, instr.c);
+                break;
+            case BC_PRINTI: case BC_PRINTF: case BC_PRINTS: case BC_RETURN:
+                printf(" r%d", instr.a);
+                break;
+            case BC_JUMP:
+                printf(" %u", BC_TARGET(instr));
+                break;
+            case BC_JUMPIF: case BC_JUMPIFNOT:
+                printf(" r%d, %u", instr.a, BC_TARGET(instr));
+                break;
+            case BC_ADDIK: case BC_SUBIK: case BC_MULIK: case BC_DIVIK:
+            case BC_ADDFK: case BC_SUBFK: case BC_MULFK: case BC_DIVFK:
+                printf(" r%d, r%d, k%d  ; ", instr.a, instr.b, instr.c);
+                print_constant(function->constant_tags[instr.c], &function->constants[instr.c]);
+                break;
+            case BC_JEQI: case BC_JNEI: case BC_JLTI: case BC_JLEI: case BC_JGTI: case BC_JGEI:
+                printf(" r%d, r%d, %d", instr.a, instr.b, instr.c);
+                break;
+            case BC_JEQIK: case BC_JNEIK: case BC_JLTIK: case BC_JLEIK: case BC_JGTIK: case BC_JGEIK:
+                printf(" r%d, k%d, %d  ; ", instr.a, instr.b, instr.c);
+                print_constant(function->constant_tags[instr.b], &function->constants[instr.b]);
+                break;
+            default:
+                printf(" r%d, r%d, r%d", instr.a, instr.b, instr.c);
+                break;
+        }
+        printf("\n");
+    }
+}
+
+void print_bytecode_program(const BCProgram* program) {
+    printf("; %d global slot(s)\n", program->global_count);
+    for (int f = 0; f < program->function_count; f++) {
+        printf("\n");
+        print_bytecode_function(&program->functions[f]);
+    }
+}
+
+// Compile a file with the selected pass pipeline and print its bytecode
+void proc_bytecode_file(const char* filename) {
+    PassManager manager;
+    if (!pass_manager_init(&manager, get_pass_pipeline())) {
+        return;
+    }
+    IRProgram* ir = compile_file_to_ir(filename, &manager);
+    pass_manager_free(&manager);
+    if (!ir) {
+        return;
+    }
+    BCProgram* program = compile_bytecode(ir);
+    free_ir_program(ir);
+    if (program) {
+        print_bytecode_program(program);
+        free_bytecode(program);
+    }
+}
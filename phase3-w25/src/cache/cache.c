@@ -0,0 +1,439 @@
+/* cache.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../../include/cache.h"
+#include "../../include/parser.h"
+#include "../../include/lexer.h"
+#include "../../include/semantic.h"
+#include "../../include/diagnostics.h"
+
+#define CACHE_MAGIC "BWCCACHE"   // 8 bytes, no terminator stored
+#define CACHE_SUFFIX ".bcc"
+
+// Entry header written before the captured diagnostics
+typedef struct {
+    char magic[8];
+    uint32_t version;            // CACHE_FORMAT_VERSION
+    uint32_t diagnostics_size;   // Bytes of diagnostics after the header
+    uint64_t build_id;           // Compiler build that produced the entry
+    uint64_t source_hash;        // Hash of the source bytes
+    uint64_t source_length;      // Source size, a cheap second check
+    uint64_t last_use;           // Use stamp of the last store or hit (use_stamp)
+    CheckResult result;
+} CacheEntryHeader;
+
+// Cache state for this run (directory NULL means caching is off)
+static char *cache_directory = NULL;
+static long cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+static uint64_t build_id = 0;
+static CacheStats stats = {0, 0, 0, 0};
+static uint64_t last_stamp = 0;
+
+// xxHash64 primes
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Little-endian loads independent of host alignment
+static uint64_t read64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+    return value;
+}
+
+static uint32_t read32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t value) {
+    acc ^= xxh_round(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+// xxHash64 of a byte range
+uint64_t hash_bytes(const void *data, size_t length, uint64_t seed) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + length;
+    uint64_t hash;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const unsigned char *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p)); p += 8;
+            v2 = xxh_round(v2, read64(p)); p += 8;
+            v3 = xxh_round(v3, read64(p)); p += 8;
+            v4 = xxh_round(v4, read64(p)); p += 8;
+        } while (p <= limit);
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = xxh_merge(hash, v1);
+        hash = xxh_merge(hash, v2);
+        hash = xxh_merge(hash, v3);
+        hash = xxh_merge(hash, v4);
+    } else {
+        hash = seed + PRIME64_5;
+    }
+
+    hash += (uint64_t)length;
+    while (p + 8 <= end) {
+        hash ^= xxh_round(0, read64(p));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        hash ^= (uint64_t)read32(p) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= (*p) * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+        p++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Hash of the compiler executable, so any rebuild starts a fresh cache
+static uint64_t compute_build_id(const char *program_path) {
+    const char *candidates[] = {"/proc/self/exe", program_path};
+
+    for (int i = 0; i < 2; i++) {
+        if (!candidates[i]) continue;
+        FILE *file = fopen(candidates[i], "rb");
+        if (!file) continue;
+
+        uint64_t id = CACHE_FORMAT_VERSION;
+        unsigned char chunk[65536];
+        size_t read;
+        while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            id = hash_bytes(chunk, read, id);
+        }
+        fclose(file);
+        return id;
+    }
+
+    // No readable executable: fall back to the build time of this file
+    const char *stamp = __DATE__ " " __TIME__;
+    return hash_bytes(stamp, strlen(stamp), CACHE_FORMAT_VERSION);
+}
+
+// Enable the cache in 'directory' (created if missing)
+void cache_open(const char *directory, long max_bytes, const char *program_path) {
+    free(cache_directory);
+    cache_directory = malloc(strlen(directory) + 1);
+    if (!cache_directory) {
+        fprintf(stderr, "Error: Memory allocation failed for cache\n");
+        exit(1);
+    }
+    strcpy(cache_directory, directory);
+    cache_max_bytes = max_bytes > 0 ? max_bytes : CACHE_DEFAULT_MAX_BYTES;
+    build_id = compute_build_id(program_path);
+    memset(&stats, 0, sizeof(stats));
+
+#ifdef _WIN32
+    mkdir(directory);
+#else
+    mkdir(directory, 0777);
+#endif
+}
+
+// Stamp for an entry used now: wall-clock nanoseconds, kept increasing
+// within a run. File times are too coarse to order the entries one run
+// touches, so least-recently-used eviction goes by these instead.
+static uint64_t use_stamp(void) {
+    struct timespec now;
+    uint64_t stamp = 0;
+    if (timespec_get(&now, TIME_UTC) == TIME_UTC) {
+        stamp = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    }
+    if (stamp <= last_stamp) {
+        stamp = last_stamp + 1;
+    }
+    last_stamp = stamp;
+    return stamp;
+}
+
+// Path of the entry for a key (caller frees)
+static char *entry_path(uint64_t key) {
+    size_t size = strlen(cache_directory) + 32;
+    char *path = malloc(size);
+    if (!path) {
+        fprintf(stderr, "Error: Memory allocation failed for cache\n");
+        exit(1);
+    }
+    snprintf(path, size, "%s/%016llx%s", cache_directory, (unsigned long long)key, CACHE_SUFFIX);
+    return path;
+}
+
+// Load a matching entry. Returns 1 and fills result/diagnostics on a hit.
+static int cache_lookup(uint64_t key, size_t source_length, CheckResult *result, DiagBuffer *diagnostics) {
+    char *path = entry_path(key);
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        free(path);
+        return 0;
+    }
+
+    CacheEntryHeader header;
+    int hit = fread(&header, sizeof(header), 1, file) == 1 &&
+              memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == CACHE_FORMAT_VERSION &&
+              header.build_id == build_id &&
+              header.source_hash == key &&
+              header.source_length == source_length;
+    if (hit && header.diagnostics_size > 0) {
+        diagnostics->data = malloc(header.diagnostics_size);
+        hit = diagnostics->data &&
+              fread(diagnostics->data, 1, header.diagnostics_size, file) == header.diagnostics_size;
+        if (hit) {
+            diagnostics->length = header.diagnostics_size;
+            diagnostics->capacity = header.diagnostics_size;
+        } else {
+            diag_buffer_free(diagnostics);
+        }
+    }
+    fclose(file);
+
+    if (hit) {
+        *result = header.result;
+        // Mark as recently used
+        file = fopen(path, "r+b");
+        if (file) {
+            uint64_t stamp = use_stamp();
+            if (fseek(file, (long)offsetof(CacheEntryHeader, last_use), SEEK_SET) == 0) {
+                fwrite(&stamp, sizeof(stamp), 1, file);
+            }
+            fclose(file);
+        }
+    }
+    free(path);
+    return hit;
+}
+
+// Write an entry through a temporary file so readers never see half of one
+static void cache_store(uint64_t key, size_t source_length, const CheckResult *result, const DiagBuffer *diagnostics) {
+    char *path = entry_path(key);
+    size_t size = strlen(path) + 5;
+    char *temp = malloc(size);
+    if (!temp) {
+        fprintf(stderr, "Error: Memory allocation failed for cache\n");
+        exit(1);
+    }
+    snprintf(temp, size, "%s.tmp", path);
+
+    CacheEntryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_FORMAT_VERSION;
+    header.diagnostics_size = (uint32_t)diagnostics->length;
+    header.build_id = build_id;
+    header.source_hash = key;
+    header.source_length = source_length;
+    header.last_use = use_stamp();
+    header.result = *result;
+
+    FILE *file = fopen(temp, "wb");
+    if (file) {
+        int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 (diagnostics->length == 0 ||
+                  fwrite(diagnostics->data, 1, diagnostics->length, file) == diagnostics->length);
+        ok = fclose(file) == 0 && ok;
+        remove(path);
+        if (ok && rename(temp, path) == 0) {
+            stats.stores++;
+        } else {
+            remove(temp);
+        }
+    }
+
+    free(temp);
+    free(path);
+}
+
+// One cache entry seen while enforcing the size bound
+typedef struct {
+    char *path;
+    long size;
+    uint64_t used;           // Last-use stamp (0 if the header is unreadable)
+} CacheFile;
+
+static int compare_by_use(const void *a, const void *b) {
+    const CacheFile *x = a;
+    const CacheFile *y = b;
+    if (x->used != y->used) return x->used < y->used ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+// Last-use stamp of an entry; entries from other formats count as oldest
+static uint64_t entry_last_use(const char *path) {
+    CacheEntryHeader header;
+    FILE *file = fopen(path, "rb");
+    if (!file) return 0;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+             memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+             header.version == CACHE_FORMAT_VERSION;
+    fclose(file);
+    return ok ? header.last_use : 0;
+}
+
+// Delete least recently used entries until the cache fits its size bound
+static void cache_evict(void) {
+    DIR *dir = opendir(cache_directory);
+    if (!dir) return;
+
+    int count = 0;
+    int capacity = 64;
+    long long total = 0;
+    CacheFile *files = malloc(capacity * sizeof(CacheFile));
+    struct dirent *entry;
+
+    while (files && (entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+        if (length < strlen(CACHE_SUFFIX) ||
+            strcmp(entry->d_name + length - strlen(CACHE_SUFFIX), CACHE_SUFFIX) != 0) {
+            continue;
+        }
+
+        char *path = malloc(strlen(cache_directory) + length + 2);
+        if (!path) break;
+        sprintf(path, "%s/%s", cache_directory, entry->d_name);
+
+        struct stat info;
+        if (stat(path, &info) != 0) {
+            free(path);
+            continue;
+        }
+        if (count == capacity) {
+            capacity *= 2;
+            CacheFile *grown = realloc(files, capacity * sizeof(CacheFile));
+            if (!grown) {
+                free(path);
+                break;
+            }
+            files = grown;
+        }
+        files[count].path = path;
+        files[count].size = (long)info.st_size;
+        files[count].used = entry_last_use(path);
+        total += info.st_size;
+        count++;
+    }
+    closedir(dir);
+
+    if (files) {
+        qsort(files, count, sizeof(CacheFile), compare_by_use);
+        for (int i = 0; i < count; i++) {
+            if (total > cache_max_bytes && remove(files[i].path) == 0) {
+                total -= files[i].size;
+                stats.evictions++;
+            }
+            free(files[i].path);
+        }
+        free(files);
+    }
+}
+
+// Enforce the size bound and report the counters
+void cache_close(void) {
+    if (!cache_directory) return;
+
+    cache_evict();
+    printf("Cache: %d hit(s), %d miss(es), %d stored, %d evicted\n",
+           stats.hits, stats.misses, stats.stores, stats.evictions);
+
+    free(cache_directory);
+    cache_directory = NULL;
+}
+
+// Print the per-file status line (identical for fresh and cached results)
+static void print_check_result(const char *filename, const CheckResult *result) {
+    printf("%s: %d lexical error(s), %d parse error(s), %d semantic error(s) - %s\n",
+           filename, result->lexical_errors, result->parse_errors, result->semantic_errors,
+           result->lexical_errors == 0 && result->parse_errors == 0 && result->semantic_valid
+               ? "OK" : "FAILED");
+}
+
+// Run lexing, parsing and semantic analysis, capturing their diagnostics
+static void run_checks(const char *source, CheckResult *result, DiagBuffer *diagnostics) {
+    diag_capture_begin(diagnostics);
+
+    reset_lexer();
+    parser_init(source);
+    ASTNode *ast = parse();
+
+    const TokenBuffer *tokens = get_token_buffer();
+    result->lexical_errors = 0;
+    for (int i = 0; i < tokens->count; i++) {
+        ErrorType error = tokens->tokens[i].error;
+        if (error != ERROR_NONE && error != ERROR_RECOVERY_MODE) {
+            result->lexical_errors++;
+        }
+    }
+    result->parse_errors = get_parse_error_count();
+
+    set_semantic_verbose(0);
+    result->semantic_valid = analyze_semantics(ast);
+    result->semantic_errors = get_semantic_error_count();
+    set_semantic_verbose(1);
+
+    diag_capture_end();
+    free_ast(ast);
+}
+
+// Check a file, replaying the cached diagnostics when its source is unchanged
+void proc_check_file(const char *filename) {
+    char *buffer = read_source_file(filename);
+    if (!buffer) {
+        printf("Error: Could not open file %s\n", filename);
+        return;
+    }
+
+    size_t length = strlen(buffer);
+    CheckResult result;
+    DiagBuffer diagnostics = {NULL, 0, 0, NULL};
+
+    if (cache_directory) {
+        uint64_t key = hash_bytes(buffer, length, build_id);
+        if (cache_lookup(key, length, &result, &diagnostics)) {
+            stats.hits++;
+        } else {
+            stats.misses++;
+            run_checks(buffer, &result, &diagnostics);
+            cache_store(key, length, &result, &diagnostics);
+        }
+    } else {
+        run_checks(buffer, &result, &diagnostics);
+    }
+
+    diag_buffer_flush(&diagnostics);
+    print_check_result(filename, &result);
+
+    diag_buffer_free(&diagnostics);
+    free(buffer);
+}
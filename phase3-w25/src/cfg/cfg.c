@@ -0,0 +1,665 @@
+/* cfg.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/cfg.h"
+#include "../../include/parser.h"
+#include "../../include/lexer.h"
+#include "../../include/semantic.h"
+#include "../../include/diagnostics.h"
+#include "../../include/dump.h"
+#include "../../include/fold.h"
+
+// An edge recorded while building; turned into adjacency lists at the end
+typedef struct {
+    int from;
+    int to;
+} Edge;
+
+// Builder state
+typedef struct {
+    CFG* cfg;
+    int block_capacity;
+    int statement_capacity;
+    Edge* edges;
+    int edge_capacity;
+    int current;               // Block receiving statements (-1 right after a return)
+} Builder;
+
+static void* grow(void* data, int* capacity, int needed, size_t size) {
+    if (needed <= *capacity) {
+        return data;
+    }
+    int new_capacity = *capacity ? *capacity * 2 : 16;
+    while (new_capacity < needed) new_capacity *= 2;
+    data = realloc(data, new_capacity * size);
+    if (!data) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return data;
+}
+
+static int new_block(Builder* builder) {
+    CFG* cfg = builder->cfg;
+    cfg->blocks = grow(cfg->blocks, &builder->block_capacity, cfg->block_count + 1, sizeof(BasicBlock));
+
+    BasicBlock* block = &cfg->blocks[cfg->block_count];
+    memset(block, 0, sizeof(*block));
+    block->first = cfg->statement_count;
+    block->end = CFG_JUMP;
+    block->idom = -1;
+    block->rpo = -1;
+    return cfg->block_count++;
+}
+
+static void add_edge(Builder* builder, int from, int to) {
+    CFG* cfg = builder->cfg;
+    builder->edges = grow(builder->edges, &builder->edge_capacity, cfg->edge_count + 1, sizeof(Edge));
+    builder->edges[cfg->edge_count].from = from;
+    builder->edges[cfg->edge_count].to = to;
+    cfg->edge_count++;
+}
+
+// Block that receives the next statement; code after a return starts a
+// fresh block with no predecessors
+static int current_block(Builder* builder) {
+    if (builder->current < 0) {
+        builder->current = new_block(builder);
+    }
+    return builder->current;
+}
+
+static void append_statement(Builder* builder, ASTNode* node) {
+    CFG* cfg = builder->cfg;
+    BasicBlock* block = &cfg->blocks[current_block(builder)];
+    if (block->count == 0) {
+        block->first = cfg->statement_count;
+    }
+    cfg->statements = grow(cfg->statements, &builder->statement_capacity,
+                           cfg->statement_count + 1, sizeof(ASTNode*));
+    cfg->statements[cfg->statement_count++] = node;
+    block->count++;
+}
+
+// End the current block with a branch on 'condition'
+static void end_with_branch(Builder* builder, int block, ASTNode* condition, int line,
+                            int if_true, int if_false) {
+    builder->cfg->blocks[block].end = CFG_BRANCH;
+    builder->cfg->blocks[block].value = condition;
+    builder->cfg->blocks[block].line = line;
+    add_edge(builder, block, if_true);
+    add_edge(builder, block, if_false);
+    builder->current = -1;
+}
+
+// Fall through from the current block (if any) to 'target'
+static void jump_to(Builder* builder, int target) {
+    if (builder->current >= 0) {
+        builder->cfg->blocks[builder->current].end = CFG_JUMP;
+        add_edge(builder, builder->current, target);
+    }
+    builder->current = -1;
+}
+
+static void end_with_return(Builder* builder, ASTNode* value, int line) {
+    int block = current_block(builder);
+    builder->cfg->blocks[block].end = CFG_RETURN;
+    builder->cfg->blocks[block].value = value;
+    builder->cfg->blocks[block].line = line;
+    add_edge(builder, block, builder->cfg->exit);
+    builder->current = -1;
+}
+
+static void lower_statement(Builder* builder, ASTNode* node);
+
+// Lower a block or program chain, or a single statement
+static void lower_body(Builder* builder, ASTNode* node) {
+    if (node && (node->type == AST_BLOCK || node->type == AST_PROGRAM)) {
+        ASTNodeType chain = node->type;
+        for (; node && node->type == chain; node = node->right) {
+            lower_statement(builder, node->left);
+        }
+    } else {
+        lower_statement(builder, node);
+    }
+}
+
+static void lower_statement(Builder* builder, ASTNode* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->type) {
+        case AST_BLOCK:
+            lower_body(builder, node);
+            break;
+
+        case AST_IF: {
+            ASTNode* then_body = node->right;
+            ASTNode* else_body = NULL;
+            if (node->right && node->right->type == AST_ELSE) {
+                then_body = node->right->left;
+                else_body = node->right->right;
+            }
+
+            int from = current_block(builder);
+            int then_block = new_block(builder);
+            int else_block = else_body ? new_block(builder) : -1;
+            int join = new_block(builder);
+            end_with_branch(builder, from, node->left, node->token.line,
+                            then_block, else_body ? else_block : join);
+
+            builder->current = then_block;
+            lower_body(builder, then_body);
+            jump_to(builder, join);
+            if (else_body) {
+                builder->current = else_block;
+                lower_body(builder, else_body);
+                jump_to(builder, join);
+            }
+            builder->current = join;
+            break;
+        }
+
+        case AST_WHILE: {
+            int header = new_block(builder);
+            jump_to(builder, header);
+            int body = new_block(builder);
+            int after = new_block(builder);
+            end_with_branch(builder, header, node->left, node->token.line, body, after);
+
+            builder->current = body;
+            lower_body(builder, node->right);
+            jump_to(builder, header);
+            builder->current = after;
+            break;
+        }
+
+        case AST_FOR: { // repeat-until: the body runs again while the condition is false
+            int body = new_block(builder);
+            jump_to(builder, body);
+            int after = new_block(builder);
+
+            builder->current = body;
+            lower_body(builder, node->left);
+            int tail = current_block(builder);
+            int line = node->right ? node->right->token.line : node->token.line;
+            end_with_branch(builder, tail, node->right, line, after, body);
+            builder->current = after;
+            break;
+        }
+
+        case AST_RETURN:
+            end_with_return(builder, node->left, node->token.line);
+            break;
+
+        case AST_PROGRAM:        // Placeholder the parser leaves after an error
+        case AST_FUNCTION_DECL:  // Functions get CFGs of their own
+            break;
+
+        default:
+            append_statement(builder, node);
+            break;
+    }
+}
+
+// Turn the recorded edges into per-block successor and predecessor lists
+static void build_adjacency(Builder* builder) {
+    CFG* cfg = builder->cfg;
+    int edges = cfg->edge_count;
+
+    cfg->edges = malloc((2 * edges + 1) * sizeof(int));
+    if (!cfg->edges) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    for (int i = 0; i < edges; i++) {
+        cfg->blocks[builder->edges[i].from].succ_count++;
+        cfg->blocks[builder->edges[i].to].pred_count++;
+    }
+    int succ = 0;
+    int pred = edges;
+    for (int b = 0; b < cfg->block_count; b++) {
+        cfg->blocks[b].succ = succ;
+        cfg->blocks[b].pred = pred;
+        succ += cfg->blocks[b].succ_count;
+        pred += cfg->blocks[b].pred_count;
+        cfg->blocks[b].succ_count = 0;
+        cfg->blocks[b].pred_count = 0;
+    }
+    // Edges were recorded in order, so a branch keeps its true successor first
+    for (int i = 0; i < edges; i++) {
+        BasicBlock* from = &cfg->blocks[builder->edges[i].from];
+        BasicBlock* to = &cfg->blocks[builder->edges[i].to];
+        cfg->edges[from->succ + from->succ_count++] = builder->edges[i].to;
+        cfg->edges[to->pred + to->pred_count++] = builder->edges[i].from;
+    }
+}
+
+// Number the blocks reachable from the entry in reverse postorder
+static void number_blocks(CFG* cfg) {
+    int* stack = malloc(cfg->block_count * sizeof(int));
+    int* next = calloc(cfg->block_count, sizeof(int));
+    char* seen = calloc(cfg->block_count, 1);
+    cfg->order = malloc(cfg->block_count * sizeof(int));
+    if (!stack || !next || !seen || !cfg->order) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+
+    int depth = 0;
+    int post = cfg->block_count;
+    stack[depth++] = cfg->entry;
+    seen[cfg->entry] = 1;
+    while (depth > 0) {
+        int b = stack[depth - 1];
+        if (next[b] < cfg->blocks[b].succ_count) {
+            int s = CFG_SUCC(cfg, b, next[b]++);
+            if (!seen[s]) {
+                seen[s] = 1;
+                stack[depth++] = s;
+            }
+        } else {
+            cfg->order[--post] = b;
+            depth--;
+        }
+    }
+
+    // Reachable blocks filled order[post..]; move them to the front
+    cfg->reachable = cfg->block_count - post;
+    memmove(cfg->order, cfg->order + post, cfg->reachable * sizeof(int));
+    for (int i = 0; i < cfg->reachable; i++) {
+        cfg->blocks[cfg->order[i]].rpo = i;
+    }
+
+    free(stack);
+    free(next);
+    free(seen);
+}
+
+// Walk two dominator chains up to their common ancestor
+static int intersect(const CFG* cfg, int a, int b) {
+    while (a != b) {
+        while (cfg->blocks[a].rpo > cfg->blocks[b].rpo) a = cfg->blocks[a].idom;
+        while (cfg->blocks[b].rpo > cfg->blocks[a].rpo) b = cfg->blocks[b].idom;
+    }
+    return a;
+}
+
+// Immediate dominators with the iterative algorithm of Cooper, Harvey and
+// Kennedy; converges in a couple of passes over reverse postorder
+static void compute_dominators(CFG* cfg) {
+    cfg->blocks[cfg->entry].idom = cfg->entry;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < cfg->reachable; i++) {
+            int b = cfg->order[i];
+            int idom = -1;
+            for (int p = 0; p < cfg->blocks[b].pred_count; p++) {
+                int pred = CFG_PRED(cfg, b, p);
+                if (cfg->blocks[pred].idom < 0) {
+                    continue; // Unreachable, or not processed yet
+                }
+                idom = idom < 0 ? pred : intersect(cfg, pred, idom);
+            }
+            if (cfg->blocks[b].idom != idom) {
+                cfg->blocks[b].idom = idom;
+                changed = 1;
+            }
+        }
+    }
+    cfg->blocks[cfg->entry].idom = -1;
+
+    // Child lists, in reverse postorder
+    cfg->dom_tree = malloc((cfg->reachable + 1) * sizeof(int));
+    if (!cfg->dom_tree) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    for (int i = 1; i < cfg->reachable; i++) {
+        cfg->blocks[cfg->blocks[cfg->order[i]].idom].dom_child_count++;
+    }
+    int start = 0;
+    for (int i = 0; i < cfg->reachable; i++) {
+        BasicBlock* block = &cfg->blocks[cfg->order[i]];
+        block->dom_children = start;
+        start += block->dom_child_count;
+        block->dom_child_count = 0;
+    }
+    for (int i = 1; i < cfg->reachable; i++) {
+        BasicBlock* parent = &cfg->blocks[cfg->blocks[cfg->order[i]].idom];
+        cfg->dom_tree[parent->dom_children + parent->dom_child_count++] = cfg->order[i];
+    }
+
+    // Pre/postorder numbers answer dominance queries in constant time
+    int* stack = malloc((cfg->reachable + 1) * sizeof(int));
+    int* next = calloc(cfg->block_count, sizeof(int));
+    if (!stack || !next) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    int depth = 0;
+    int pre = 0;
+    int post = 0;
+    stack[depth++] = cfg->entry;
+    cfg->blocks[cfg->entry].dom_pre = pre++;
+    while (depth > 0) {
+        BasicBlock* block = &cfg->blocks[stack[depth - 1]];
+        if (next[stack[depth - 1]] < block->dom_child_count) {
+            int child = cfg->dom_tree[block->dom_children + next[stack[depth - 1]]++];
+            cfg->blocks[child].dom_pre = pre++;
+            stack[depth++] = child;
+        } else {
+            block->dom_post = post++;
+            depth--;
+        }
+    }
+    free(stack);
+    free(next);
+}
+
+// Loop depth: every back edge (to a block that dominates its source) closes
+// a natural loop; each block counts the loops it belongs to
+static void compute_loop_depths(CFG* cfg) {
+    int* work = malloc((cfg->block_count + 1) * sizeof(int));
+    int* mark = malloc(cfg->block_count * sizeof(int));
+    if (!work || !mark) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    for (int b = 0; b < cfg->block_count; b++) mark[b] = -1;
+
+    for (int i = 0; i < cfg->reachable; i++) {
+        int header = cfg->order[i];
+        int count = 0;
+        for (int p = 0; p < cfg->blocks[header].pred_count; p++) {
+            int pred = CFG_PRED(cfg, header, p);
+            if (cfg_dominates(cfg, header, pred) && mark[pred] != header) {
+                mark[pred] = header;
+                work[count++] = pred;
+            }
+        }
+        if (count == 0) {
+            continue;
+        }
+
+        // Everything that reaches a latch without passing the header
+        mark[header] = header;
+        cfg->blocks[header].loop_depth++;
+        while (count > 0) {
+            int b = work[--count];
+            if (b == header) {
+                continue;
+            }
+            cfg->blocks[b].loop_depth++;
+            for (int p = 0; p < cfg->blocks[b].pred_count; p++) {
+                int pred = CFG_PRED(cfg, b, p);
+                if (cfg->blocks[pred].rpo >= 0 && mark[pred] != header) {
+                    mark[pred] = header;
+                    work[count++] = pred;
+                }
+            }
+        }
+    }
+
+    free(work);
+    free(mark);
+}
+
+// Build the CFG of a checked function declaration, or of the top-level
+// statements when given the program root
+CFG* build_cfg(ASTNode* function) {
+    CFG* cfg = calloc(1, sizeof(CFG));
+    if (!cfg) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    Builder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.cfg = cfg;
+    cfg->function = function;
+
+    cfg->entry = new_block(&builder);
+    cfg->exit = new_block(&builder);
+    cfg->blocks[cfg->exit].end = CFG_EXIT;
+    builder.current = cfg->entry;
+
+    // The program root stands for its top-level statements
+    lower_body(&builder, function && function->type != AST_PROGRAM ? function->right : function);
+    if (builder.current >= 0) {
+        // Falling off the end returns
+        end_with_return(&builder, NULL, function ? function->token.line : 0);
+    }
+
+    build_adjacency(&builder);
+    free(builder.edges);
+    number_blocks(cfg);
+    compute_dominators(cfg);
+    compute_loop_depths(cfg);
+    return cfg;
+}
+
+// Dominators and loop depths of a graph given as an edge list, entry block 0
+CFG* build_cfg_from_edges(int block_count, const int* from, const int* to, int edge_count) {
+    CFG* cfg = calloc(1, sizeof(CFG));
+    if (!cfg) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    Builder builder;
+    memset(&builder, 0, sizeof(builder));
+    builder.cfg = cfg;
+    cfg->exit = -1;
+
+    for (int b = 0; b < block_count || b == 0; b++) {
+        new_block(&builder);
+    }
+    for (int i = 0; i < edge_count; i++) {
+        add_edge(&builder, from[i], to[i]);
+    }
+
+    build_adjacency(&builder);
+    free(builder.edges);
+    number_blocks(cfg);
+    compute_dominators(cfg);
+    compute_loop_depths(cfg);
+    return cfg;
+}
+
+// Dominance frontiers (Cooper, Harvey and Kennedy): walk up from each
+// predecessor of a join point until reaching the join's immediate dominator
+void cfg_dominance_frontiers(CFG* cfg) {
+    if (cfg->frontiers) {
+        return;
+    }
+
+    Edge* pairs = NULL;
+    int pair_count = 0;
+    int pair_capacity = 0;
+    int* last = malloc(cfg->block_count * sizeof(int));
+    if (!last) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    for (int b = 0; b < cfg->block_count; b++) last[b] = -1;
+
+    for (int i = 0; i < cfg->reachable; i++) {
+        int b = cfg->order[i];
+        if (cfg->blocks[b].pred_count < 2) {
+            continue;
+        }
+        for (int p = 0; p < cfg->blocks[b].pred_count; p++) {
+            int runner = CFG_PRED(cfg, b, p);
+            if (cfg->blocks[runner].rpo < 0) {
+                continue;
+            }
+            while (runner >= 0 && runner != cfg->blocks[b].idom && last[runner] != b) {
+                last[runner] = b;
+                pairs = grow(pairs, &pair_capacity, pair_count + 1, sizeof(Edge));
+                pairs[pair_count].from = runner;
+                pairs[pair_count].to = b;
+                pair_count++;
+                runner = cfg->blocks[runner].idom;
+            }
+        }
+    }
+
+    cfg->frontiers = malloc((pair_count + 1) * sizeof(int));
+    if (!cfg->frontiers) {
+        fprintf(stderr, "Error: Memory allocation failed for control-flow graph\n");
+        exit(1);
+    }
+    for (int i = 0; i < pair_count; i++) {
+        cfg->blocks[pairs[i].from].frontier_count++;
+    }
+    int start = 0;
+    for (int b = 0; b < cfg->block_count; b++) {
+        cfg->blocks[b].frontier = start;
+        start += cfg->blocks[b].frontier_count;
+        cfg->blocks[b].frontier_count = 0;
+    }
+    for (int i = 0; i < pair_count; i++) {
+        BasicBlock* block = &cfg->blocks[pairs[i].from];
+        cfg->frontiers[block->frontier + block->frontier_count++] = pairs[i].to;
+    }
+
+    free(pairs);
+    free(last);
+}
+
+void free_cfg(CFG* cfg) {
+    if (!cfg) {
+        return;
+    }
+    free(cfg->blocks);
+    free(cfg->statements);
+    free(cfg->edges);
+    free(cfg->order);
+    free(cfg->dom_tree);
+    free(cfg->frontiers);
+    free(cfg);
+}
+
+// Does block a dominate block b?
+int cfg_dominates(const CFG* cfg, int a, int b) {
+    const BasicBlock* x = &cfg->blocks[a];
+    const BasicBlock* y = &cfg->blocks[b];
+    if (x->rpo < 0 || y->rpo < 0) {
+        return 0;
+    }
+    return x->dom_pre <= y->dom_pre && y->dom_post <= x->dom_post;
+}
+
+// "Kind lexeme" for a statement or expression
+static void print_node(const ASTNode* node) {
+    printf("%s", ast_kind_name(node->type));
+    if (node->token.lexeme[0]) {
+        printf(" %s", node->token.lexeme);
+    }
+}
+
+static void print_block_list(const CFG* cfg, int start, int count) {
+    if (count == 0) {
+        printf("-");
+    }
+    for (int i = 0; i < count; i++) {
+        printf("%sB%d", i ? ", " : "", cfg->edges[start + i]);
+    }
+}
+
+// Print blocks, edges, dominators and loop depths
+void print_cfg(const CFG* cfg) {
+    const char* name = cfg->function ? cfg->function->token.lexeme : "?";
+    printf("CFG of %s: %d block(s), %d edge(s), %d reachable\n",
+           name, cfg->block_count, cfg->edge_count, cfg->reachable);
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        const BasicBlock* block = &cfg->blocks[b];
+        printf("  B%d%s%s  preds: ", b,
+               b == cfg->entry ? " (entry)" : b == cfg->exit ? " (exit)" : "",
+               block->rpo < 0 ? " (unreachable)" : "");
+        print_block_list(cfg, block->pred, block->pred_count);
+        if (block->idom >= 0) {
+            printf("  idom: B%d", block->idom);
+        } else {
+            printf("  idom: -");
+        }
+        printf("  loop depth: %d\n", block->loop_depth);
+
+        for (int i = 0; i < block->count; i++) {
+            const ASTNode* node = cfg->statements[block->first + i];
+            printf("      line %d: ", node->token.line);
+            print_node(node);
+            printf("\n");
+        }
+
+        switch (block->end) {
+            case CFG_JUMP:
+                printf("      goto B%d\n", CFG_SUCC(cfg, b, 0));
+                break;
+            case CFG_BRANCH:
+                printf("      line %d: if ", block->line);
+                if (block->value) print_node(block->value);
+                printf(" then B%d else B%d\n", CFG_SUCC(cfg, b, 0), CFG_SUCC(cfg, b, 1));
+                break;
+            case CFG_RETURN:
+                printf("      line %d: return", block->line);
+                if (block->value) {
+                    printf(" ");
+                    print_node(block->value);
+                }
+                printf("\n");
+                break;
+            case CFG_EXIT:
+                break;
+        }
+    }
+}
+
+// Parse and check a file, then print the CFG of each top-level function
+void proc_cfg_file(const char* filename) {
+    char* buffer = read_source_file(filename);
+    if (!buffer) {
+        fprintf(stderr, "Error: Could not open file %s\n", filename);
+        return;
+    }
+
+    DiagBuffer diagnostics = {NULL, 0, 0, NULL};
+    reset_lexer();
+    diag_capture_begin(&diagnostics);
+    parser_init(buffer);
+    ASTNode* ast = parse();
+    set_semantic_verbose(0);
+    analyze_semantics(ast);
+    set_semantic_verbose(1);
+    diag_capture_end();
+
+    // The graph lowering sees: folded, as compile_file_to_ir folds
+    FoldStats folding;
+    fold_constants(ast, &folding);
+
+    int functions = 0;
+    for (ASTNode* item = ast; item && item->type == AST_PROGRAM; item = item->right) {
+        if (item->left && item->left->type == AST_FUNCTION_DECL) {
+            CFG* cfg = build_cfg(item->left);
+            printf("%s", functions++ ? "\n" : "");
+            print_cfg(cfg);
+            free_cfg(cfg);
+        }
+    }
+    if (functions == 0) {
+        printf("No functions in %s\n", filename);
+    }
+
+    fflush(stdout);
+    if (diagnostics.length > 0) {
+        fwrite(diagnostics.data, 1, diagnostics.length, stderr);
+    }
+    diag_buffer_free(&diagnostics);
+    free_ast(ast);
+    free(buffer);
+}
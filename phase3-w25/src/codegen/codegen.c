@@ -0,0 +1,831 @@
+/* codegen.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include "../../include/codegen.h"
+#include "../../include/ir.h"
+#include "../../include/pass.h"
+#include "../../include/regalloc.h"
+#include "../../include/bytecode.h"
+#include "../../include/vm.h"
+#include "../../include/jit.h"
+
+// Integer argument registers, in order
+static const char* arg_registers[6] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+static const char* arg_registers32[6] = {"%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d"};
+
+// A pending move on a control-flow edge, between locations
+typedef struct {
+    int dest;
+    int source;
+} EdgeMove;
+
+// Per-program translation state (the per-function part is reset for each)
+typedef struct {
+    FILE* out;
+    IRProgram* program;
+    CodegenOptions options;
+    const IRFunction* function;
+    int index;                 // Number of the function being translated
+    int* locations;            // Where each value lives, by value number: a frame offset
+                               // below %rbp, a register as -(r + 1), or 0 if none
+    RegAllocation allocation;
+    int saves[RA_CALLEE_SAVED]; // Slots preserving the callee-saved registers used (0 if unused)
+    int scratch;               // Slot that breaks cycles among phi moves
+    int frame_size;
+    int labels;                // Local labels handed out
+    EdgeMove* moves;
+    int move_capacity;
+    const char** strings;      // String literals, emitted as .LS<n>
+    int string_count;
+    int string_capacity;
+    int failed;
+} Codegen;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for code generation\n");
+    exit(1);
+}
+
+// One instruction line
+static void ins(Codegen* cg, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    fputc('\t', cg->out);
+    vfprintf(cg->out, format, args);
+    fputc('\n', cg->out);
+    va_end(args);
+}
+
+static int is_register(int location) {
+    return location < 0;
+}
+
+// Operand for a location: a register at 'bits' bits, or a stack slot. Up to
+// four stay valid at once.
+static const char* location_operand(int location, int bits) {
+    static char buffers[4][32];
+    static int next;
+    if (is_register(location)) {
+        return ra_register_name(-location - 1, bits);
+    }
+    char* buffer = buffers[next];
+    next = (next + 1) % 4;
+    snprintf(buffer, sizeof(buffers[0]), "-%d(%%rbp)", location);
+    return buffer;
+}
+
+static int location(Codegen* cg, const IRInstr* value) {
+    int where = cg->locations[ir_resolve((IRInstr*)value)->id];
+    if (!where) {
+        cg->failed = 1;
+    }
+    return where;
+}
+
+// A value as a 64-bit operand, and as a 32-bit one (for ints)
+static const char* operand(Codegen* cg, const IRInstr* value) {
+    return location_operand(location(cg, value), 64);
+}
+
+static const char* word(Codegen* cg, const IRInstr* value) {
+    return location_operand(location(cg, value), 32);
+}
+
+// Operand for global 'index', or for the call depth counter. Data the
+// loader supplies is reached through its GOT slot, loaded into %rcx first.
+static const char* global_operand(Codegen* cg, int index) {
+    static char buffer[48];
+    if (cg->options.external_data) {
+        ins(cg, "movq\tbc_globals@GOTPCREL(%%rip), %%rcx");
+        snprintf(buffer, sizeof(buffer), "%d(%%rcx)", 8 * index);
+    } else {
+        snprintf(buffer, sizeof(buffer), "bc_globals+%d(%%rip)", 8 * index);
+    }
+    return buffer;
+}
+
+static const char* depth_operand(Codegen* cg) {
+    if (cg->options.external_data) {
+        ins(cg, "movq\tbc_depth@GOTPCREL(%%rip), %%rcx");
+        return "(%rcx)";
+    }
+    return "bc_depth(%rip)";
+}
+
+static int new_label(Codegen* cg) {
+    return cg->labels++;
+}
+
+static int string_label(Codegen* cg, const char* s) {
+    for (int i = 0; i < cg->string_count; i++) {
+        if (strcmp(cg->strings[i], s) == 0) return i;
+    }
+    if (cg->string_count == cg->string_capacity) {
+        cg->string_capacity = cg->string_capacity ? cg->string_capacity * 2 : 16;
+        cg->strings = realloc(cg->strings, cg->string_capacity * sizeof(const char*));
+        if (!cg->strings) out_of_memory();
+    }
+    cg->strings[cg->string_count] = s;
+    return cg->string_count++;
+}
+
+// Values the allocator put in registers stay there; every other value gets a
+// slot: parameters first (copied in by the prologue), then the rest, then the
+// scratch slot and the saves of callee-saved registers
+static void assign_locations(Codegen* cg) {
+    const IRFunction* ir = cg->function;
+    int next = ir->param_count;
+    memset(cg->locations, 0, (ir->value_count + 1) * sizeof(int));
+    for (int b = 0; b < ir->block_count; b++) {
+        const IRBlock* block = &ir->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        for (int i = 0; i < block->count; i++) {
+            const IRInstr* instr = block->code[i];
+            if (instr->type != IR_VOID && cg->allocation.registers[instr->id] >= 0) {
+                cg->locations[instr->id] = -(cg->allocation.registers[instr->id] + 1);
+            } else if (instr->op == IR_PARAM) {
+                cg->locations[instr->id] = 8 * (instr->index + 1);
+            } else if (instr->type != IR_VOID) {
+                cg->locations[instr->id] = 8 * (++next);
+            }
+        }
+    }
+    cg->scratch = 8 * (++next);
+    for (int r = 0; r < RA_CALLEE_SAVED; r++) {
+        cg->saves[r] = cg->allocation.used & (1 << r) ? 8 * (++next) : 0;
+    }
+    cg->frame_size = (8 * next + 15) & ~15;
+}
+
+static void emit_prologue(Codegen* cg) {
+    const IRFunction* ir = cg->function;
+    fprintf(cg->out, "\n# %s: %d values in registers, %d spilled\n", ir->name,
+            cg->allocation.candidates - cg->allocation.spilled, cg->allocation.spilled);
+    fprintf(cg->out, "\t.type\tbc_f%d, @function\n", cg->index);
+    fprintf(cg->out, "bc_f%d:\n", cg->index);
+    ins(cg, "pushq\t%%rbp");
+    ins(cg, "movq\t%%rsp, %%rbp");
+    ins(cg, "subq\t$%d, %%rsp", cg->frame_size);
+    for (int r = 0; r < RA_CALLEE_SAVED; r++) {
+        if (cg->saves[r]) ins(cg, "movq\t%s, %s", ra_register_name(r, 64), location_operand(cg->saves[r], 64));
+    }
+
+    // Parameters go where their values live (unused ones to their slots)
+    int* where = malloc((ir->param_count + 1) * sizeof(int));
+    if (!where) out_of_memory();
+    for (int p = 0; p < ir->param_count; p++) where[p] = 8 * (p + 1);
+    for (int i = 0; ir->block_count > 0 && i < ir->blocks[0].count; i++) {
+        const IRInstr* instr = ir->blocks[0].code[i];
+        if (instr->op == IR_PARAM && instr->index < ir->param_count) where[instr->index] = cg->locations[instr->id];
+    }
+    for (int p = 0; p < ir->param_count; p++) {
+        if (p < 6) {
+            ins(cg, "movq\t%s, %s", arg_registers[p], location_operand(where[p], 64));
+        } else if (is_register(where[p])) {
+            ins(cg, "movq\t%d(%%rbp), %s", 16 + 8 * (p - 6), location_operand(where[p], 64));
+        } else {
+            ins(cg, "movq\t%d(%%rbp), %%rax", 16 + 8 * (p - 6));
+            ins(cg, "movq\t%%rax, %s", location_operand(where[p], 64));
+        }
+    }
+    free(where);
+}
+
+static void emit_return(Codegen* cg) {
+    for (int r = 0; r < RA_CALLEE_SAVED; r++) {
+        if (cg->saves[r]) ins(cg, "movq\t%s, %s", location_operand(cg->saves[r], 64), ra_register_name(r, 64));
+    }
+    ins(cg, "leave");
+    ins(cg, "ret");
+}
+
+static void emit_move(Codegen* cg, int dest, int source) {
+    if (is_register(dest) || is_register(source)) {
+        ins(cg, "movq\t%s, %s", location_operand(source, 64), location_operand(dest, 64));
+        return;
+    }
+    ins(cg, "movq\t%s, %%rax", location_operand(source, 64));
+    ins(cg, "movq\t%%rax, %s", location_operand(dest, 64));
+}
+
+// Moves feeding the phis of 'to' along the edge from 'from', ordered so no
+// source is overwritten before it is read
+static void emit_edge_moves(Codegen* cg, int from, int to) {
+    const IRBlock* target = &cg->function->blocks[to];
+    int pred = 0;
+    while (pred < target->pred_count && target->preds[pred] != from) pred++;
+    if (pred == target->pred_count) {
+        return;
+    }
+
+    int count = 0;
+    for (int i = 0; i < target->count && target->code[i]->op == IR_PHI; i++) {
+        if (count == cg->move_capacity) {
+            cg->move_capacity = cg->move_capacity ? cg->move_capacity * 2 : 16;
+            cg->moves = realloc(cg->moves, cg->move_capacity * sizeof(EdgeMove));
+            if (!cg->moves) out_of_memory();
+        }
+        const IRInstr* phi = target->code[i];
+        EdgeMove move = {cg->locations[phi->id], cg->locations[ir_resolve(phi->args[pred])->id]};
+        if (!move.dest || !move.source) {
+            cg->failed = 1;
+        } else if (move.dest != move.source) {
+            cg->moves[count++] = move;
+        }
+    }
+
+    EdgeMove* moves = cg->moves;
+    while (count > 0) {
+        int ready = -1;
+        for (int m = 0; m < count && ready < 0; m++) {
+            int read = 0;
+            for (int n = 0; n < count; n++) {
+                if (n != m && moves[n].source == moves[m].dest) {
+                    read = 1;
+                    break;
+                }
+            }
+            if (!read) ready = m;
+        }
+        if (ready < 0) {
+            // Only cycles are left: park one destination's value in scratch
+            int dest = moves[0].dest;
+            emit_move(cg, cg->scratch, dest);
+            for (int n = 0; n < count; n++) {
+                if (moves[n].source == dest) moves[n].source = cg->scratch;
+            }
+            ready = 0;
+        }
+        emit_move(cg, moves[ready].dest, moves[ready].source);
+        moves[ready] = moves[--count];
+    }
+}
+
+static int has_edge_moves(Codegen* cg, int from, int to) {
+    const IRBlock* target = &cg->function->blocks[to];
+    int pred = 0;
+    while (pred < target->pred_count && target->preds[pred] != from) pred++;
+    if (pred == target->pred_count) {
+        return 0;
+    }
+    for (int i = 0; i < target->count && target->code[i]->op == IR_PHI; i++) {
+        if (cg->locations[target->code[i]->id] != cg->locations[ir_resolve(target->code[i]->args[pred])->id]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void emit_jump(Codegen* cg, const char* op, int block) {
+    ins(cg, "%s\t.Lf%d_b%d", op, cg->index, block);
+}
+
+// Go from block 'from' to 'to' after the edge's moves, falling through
+// when 'to' is laid out next
+static void emit_edge(Codegen* cg, int from, int to, int next) {
+    emit_edge_moves(cg, from, to);
+    if (to != next) {
+        emit_jump(cg, "jmp", to);
+    }
+}
+
+// Call function 'callee' with the int arguments given; parameters the call
+// leaves out are 0. The result is in %eax.
+static void emit_call(Codegen* cg, int callee, IRInstr** args, int arg_count) {
+    int params = cg->program->functions[callee]->param_count;
+    int count = arg_count > params ? arg_count : params;
+    int on_stack = count > 6 ? count - 6 : 0;
+    int padding = on_stack % 2 ? 8 : 0;
+    if (padding) {
+        ins(cg, "subq\t$8, %%rsp");
+    }
+    for (int a = count - 1; a >= 6; a--) {
+        if (a < arg_count) {
+            ins(cg, "pushq\t%s", operand(cg, ir_resolve(args[a])));
+        } else {
+            ins(cg, "pushq\t$0");
+        }
+    }
+    for (int a = 0; a < count && a < 6; a++) {
+        if (a < arg_count) {
+            ins(cg, "movq\t%s, %s", operand(cg, ir_resolve(args[a])), arg_registers[a]);
+        } else {
+            ins(cg, "xorl\t%s, %s", arg_registers32[a], arg_registers32[a]);
+        }
+    }
+    ins(cg, "call\tbc_f%d", callee);
+    if (on_stack) {
+        ins(cg, "addq\t$%d, %%rsp", 8 * on_stack + padding);
+    }
+}
+
+// Report a runtime error at 'line' and exit (the call does not return)
+static void emit_runtime_error(Codegen* cg, int line, const char* message) {
+    ins(cg, "leaq\t.LS%d(%%rip), %%rdx", string_label(cg, message));
+    ins(cg, "leaq\t.LS%d(%%rip), %%rsi", string_label(cg, cg->function->name));
+    ins(cg, "movl\t$%d, %%edi", line);
+    ins(cg, "call\tbc_runtime_error@PLT");
+}
+
+// Condition codes for a comparison of ints (signed)
+static const char* int_conditions[] = {"e", "ne", "l", "le", "g", "ge"};
+
+static void emit_compare(Codegen* cg, const IRInstr* instr) {
+    int is_float = ir_resolve(instr->args[0])->type == IR_FLOAT;
+    const char* a = is_float ? operand(cg, instr->args[0]) : word(cg, instr->args[0]);
+    const char* b = is_float ? operand(cg, instr->args[1]) : word(cg, instr->args[1]);
+    if (!is_float) {
+        ins(cg, "movl\t%s, %%eax", a);
+        ins(cg, "cmpl\t%s, %%eax", b);
+        ins(cg, "set%s\t%%al", int_conditions[instr->op - IR_EQ]);
+    } else {
+        // Unordered (NaN) operands compare false except for !=
+        ins(cg, "movsd\t%s, %%xmm0", a);
+        ins(cg, "movsd\t%s, %%xmm1", b);
+        switch (instr->op) {
+            case IR_EQ:
+                ins(cg, "ucomisd\t%%xmm1, %%xmm0");
+                ins(cg, "sete\t%%al");
+                ins(cg, "setnp\t%%cl");
+                ins(cg, "andb\t%%cl, %%al");
+                break;
+            case IR_NE:
+                ins(cg, "ucomisd\t%%xmm1, %%xmm0");
+                ins(cg, "setne\t%%al");
+                ins(cg, "setp\t%%cl");
+                ins(cg, "orb\t%%cl, %%al");
+                break;
+            case IR_LT: case IR_LE:
+                ins(cg, "ucomisd\t%%xmm0, %%xmm1");
+                ins(cg, "%s\t%%al", instr->op == IR_LT ? "seta" : "setae");
+                break;
+            default:
+                ins(cg, "ucomisd\t%%xmm1, %%xmm0");
+                ins(cg, "%s\t%%al", instr->op == IR_GT ? "seta" : "setae");
+                break;
+        }
+    }
+    if (is_register(location(cg, instr))) {
+        ins(cg, "movzbl\t%%al, %s", word(cg, instr));
+    } else {
+        ins(cg, "movzbl\t%%al, %%eax");
+        ins(cg, "movl\t%%eax, %s", word(cg, instr));
+    }
+}
+
+// Ints wrap like 32-bit values; division by zero is a runtime error and
+// INT_MIN / -1 is INT_MIN (idiv would fault). A result in a register is
+// computed there unless the right operand lives in the same register.
+static void emit_int_arith(Codegen* cg, const IRInstr* instr) {
+    const char* a = word(cg, instr->args[0]);
+    const char* b = word(cg, instr->args[1]);
+    if (instr->op != IR_DIV) {
+        static const char* ops[] = {"addl", "subl", "imull"};
+        int dest = location(cg, instr);
+        if (is_register(dest) && dest != location(cg, instr->args[1])) {
+            if (dest != location(cg, instr->args[0])) {
+                ins(cg, "movl\t%s, %s", a, word(cg, instr));
+            }
+            ins(cg, "%s\t%s, %s", ops[instr->op - IR_ADD], b, word(cg, instr));
+            return;
+        }
+        ins(cg, "movl\t%s, %%eax", a);
+        ins(cg, "%s\t%s, %%eax", ops[instr->op - IR_ADD], b);
+    } else {
+        int ok = new_label(cg);
+        int negate = new_label(cg);
+        int done = new_label(cg);
+        ins(cg, "movl\t%s, %%ecx", b);
+        ins(cg, "testl\t%%ecx, %%ecx");
+        ins(cg, "jne\t.L%d", ok);
+        emit_runtime_error(cg, instr->line, "division by zero");
+        fprintf(cg->out, ".L%d:\n", ok);
+        ins(cg, "movl\t%s, %%eax", a);
+        ins(cg, "cmpl\t$-1, %%ecx");
+        ins(cg, "je\t.L%d", negate);
+        ins(cg, "cltd");
+        ins(cg, "idivl\t%%ecx");
+        ins(cg, "jmp\t.L%d", done);
+        fprintf(cg->out, ".L%d:\n", negate);
+        ins(cg, "negl\t%%eax");
+        fprintf(cg->out, ".L%d:\n", done);
+    }
+    ins(cg, "movl\t%%eax, %s", word(cg, instr));
+}
+
+static void emit_float_arith(Codegen* cg, const IRInstr* instr) {
+    static const char* ops[] = {"addsd", "subsd", "mulsd", "divsd"};
+    ins(cg, "movsd\t%s, %%xmm0", operand(cg, ir_resolve(instr->args[0])));
+    ins(cg, "%s\t%s, %%xmm0", ops[instr->op - IR_ADD], operand(cg, ir_resolve(instr->args[1])));
+    ins(cg, "movsd\t%%xmm0, %s", operand(cg, instr));
+}
+
+static void emit_constant(Codegen* cg, const IRInstr* instr) {
+    if (instr->type == IR_FLOAT) {
+        uint64_t bits;
+        memcpy(&bits, &instr->imm.f, sizeof(bits));
+        ins(cg, "movabsq\t$%llu, %%rax", (unsigned long long)bits);
+        ins(cg, "movq\t%%rax, %s", operand(cg, instr));
+    } else if (instr->type == IR_STR) {
+        ins(cg, "leaq\t.LS%d(%%rip), %s", string_label(cg, instr->imm.s),
+            is_register(location(cg, instr)) ? operand(cg, instr) : "%rax");
+        if (!is_register(location(cg, instr))) ins(cg, "movq\t%%rax, %s", operand(cg, instr));
+    } else {
+        ins(cg, "movl\t$%d, %s", instr->imm.i, word(cg, instr));
+    }
+}
+
+static void emit_instr(Codegen* cg, int b, const IRInstr* instr, int next) {
+    const IRBlock* block = &cg->function->blocks[b];
+    switch (instr->op) {
+        case IR_CONST:
+            emit_constant(cg, instr);
+            break;
+        case IR_PARAM:
+        case IR_PHI:
+            break;
+        case IR_LOAD: {
+            const char* global = global_operand(cg, instr->index);
+            if (is_register(location(cg, instr))) {
+                ins(cg, "movq\t%s, %s", global, operand(cg, instr));
+                break;
+            }
+            ins(cg, "movq\t%s, %%rax", global);
+            ins(cg, "movq\t%%rax, %s", operand(cg, instr));
+            break;
+        }
+        case IR_STORE: {
+            const char* global = global_operand(cg, instr->index);
+            if (is_register(location(cg, instr->args[0]))) {
+                ins(cg, "movq\t%s, %s", operand(cg, instr->args[0]), global);
+                break;
+            }
+            ins(cg, "movq\t%s, %%rax", operand(cg, instr->args[0]));
+            ins(cg, "movq\t%%rax, %s", global);
+            break;
+        }
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+            if (instr->type == IR_FLOAT) {
+                emit_float_arith(cg, instr);
+            } else {
+                emit_int_arith(cg, instr);
+            }
+            break;
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+            emit_compare(cg, instr);
+            break;
+        case IR_AND: case IR_OR:
+            ins(cg, "movl\t%s, %%eax", word(cg, instr->args[0]));
+            ins(cg, "movl\t%s, %%ecx", word(cg, instr->args[1]));
+            ins(cg, "testl\t%%eax, %%eax");
+            ins(cg, "setne\t%%al");
+            ins(cg, "testl\t%%ecx, %%ecx");
+            ins(cg, "setne\t%%cl");
+            ins(cg, "%s\t%%cl, %%al", instr->op == IR_AND ? "andb" : "orb");
+            ins(cg, "movzbl\t%%al, %%eax");
+            ins(cg, "movl\t%%eax, %s", word(cg, instr));
+            break;
+        case IR_ITOF:
+            ins(cg, "cvtsi2sdl\t%s, %%xmm0", word(cg, instr->args[0]));
+            ins(cg, "movsd\t%%xmm0, %s", operand(cg, instr));
+            break;
+        case IR_FTOI:
+            ins(cg, "movsd\t%s, %%xmm0", operand(cg, ir_resolve(instr->args[0])));
+            ins(cg, "call\tbc_float_to_int@PLT");
+            ins(cg, "movl\t%%eax, %s", word(cg, instr));
+            break;
+        case IR_FACT:
+            ins(cg, "movl\t%s, %%edi", word(cg, instr->args[0]));
+            ins(cg, "call\tbc_factorial@PLT");
+            ins(cg, "movl\t%%eax, %s", word(cg, instr));
+            break;
+        case IR_COPY:
+            emit_move(cg, location(cg, instr), location(cg, instr->args[0]));
+            break;
+        case IR_CALL:
+            if (instr->index < 0) {
+                cg->failed = 1;
+                break;
+            }
+            if (cg->options.depth_limit > 0) {
+                // Calls nested as deep as the VM's frame limit fail the same way
+                int ok = new_label(cg);
+                const char* depth = depth_operand(cg);
+                ins(cg, "cmpl\t$%d, %s", cg->options.depth_limit, depth);
+                ins(cg, "jl\t.L%d", ok);
+                emit_runtime_error(cg, instr->line, "stack overflow");
+                fprintf(cg->out, ".L%d:\n", ok);
+                ins(cg, "addl\t$1, %s", depth);
+                emit_call(cg, instr->index, instr->args, instr->arg_count);
+                ins(cg, "subl\t$1, %s", depth_operand(cg));
+            } else {
+                emit_call(cg, instr->index, instr->args, instr->arg_count);
+            }
+            ins(cg, "movl\t%%eax, %s", word(cg, instr));
+            break;
+        case IR_PRINT: {
+            const IRInstr* value = ir_resolve(instr->args[0]);
+            if (value->type == IR_FLOAT) {
+                ins(cg, "movsd\t%s, %%xmm0", operand(cg, value));
+                ins(cg, "call\tbc_print_float@PLT");
+            } else if (value->type == IR_STR) {
+                ins(cg, "movq\t%s, %%rdi", operand(cg, value));
+                ins(cg, "call\tbc_print_str@PLT");
+            } else {
+                ins(cg, "movl\t%s, %%edi", word(cg, value));
+                ins(cg, "call\tbc_print_int@PLT");
+            }
+            break;
+        }
+        case IR_JUMP:
+            emit_edge(cg, b, block->succ[0], next);
+            break;
+        case IR_BRANCH: {
+            int yes = block->succ[0];
+            int no = block->succ_count > 1 ? block->succ[1] : yes;
+            int yes_moves = has_edge_moves(cg, b, yes);
+            int no_moves = has_edge_moves(cg, b, no);
+            ins(cg, "cmpl\t$0, %s", word(cg, instr->args[0]));
+            if (!no_moves && (yes_moves || yes == next)) {
+                emit_jump(cg, "je", no);
+                emit_edge(cg, b, yes, next);
+            } else if (!yes_moves) {
+                emit_jump(cg, "jne", yes);
+                emit_edge(cg, b, no, next);
+            } else {
+                int skip = new_label(cg);
+                ins(cg, "je\t.L%d", skip);
+                emit_edge_moves(cg, b, yes);
+                emit_jump(cg, "jmp", yes);
+                fprintf(cg->out, ".L%d:\n", skip);
+                emit_edge(cg, b, no, next);
+            }
+            break;
+        }
+        case IR_RETURN:
+            ins(cg, "movl\t%s, %%eax", word(cg, instr->args[0]));
+            emit_return(cg);
+            break;
+        default:
+            cg->failed = 1;
+            break;
+    }
+}
+
+// bc_enter_N: call the function with the arguments in the array at %rdi
+static void emit_call_entry(Codegen* cg) {
+    int params = cg->function->param_count;
+    int on_stack = params > 6 ? params - 6 : 0;
+    fprintf(cg->out, "\t.type\tbc_enter_%d, @function\n", cg->index);
+    fprintf(cg->out, "bc_enter_%d:\n", cg->index);
+    ins(cg, "pushq\t%%rbp");
+    ins(cg, "movq\t%%rsp, %%rbp");
+    if (on_stack % 2) {
+        ins(cg, "subq\t$8, %%rsp");
+    }
+    for (int a = params - 1; a >= 6; a--) {
+        ins(cg, "movq\t%d(%%rdi), %%rax", 8 * a);
+        ins(cg, "pushq\t%%rax");
+    }
+    // %rdi last, since it holds the array
+    for (int a = (params < 6 ? params : 6) - 1; a >= 0; a--) {
+        ins(cg, "movq\t%d(%%rdi), %s", 8 * a, arg_registers[a]);
+    }
+    ins(cg, "call\tbc_f%d", cg->index);
+    ins(cg, "leave");
+    ins(cg, "ret");
+    fprintf(cg->out, "\t.size\tbc_enter_%d, .-bc_enter_%d\n", cg->index, cg->index);
+}
+
+// bc_osr_N_B for each loop header B (a block some later block jumps back
+// to): the function's own prologue, then each value live into B (and B's
+// phis) from the interpreter's frame at %rdi, constants recomputed, since
+// the bytecode may never have loaded them
+static void emit_osr_entries(Codegen* cg) {
+    const IRFunction* ir = cg->function;
+    int* registers = malloc((ir->value_count + 1) * sizeof(int));
+    if (!registers) out_of_memory();
+    bc_value_registers(ir, registers);
+
+    for (int h = 0; h < ir->block_count; h++) {
+        const IRBlock* header = &ir->blocks[h];
+        int loop = 0;
+        for (int p = 0; p < header->pred_count; p++) {
+            loop |= header->preds[p] >= h && !ir->blocks[header->preds[p]].dead;
+        }
+        if (header->dead || !loop) {
+            continue;
+        }
+        fprintf(cg->out, "\t.type\tbc_osr_%d_%d, @function\n", cg->index, h);
+        fprintf(cg->out, "bc_osr_%d_%d:\n", cg->index, h);
+        ins(cg, "pushq\t%%rbp");
+        ins(cg, "movq\t%%rsp, %%rbp");
+        ins(cg, "subq\t$%d, %%rsp", cg->frame_size);
+        for (int r = 0; r < RA_CALLEE_SAVED; r++) {
+            if (cg->saves[r]) ins(cg, "movq\t%s, %s", ra_register_name(r, 64), location_operand(cg->saves[r], 64));
+        }
+        const uint64_t* live = cg->allocation.live_in + (size_t)h * cg->allocation.words;
+        for (int b = 0; b < ir->block_count; b++) {
+            for (int i = 0; !ir->blocks[b].dead && i < ir->blocks[b].count; i++) {
+                const IRInstr* instr = ir->blocks[b].code[i];
+                int is_live = (live[instr->id / 64] >> (instr->id % 64)) & 1;
+                if (instr->type == IR_VOID || !(is_live || (b == h && instr->op == IR_PHI))) {
+                    continue;
+                }
+                int where = cg->locations[instr->id];
+                if (instr->op == IR_CONST) {
+                    emit_constant(cg, instr);
+                } else if (registers[instr->id] < 0 || !where) {
+                    cg->failed = 1;
+                } else if (is_register(where)) {
+                    ins(cg, "movq\t%d(%%rdi), %s", 8 * registers[instr->id], location_operand(where, 64));
+                } else {
+                    ins(cg, "movq\t%d(%%rdi), %%rax", 8 * registers[instr->id]);
+                    ins(cg, "movq\t%%rax, %s", location_operand(where, 64));
+                }
+            }
+        }
+        emit_jump(cg, "jmp", h);
+        fprintf(cg->out, "\t.size\tbc_osr_%d_%d, .-bc_osr_%d_%d\n", cg->index, h, cg->index, h);
+    }
+    free(registers);
+}
+
+static int emit_function(Codegen* cg, int index) {
+    IRFunction* ir = cg->program->functions[index];
+    cg->function = ir;
+    cg->index = index;
+    cg->failed = 0;
+    allocate_registers(ir, &cg->allocation);
+    cg->locations = malloc((ir->value_count + 1) * sizeof(int));
+    if (!cg->locations) out_of_memory();
+    assign_locations(cg);
+    emit_prologue(cg);
+
+    for (int b = 0; b < ir->block_count; b++) {
+        const IRBlock* block = &ir->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        int next = b + 1;
+        while (next < ir->block_count && ir->blocks[next].dead) next++;
+
+        fprintf(cg->out, ".Lf%d_b%d:\n", index, b);
+        for (int i = 0; i < block->count; i++) {
+            emit_instr(cg, b, block->code[i], next);
+        }
+        // A block without a terminator (nothing lowers one) still leaves
+        const IRInstr* last = block->count ? block->code[block->count - 1] : NULL;
+        if (!last || (last->op != IR_JUMP && last->op != IR_BRANCH && last->op != IR_RETURN)) {
+            if (block->succ_count > 0) {
+                emit_edge(cg, b, block->succ[0], next);
+            } else {
+                ins(cg, "xorl\t%%eax, %%eax");
+                emit_return(cg);
+            }
+        }
+    }
+    fprintf(cg->out, "\t.size\tbc_f%d, .-bc_f%d\n", index, index);
+    if (cg->options.entries) {
+        emit_call_entry(cg);
+        emit_osr_entries(cg);
+    }
+
+    if (cg->failed) {
+        fprintf(stderr, "Error: function %s cannot be translated to assembly\n", ir->name);
+    }
+    free(cg->locations);
+    cg->locations = NULL;
+    free_allocation(&cg->allocation);
+    return !cg->failed;
+}
+
+// A string literal as a .string directive, escaping what the assembler would read
+static void emit_string(FILE* out, const char* s) {
+    fprintf(out, "\t.string\t\"");
+    for (const unsigned char* c = (const unsigned char*)s; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 32 || *c >= 127) {
+            fprintf(out, "\\%03o", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fprintf(out, "\"\n");
+}
+
+// String literals and the data, after the code
+static int finish_assembly(Codegen* cg, int ok) {
+    FILE* out = cg->out;
+    fprintf(out, "\n\t.section\t.rodata\n");
+    for (int i = 0; i < cg->string_count; i++) {
+        fprintf(out, ".LS%d:\n", i);
+        emit_string(out, cg->strings[i]);
+    }
+    if (!cg->options.external_data) {
+        fprintf(out, "\n\t.bss\n");
+        fprintf(out, "\t.align\t8\n");
+        fprintf(out, "bc_globals:\n");
+        fprintf(out, "\t.zero\t%d\n", 8 * (cg->program->global_count > 0 ? cg->program->global_count : 1));
+        if (cg->options.depth_limit > 0) {
+            fprintf(out, "bc_depth:\n");
+            fprintf(out, "\t.zero\t8\n");
+        }
+    }
+    fprintf(out, "\n\t.section\t.note.GNU-stack,\"\",@progbits\n");
+
+    free(cg->moves);
+    free(cg->strings);
+    return ok;
+}
+
+int emit_assembly(IRProgram* program, const CodegenOptions* options, FILE* out) {
+    Codegen cg;
+    memset(&cg, 0, sizeof(cg));
+    cg.out = out;
+    cg.program = program;
+    if (options) {
+        cg.options = *options;
+    }
+
+    fprintf(out, "# Generated by compiler.exe -S; link with runtime/runtime.c\n");
+    fprintf(out, "\t.text\n");
+    int ok = 1;
+    for (int f = 0; f < program->function_count; f++) {
+        if (!cg.options.functions || cg.options.functions[f]) {
+            ok = emit_function(&cg, f) && ok;
+        }
+    }
+    if (cg.options.functions) {
+        return finish_assembly(&cg, ok);
+    }
+
+    // main runs the top-level statements, then niam, whose result is the exit
+    // status; with a stack size, main hands the program, as bc_main, to the
+    // runtime, which runs it on a stack of that size
+    const char* entry = cg.options.stack_size ? "bc_main" : "main";
+    if (cg.options.stack_size) {
+        fprintf(out, "\n\t.globl\tmain\n");
+        fprintf(out, "\t.type\tmain, @function\n");
+        fprintf(out, "main:\n");
+        ins(&cg, "pushq\t%%rbp");
+        ins(&cg, "movq\t%%rsp, %%rbp");
+        ins(&cg, "leaq\tbc_main(%%rip), %%rdi");
+        ins(&cg, "movabsq\t$%zu, %%rsi", cg.options.stack_size);
+        ins(&cg, "call\tbc_run_main@PLT");
+        ins(&cg, "popq\t%%rbp");
+        ins(&cg, "ret");
+        fprintf(out, "\t.size\tmain, .-main\n");
+    } else {
+        fprintf(out, "\n\t.globl\tmain\n");
+    }
+    fprintf(out, "\t.type\t%s, @function\n", entry);
+    fprintf(out, "%s:\n", entry);
+    ins(&cg, "pushq\t%%rbp");
+    ins(&cg, "movq\t%%rsp, %%rbp");
+    if (program->init_function >= 0) {
+        emit_call(&cg, program->init_function, NULL, 0);
+    }
+    if (program->main_function >= 0) {
+        emit_call(&cg, program->main_function, NULL, 0);
+    } else {
+        ins(&cg, "xorl\t%%eax, %%eax");
+    }
+    ins(&cg, "popq\t%%rbp");
+    ins(&cg, "ret");
+    fprintf(out, "\t.size\t%s, .-%s\n", entry, entry);
+    return finish_assembly(&cg, ok);
+}
+
+int proc_assembly_file(const char* filename, const char* output) {
+    PassManager manager;
+    if (!pass_manager_init(&manager, get_pass_pipeline())) {
+        return 0;
+    }
+    IRProgram* ir = compile_file_to_ir(filename, &manager);
+    pass_manager_free(&manager);
+    if (!ir) {
+        return 0;
+    }
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Error: Could not write %s\n", output);
+        free_ir_program(ir);
+        return 0;
+    }
+    // Calls check their depth, as in the VM and the JIT, on a stack with room
+    // for that many
+    CodegenOptions options = {VM_MAX_FRAMES, NULL, 0, 0, jit_stack_size(ir)};
+    int ok = emit_assembly(ir, &options, out);
+    if (output) {
+        fclose(out);
+    }
+    free_ir_program(ir);
+    return ok;
+}
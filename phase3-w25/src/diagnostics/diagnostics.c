@@ -0,0 +1,100 @@
+/* diagnostics.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "../../include/diagnostics.h"
+
+// Buffer receiving this thread's diagnostics (NULL writes straight to stdout)
+static _Thread_local DiagBuffer* capture = NULL;
+
+// Make sure the buffer can hold 'extra' more bytes
+static void reserve(DiagBuffer* buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) {
+        return;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+
+    char* data = realloc(buffer->data, capacity);
+    if (!data) {
+        fprintf(stderr, "Error: Memory allocation failed for diagnostics\n");
+        exit(1);
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+}
+
+// Print a diagnostic, or append it to the active capture buffer
+void diag_printf(const char* format, ...) {
+    va_list args;
+
+    if (!capture) {
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+
+    va_start(args, format);
+    int needed = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (needed <= 0) {
+        return;
+    }
+
+    // vsnprintf always writes a terminator, so reserve room for it too
+    reserve(capture, (size_t)needed + 1);
+    va_start(args, format);
+    vsnprintf(capture->data + capture->length, (size_t)needed + 1, format, args);
+    va_end(args);
+    capture->length += (size_t)needed;
+}
+
+// Append raw bytes to a buffer
+void diag_write(DiagBuffer* buffer, const char* data, size_t length) {
+    reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+// Route this thread's diagnostics into a buffer; captures nest, so the
+// one already active (if any) resumes at the matching diag_capture_end
+void diag_capture_begin(DiagBuffer* buffer) {
+    buffer->previous = capture;
+    capture = buffer;
+}
+
+// Route this thread's diagnostics back to where they went before the
+// innermost diag_capture_begin
+void diag_capture_end(void) {
+    if (capture) {
+        DiagBuffer* buffer = capture;
+        capture = buffer->previous;
+        buffer->previous = NULL;
+    }
+}
+
+// Pass captured diagnostics on, to the enclosing capture when one is active
+// and to stdout otherwise, and empty the buffer
+void diag_buffer_flush(DiagBuffer* buffer) {
+    if (buffer->length > 0) {
+        if (capture && capture != buffer) {
+            diag_write(capture, buffer->data, buffer->length);
+        } else {
+            fwrite(buffer->data, 1, buffer->length, stdout);
+        }
+    }
+    buffer->length = 0;
+}
+
+// Release a capture buffer
+void diag_buffer_free(DiagBuffer* buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
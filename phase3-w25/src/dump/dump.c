@@ -0,0 +1,472 @@
+/* dump.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/dump.h"
+#include "../../include/lexer.h"
+#include "../../include/parser.h"
+#include "../../include/diagnostics.h"
+#include "../../include/semantic.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Token names as the text dump prints them (unlisted kinds print UNKNOWN)
+static const char *token_names[] = {
+    [TOKEN_EOF] = "EOF",
+    [TOKEN_NUMBER] = "NUMBER",
+    [TOKEN_FLOAT] = "FLOATING POINT NUMBER",
+    [TOKEN_OPERATOR] = "OPERATOR",
+    [TOKEN_EQUALS_EQUALS] = "EQUALS_EQUALS",
+    [TOKEN_NOT_EQUALS] = "NOT_EQUALS",
+    [TOKEN_LOGICAL_AND] = "LOGICAL_AND",
+    [TOKEN_LOGICAL_OR] = "LOGICAL_OR",
+    [TOKEN_GREATER_EQUALS] = "GREATER_EQUALS",
+    [TOKEN_LESS_EQUALS] = "LESS_EQUALS",
+    [TOKEN_IDENTIFIER] = "IDENTIFIER",
+    [TOKEN_STRING] = "STRING",
+    [TOKEN_CHAR_LITERAL] = "CHARACTER",
+    [TOKEN_COMMENT] = "COMMENT",
+    [TOKEN_POINTER] = "POINTER",
+    [TOKEN_EQUALS] = "EQUALS",
+    [TOKEN_SEMICOLON] = "SEMICOLON",
+    [TOKEN_LPAREN] = "LPAREN",
+    [TOKEN_RPAREN] = "RPAREN",
+    [TOKEN_LBRACE] = "LBRACE",
+    [TOKEN_RBRACE] = "RBRACE",
+    [TOKEN_COMMA] = "COMMA",
+    [TOKEN_IF] = "IF",
+    [TOKEN_INT] = "INT",
+    [TOKEN_CHAR] = "CHAR",
+    [TOKEN_VOID] = "VOID",
+    [TOKEN_RETURN] = "RETURN",
+    [TOKEN_FOR] = "FOR",
+    [TOKEN_WHILE] = "WHILE",
+    [TOKEN_DO] = "DO",
+    [TOKEN_BREAK] = "BREAK",
+    [TOKEN_CONTINUE] = "CONTINUE",
+    [TOKEN_SWITCH] = "SWITCH",
+    [TOKEN_CASE] = "CASE",
+    [TOKEN_DEFAULT] = "DEFAULT",
+    [TOKEN_GOTO] = "GOTO",
+    [TOKEN_SIZEOF] = "SIZEOF",
+    [TOKEN_STATIC] = "STATIC",
+    [TOKEN_EXTERN] = "EXTERN",
+    [TOKEN_CONST] = "CONST",
+    [TOKEN_VOLATILE] = "VOLATILE",
+    [TOKEN_STRUCT] = "STRUCT",
+    [TOKEN_UNION] = "UNION",
+    [TOKEN_ENUM] = "ENUM",
+    [TOKEN_TYPEDEF] = "TYPEDEF",
+    [TOKEN_UNSIGNED] = "UNSIGNED",
+    [TOKEN_SHORT] = "SHORT",
+    [TOKEN_LONG] = "LONG",
+    [TOKEN_FLOAT_KEY] = "FLOAT",
+    [TOKEN_DOUBLE] = "DOUBLE",
+    [TOKEN_ELSE] = "ELSE",
+    [TOKEN_VOID_STAR] = "VOID*",
+    [TOKEN_INT_STAR] = "INT*",
+    [TOKEN_PRINT] = "PRINT",
+    [TOKEN_REPEAT] = "REPEAT",
+    [TOKEN_UNTIL] = "UNTIL",
+    [TOKEN_FACTORIAL] = "FACTORIAL"
+};
+
+// Lexical error messages; 'quoted' messages end with the lexeme in quotes
+static const struct {
+    const char *text;
+    int quoted;
+} error_messages[] = {
+    [ERROR_NONE] = {"Unknown error", 0},
+    [ERROR_INVALID_CHAR] = {"Invalid character", 1},
+    [ERROR_INVALID_NUMBER] = {"Invalid number format", 0},
+    [ERROR_CONSECUTIVE_OPERATORS] = {"Consecutive operators not allowed", 0},
+    [ERROR_UNTERMINATED_STRING] = {"Unterminated string literal", 0},
+    [ERROR_UNTERMINATED_CHAR] = {"Unterminated character literal", 0},
+    [ERROR_INVALID_IDENTIFIER] = {"Invalid identifier", 0},
+    [ERROR_STRING_TOO_LONG] = {"String literal too long", 0},
+    [ERROR_INVALID_ESCAPE_SEQUENCE] = {"Invalid escape sequence", 0},
+    [ERROR_EMPTY_CHAR_LITERAL] = {"Empty character literal", 0},
+    [ERROR_MULTI_CHAR_LITERAL] = {"Multi-character literal not allowed", 0},
+    [ERROR_INVALID_FLOAT] = {"Invalid float format", 0},
+    [ERROR_RECOVERY_MODE] = {"Skipping invalid input ", 0},
+    [ERROR_UNEXPECTED_TOKEN] = {"Unexpected token", 1}
+};
+
+// AST labels: text label, then how the lexeme follows it
+// (0 = not shown, 1 = after ": ", 2 = after ": " in double quotes)
+static const struct {
+    const char *label;
+    int lexeme;
+    const char *name;          // Kind name for JSON
+} ast_labels[] = {
+    [AST_PROGRAM] = {"Program", 0, "Program"},
+    [AST_VARDECL] = {"VarDecl", 1, "VarDecl"},
+    [AST_ASSIGN] = {"Assign", 0, "Assign"},
+    [AST_PRINT] = {"Print Statement", 0, "Print"},
+    [AST_NUMBER] = {"Number", 1, "Number"},
+    [AST_STRING] = {"String", 2, "String"},
+    [AST_OPERATOR] = {NULL, 0, "Operator"},
+    [AST_IDENTIFIER] = {"Identifier", 1, "Identifier"},
+    [AST_IF] = {"If Statement", 0, "If"},
+    [AST_ELSE] = {"Else Statement", 0, "Else"},
+    [AST_WHILE] = {"While Loop", 0, "While"},
+    [AST_FOR] = {"Repeat-Until Loop", 0, "RepeatUntil"},
+    [AST_BLOCK] = {"Block", 0, "Block"},
+    [AST_BINOP] = {"BinaryOp", 1, "BinaryOp"},
+    [AST_FACTORIAL] = {"Factorial Function", 0, "Factorial"},
+    [AST_FUNCTION_CALL] = {"Function Call", 1, "FunctionCall"},
+    [AST_RETURN] = {"Return Statement", 0, "Return"},
+    [AST_FUNCTION_DECL] = {"Function Declaration", 1, "FunctionDecl"}
+};
+
+#define TABLE_SIZE(table) ((int)(sizeof(table) / sizeof(table[0])))
+
+// Pending AST node for the iterative walk
+typedef struct {
+    const ASTNode *node;
+    int level;                 // Depth below the dump's root
+    int parent;                // Preorder id of the parent, -1 for the root
+    char edge;                 // 'l', 'r', or 0 for the root
+} DumpFrame;
+
+// Walk stack, kept between dumps
+static DumpFrame *stack = NULL;
+static int stack_capacity = 0;
+
+// Name of a token kind
+const char *token_kind_name(TokenType type) {
+    if ((int)type < 0 || (int)type >= TABLE_SIZE(token_names) || !token_names[type]) {
+        return "UNKNOWN";
+    }
+    return token_names[type];
+}
+
+// Name of an AST node kind
+const char *ast_kind_name(ASTNodeType type) {
+    if ((int)type < 0 || (int)type >= TABLE_SIZE(ast_labels)) {
+        return "Unknown";
+    }
+    return ast_labels[type].name;
+}
+
+// Map "text", "json" or "binary" to a format; returns 0 for anything else
+int parse_dump_format(const char *name, DumpFormat *format) {
+    if (strcmp(name, "text") == 0) {
+        *format = DUMP_TEXT;
+    } else if (strcmp(name, "json") == 0) {
+        *format = DUMP_JSON;
+    } else if (strcmp(name, "binary") == 0) {
+        *format = DUMP_BINARY;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Hand a large buffer to stdout so it does not grow without bound
+static void maybe_flush(DiagBuffer *out) {
+    if (out->length >= DUMP_FLUSH_BYTES) {
+        diag_buffer_flush(out);
+    }
+}
+
+static void put_str(DiagBuffer *out, const char *text) {
+    diag_write(out, text, strlen(text));
+}
+
+static void put_char(DiagBuffer *out, char c) {
+    diag_write(out, &c, 1);
+}
+
+static void put_int(DiagBuffer *out, int value) {
+    char digits[12];
+    int n = sizeof(digits);
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do {
+        digits[--n] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        digits[--n] = '-';
+    }
+    diag_write(out, digits + n, sizeof(digits) - n);
+}
+
+// JSON string literal with the required escapes
+static void put_json_string(DiagBuffer *out, const char *text) {
+    static const char hex[] = "0123456789abcdef";
+
+    put_char(out, '"');
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            put_char(out, '\\');
+            put_char(out, (char)*p);
+        } else if (*p == '\n') {
+            put_str(out, "\\n");
+        } else if (*p == '\t') {
+            put_str(out, "\\t");
+        } else if (*p == '\r') {
+            put_str(out, "\\r");
+        } else if (*p < 0x20) {
+            char escape[] = {'\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 15]};
+            diag_write(out, escape, sizeof(escape));
+        } else {
+            put_char(out, (char)*p);
+        }
+    }
+    put_char(out, '"');
+}
+
+static void put_varint(DiagBuffer *out, unsigned int value) {
+    char bytes[5];
+    int n = 0;
+
+    do {
+        bytes[n] = (char)(value & 0x7f);
+        value >>= 7;
+        if (value) bytes[n] |= (char)0x80;
+        n++;
+    } while (value);
+    diag_write(out, bytes, n);
+}
+
+static void put_binary_string(DiagBuffer *out, const char *text) {
+    size_t length = strlen(text);
+    put_varint(out, (unsigned int)length);
+    diag_write(out, text, length);
+}
+
+// Message text for a lexical error, without the location prefix
+static void put_error_message(DiagBuffer *out, ErrorType error, const char *lexeme) {
+    if ((int)error < 0 || (int)error >= TABLE_SIZE(error_messages)) {
+        error = ERROR_NONE;
+    }
+    put_str(out, error_messages[error].text);
+    if (error_messages[error].quoted) {
+        put_str(out, " '");
+        put_str(out, lexeme);
+        put_char(out, '\'');
+    }
+}
+
+// "Lexical Error at line N: message"
+void dump_lexical_error(DiagBuffer *out, ErrorType error, int line, const char *lexeme) {
+    put_str(out, "Lexical Error at line ");
+    put_int(out, line);
+    put_str(out, ": ");
+    put_error_message(out, error, lexeme);
+    put_char(out, '\n');
+}
+
+// One token in the chosen format
+void dump_token(DiagBuffer *out, const Token *token, DumpFormat format) {
+    switch (format) {
+        case DUMP_TEXT:
+            if (token->type == TOKEN_SKIP) {
+                return;
+            }
+            if (token->error != ERROR_NONE) {
+                dump_lexical_error(out, token->error, token->line, token->lexeme);
+                return;
+            }
+            put_str(out, "Token: ");
+            put_str(out, token_kind_name(token->type));
+            put_str(out, " | Lexeme: '");
+            put_str(out, token->lexeme);
+            put_str(out, "' | Line: ");
+            put_int(out, token->line);
+            put_str(out, " | Column: ");
+            put_int(out, token->column);
+            put_char(out, '\n');
+            break;
+        case DUMP_JSON:
+            put_str(out, "{\"token\":");
+            put_json_string(out, token_kind_name(token->type));
+            put_str(out, ",\"lexeme\":");
+            put_json_string(out, token->lexeme);
+            put_str(out, ",\"line\":");
+            put_int(out, token->line);
+            put_str(out, ",\"column\":");
+            put_int(out, token->column);
+            put_str(out, ",\"offset\":");
+            put_int(out, token->offset);
+            if (token->error != ERROR_NONE) {
+                DiagBuffer message = {NULL, 0, 0, NULL};
+                put_error_message(&message, token->error, token->lexeme);
+                put_char(&message, '\0');
+                put_str(out, ",\"error\":");
+                put_json_string(out, message.data);
+                diag_buffer_free(&message);
+            }
+            put_str(out, "}\n");
+            break;
+        case DUMP_BINARY:
+            put_char(out, 'T');
+            put_varint(out, (unsigned int)token->type);
+            put_varint(out, (unsigned int)token->error);
+            put_varint(out, (unsigned int)token->line);
+            put_varint(out, (unsigned int)token->column);
+            put_varint(out, (unsigned int)token->offset);
+            put_binary_string(out, token->lexeme);
+            break;
+    }
+}
+
+// A run of tokens, flushing as the buffer fills
+void dump_tokens(DiagBuffer *out, const Token *tokens, int count, DumpFormat format) {
+    for (int i = 0; i < count; i++) {
+        dump_token(out, &tokens[i], format);
+        maybe_flush(out);
+    }
+}
+
+// The one-line text description of an AST node
+void dump_ast_label(DiagBuffer *out, ASTNodeType type, const char *lexeme) {
+    if ((int)type < 0 || (int)type >= TABLE_SIZE(ast_labels) || !ast_labels[type].label) {
+        put_str(out, "Unknown node type: ");
+        put_int(out, type);
+        put_char(out, '\n');
+        return;
+    }
+
+    put_str(out, ast_labels[type].label);
+    if (ast_labels[type].lexeme) {
+        int quoted = ast_labels[type].lexeme == 2;
+        put_str(out, quoted ? ": \"" : ": ");
+        put_str(out, lexeme);
+        if (quoted) put_char(out, '"');
+    }
+    put_char(out, '\n');
+}
+
+// Make room for one more frame on the walk stack
+static void push_frame(int *depth, const ASTNode *node, int level, int parent, char edge) {
+    if (*depth == stack_capacity) {
+        int capacity = stack_capacity ? stack_capacity * 2 : 256;
+        DumpFrame *grown = realloc(stack, capacity * sizeof(DumpFrame));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed for AST dump\n");
+            exit(1);
+        }
+        stack = grown;
+        stack_capacity = capacity;
+    }
+    DumpFrame frame = {node, level, parent, edge};
+    stack[(*depth)++] = frame;
+}
+
+// Whole tree in preorder, without recursion; 'level' indents the text format
+void dump_ast(DiagBuffer *out, const ASTNode *root, int level, DumpFormat format) {
+    int depth = 0;
+    int next_id = 0;
+
+    if (root) push_frame(&depth, root, level, -1, 0);
+    while (depth > 0) {
+        DumpFrame frame = stack[--depth];
+        const ASTNode *node = frame.node;
+        int id = next_id++;
+
+        switch (format) {
+            case DUMP_TEXT:
+                for (int i = 0; i < frame.level; i++) put_str(out, "  ");
+                dump_ast_label(out, node->type, node->token.lexeme);
+                break;
+            case DUMP_JSON:
+                put_str(out, "{\"node\":");
+                put_json_string(out, ast_kind_name(node->type));
+                put_str(out, ",\"id\":");
+                put_int(out, id);
+                put_str(out, ",\"parent\":");
+                put_int(out, frame.parent);
+                if (frame.edge) {
+                    put_str(out, frame.edge == 'l' ? ",\"edge\":\"left\"" : ",\"edge\":\"right\"");
+                }
+                put_str(out, ",\"lexeme\":");
+                put_json_string(out, node->token.lexeme);
+                put_str(out, ",\"line\":");
+                put_int(out, node->token.line);
+                put_str(out, ",\"column\":");
+                put_int(out, node->token.column);
+                if (node->static_type != TOKEN_ERROR) {
+                    put_str(out, ",\"type\":");
+                    put_json_string(out, token_kind_name(node->static_type));
+                }
+                if (node->slot >= 0) {
+                    put_str(out, ",\"slot\":");
+                    put_int(out, node->slot);
+                    put_str(out, ",\"depth\":");
+                    put_int(out, node->scope_depth);
+                }
+                put_str(out, "}\n");
+                break;
+            case DUMP_BINARY:
+                put_char(out, 'N');
+                put_varint(out, (unsigned int)node->type);
+                put_varint(out, (node->left ? 1u : 0u) | (node->right ? 2u : 0u));
+                put_varint(out, (unsigned int)node->token.line);
+                put_varint(out, (unsigned int)node->token.column);
+                put_varint(out, (unsigned int)node->static_type);
+                put_varint(out, (unsigned int)(node->slot + 1));
+                put_varint(out, (unsigned int)(node->scope_depth + 1));
+                put_binary_string(out, node->token.lexeme);
+                break;
+        }
+        maybe_flush(out);
+
+        // Right is pushed first so the left subtree comes out first
+        if (node->right) push_frame(&depth, node->right, frame.level + 1, id, 'r');
+        if (node->left) push_frame(&depth, node->left, frame.level + 1, id, 'l');
+    }
+}
+
+// Parse and check a file, then dump its tokens and annotated AST to stdout.
+// Diagnostics go to stderr so the JSON and binary streams stay machine-readable.
+void dump_source_file(const char *filename, DumpFormat format) {
+    char *buffer = read_source_file(filename);
+    if (!buffer) {
+        fprintf(stderr, "Error: Could not open file %s\n", filename);
+        return;
+    }
+
+    DiagBuffer diagnostics = {NULL, 0, 0, NULL};
+    reset_lexer();
+    diag_capture_begin(&diagnostics);
+    parser_init(buffer);
+    ASTNode *ast = parse();
+    set_semantic_verbose(0);
+    analyze_semantics(ast);
+    set_semantic_verbose(1);
+    diag_capture_end();
+
+    const TokenBuffer *tokens = get_token_buffer();
+    DiagBuffer out = {NULL, 0, 0, NULL};
+    if (format == DUMP_BINARY) {
+#ifdef _WIN32
+        fflush(stdout);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        diag_write(&out, DUMP_MAGIC, strlen(DUMP_MAGIC));
+        put_char(&out, DUMP_VERSION);
+    }
+
+    if (format == DUMP_TEXT) put_str(&out, "TOKEN STREAM:\n");
+    dump_tokens(&out, tokens->tokens, tokens->count, format);
+    if (format == DUMP_TEXT) put_str(&out, "\nABSTRACT SYNTAX TREE:\n");
+    dump_ast(&out, ast, 0, format);
+    if (format == DUMP_BINARY) put_char(&out, 'E');
+
+    diag_buffer_flush(&out);
+    diag_buffer_free(&out);
+    fflush(stdout);
+    if (diagnostics.length > 0) {
+        fwrite(diagnostics.data, 1, diagnostics.length, stderr);
+    }
+    diag_buffer_free(&diagnostics);
+
+    free_ast(ast);
+    free(buffer);
+}
@@ -0,0 +1,528 @@
+/* elfobj.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include "../../include/elfobj.h"
+#include "../../include/asm.h"
+#include "../../include/codegen.h"
+#include "../../include/jit.h"
+#include "../../include/vm.h"
+#include "../../include/ir.h"
+#include "../../include/pass.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+
+#include "runtime.inc"
+
+// Executables load at the usual non-PIE address, one segment per page
+#define EXE_BASE 0x400000
+#define EXE_PAGE 0x1000
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed in the ELF writer\n");
+    exit(1);
+}
+
+static const char* section_names[ASM_SECTION_COUNT] = {".text", ".rodata", ".bss"};
+
+// Growable bytes: a file image or a string table
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+// Append 'length' bytes (zeros if 'bytes' is NULL); returns their offset
+static size_t buffer_add(Buffer* buffer, const void* bytes, size_t length) {
+    if (buffer->size + length > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + length) capacity *= 2;
+        buffer->data = realloc(buffer->data, capacity);
+        if (!buffer->data) out_of_memory();
+        buffer->capacity = capacity;
+    }
+    size_t offset = buffer->size;
+    if (bytes) {
+        memcpy(buffer->data + offset, bytes, length);
+    } else {
+        memset(buffer->data + offset, 0, length);
+    }
+    buffer->size += length;
+    return offset;
+}
+
+static size_t buffer_align(Buffer* buffer, size_t align) {
+    if (buffer->size % align) buffer_add(buffer, NULL, align - buffer->size % align);
+    return buffer->size;
+}
+
+static uint32_t add_string(Buffer* strings, const char* s) {
+    return (uint32_t)buffer_add(strings, s, strlen(s) + 1);
+}
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+// .symtab and .strtab: locals first (section symbols, if wanted, then the
+// named ones), then globals, as ELF requires. Local labels (.L) stay out.
+typedef struct {
+    Buffer symbols;            // Elf64_Sym
+    Buffer names;
+    int count;
+    int first_global;
+    int* index;                // By AsmSymbol: its entry, or 0 if none
+} SymbolTable;
+
+static void add_symbol(SymbolTable* table, const Elf64_Sym* symbol) {
+    buffer_add(&table->symbols, symbol, sizeof(*symbol));
+    table->count++;
+}
+
+// 'shndx' and 'base' give each AsmSection's section header and address
+static void build_symbols(const AsmUnit* unit, const int* shndx, const uint64_t* base, int section_symbols,
+                          SymbolTable* table) {
+    memset(table, 0, sizeof(*table));
+    table->index = calloc(unit->symbol_count + 1, sizeof(int));
+    if (!table->index) out_of_memory();
+    add_string(&table->names, "");
+    Elf64_Sym null_symbol;
+    memset(&null_symbol, 0, sizeof(null_symbol));
+    add_symbol(table, &null_symbol);
+    if (section_symbols) {
+        for (int s = 0; s < ASM_SECTION_COUNT; s++) {
+            Elf64_Sym symbol;
+            memset(&symbol, 0, sizeof(symbol));
+            symbol.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+            symbol.st_shndx = shndx[s];
+            add_symbol(table, &symbol);
+        }
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        if (pass == 1) {
+            table->first_global = table->count;
+        }
+        for (int i = 0; i < unit->symbol_count; i++) {
+            const AsmSymbol* s = &unit->symbols[i];
+            int global = s->global || s->section < 0;
+            if (strncmp(s->name, ".L", 2) == 0 || global != pass) {
+                continue;
+            }
+            Elf64_Sym symbol;
+            memset(&symbol, 0, sizeof(symbol));
+            symbol.st_name = add_string(&table->names, s->name);
+            if (s->section < 0) {
+                symbol.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+                symbol.st_shndx = SHN_UNDEF;
+            } else {
+                int type = s->function ? STT_FUNC : (s->section == ASM_TEXT ? STT_NOTYPE : STT_OBJECT);
+                symbol.st_info = ELF64_ST_INFO(global ? STB_GLOBAL : STB_LOCAL, type);
+                symbol.st_shndx = shndx[s->section];
+                symbol.st_value = base[s->section] + s->offset;
+                symbol.st_size = s->size;
+            }
+            table->index[i] = table->count;
+            add_symbol(table, &symbol);
+        }
+    }
+}
+
+static void free_symbols(SymbolTable* table) {
+    free(table->symbols.data);
+    free(table->names.data);
+    free(table->index);
+}
+
+static Elf64_Shdr section_header(uint32_t name, uint32_t type, uint64_t flags, uint64_t address, uint64_t offset,
+                                 uint64_t size, uint64_t align) {
+    Elf64_Shdr header;
+    memset(&header, 0, sizeof(header));
+    header.sh_name = name;
+    header.sh_type = type;
+    header.sh_flags = flags;
+    header.sh_addr = address;
+    header.sh_offset = offset;
+    header.sh_size = size;
+    header.sh_addralign = align;
+    return header;
+}
+
+static Elf64_Ehdr file_header(uint16_t type) {
+    Elf64_Ehdr header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = type;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    return header;
+}
+
+static int write_file(const Buffer* image, const char* filename, int executable, char* error, int error_size) {
+    if (executable) {
+        unlink(filename);          // A fresh file gets the executable mode, as ld's output does
+    }
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, executable ? 0777 : 0666);
+    size_t written = 0;
+    while (fd >= 0 && written < image->size) {
+        ssize_t n = write(fd, image->data + written, image->size - written);
+        if (n <= 0) break;
+        written += (size_t)n;
+    }
+    int failed = fd < 0 || written < image->size;
+    if (fd >= 0 && close(fd) != 0) failed = 1;
+    if (failed) {
+        snprintf(error, error_size, "%s", strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Relocatable objects
+
+// Section headers of an object, in order
+enum {
+    OBJ_NULL, OBJ_TEXT, OBJ_RODATA, OBJ_BSS, OBJ_RELA_TEXT, OBJ_SYMTAB, OBJ_STRTAB, OBJ_SHSTRTAB, OBJ_NOTE,
+    OBJ_SECTION_COUNT
+};
+
+int write_elf_object(const AsmUnit* unit, const char* filename, char* error, int error_size) {
+    static const int shndx[ASM_SECTION_COUNT] = {OBJ_TEXT, OBJ_RODATA, OBJ_BSS};
+    static const uint64_t base[ASM_SECTION_COUNT] = {0, 0, 0};
+    SymbolTable table;
+    build_symbols(unit, shndx, base, 1, &table);
+
+    // References to local symbols go through their section's symbol, as
+    // GNU as writes them; the rest name the symbol
+    Buffer relocs = {NULL, 0, 0};
+    for (int i = 0; i < unit->reloc_count; i++) {
+        const AsmReloc* r = &unit->relocs[i];
+        const AsmSymbol* s = &unit->symbols[r->symbol];
+        if (r->section != ASM_TEXT) {
+            snprintf(error, error_size, "relocation outside .text");
+            free(relocs.data);
+            free_symbols(&table);
+            return 0;
+        }
+        Elf64_Rela rela;
+        int symbol = table.index[r->symbol];
+        rela.r_offset = r->offset;
+        rela.r_addend = r->addend;
+        if (s->section >= 0 && !s->global) {
+            symbol = 1 + s->section;
+            rela.r_addend += s->offset;
+        }
+        int type = r->type == ASM_RELOC_PLT32 ? R_X86_64_PLT32 :
+                   r->type == ASM_RELOC_GOTPCREL ? R_X86_64_GOTPCREL : R_X86_64_PC32;
+        rela.r_info = ELF64_R_INFO(symbol, type);
+        buffer_add(&relocs, &rela, sizeof(rela));
+    }
+
+    Buffer shstrtab = {NULL, 0, 0};
+    uint32_t names[OBJ_SECTION_COUNT];
+    names[OBJ_NULL] = add_string(&shstrtab, "");
+    for (int s = 0; s < ASM_SECTION_COUNT; s++) names[shndx[s]] = add_string(&shstrtab, section_names[s]);
+    names[OBJ_RELA_TEXT] = add_string(&shstrtab, ".rela.text");
+    names[OBJ_SYMTAB] = add_string(&shstrtab, ".symtab");
+    names[OBJ_STRTAB] = add_string(&shstrtab, ".strtab");
+    names[OBJ_SHSTRTAB] = add_string(&shstrtab, ".shstrtab");
+    names[OBJ_NOTE] = add_string(&shstrtab, ".note.GNU-stack");
+
+    Buffer image = {NULL, 0, 0};
+    Elf64_Shdr headers[OBJ_SECTION_COUNT];
+    memset(headers, 0, sizeof(headers));
+    buffer_add(&image, NULL, sizeof(Elf64_Ehdr));
+    size_t offset = buffer_align(&image, unit->align[ASM_TEXT]);
+    buffer_add(&image, unit->bytes[ASM_TEXT], unit->size[ASM_TEXT]);
+    headers[OBJ_TEXT] = section_header(names[OBJ_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0, offset,
+                                       unit->size[ASM_TEXT], unit->align[ASM_TEXT]);
+    offset = buffer_align(&image, unit->align[ASM_RODATA]);
+    buffer_add(&image, unit->bytes[ASM_RODATA], unit->size[ASM_RODATA]);
+    headers[OBJ_RODATA] = section_header(names[OBJ_RODATA], SHT_PROGBITS, SHF_ALLOC, 0, offset,
+                                         unit->size[ASM_RODATA], unit->align[ASM_RODATA]);
+    headers[OBJ_BSS] = section_header(names[OBJ_BSS], SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 0, image.size,
+                                      unit->size[ASM_BSS], unit->align[ASM_BSS]);
+    offset = buffer_align(&image, 8);
+    buffer_add(&image, relocs.data, relocs.size);
+    headers[OBJ_RELA_TEXT] = section_header(names[OBJ_RELA_TEXT], SHT_RELA, SHF_INFO_LINK, 0, offset, relocs.size, 8);
+    headers[OBJ_RELA_TEXT].sh_link = OBJ_SYMTAB;
+    headers[OBJ_RELA_TEXT].sh_info = OBJ_TEXT;
+    headers[OBJ_RELA_TEXT].sh_entsize = sizeof(Elf64_Rela);
+    offset = buffer_add(&image, table.symbols.data, table.symbols.size);
+    headers[OBJ_SYMTAB] = section_header(names[OBJ_SYMTAB], SHT_SYMTAB, 0, 0, offset, table.symbols.size, 8);
+    headers[OBJ_SYMTAB].sh_link = OBJ_STRTAB;
+    headers[OBJ_SYMTAB].sh_info = table.first_global;
+    headers[OBJ_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    offset = buffer_add(&image, table.names.data, table.names.size);
+    headers[OBJ_STRTAB] = section_header(names[OBJ_STRTAB], SHT_STRTAB, 0, 0, offset, table.names.size, 1);
+    offset = buffer_add(&image, shstrtab.data, shstrtab.size);
+    headers[OBJ_SHSTRTAB] = section_header(names[OBJ_SHSTRTAB], SHT_STRTAB, 0, 0, offset, shstrtab.size, 1);
+    // An empty .note.GNU-stack asks for a stack that is not executable
+    headers[OBJ_NOTE] = section_header(names[OBJ_NOTE], SHT_PROGBITS, 0, 0, image.size, 0, 1);
+
+    Elf64_Ehdr header = file_header(ET_REL);
+    header.e_shoff = buffer_align(&image, 8);
+    header.e_shnum = OBJ_SECTION_COUNT;
+    header.e_shstrndx = OBJ_SHSTRTAB;
+    buffer_add(&image, headers, sizeof(headers));
+    memcpy(image.data, &header, sizeof(header));
+
+    int ok = write_file(&image, filename, 0, error, error_size);
+    free(image.data);
+    free(shstrtab.data);
+    free(relocs.data);
+    free_symbols(&table);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Static executables
+
+enum {
+    EXE_NULL, EXE_TEXT, EXE_RODATA, EXE_BSS, EXE_SYMTAB, EXE_STRTAB, EXE_SHSTRTAB, EXE_SECTION_COUNT
+};
+
+static Elf64_Phdr segment(uint32_t type, uint32_t flags, uint64_t offset, uint64_t address, uint64_t file_size,
+                          uint64_t memory_size) {
+    Elf64_Phdr header;
+    memset(&header, 0, sizeof(header));
+    header.p_type = type;
+    header.p_flags = flags;
+    header.p_offset = offset;
+    header.p_vaddr = address;
+    header.p_paddr = address;
+    header.p_filesz = file_size;
+    header.p_memsz = memory_size;
+    header.p_align = type == PT_LOAD ? EXE_PAGE : 16;
+    return header;
+}
+
+int write_elf_executable(AsmUnit* unit, const char* filename, char* error, int error_size) {
+    // Code follows the headers in the first, executable segment; read-only
+    // data and .bss each start a page of their own, so each has one set of
+    // permissions
+    enum { SEGMENT_COUNT = 4 };
+    size_t headers_size = sizeof(Elf64_Ehdr) + SEGMENT_COUNT * sizeof(Elf64_Phdr);
+    uint64_t offset[ASM_SECTION_COUNT];
+    uint64_t base[ASM_SECTION_COUNT];
+    offset[ASM_TEXT] = round_up(headers_size, unit->align[ASM_TEXT]);
+    offset[ASM_RODATA] = round_up(offset[ASM_TEXT] + unit->size[ASM_TEXT], EXE_PAGE);
+    offset[ASM_BSS] = 0;
+    base[ASM_TEXT] = EXE_BASE + offset[ASM_TEXT];
+    base[ASM_RODATA] = EXE_BASE + offset[ASM_RODATA];
+    base[ASM_BSS] = round_up(base[ASM_RODATA] + unit->size[ASM_RODATA], EXE_PAGE);
+
+    for (int i = 0; i < unit->reloc_count; i++) {
+        const AsmReloc* r = &unit->relocs[i];
+        const AsmSymbol* s = &unit->symbols[r->symbol];
+        if (s->section < 0) {
+            snprintf(error, error_size, "undefined symbol %s", s->name);
+            return 0;
+        }
+        if (r->type == ASM_RELOC_GOTPCREL || r->section == ASM_BSS) {
+            snprintf(error, error_size, "unsupported reference to %s", s->name);
+            return 0;
+        }
+        int64_t value = (int64_t)(base[s->section] + s->offset) + r->addend - (int64_t)(base[r->section] + r->offset);
+        if (value < INT32_MIN || value > INT32_MAX) {
+            snprintf(error, error_size, "reference to %s out of range", s->name);
+            return 0;
+        }
+        unsigned char* field = unit->bytes[r->section] + r->offset;
+        for (int b = 0; b < 4; b++) field[b] = (unsigned char)((uint64_t)value >> (8 * b));
+    }
+    int start = asm_find_symbol(unit, "_start");
+    if (start < 0 || unit->symbols[start].section != ASM_TEXT) {
+        snprintf(error, error_size, "no entry point");
+        return 0;
+    }
+
+    static const int shndx[ASM_SECTION_COUNT] = {EXE_TEXT, EXE_RODATA, EXE_BSS};
+    SymbolTable table;
+    build_symbols(unit, shndx, base, 0, &table);
+
+    Buffer image = {NULL, 0, 0};
+    buffer_add(&image, NULL, offset[ASM_TEXT]);
+    buffer_add(&image, unit->bytes[ASM_TEXT], unit->size[ASM_TEXT]);
+    size_t text_end = image.size;
+    buffer_add(&image, NULL, offset[ASM_RODATA] - image.size);
+    buffer_add(&image, unit->bytes[ASM_RODATA], unit->size[ASM_RODATA]);
+
+    Elf64_Phdr segments[SEGMENT_COUNT];
+    segments[0] = segment(PT_LOAD, PF_R | PF_X, 0, EXE_BASE, text_end, text_end);
+    segments[1] = segment(PT_LOAD, PF_R, offset[ASM_RODATA], base[ASM_RODATA], unit->size[ASM_RODATA],
+                          unit->size[ASM_RODATA]);
+    segments[2] = segment(PT_LOAD, PF_R | PF_W, 0, base[ASM_BSS], 0, unit->size[ASM_BSS]);
+    segments[3] = segment(PT_GNU_STACK, PF_R | PF_W, 0, 0, 0, 0);
+
+    // Section headers are not needed to run it, only to look at it
+    Buffer shstrtab = {NULL, 0, 0};
+    uint32_t names[EXE_SECTION_COUNT];
+    names[EXE_NULL] = add_string(&shstrtab, "");
+    for (int s = 0; s < ASM_SECTION_COUNT; s++) names[shndx[s]] = add_string(&shstrtab, section_names[s]);
+    names[EXE_SYMTAB] = add_string(&shstrtab, ".symtab");
+    names[EXE_STRTAB] = add_string(&shstrtab, ".strtab");
+    names[EXE_SHSTRTAB] = add_string(&shstrtab, ".shstrtab");
+    Elf64_Shdr headers[EXE_SECTION_COUNT];
+    memset(headers, 0, sizeof(headers));
+    headers[EXE_TEXT] = section_header(names[EXE_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, base[ASM_TEXT],
+                                       offset[ASM_TEXT], unit->size[ASM_TEXT], unit->align[ASM_TEXT]);
+    headers[EXE_RODATA] = section_header(names[EXE_RODATA], SHT_PROGBITS, SHF_ALLOC, base[ASM_RODATA],
+                                         offset[ASM_RODATA], unit->size[ASM_RODATA], unit->align[ASM_RODATA]);
+    headers[EXE_BSS] = section_header(names[EXE_BSS], SHT_NOBITS, SHF_ALLOC | SHF_WRITE, base[ASM_BSS], image.size,
+                                      unit->size[ASM_BSS], unit->align[ASM_BSS]);
+    size_t at = buffer_align(&image, 8);
+    buffer_add(&image, table.symbols.data, table.symbols.size);
+    headers[EXE_SYMTAB] = section_header(names[EXE_SYMTAB], SHT_SYMTAB, 0, 0, at, table.symbols.size, 8);
+    headers[EXE_SYMTAB].sh_link = EXE_STRTAB;
+    headers[EXE_SYMTAB].sh_info = table.first_global;
+    headers[EXE_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    at = buffer_add(&image, table.names.data, table.names.size);
+    headers[EXE_STRTAB] = section_header(names[EXE_STRTAB], SHT_STRTAB, 0, 0, at, table.names.size, 1);
+    at = buffer_add(&image, shstrtab.data, shstrtab.size);
+    headers[EXE_SHSTRTAB] = section_header(names[EXE_SHSTRTAB], SHT_STRTAB, 0, 0, at, shstrtab.size, 1);
+
+    Elf64_Ehdr header = file_header(ET_EXEC);
+    header.e_entry = base[ASM_TEXT] + unit->symbols[start].offset;
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = SEGMENT_COUNT;
+    header.e_shoff = buffer_align(&image, 8);
+    header.e_shnum = EXE_SECTION_COUNT;
+    header.e_shstrndx = EXE_SHSTRTAB;
+    buffer_add(&image, headers, sizeof(headers));
+    memcpy(image.data, &header, sizeof(header));
+    memcpy(image.data + sizeof(header), segments, sizeof(segments));
+
+    int ok = write_file(&image, filename, 1, error, error_size);
+    free(image.data);
+    free(shstrtab.data);
+    free_symbols(&table);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+
+// Translate and assemble a file; 'runtime' adds the built-in runtime and
+// the stack it needs
+static int compile_unit(const char* filename, int runtime, AsmUnit* unit) {
+    PassManager manager;
+    if (!pass_manager_init(&manager, get_pass_pipeline())) {
+        return 0;
+    }
+    IRProgram* ir = compile_file_to_ir(filename, &manager);
+    pass_manager_free(&manager);
+    if (!ir) {
+        return 0;
+    }
+    char* text = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    if (!out) out_of_memory();
+    // Calls check their depth, as the VM and the JIT do. The runtime an
+    // executable carries runs main on a deep enough stack; an object leaves
+    // that to bc_run_main in runtime/runtime.c.
+    CodegenOptions options = {VM_MAX_FRAMES, NULL, 0, 0, runtime ? 0 : jit_stack_size(ir)};
+    int ok = emit_assembly(ir, &options, out);
+    if (runtime) {
+        fprintf(out, "\n\t.section\t.rodata\n\t.align\t8\n.Lrt_stack_size:\n\t.quad\t%zu\n\n", jit_stack_size(ir));
+        fputs(builtin_runtime, out);
+    }
+    fclose(out);
+    free_ir_program(ir);
+    if (!ok) {
+        free(text);
+        return 0;
+    }
+    ok = assemble(text, unit);
+    free(text);
+    if (!ok) {
+        fprintf(stderr, "Error: Cannot assemble generated code (%s)\n", unit->error);
+        free_asm_unit(unit);
+    }
+    return ok;
+}
+
+int proc_object_file(const char* filename, const char* output) {
+    char* name = NULL;
+    if (!output) {
+        // The source's base name, with .o for its extension
+        const char* base = strrchr(filename, '/');
+        base = base ? base + 1 : filename;
+        const char* dot = strrchr(base, '.');
+        size_t length = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+        name = malloc(length + 3);
+        if (!name) out_of_memory();
+        memcpy(name, base, length);
+        strcpy(name + length, ".o");
+        output = name;
+    }
+    AsmUnit unit;
+    int ok = compile_unit(filename, 0, &unit);
+    if (ok) {
+        char error[160];
+        ok = write_elf_object(&unit, output, error, sizeof(error));
+        if (!ok) {
+            fprintf(stderr, "Error: Could not write %s (%s)\n", output, error);
+        }
+        free_asm_unit(&unit);
+    }
+    free(name);
+    return ok;
+}
+
+int proc_executable_file(const char* filename, const char* output) {
+    AsmUnit unit;
+    if (!compile_unit(filename, 1, &unit)) {
+        return 0;
+    }
+    char error[160];
+    output = output ? output : "a.out";
+    int ok = write_elf_executable(&unit, output, error, sizeof(error));
+    if (!ok) {
+        fprintf(stderr, "Error: Could not write %s (%s)\n", output, error);
+    }
+    free_asm_unit(&unit);
+    return ok;
+}
+#else
+// The ELF definitions and in-memory streams this needs come with Linux;
+// elsewhere -S and a system assembler still work
+int write_elf_object(const AsmUnit* unit, const char* filename, char* error, int error_size) {
+    (void)unit;
+    (void)filename;
+    snprintf(error, error_size, "ELF output is only supported on Linux");
+    return 0;
+}
+
+int write_elf_executable(AsmUnit* unit, const char* filename, char* error, int error_size) {
+    (void)unit;
+    (void)filename;
+    snprintf(error, error_size, "ELF output is only supported on Linux");
+    return 0;
+}
+
+int proc_object_file(const char* filename, const char* output) {
+    (void)output;
+    fprintf(stderr, "Error: Cannot compile %s: ELF output is only supported on Linux; use -S\n", filename);
+    return 0;
+}
+
+int proc_executable_file(const char* filename, const char* output) {
+    (void)output;
+    fprintf(stderr, "Error: Cannot compile %s: ELF output is only supported on Linux; use -S\n", filename);
+    return 0;
+}
+#endif
@@ -0,0 +1,378 @@
+/* fold.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "../../include/fold.h"
+#include "../../include/parser.h"
+#include "../../include/tokens.h"
+
+// Value of a literal
+typedef struct {
+    int is_float;
+    int i;
+    double f;
+} Constant;
+
+// Per-slot facts for one namespace (globals, or one function's locals)
+typedef struct {
+    char* assigned;            // slot -> assigned after its declaration?
+    ASTNode** value;           // slot -> literal the variable always holds (or NULL)
+    int capacity;
+} SlotFacts;
+
+// Pass state
+typedef struct {
+    SlotFacts globals;
+    SlotFacts locals;
+    FoldStats* stats;
+} FoldContext;
+
+// Make sure 'slot' has an entry
+static void reserve_slot(SlotFacts* facts, int slot) {
+    if (slot < facts->capacity) {
+        return;
+    }
+
+    int capacity = facts->capacity ? facts->capacity * 2 : 64;
+    while (capacity <= slot) capacity *= 2;
+    char* assigned = realloc(facts->assigned, capacity);
+    ASTNode** value = realloc(facts->value, capacity * sizeof(ASTNode*));
+    if (!assigned || !value) {
+        fprintf(stderr, "Error: Memory allocation failed for constant folding\n");
+        exit(1);
+    }
+    memset(assigned + facts->capacity, 0, capacity - facts->capacity);
+    memset(value + facts->capacity, 0, (capacity - facts->capacity) * sizeof(ASTNode*));
+    facts->assigned = assigned;
+    facts->value = value;
+    facts->capacity = capacity;
+}
+
+static void clear_facts(SlotFacts* facts) {
+    if (facts->capacity) {
+        memset(facts->assigned, 0, facts->capacity);
+        memset(facts->value, 0, facts->capacity * sizeof(ASTNode*));
+    }
+}
+
+static void free_facts(SlotFacts* facts) {
+    free(facts->assigned);
+    free(facts->value);
+}
+
+// Facts for the variable a resolved node refers to (NULL if unresolved)
+static SlotFacts* facts_for(FoldContext* context, ASTNode* node) {
+    if (node->slot < 0) {
+        return NULL;
+    }
+    SlotFacts* facts = node->scope_depth == 0 ? &context->globals : &context->locals;
+    reserve_slot(facts, node->slot);
+    return facts;
+}
+
+// Mark every variable assigned somewhere in a subtree
+static void find_assignments(FoldContext* context, ASTNode* node, int into_functions) {
+    while (node) {
+        if (node->type == AST_FUNCTION_DECL && !into_functions) {
+            return;
+        }
+        if (node->type == AST_ASSIGN && node->left) {
+            SlotFacts* facts = facts_for(context, node->left);
+            if (facts) facts->assigned[node->left->slot] = 1;
+        }
+        find_assignments(context, node->left, into_functions);
+        node = node->right;
+    }
+}
+
+// Free a subtree, counting the nodes
+static void release(FoldContext* context, ASTNode* node) {
+    while (node) {
+        ASTNode* right = node->right;
+        release(context, node->left);
+        free(node);
+        context->stats->removed++;
+        node = right;
+    }
+}
+
+// Read a literal node
+static int literal_value(const ASTNode* node, Constant* value) {
+    if (!node || node->type != AST_NUMBER) {
+        return 0;
+    }
+
+    char* end;
+    if (node->token.type == TOKEN_FLOAT || strchr(node->token.lexeme, '.')) {
+        value->is_float = 1;
+        value->f = strtod(node->token.lexeme, &end);
+    } else {
+        long long i = strtoll(node->token.lexeme, &end, 10);
+        if (i < INT_MIN || i > INT_MAX) {
+            return 0;
+        }
+        value->is_float = 0;
+        value->i = (int)i;
+        value->f = (double)i;
+    }
+    return *end == '\0' && end != node->token.lexeme;
+}
+
+// Turn a node into a literal, freeing what it held
+static void make_literal(FoldContext* context, ASTNode* node, Constant value) {
+    release(context, node->left);
+    release(context, node->right);
+    node->left = NULL;
+    node->right = NULL;
+    node->type = AST_NUMBER;
+    node->slot = -1;
+    node->scope_depth = -1;
+
+    if (value.is_float) {
+        snprintf(node->token.lexeme, sizeof(node->token.lexeme), "%.17g", value.f);
+        if (!strpbrk(node->token.lexeme, ".e")) {
+            strcat(node->token.lexeme, ".0");
+        }
+        node->token.type = TOKEN_FLOAT;
+        node->static_type = TOKEN_FLOAT_KEY;
+    } else {
+        snprintf(node->token.lexeme, sizeof(node->token.lexeme), "%d", value.i);
+        node->token.type = TOKEN_NUMBER;
+        node->static_type = TOKEN_INT;
+    }
+}
+
+// Give a declaration's literal initializer the type of the variable, as
+// storing it would; returns 0 if it is not a literal or does not fit
+static int convert_initializer(FoldContext* context, ASTNode* decl) {
+    Constant value;
+    if (!literal_value(decl->right, &value)) {
+        return 0;
+    }
+
+    int is_float = decl->static_type == TOKEN_FLOAT_KEY;
+    if (value.is_float == is_float) {
+        return 1;
+    }
+    if (is_float) {
+        value.f = value.i;
+    } else {
+        // Truncate toward zero, like the conversion on store
+        if (!(value.f > (double)INT_MIN - 1.0 && value.f < (double)INT_MAX + 1.0)) {
+            return 0;
+        }
+        value.i = (int)value.f;
+        value.f = value.i;
+    }
+    value.is_float = is_float;
+    make_literal(context, decl->right, value);
+    return 1;
+}
+
+// Apply a binary operator; returns 0 if it cannot be folded
+static int apply_operator(const char* op, Constant a, Constant b, Constant* result) {
+    int is_float = a.is_float || b.is_float;
+    result->is_float = 0;
+
+    // Comparisons and logic give an int either way
+    int truth;
+    if (strcmp(op, "==") == 0) truth = a.f == b.f;
+    else if (strcmp(op, "!=") == 0) truth = a.f != b.f;
+    else if (strcmp(op, ">=") == 0) truth = a.f >= b.f;
+    else if (strcmp(op, "<=") == 0) truth = a.f <= b.f;
+    else if (strcmp(op, ">") == 0) truth = a.f > b.f;
+    else if (strcmp(op, "<") == 0) truth = a.f < b.f;
+    else if (strcmp(op, "&&") == 0) truth = a.f != 0 && b.f != 0;
+    else if (strcmp(op, "||") == 0) truth = a.f != 0 || b.f != 0;
+    else truth = -1;
+    if (truth >= 0) {
+        result->i = truth;
+        result->f = truth;
+        return 1;
+    }
+
+    if (op[0] == '\0' || op[1] != '\0') {
+        return 0;
+    }
+
+    if (is_float) {
+        switch (op[0]) {
+            case '+': result->f = a.f + b.f; break;
+            case '-': result->f = a.f - b.f; break;
+            case '*': result->f = a.f * b.f; break;
+            case '/': result->f = a.f / b.f; break;
+            default: return 0;
+        }
+        result->is_float = 1;
+        return isfinite(result->f);
+    }
+
+    // Wrap like 32-bit ints instead of overflowing
+    unsigned int x = (unsigned int)a.i;
+    unsigned int y = (unsigned int)b.i;
+    switch (op[0]) {
+        case '+': result->i = (int)(x + y); break;
+        case '-': result->i = (int)(x - y); break;
+        case '*': result->i = (int)(x * y); break;
+        case '/':
+            if (a.i == INT_MIN && b.i == -1) return 0;
+            result->i = a.i / b.i;
+            break;
+        default: return 0;
+    }
+    result->f = result->i;
+    return 1;
+}
+
+// Fold an expression in place
+static void fold_expression(FoldContext* context, ASTNode* node) {
+    if (!node) {
+        return;
+    }
+
+    switch (node->type) {
+        case AST_IDENTIFIER: {
+            SlotFacts* facts = facts_for(context, node);
+            ASTNode* value = facts ? facts->value[node->slot] : NULL;
+            if (value) {
+                node->type = AST_NUMBER;
+                node->token.type = value->token.type;
+                strcpy(node->token.lexeme, value->token.lexeme);
+                node->static_type = value->static_type;
+                node->slot = -1;
+                node->scope_depth = -1;
+                context->stats->propagated++;
+            }
+            break;
+        }
+
+        case AST_BINOP: {
+            // A literal zero divisor was already reported by the checker
+            int literal_divisor = node->right && node->right->type == AST_NUMBER;
+            Constant a, b, result;
+
+            fold_expression(context, node->left);
+            fold_expression(context, node->right);
+            if (strcmp(node->token.lexeme, "/") == 0 && literal_value(node->right, &b) && b.f == 0) {
+                // The division may never run, so it is left to fail at run time
+                if (!literal_divisor) {
+                    context->stats->division_by_zero++;
+                }
+                break;
+            }
+            if (!literal_value(node->left, &a) || !literal_value(node->right, &b)) {
+                break;
+            }
+            if (apply_operator(node->token.lexeme, a, b, &result)) {
+                make_literal(context, node, result);
+                context->stats->folded++;
+            }
+            break;
+        }
+
+        case AST_FACTORIAL: {
+            Constant argument;
+
+            fold_expression(context, node->left);
+            if (literal_value(node->left, &argument) && !argument.is_float &&
+                argument.i >= 0 && argument.i <= 12) {
+                Constant result = {0, 1, 1};
+                for (int k = 2; k <= argument.i; k++) result.i *= k;
+                result.f = result.i;
+                make_literal(context, node, result);
+                context->stats->folded++;
+            }
+            break;
+        }
+
+        case AST_FUNCTION_CALL:
+            fold_expression(context, node->left);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Fold the statements of a program, block or function body
+static void fold_statements(FoldContext* context, ASTNode* node) {
+    while (node) {
+        switch (node->type) {
+            case AST_PROGRAM:
+            case AST_BLOCK:
+                fold_statements(context, node->left);
+                node = node->right;
+                continue;
+
+            case AST_FUNCTION_DECL:
+                // Locals are numbered per function, so start afresh
+                clear_facts(&context->locals);
+                find_assignments(context, node->right, 0);
+                fold_statements(context, node->right);
+                clear_facts(&context->locals);
+                break;
+
+            case AST_VARDECL: {
+                fold_expression(context, node->right);
+                SlotFacts* facts = facts_for(context, node);
+                if (facts && !facts->assigned[node->slot] && convert_initializer(context, node)) {
+                    facts->value[node->slot] = node->right;
+                }
+                break;
+            }
+
+            case AST_ASSIGN:
+                fold_expression(context, node->right);
+                break;
+
+            case AST_IF:
+                fold_expression(context, node->left);
+                if (node->right && node->right->type == AST_ELSE) {
+                    fold_statements(context, node->right->left);
+                    fold_statements(context, node->right->right);
+                } else {
+                    fold_statements(context, node->right);
+                }
+                break;
+
+            case AST_WHILE:
+                fold_expression(context, node->left);
+                fold_statements(context, node->right);
+                break;
+
+            case AST_FOR: // repeat-until
+                fold_statements(context, node->left);
+                fold_expression(context, node->right);
+                break;
+
+            case AST_PRINT:
+            case AST_RETURN:
+                fold_expression(context, node->left);
+                break;
+
+            default:
+                fold_expression(context, node);
+                break;
+        }
+        return;
+    }
+}
+
+// Fold constant expressions and propagate never-reassigned variables
+void fold_constants(ASTNode* ast, FoldStats* stats) {
+    FoldContext context;
+    memset(&context, 0, sizeof(context));
+    memset(stats, 0, sizeof(*stats));
+    context.stats = stats;
+
+    // Globals can be assigned from any function
+    find_assignments(&context, ast, 1);
+    clear_facts(&context.locals);
+
+    fold_statements(&context, ast);
+
+    free_facts(&context.globals);
+    free_facts(&context.locals);
+}
@@ -0,0 +1,242 @@
+/* gvn.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/gvn.h"
+#include "../../include/ir.h"
+
+// Undo log entry: a hash table slot to clear (slot < 0, at -slot - 1) or
+// the previous value known for a global
+typedef struct {
+    int slot;
+    IRInstr* value;
+} UndoEntry;
+
+typedef struct {
+    IRFunction* function;
+    IRInstr** table;           // Open addressing, linear probing
+    unsigned int mask;
+    IRInstr** memory;          // Value each global is known to hold (or NULL)
+    int global_count;
+    UndoEntry* log;
+    int log_count;
+    int log_capacity;
+    int eliminated;
+} Numbering;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for value numbering\n");
+    exit(1);
+}
+
+static void push_undo(Numbering* numbering, int slot, IRInstr* value) {
+    if (numbering->log_count == numbering->log_capacity) {
+        numbering->log_capacity = numbering->log_capacity ? numbering->log_capacity * 2 : 64;
+        numbering->log = realloc(numbering->log, numbering->log_capacity * sizeof(UndoEntry));
+        if (!numbering->log) out_of_memory();
+    }
+    numbering->log[numbering->log_count].slot = slot;
+    numbering->log[numbering->log_count].value = value;
+    numbering->log_count++;
+}
+
+// Operations whose result depends only on their operands
+static int is_pure(const IRInstr* instr) {
+    switch (instr->op) {
+        case IR_CONST:
+        case IR_PARAM:
+        case IR_PHI:
+            return 1;
+        default:
+            return instr->op >= IR_ADD && instr->op <= IR_FACT;
+    }
+}
+
+static int is_commutative(IROp op) {
+    return op == IR_ADD || op == IR_MUL || op == IR_EQ || op == IR_NE || op == IR_AND || op == IR_OR;
+}
+
+// Operand i, with commutative operands in value-number order
+static IRInstr* operand(const IRInstr* instr, int i) {
+    if (instr->arg_count == 2 && is_commutative(instr->op) &&
+        instr->args[0]->id > instr->args[1]->id) {
+        return instr->args[1 - i];
+    }
+    return instr->args[i];
+}
+
+static unsigned int hash_expression(const IRInstr* instr) {
+    unsigned int hash = 2166136261u ^ (instr->op * 31u + instr->type);
+    if (instr->op == IR_CONST) {
+        if (instr->type == IR_STR) {
+            for (const char* s = instr->imm.s; *s; s++) hash = (hash ^ (unsigned char)*s) * 16777619u;
+        } else if (instr->type == IR_FLOAT) {
+            unsigned char bytes[sizeof(double)];
+            memcpy(bytes, &instr->imm.f, sizeof(double));
+            for (size_t k = 0; k < sizeof(double); k++) hash = (hash ^ bytes[k]) * 16777619u;
+        } else {
+            hash = (hash ^ (unsigned int)instr->imm.i) * 16777619u;
+        }
+    } else if (instr->op == IR_PARAM) {
+        hash = (hash ^ (unsigned int)instr->index) * 16777619u;
+    } else if (instr->op == IR_PHI) {
+        hash = (hash ^ (unsigned int)instr->block) * 16777619u;
+    }
+    for (int a = 0; a < instr->arg_count; a++) {
+        hash = (hash ^ (unsigned int)operand(instr, a)->id) * 16777619u;
+    }
+    return hash;
+}
+
+static int same_expression(const IRInstr* a, const IRInstr* b) {
+    if (a->op != b->op || a->type != b->type || a->arg_count != b->arg_count) {
+        return 0;
+    }
+    if (a->op == IR_CONST) {
+        if (a->type == IR_STR) return strcmp(a->imm.s, b->imm.s) == 0;
+        if (a->type == IR_FLOAT) return memcmp(&a->imm.f, &b->imm.f, sizeof(double)) == 0;
+        return a->imm.i == b->imm.i;
+    }
+    if (a->op == IR_PARAM && a->index != b->index) {
+        return 0;
+    }
+    // Phis only agree within one block, where their operands line up
+    if (a->op == IR_PHI && a->block != b->block) {
+        return 0;
+    }
+    for (int i = 0; i < a->arg_count; i++) {
+        if (operand(a, i) != operand(b, i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The earlier instruction computing the same value, or NULL after
+// recording this one as available in the current subtree
+static IRInstr* find_or_add(Numbering* numbering, IRInstr* instr) {
+    unsigned int slot = hash_expression(instr) & numbering->mask;
+    while (numbering->table[slot]) {
+        if (same_expression(numbering->table[slot], instr)) {
+            return numbering->table[slot];
+        }
+        slot = (slot + 1) & numbering->mask;
+    }
+    numbering->table[slot] = instr;
+    push_undo(numbering, -(int)slot - 1, NULL);
+    return NULL;
+}
+
+static void set_memory(Numbering* numbering, int global, IRInstr* value) {
+    if (global < 0 || global >= numbering->global_count || numbering->memory[global] == value) {
+        return;
+    }
+    push_undo(numbering, global, numbering->memory[global]);
+    numbering->memory[global] = value;
+}
+
+// Forget every global (a call may store to any of them)
+static void clear_memory(Numbering* numbering) {
+    for (int g = 0; g < numbering->global_count; g++) {
+        set_memory(numbering, g, NULL);
+    }
+}
+
+static void number_block(Numbering* numbering, int b) {
+    IRBlock* block = &numbering->function->blocks[b];
+
+    // Values known for globals only carry into a block its dominator alone
+    // flows into; at a join another path may have stored something else
+    if (block->pred_count != 1) {
+        clear_memory(numbering);
+    }
+
+    for (int i = 0; i < block->count; i++) {
+        IRInstr* instr = block->code[i];
+        for (int a = 0; a < instr->arg_count; a++) {
+            instr->args[a] = ir_resolve(instr->args[a]);
+        }
+
+        if (instr->op == IR_LOAD) {
+            IRInstr* known = instr->index < numbering->global_count ? numbering->memory[instr->index] : NULL;
+            if (known && known->type == instr->type) {
+                instr->replacement = known;
+                numbering->eliminated++;
+            } else {
+                set_memory(numbering, instr->index, instr);
+            }
+        } else if (instr->op == IR_STORE) {
+            set_memory(numbering, instr->index, instr->args[0]);
+        } else if (instr->op == IR_CALL) {
+            clear_memory(numbering);
+        } else if (is_pure(instr)) {
+            IRInstr* earlier = find_or_add(numbering, instr);
+            if (earlier) {
+                instr->replacement = earlier;
+                numbering->eliminated++;
+            }
+        }
+    }
+}
+
+int gvn_pass(IRFunction* function, int* changes) {
+    CFG* dom = ir_dominators(function);
+    int blocks = function->block_count;
+
+    Numbering numbering;
+    memset(&numbering, 0, sizeof(numbering));
+    numbering.function = function;
+    unsigned int size = 64;
+    while (size < 2u * (unsigned int)function->value_count + 2) size *= 2;
+    numbering.mask = size - 1;
+    numbering.table = calloc(size, sizeof(IRInstr*));
+    for (int b = 0; b < blocks; b++) {
+        for (int i = 0; i < function->blocks[b].count; i++) {
+            IRInstr* instr = function->blocks[b].code[i];
+            if ((instr->op == IR_LOAD || instr->op == IR_STORE) && instr->index >= numbering.global_count) {
+                numbering.global_count = instr->index + 1;
+            }
+        }
+    }
+    numbering.memory = calloc(numbering.global_count + 1, sizeof(IRInstr*));
+    int* stack = malloc((2 * blocks + 2) * sizeof(int));
+    if (!numbering.table || !numbering.memory || !stack) out_of_memory();
+
+    // Walk the dominator tree; leaving a block undoes what it made available
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        int entry = stack[--depth];
+        if (entry < 0) {
+            int mark = -entry - 1;
+            while (numbering.log_count > mark) {
+                UndoEntry* undo = &numbering.log[--numbering.log_count];
+                if (undo->slot < 0) {
+                    numbering.table[-undo->slot - 1] = NULL;
+                } else {
+                    numbering.memory[undo->slot] = undo->value;
+                }
+            }
+            continue;
+        }
+
+        stack[depth++] = -numbering.log_count - 1;
+        number_block(&numbering, entry);
+        BasicBlock* node = &dom->blocks[entry];
+        for (int c = node->dom_child_count - 1; c >= 0; c--) {
+            stack[depth++] = dom->dom_tree[node->dom_children + c];
+        }
+    }
+
+    if (numbering.eliminated) {
+        ir_apply_replacements(function);
+    }
+
+    free(numbering.table);
+    free(numbering.memory);
+    free(numbering.log);
+    free(stack);
+
+    *changes += numbering.eliminated;
+    return IR_ANALYSIS_DOMINATORS;
+}
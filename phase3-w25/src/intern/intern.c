@@ -0,0 +1,141 @@
+/* intern.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/intern.h"
+
+// Exit on allocation failure, like the parser does for AST nodes
+static void *checked_realloc(void *ptr, size_t size) {
+    void *result = realloc(ptr, size);
+    if (!result) {
+        fprintf(stderr, "Error: Memory allocation failed for string table\n");
+        exit(1);
+    }
+    return result;
+}
+
+// FNV-1a hash of a NUL-terminated string
+static unsigned int hash_string(const char *name) {
+    unsigned int hash = 2166136261u;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Slot holding 'name', or the empty slot where it would go
+static int find_slot(const StringTable *table, const char *name, unsigned int hash) {
+    int mask = table->slot_count - 1;
+    int slot = (int)(hash & (unsigned int)mask);
+
+    while (table->slots[slot]) {
+        int id = table->slots[slot] - 1;
+        if (table->hashes[id] == hash && strcmp(table->chars + table->offsets[id], name) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Double the slot array and re-insert every id
+static void grow_slots(StringTable *table) {
+    int slot_count = table->slot_count * 2;
+    int mask = slot_count - 1;
+
+    free(table->slots);
+    table->slots = calloc(slot_count, sizeof(int));
+    if (!table->slots) {
+        fprintf(stderr, "Error: Memory allocation failed for string table\n");
+        exit(1);
+    }
+    table->slot_count = slot_count;
+
+    for (int id = 0; id < table->count; id++) {
+        int slot = (int)(table->hashes[id] & (unsigned int)mask);
+        while (table->slots[slot]) {
+            slot = (slot + 1) & mask;
+        }
+        table->slots[slot] = id + 1;
+    }
+}
+
+// Create an empty string table
+StringTable *intern_create(void) {
+    StringTable *table = calloc(1, sizeof(StringTable));
+    if (!table) {
+        fprintf(stderr, "Error: Memory allocation failed for string table\n");
+        exit(1);
+    }
+    table->slot_count = 64;
+    table->slots = calloc(table->slot_count, sizeof(int));
+    if (!table->slots) {
+        fprintf(stderr, "Error: Memory allocation failed for string table\n");
+        exit(1);
+    }
+    return table;
+}
+
+// Return the id of 'name', adding it if it is new
+int intern_string(StringTable *table, const char *name) {
+    unsigned int hash = hash_string(name);
+    int slot = find_slot(table, name, hash);
+    if (table->slots[slot]) {
+        return table->slots[slot] - 1;
+    }
+
+    int length = (int)strlen(name) + 1;
+    if (table->chars_used + length > table->chars_capacity) {
+        int capacity = table->chars_capacity ? table->chars_capacity : 1024;
+        while (capacity < table->chars_used + length) {
+            capacity *= 2;
+        }
+        table->chars = checked_realloc(table->chars, capacity);
+        table->chars_capacity = capacity;
+    }
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 64;
+        table->offsets = checked_realloc(table->offsets, table->capacity * sizeof(int));
+        table->hashes = checked_realloc(table->hashes, table->capacity * sizeof(unsigned int));
+    }
+
+    int id = table->count++;
+    memcpy(table->chars + table->chars_used, name, length);
+    table->offsets[id] = table->chars_used;
+    table->hashes[id] = hash;
+    table->chars_used += length;
+    table->slots[slot] = id + 1;
+
+    // Keep the load factor at or below one half
+    if (table->count * 2 > table->slot_count) {
+        grow_slots(table);
+    }
+    return id;
+}
+
+// Return the id of 'name', or -1 if it was never interned
+int intern_find(const StringTable *table, const char *name) {
+    int slot = find_slot(table, name, hash_string(name));
+    return table->slots[slot] - 1;
+}
+
+// String for an id (valid until the next intern_string call)
+const char *intern_name(const StringTable *table, int id) {
+    if (id < 0 || id >= table->count) {
+        return NULL;
+    }
+    return table->chars + table->offsets[id];
+}
+
+// Release the string table
+void intern_free(StringTable *table) {
+    if (!table) {
+        return;
+    }
+    free(table->chars);
+    free(table->offsets);
+    free(table->hashes);
+    free(table->slots);
+    free(table);
+}
@@ -0,0 +1,1085 @@
+/* ir.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "../../include/ir.h"
+#include "../../include/cfg.h"
+#include "../../include/parser.h"
+#include "../../include/tokens.h"
+
+#define IR_CHUNK_SIZE (64 * 1024)
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for IR\n");
+    exit(1);
+}
+
+// Bump-allocate from the function's arena
+static void* ir_alloc(IRFunction* function, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    IRChunk* chunk = function->arena;
+    if (!chunk || chunk->used + size > chunk->size) {
+        size_t capacity = size > IR_CHUNK_SIZE ? size : IR_CHUNK_SIZE;
+        chunk = malloc(sizeof(IRChunk) + capacity);
+        if (!chunk) out_of_memory();
+        chunk->next = function->arena;
+        chunk->used = 0;
+        chunk->size = capacity;
+        function->arena = chunk;
+    }
+    void* memory = chunk->data + chunk->used;
+    chunk->used += size;
+    memset(memory, 0, size);
+    return memory;
+}
+
+static char* ir_strdup(IRFunction* function, const char* text) {
+    char* copy = ir_alloc(function, strlen(text) + 1);
+    strcpy(copy, text);
+    return copy;
+}
+
+// New instruction with room for arg_count operands; not yet in a block
+IRInstr* ir_new_instr(IRFunction* function, IROp op, IRType type, int arg_count) {
+    IRInstr* instr = ir_alloc(function, sizeof(IRInstr) + arg_count * sizeof(IRInstr*));
+    instr->op = op;
+    instr->type = type;
+    instr->id = function->value_count++;
+    instr->block = -1;
+    instr->index = -1;
+    instr->arg_count = arg_count;
+    instr->args = (IRInstr**)(instr + 1);
+    return instr;
+}
+
+IRInstr* ir_const_int(IRFunction* function, int value) {
+    IRInstr* instr = ir_new_instr(function, IR_CONST, IR_INT, 0);
+    instr->imm.i = value;
+    return instr;
+}
+
+IRInstr* ir_const_float(IRFunction* function, double value) {
+    IRInstr* instr = ir_new_instr(function, IR_CONST, IR_FLOAT, 0);
+    instr->imm.f = value;
+    return instr;
+}
+
+// Put an instruction into a block before 'position' (-1 appends)
+void ir_insert(IRFunction* function, int block, int position, IRInstr* instr) {
+    IRBlock* b = &function->blocks[block];
+    if (b->count == b->capacity) {
+        b->capacity = b->capacity ? b->capacity * 2 : 8;
+        b->code = realloc(b->code, b->capacity * sizeof(IRInstr*));
+        if (!b->code) out_of_memory();
+    }
+    if (position < 0 || position > b->count) {
+        position = b->count;
+    }
+    memmove(b->code + position + 1, b->code + position, (b->count - position) * sizeof(IRInstr*));
+    b->code[position] = instr;
+    b->count++;
+    instr->block = block;
+}
+
+static void add_pred(IRFunction* function, int block, int pred) {
+    IRBlock* b = &function->blocks[block];
+    if (b->pred_count == b->pred_capacity) {
+        b->pred_capacity = b->pred_capacity ? b->pred_capacity * 2 : 4;
+        b->preds = realloc(b->preds, b->pred_capacity * sizeof(int));
+        if (!b->preds) out_of_memory();
+    }
+    b->preds[b->pred_count++] = pred;
+}
+
+// The zero an unset variable of this type reads as; placed in the entry
+// block by whoever first needs it
+static IRInstr* undefined_value(IRFunction* function, IRType type) {
+    if (!function->undefined[type]) {
+        function->undefined[type] = type == IR_FLOAT ? ir_const_float(function, 0.0)
+                                                     : ir_const_int(function, 0);
+    }
+    return function->undefined[type];
+}
+
+// Follow replacements to the value that stands for 'value' now
+IRInstr* ir_resolve(IRInstr* value) {
+    while (value && value->replacement) {
+        value = value->replacement;
+    }
+    return value;
+}
+
+// Rewrite operands through replacements and drop the replaced instructions;
+// returns how many were dropped
+int ir_apply_replacements(IRFunction* function) {
+    int removed = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        IRBlock* block = &function->blocks[b];
+        int kept = 0;
+        for (int i = 0; i < block->count; i++) {
+            IRInstr* instr = block->code[i];
+            for (int a = 0; a < instr->arg_count; a++) {
+                instr->args[a] = ir_resolve(instr->args[a]);
+            }
+            if (instr->replacement) {
+                removed++;
+                continue;
+            }
+            block->code[kept++] = instr;
+        }
+        block->count = kept;
+    }
+    return removed;
+}
+
+// Drop the edge from -> to, along with the phi operands it fed
+void ir_remove_edge(IRFunction* function, int from, int to) {
+    IRBlock* source = &function->blocks[from];
+    for (int s = 0; s < source->succ_count; s++) {
+        if (source->succ[s] == to) {
+            for (; s < source->succ_count - 1; s++) {
+                source->succ[s] = source->succ[s + 1];
+            }
+            source->succ_count--;
+            break;
+        }
+    }
+
+    IRBlock* target = &function->blocks[to];
+    for (int p = 0; p < target->pred_count; p++) {
+        if (target->preds[p] != from) {
+            continue;
+        }
+        memmove(target->preds + p, target->preds + p + 1, (target->pred_count - p - 1) * sizeof(int));
+        target->pred_count--;
+        for (int i = 0; i < target->count && target->code[i]->op == IR_PHI; i++) {
+            IRInstr* phi = target->code[i];
+            memmove(phi->args + p, phi->args + p + 1, (phi->arg_count - p - 1) * sizeof(IRInstr*));
+            phi->arg_count--;
+        }
+        break;
+    }
+}
+
+// Delete a block nothing jumps to any more
+void ir_remove_block(IRFunction* function, int block) {
+    IRBlock* b = &function->blocks[block];
+    while (b->succ_count > 0) {
+        ir_remove_edge(function, block, b->succ[0]);
+    }
+    while (b->pred_count > 0) {
+        ir_remove_edge(function, b->preds[0], block);
+    }
+    b->count = 0;
+    b->dead = 1;
+}
+
+// Must the instruction stay even if its value is unused?
+int ir_has_side_effects(const IRInstr* instr) {
+    switch (instr->op) {
+        case IR_STORE:
+        case IR_CALL:
+        case IR_PRINT:
+        case IR_SET:
+        case IR_JUMP:
+        case IR_BRANCH:
+        case IR_RETURN:
+            return 1;
+        case IR_DIV: {
+            // An int division can fault unless the divisor is a known non-zero
+            const IRInstr* divisor = instr->args[1];
+            return instr->type == IR_INT && !(divisor->op == IR_CONST && divisor->imm.i != 0);
+        }
+        default:
+            return 0;
+    }
+}
+
+// Dominators, frontiers and loop depths of the current block graph
+CFG* ir_dominators(IRFunction* function) {
+    if (function->dominators) {
+        return function->dominators;
+    }
+
+    int edges = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        edges += function->blocks[b].succ_count;
+    }
+    int* from = malloc((edges + 1) * sizeof(int));
+    int* to = malloc((edges + 1) * sizeof(int));
+    if (!from || !to) out_of_memory();
+    edges = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        for (int s = 0; s < function->blocks[b].succ_count; s++) {
+            from[edges] = b;
+            to[edges] = function->blocks[b].succ[s];
+            edges++;
+        }
+    }
+
+    function->dominators = build_cfg_from_edges(function->block_count, from, to, edges);
+    cfg_dominance_frontiers(function->dominators);
+    free(from);
+    free(to);
+    return function->dominators;
+}
+
+// Number of operands referring to each value, by value number
+const int* ir_use_counts(IRFunction* function) {
+    if (function->use_counts) {
+        return function->use_counts;
+    }
+
+    function->use_counts = calloc(function->value_count + 1, sizeof(int));
+    if (!function->use_counts) out_of_memory();
+    for (int b = 0; b < function->block_count; b++) {
+        IRBlock* block = &function->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            for (int a = 0; a < block->code[i]->arg_count; a++) {
+                function->use_counts[block->code[i]->args[a]->id]++;
+            }
+        }
+    }
+    return function->use_counts;
+}
+
+// Drop cached analyses other than those in 'kept'
+void ir_invalidate(IRFunction* function, int kept) {
+    if (!(kept & IR_ANALYSIS_DOMINATORS)) {
+        free_cfg(function->dominators);
+        function->dominators = NULL;
+    }
+    if (!(kept & IR_ANALYSIS_USES)) {
+        free(function->use_counts);
+        function->use_counts = NULL;
+    }
+}
+
+// Lowering state for one function
+typedef struct {
+    IRProgram* program;
+    IRFunction* function;
+    ASTNode** declarations;    // Top-level function declarations, by function index
+    int declaration_count;
+    int block;                 // Block receiving code
+    int next_temporary;        // Next local slot free for the lowering's own use
+} Lowering;
+
+static IRInstr* emit(Lowering* lowering, IROp op, IRType type, int arg_count, int line) {
+    IRInstr* instr = ir_new_instr(lowering->function, op, type, arg_count);
+    instr->line = line;
+    ir_insert(lowering->function, lowering->block, -1, instr);
+    return instr;
+}
+
+static IRInstr* emit_const_int(Lowering* lowering, int value, int line) {
+    IRInstr* instr = emit(lowering, IR_CONST, IR_INT, 0, line);
+    instr->imm.i = value;
+    return instr;
+}
+
+// IR type of a variable or expression with the given static type
+static IRType ir_type_of(int static_type) {
+    if (static_type == TOKEN_FLOAT_KEY || static_type == TOKEN_DOUBLE) {
+        return IR_FLOAT;
+    }
+    if (static_type == TOKEN_STRING) {
+        return IR_STR;
+    }
+    return IR_INT;
+}
+
+static IRInstr* convert(Lowering* lowering, IRInstr* value, IRType type, int line) {
+    if (value->type == type || type == IR_VOID) {
+        return value;
+    }
+    if (value->type == IR_INT && type == IR_FLOAT) {
+        IRInstr* instr = emit(lowering, IR_ITOF, IR_FLOAT, 1, line);
+        instr->args[0] = value;
+        return instr;
+    }
+    if (value->type == IR_FLOAT && type == IR_INT) {
+        IRInstr* instr = emit(lowering, IR_FTOI, IR_INT, 1, line);
+        instr->args[0] = value;
+        return instr;
+    }
+    return emit_const_int(lowering, 0, line);
+}
+
+// An int that is non-zero exactly when 'value' is
+static IRInstr* truth_value(Lowering* lowering, IRInstr* value, int line) {
+    if (value->type != IR_FLOAT) {
+        return value;
+    }
+    IRInstr* zero = emit(lowering, IR_CONST, IR_FLOAT, 0, line);
+    zero->imm.f = 0.0;
+    IRInstr* instr = emit(lowering, IR_NE, IR_INT, 2, line);
+    instr->args[0] = value;
+    instr->args[1] = zero;
+    return instr;
+}
+
+static void note_local(Lowering* lowering, int slot) {
+    if (slot >= lowering->function->local_count) {
+        lowering->function->local_count = slot + 1;
+    }
+}
+
+// Append an empty block to the function being lowered
+static int new_block(Lowering* lowering) {
+    IRFunction* function = lowering->function;
+    IRBlock* blocks = realloc(function->blocks, (function->block_count + 1) * sizeof(IRBlock));
+    if (!blocks) out_of_memory();
+    function->blocks = blocks;
+    memset(&blocks[function->block_count], 0, sizeof(IRBlock));
+    return function->block_count++;
+}
+
+// Add the edge from -> to; a branch's true target goes first
+static void add_edge(Lowering* lowering, int from, int to) {
+    IRBlock* block = &lowering->function->blocks[from];
+    block->succ[block->succ_count++] = to;
+    add_pred(lowering->function, to, from);
+}
+
+// 1 if 'value' is non-zero, else 0
+static IRInstr* boolean_value(Lowering* lowering, IRInstr* value, int line) {
+    if (value->type == IR_STR) {
+        return emit_const_int(lowering, 0, line);
+    }
+    if (value->type == IR_FLOAT || (value->op >= IR_EQ && value->op <= IR_OR)) {
+        return truth_value(lowering, value, line);
+    }
+    IRInstr* zero = emit_const_int(lowering, 0, line);
+    IRInstr* instr = emit(lowering, IR_NE, IR_INT, 2, line);
+    instr->args[0] = value;
+    instr->args[1] = zero;
+    return instr;
+}
+
+static int find_function(Lowering* lowering, const char* name) {
+    for (int i = 0; i < lowering->declaration_count; i++) {
+        if (strcmp(lowering->declarations[i]->token.lexeme, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Binary operator lexeme -> opcode (-1 if unknown)
+static int binary_op(const char* lexeme) {
+    static const struct {
+        const char* lexeme;
+        IROp op;
+    } ops[] = {
+        {"+", IR_ADD}, {"-", IR_SUB}, {"*", IR_MUL}, {"/", IR_DIV},
+        {"==", IR_EQ}, {"!=", IR_NE}, {"<", IR_LT}, {"<=", IR_LE},
+        {">", IR_GT}, {">=", IR_GE}, {"&&", IR_AND}, {"||", IR_OR}
+    };
+    for (int i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++) {
+        if (strcmp(ops[i].lexeme, lexeme) == 0) {
+            return ops[i].op;
+        }
+    }
+    return -1;
+}
+
+static IRInstr* lower_expression(Lowering* lowering, ASTNode* node);
+
+// a && b and a || b evaluate b only when a leaves the result open. The
+// result goes through a local of the lowering's own, which SSA
+// construction turns into a phi where the two paths meet.
+static IRInstr* lower_logic(Lowering* lowering, ASTNode* node, int is_and) {
+    int line = node->token.line;
+    int result = lowering->next_temporary++;
+    note_local(lowering, result);
+
+    // When a decides, the result is a itself: 0 for &&, 1 for ||
+    IRInstr* left = boolean_value(lowering, lower_expression(lowering, node->left), line);
+    IRInstr* set = emit(lowering, IR_SET, IR_INT, 1, line);
+    set->args[0] = left;
+    set->index = result;
+    IRInstr* branch = emit(lowering, IR_BRANCH, IR_VOID, 1, line);
+    branch->args[0] = left;
+    int from = lowering->block;
+    int rest = new_block(lowering);
+    int join = new_block(lowering);
+    add_edge(lowering, from, is_and ? rest : join);
+    add_edge(lowering, from, is_and ? join : rest);
+
+    lowering->block = rest;
+    IRInstr* right = boolean_value(lowering, lower_expression(lowering, node->right), line);
+    set = emit(lowering, IR_SET, IR_INT, 1, line);
+    set->args[0] = right;
+    set->index = result;
+    emit(lowering, IR_JUMP, IR_VOID, 0, line);
+    add_edge(lowering, lowering->block, join);
+
+    lowering->block = join;
+    IRInstr* get = emit(lowering, IR_GET, IR_INT, 0, line);
+    get->index = result;
+    return get;
+}
+
+static IRInstr* lower_expression(Lowering* lowering, ASTNode* node) {
+    if (!node) {
+        return emit_const_int(lowering, 0, 0);
+    }
+    int line = node->token.line;
+
+    switch (node->type) {
+        case AST_NUMBER: {
+            const char* text = node->token.lexeme;
+            if (node->token.type == TOKEN_FLOAT || strpbrk(text, ".eE")) {
+                IRInstr* instr = emit(lowering, IR_CONST, IR_FLOAT, 0, line);
+                instr->imm.f = strtod(text, NULL);
+                return instr;
+            }
+            return emit_const_int(lowering, (int)(unsigned int)strtoll(text, NULL, 10), line);
+        }
+
+        case AST_STRING: {
+            IRInstr* instr = emit(lowering, IR_CONST, IR_STR, 0, line);
+            instr->imm.s = ir_strdup(lowering->function, node->token.lexeme);
+            return instr;
+        }
+
+        case AST_IDENTIFIER: {
+            if (node->slot < 0) {
+                return emit_const_int(lowering, 0, line);
+            }
+            IRInstr* instr;
+            if (node->scope_depth == 0) {
+                instr = emit(lowering, IR_LOAD, IR_INT, 0, line);
+            } else {
+                instr = emit(lowering, IR_GET, ir_type_of(node->static_type), 0, line);
+                note_local(lowering, node->slot);
+            }
+            instr->index = node->slot;
+            return instr;
+        }
+
+        case AST_BINOP: {
+            int op = binary_op(node->token.lexeme);
+            if (op == IR_AND || op == IR_OR) {
+                return lower_logic(lowering, node, op == IR_AND);
+            }
+            IRInstr* left = lower_expression(lowering, node->left);
+            IRInstr* right = lower_expression(lowering, node->right);
+            if (op < 0 || left->type == IR_STR || right->type == IR_STR) {
+                return emit_const_int(lowering, 0, line);
+            }
+
+            // An int operand meeting a float is promoted
+            IRType operands = left->type == IR_FLOAT || right->type == IR_FLOAT ? IR_FLOAT : IR_INT;
+            left = convert(lowering, left, operands, line);
+            right = convert(lowering, right, operands, line);
+            IRType type = op >= IR_EQ ? IR_INT : operands;
+            IRInstr* instr = emit(lowering, op, type, 2, line);
+            instr->args[0] = left;
+            instr->args[1] = right;
+            return instr;
+        }
+
+        case AST_FACTORIAL: {
+            IRInstr* argument = convert(lowering, lower_expression(lowering, node->left), IR_INT, line);
+            IRInstr* instr = emit(lowering, IR_FACT, IR_INT, 1, line);
+            instr->args[0] = argument;
+            return instr;
+        }
+
+        case AST_FUNCTION_CALL: {
+            IRInstr* argument = node->left ? lower_expression(lowering, node->left) : NULL;
+            if (argument) {
+                argument = convert(lowering, argument, IR_INT, line);
+            }
+            IRInstr* instr = emit(lowering, IR_CALL, IR_INT, argument ? 1 : 0, line);
+            if (argument) {
+                instr->args[0] = argument;
+            }
+            instr->index = find_function(lowering, node->token.lexeme);
+            instr->imm.s = ir_strdup(lowering->function, node->token.lexeme);
+            return instr;
+        }
+
+        default:
+            return emit_const_int(lowering, 0, line);
+    }
+}
+
+// Store to a variable: locals become IR_SET until SSA construction
+static void lower_store(Lowering* lowering, ASTNode* variable, IRInstr* value, int line) {
+    if (variable->slot < 0) {
+        return;
+    }
+    IRInstr* instr;
+    if (variable->scope_depth == 0) {
+        value = convert(lowering, value, IR_INT, line);
+        instr = emit(lowering, IR_STORE, IR_VOID, 1, line);
+    } else {
+        IRType type = ir_type_of(variable->static_type);
+        value = convert(lowering, value, type, line);
+        instr = emit(lowering, IR_SET, type, 1, line);
+        note_local(lowering, variable->slot);
+    }
+    instr->args[0] = value;
+    instr->index = variable->slot;
+}
+
+static void lower_statement(Lowering* lowering, ASTNode* node) {
+    int line = node->token.line;
+
+    switch (node->type) {
+        case AST_VARDECL: {
+            IRInstr* value = node->right ? lower_expression(lowering, node->right)
+                                         : emit_const_int(lowering, 0, line);
+            lower_store(lowering, node, value, line);
+            break;
+        }
+
+        case AST_ASSIGN:
+            if (node->left) {
+                lower_store(lowering, node->left, lower_expression(lowering, node->right), line);
+            }
+            break;
+
+        case AST_PRINT: {
+            IRInstr* value = lower_expression(lowering, node->left);
+            IRInstr* instr = emit(lowering, IR_PRINT, IR_VOID, 1, line);
+            instr->args[0] = value;
+            break;
+        }
+
+        default:
+            // Expression statements: lairotcaf(...), calls
+            lower_expression(lowering, node);
+            break;
+    }
+}
+
+// Place phis at the iterated dominance frontiers of each variable's
+// definitions, then rename along the dominator tree
+static void construct_ssa(IRFunction* function) {
+    int locals = function->local_count;
+    int blocks = function->block_count;
+    CFG* dom = ir_dominators(function);
+
+    // Variable types and definition sites
+    IRType* types = calloc(locals + 1, sizeof(IRType));
+    int* def_count = calloc(locals + 1, sizeof(int));
+    int* def_start = calloc(locals + 1, sizeof(int));
+    if (!types || !def_count || !def_start) out_of_memory();
+    int defs = 0;
+    for (int b = 0; b < blocks; b++) {
+        for (int i = 0; i < function->blocks[b].count; i++) {
+            IRInstr* instr = function->blocks[b].code[i];
+            if (instr->op == IR_SET || instr->op == IR_GET) {
+                types[instr->index] = instr->type;
+            }
+            if (instr->op == IR_SET) {
+                def_count[instr->index]++;
+                defs++;
+            }
+        }
+    }
+    for (int v = 0, start = 0; v < locals; v++) {
+        def_start[v] = start;
+        start += def_count[v];
+        def_count[v] = 0;
+    }
+    int* def_blocks = malloc((defs + 1) * sizeof(int));
+    if (!def_blocks) out_of_memory();
+    for (int b = 0; b < blocks; b++) {
+        for (int i = 0; i < function->blocks[b].count; i++) {
+            IRInstr* instr = function->blocks[b].code[i];
+            if (instr->op == IR_SET) {
+                def_blocks[def_start[instr->index] + def_count[instr->index]++] = b;
+            }
+        }
+    }
+
+    // Phi placement
+    int* has_phi = malloc((blocks + 1) * sizeof(int));
+    int* queued = malloc((blocks + 1) * sizeof(int));
+    int* work = malloc((blocks + 1) * sizeof(int));
+    if (!has_phi || !queued || !work) out_of_memory();
+    for (int b = 0; b < blocks; b++) {
+        has_phi[b] = -1;
+        queued[b] = -1;
+    }
+    for (int v = 0; v < locals; v++) {
+        int count = 0;
+        for (int d = 0; d < def_count[v]; d++) {
+            int b = def_blocks[def_start[v] + d];
+            if (queued[b] != v) {
+                queued[b] = v;
+                work[count++] = b;
+            }
+        }
+        while (count > 0) {
+            BasicBlock* block = &dom->blocks[work[--count]];
+            for (int f = 0; f < block->frontier_count; f++) {
+                int join = dom->frontiers[block->frontier + f];
+                if (has_phi[join] == v) {
+                    continue;
+                }
+                has_phi[join] = v;
+                IRInstr* phi = ir_new_instr(function, IR_PHI, types[v], function->blocks[join].pred_count);
+                phi->index = v;
+                phi->line = function->line;
+                ir_insert(function, join, 0, phi);
+                if (queued[join] != v) {
+                    queued[join] = v;
+                    work[count++] = join;
+                }
+            }
+        }
+    }
+
+    // Renaming: current[v] is the value variable v holds at this point; the
+    // undo log restores it when leaving a dominator subtree
+    IRInstr** current = calloc(locals + 1, sizeof(IRInstr*));
+    int log_capacity = 64;
+    int log_count = 0;
+    struct { int slot; IRInstr* value; }* log = malloc(log_capacity * sizeof(*log));
+    int* stack = malloc((2 * blocks + 2) * sizeof(int));
+    if (!current || !log || !stack) out_of_memory();
+
+    // Reachable blocks in dominator-tree order, then each unreachable block
+    // on its own with every variable unset
+    for (int root = -1; root < blocks; root++) {
+        int start;
+        if (root < 0) {
+            start = 0;
+        } else if (dom->blocks[root].rpo < 0 && !function->blocks[root].dead) {
+            start = root;
+            memset(current, 0, locals * sizeof(IRInstr*));
+            log_count = 0;
+        } else {
+            continue;
+        }
+
+        int depth = 0;
+        stack[depth++] = start;
+        while (depth > 0) {
+            int entry = stack[--depth];
+            if (entry < 0) {
+                // Leaving a block: undo its definitions
+                int mark = -entry - 1;
+                while (log_count > mark) {
+                    log_count--;
+                    current[log[log_count].slot] = log[log_count].value;
+                }
+                continue;
+            }
+
+            IRBlock* block = &function->blocks[entry];
+            stack[depth++] = -log_count - 1;
+            for (int i = 0; i < block->count; i++) {
+                IRInstr* instr = block->code[i];
+                if (instr->op != IR_PHI) {
+                    for (int a = 0; a < instr->arg_count; a++) {
+                        instr->args[a] = ir_resolve(instr->args[a]);
+                    }
+                }
+                if (instr->op == IR_PHI || instr->op == IR_SET) {
+                    if (log_count == log_capacity) {
+                        log_capacity *= 2;
+                        log = realloc(log, log_capacity * sizeof(*log));
+                        if (!log) out_of_memory();
+                    }
+                    log[log_count].slot = instr->index;
+                    log[log_count].value = current[instr->index];
+                    log_count++;
+                    current[instr->index] = instr->op == IR_PHI ? instr : instr->args[0];
+                } else if (instr->op == IR_GET) {
+                    instr->replacement = current[instr->index] ? current[instr->index]
+                                                               : undefined_value(function, instr->type);
+                }
+            }
+
+            // Feed the phis of the successors
+            for (int s = 0; s < block->succ_count; s++) {
+                IRBlock* succ = &function->blocks[block->succ[s]];
+                if (s == 1 && block->succ[1] == block->succ[0]) {
+                    break;
+                }
+                for (int p = 0; p < succ->pred_count; p++) {
+                    if (succ->preds[p] != entry) {
+                        continue;
+                    }
+                    for (int i = 0; i < succ->count && succ->code[i]->op == IR_PHI; i++) {
+                        IRInstr* phi = succ->code[i];
+                        phi->args[p] = current[phi->index] ? current[phi->index]
+                                                           : undefined_value(function, phi->type);
+                    }
+                }
+            }
+
+            if (root < 0) {
+                BasicBlock* node = &dom->blocks[entry];
+                for (int c = node->dom_child_count - 1; c >= 0; c--) {
+                    stack[depth++] = dom->dom_tree[node->dom_children + c];
+                }
+            }
+        }
+    }
+
+    // The variables are gone; drop the GETs and SETs
+    for (int b = 0; b < blocks; b++) {
+        IRBlock* block = &function->blocks[b];
+        int kept = 0;
+        for (int i = 0; i < block->count; i++) {
+            if (block->code[i]->op != IR_SET) {
+                block->code[kept++] = block->code[i];
+            }
+        }
+        block->count = kept;
+        for (int i = 0; i < block->count && block->code[i]->op == IR_PHI; i++) {
+            for (int a = 0; a < block->code[i]->arg_count; a++) {
+                if (!block->code[i]->args[a]) {
+                    block->code[i]->args[a] = undefined_value(function, block->code[i]->type);
+                }
+            }
+        }
+    }
+    ir_apply_replacements(function);
+    for (int t = 0; t < 4; t++) {
+        if (function->undefined[t] && function->undefined[t]->block < 0) {
+            ir_insert(function, 0, 0, function->undefined[t]);
+        }
+    }
+
+    free(types);
+    free(def_count);
+    free(def_start);
+    free(def_blocks);
+    free(has_phi);
+    free(queued);
+    free(work);
+    free(current);
+    free(log);
+    free(stack);
+    ir_invalidate(function, IR_ANALYSIS_DOMINATORS);
+}
+
+// Highest local slot used anywhere in a subtree, plus one
+static int count_locals(const ASTNode* node) {
+    int count = 0;
+    while (node) {
+        if (node->scope_depth > 0 && node->slot >= count) {
+            count = node->slot + 1;
+        }
+        int left = count_locals(node->left);
+        if (left > count) count = left;
+        node = node->right;
+    }
+    return count;
+}
+
+// IR block for a CFG block; the CFG's exit block has no counterpart
+static int ir_block_of(const CFG* cfg, int block) {
+    return block > cfg->exit ? block - 1 : block;
+}
+
+// Lower one function declaration, or the program's top-level statements
+static IRFunction* lower_function(Lowering* lowering, ASTNode* node, const char* name) {
+    IRFunction* function = calloc(1, sizeof(IRFunction));
+    if (!function) out_of_memory();
+    function->name = ir_strdup(function, name);
+    function->line = node->token.line;
+    lowering->function = function;
+
+    CFG* cfg = build_cfg(node);
+
+    // Same blocks as the CFG, minus its exit block (returns have no successor)
+    function->block_count = cfg->block_count - 1;
+    function->blocks = calloc(function->block_count, sizeof(IRBlock));
+    if (!function->blocks) out_of_memory();
+
+    // Parameters arrive as the first locals; the lowering's own locals
+    // come after the program's
+    lowering->block = 0;
+    lowering->next_temporary = count_locals(node);
+    if (node->type == AST_FUNCTION_DECL) {
+        for (ASTNode* param = node->left; param; param = param->right) {
+            IRInstr* value = emit(lowering, IR_PARAM, IR_INT, 0, param->token.line);
+            value->index = function->param_count++;
+            lower_store(lowering, param, value, param->token.line);
+        }
+    }
+
+    // Where the code of each CFG block ends up ending: && and || add blocks
+    int* tail = malloc((cfg->block_count + 1) * sizeof(int));
+    if (!tail) out_of_memory();
+    for (int b = 0; b < cfg->block_count; b++) {
+        BasicBlock* source = &cfg->blocks[b];
+        if (b == cfg->exit) {
+            continue;
+        }
+        lowering->block = ir_block_of(cfg, b);
+
+        for (int i = 0; i < source->count; i++) {
+            lower_statement(lowering, cfg->statements[source->first + i]);
+        }
+
+        switch (source->end) {
+            case CFG_JUMP:
+                emit(lowering, IR_JUMP, IR_VOID, 0, source->line);
+                break;
+            case CFG_BRANCH: {
+                IRInstr* condition = truth_value(lowering, lower_expression(lowering, source->value),
+                                                 source->line);
+                IRInstr* instr = emit(lowering, IR_BRANCH, IR_VOID, 1, source->line);
+                instr->args[0] = condition;
+                break;
+            }
+            case CFG_RETURN: {
+                IRInstr* value = source->value ? lower_expression(lowering, source->value)
+                                               : emit_const_int(lowering, 0, source->line);
+                value = convert(lowering, value, IR_INT, source->line);
+                IRInstr* instr = emit(lowering, IR_RETURN, IR_VOID, 1, source->line);
+                instr->args[0] = value;
+                break;
+            }
+            case CFG_EXIT:
+                break;
+        }
+        tail[b] = lowering->block;
+    }
+
+    for (int b = 0; b < cfg->block_count; b++) {
+        BasicBlock* source = &cfg->blocks[b];
+        if (b == cfg->exit) {
+            continue;
+        }
+        IRBlock* block = &function->blocks[tail[b]];
+        for (int s = 0; s < source->succ_count; s++) {
+            int succ = CFG_SUCC(cfg, b, s);
+            if (succ != cfg->exit) {
+                block->succ[block->succ_count++] = ir_block_of(cfg, succ);
+            }
+        }
+        for (int p = 0; p < source->pred_count; p++) {
+            add_pred(function, ir_block_of(cfg, b), tail[CFG_PRED(cfg, b, p)]);
+        }
+    }
+    free(tail);
+    free_cfg(cfg);
+
+    construct_ssa(function);
+    return function;
+}
+
+static void add_function(IRProgram* program, IRFunction* function) {
+    IRFunction** functions = realloc(program->functions, (program->function_count + 1) * sizeof(IRFunction*));
+    if (!functions) out_of_memory();
+    program->functions = functions;
+    program->functions[program->function_count++] = function;
+}
+
+// Highest global slot used anywhere in a subtree, plus one
+static int count_globals(const ASTNode* node) {
+    int count = 0;
+    while (node) {
+        if (node->scope_depth == 0 && node->slot >= count) {
+            count = node->slot + 1;
+        }
+        int left = count_globals(node->left);
+        if (left > count) count = left;
+        node = node->right;
+    }
+    return count;
+}
+
+// Lower a semantically valid AST: one IR function per top-level function
+// declaration, in order, plus one for any top-level statements
+IRProgram* lower_program(ASTNode* ast) {
+    IRProgram* program = calloc(1, sizeof(IRProgram));
+    if (!program) out_of_memory();
+    program->main_function = -1;
+    program->init_function = -1;
+    program->global_count = count_globals(ast);
+
+    Lowering lowering;
+    memset(&lowering, 0, sizeof(lowering));
+    lowering.program = program;
+    int statements = 0;
+    for (ASTNode* item = ast; item && item->type == AST_PROGRAM; item = item->right) {
+        if (item->left && item->left->type == AST_FUNCTION_DECL) {
+            lowering.declaration_count++;
+        } else if (item->left && item->left->type != AST_PROGRAM) {
+            statements++;
+        }
+    }
+    lowering.declarations = malloc((lowering.declaration_count + 1) * sizeof(ASTNode*));
+    if (!lowering.declarations) out_of_memory();
+    int index = 0;
+    for (ASTNode* item = ast; item && item->type == AST_PROGRAM; item = item->right) {
+        if (item->left && item->left->type == AST_FUNCTION_DECL) {
+            lowering.declarations[index++] = item->left;
+        }
+    }
+
+    for (int i = 0; i < lowering.declaration_count; i++) {
+        ASTNode* declaration = lowering.declarations[i];
+        add_function(program, lower_function(&lowering, declaration, declaration->token.lexeme));
+        if (program->main_function < 0 && strcmp(declaration->token.lexeme, "niam") == 0) {
+            program->main_function = i;
+        }
+    }
+    if (statements > 0) {
+        program->init_function = program->function_count;
+        add_function(program, lower_function(&lowering, ast, "(top level)"));
+    }
+
+    free(lowering.declarations);
+    return program;
+}
+
+static void free_ir_function(IRFunction* function) {
+    for (int b = 0; b < function->block_count; b++) {
+        free(function->blocks[b].code);
+        free(function->blocks[b].preds);
+    }
+    free(function->blocks);
+    ir_invalidate(function, 0);
+    while (function->arena) {
+        IRChunk* next = function->arena->next;
+        free(function->arena);
+        function->arena = next;
+    }
+    free(function);
+}
+
+void free_ir_program(IRProgram* program) {
+    if (!program) {
+        return;
+    }
+    for (int i = 0; i < program->function_count; i++) {
+        free_ir_function(program->functions[i]);
+    }
+    free(program->functions);
+    free(program);
+}
+
+// Opcode names as the IR listing prints them
+static const char* op_names[] = {
+    [IR_CONST] = "const", [IR_PARAM] = "param", [IR_LOAD] = "load", [IR_STORE] = "store",
+    [IR_ADD] = "add", [IR_SUB] = "sub", [IR_MUL] = "mul", [IR_DIV] = "div",
+    [IR_EQ] = "eq", [IR_NE] = "ne", [IR_LT] = "lt", [IR_LE] = "le",
+    [IR_GT] = "gt", [IR_GE] = "ge", [IR_AND] = "and", [IR_OR] = "or",
+    [IR_ITOF] = "itof", [IR_FTOI] = "ftoi", [IR_FACT] = "fact", [IR_CALL] = "call",
+    [IR_PRINT] = "print", [IR_PHI] = "phi", [IR_COPY] = "copy", [IR_GET] = "get",
+    [IR_SET] = "set", [IR_JUMP] = "jmp", [IR_BRANCH] = "br", [IR_RETURN] = "ret"
+};
+
+const char* ir_op_name(IROp op) {
+    return op_names[op];
+}
+
+static const char* type_suffix(IRType type) {
+    switch (type) {
+        case IR_INT: return ".i";
+        case IR_FLOAT: return ".f";
+        case IR_STR: return ".s";
+        default: return "";
+    }
+}
+
+static void print_instr(const IRFunction* function, const IRBlock* block, const IRInstr* instr) {
+    printf("    ");
+    if (instr->type != IR_VOID && instr->op != IR_SET) {
+        printf("v%d = ", instr->id);
+    }
+
+    // Comparisons are suffixed with their operand type
+    IRType suffix = instr->type;
+    if (instr->op >= IR_EQ && instr->op <= IR_GE) {
+        suffix = instr->args[0]->type;
+    }
+    printf("%s%s", ir_op_name(instr->op), type_suffix(suffix));
+
+    switch (instr->op) {
+        case IR_CONST:
+            if (instr->type == IR_FLOAT) printf(" %.17g", instr->imm.f);
+            else if (instr->type == IR_STR) printf(" \"%s\"", instr->imm.s);
+            else printf(" %d", instr->imm.i);
+            break;
+        case IR_PARAM:
+            printf(" %d", instr->index);
+            break;
+        case IR_LOAD:
+            printf(" g%d", instr->index);
+            break;
+        case IR_STORE:
+            printf(" g%d, v%d", instr->index, instr->args[0]->id);
+            break;
+        case IR_GET:
+        case IR_SET:
+            printf(" %%%d", instr->index);
+            if (instr->op == IR_SET) printf(", v%d", instr->args[0]->id);
+            break;
+        case IR_CALL:
+            printf(" %s(", instr->imm.s);
+            for (int a = 0; a < instr->arg_count; a++) {
+                printf("%sv%d", a ? ", " : "", instr->args[a]->id);
+            }
+            printf(")");
+            break;
+        case IR_PHI:
+            for (int a = 0; a < instr->arg_count; a++) {
+                printf("%s [b%d: v%d]", a ? "," : "", block->preds[a], instr->args[a]->id);
+            }
+            break;
+        case IR_JUMP:
+            printf(" b%d", block->succ[0]);
+            break;
+        case IR_BRANCH:
+            printf(" v%d, b%d, b%d", instr->args[0]->id, block->succ[0], block->succ[1]);
+            break;
+        default:
+            for (int a = 0; a < instr->arg_count; a++) {
+                printf("%s v%d", a ? "," : "", instr->args[a]->id);
+            }
+            break;
+    }
+    (void)function;
+    printf("\n");
+}
+
+// Print a function in the listing format
+void print_ir_function(const IRFunction* function) {
+    int live = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        live += !function->blocks[b].dead;
+    }
+    printf("function %s: %d param(s), %d block(s)\n", function->name, function->param_count, live);
+
+    for (int b = 0; b < function->block_count; b++) {
+        const IRBlock* block = &function->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        printf("  b%d:", b);
+        if (block->pred_count > 0) {
+            printf("  ; preds");
+            for (int p = 0; p < block->pred_count; p++) {
+                printf(" b%d", block->preds[p]);
+            }
+        }
+        printf("\n");
+        for (int i = 0; i < block->count; i++) {
+            print_instr(function, block, block->code[i]);
+        }
+    }
+}
+
+void print_ir_program(const IRProgram* program) {
+    printf("; %d global slot(s)\n", program->global_count);
+    for (int i = 0; i < program->function_count; i++) {
+        printf("\n");
+        print_ir_function(program->functions[i]);
+    }
+}
@@ -0,0 +1,392 @@
+/* jit.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../../include/jit.h"
+#include "../../include/asm.h"
+#include "../../include/codegen.h"
+#include "../../include/regalloc.h"
+#include "../../include/runtime.h"
+#include "../../include/bytecode.h"
+#include "../../include/vm.h"
+#include "../../include/ir.h"
+#include "../../include/pass.h"
+#include "../../include/tier.h"
+
+#if JIT_NATIVE
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+static ExecutionEngine engine = ENGINE_VM;
+
+static const char* engine_names[] = {"vm", "jit", "tiered"};
+
+int set_engine(const char* name) {
+    for (int e = ENGINE_VM; e <= ENGINE_TIERED; e++) {
+        if (strcmp(name, engine_names[e]) == 0) {
+            engine = (ExecutionEngine)e;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static size_t round_up(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+static size_t page_size(void) {
+#if JIT_NATIVE
+    return (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+}
+
+#if JIT_NATIVE
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed in the JIT\n");
+    exit(1);
+}
+
+// Functions in the compiler that generated code may call
+static const struct {
+    const char* name;
+    void* address;
+} runtime_symbols[] = {
+    {"bc_print_int", (void*)bc_print_int},
+    {"bc_print_float", (void*)bc_print_float},
+    {"bc_print_str", (void*)bc_print_str},
+    {"bc_float_to_int", (void*)bc_float_to_int},
+    {"bc_factorial", (void*)bc_factorial},
+    {"bc_runtime_error", (void*)bc_runtime_error},
+};
+
+#define RUNTIME_SYMBOL_COUNT ((int)(sizeof(runtime_symbols) / sizeof(runtime_symbols[0])))
+
+// Symbols a unit uses but does not define are reached through a slot in
+// the read-only data holding their address: calls through an 8-byte stub
+// in the code, "jmp *slot(%rip)", and @GOTPCREL loads through the slot
+// itself. Their definitions may be too far away for a 32-bit displacement.
+#define STUB_SIZE 8
+
+static void* lookup(const char* name, const JitSymbol* symbols, int symbol_count) {
+    for (int i = 0; i < RUNTIME_SYMBOL_COUNT; i++) {
+        if (strcmp(name, runtime_symbols[i].name) == 0) return runtime_symbols[i].address;
+    }
+    for (int i = 0; i < symbol_count; i++) {
+        if (strcmp(name, symbols[i].name) == 0) return symbols[i].address;
+    }
+    return NULL;
+}
+
+static void write32(unsigned char* at, int32_t value) {
+    memcpy(at, &value, sizeof(value));
+}
+
+int jit_load(const AsmUnit* unit, const JitSymbol* symbols, int symbol_count, JitCode* code, char* error,
+             int error_size) {
+    memset(code, 0, sizeof(*code));
+    // Slot of each symbol that needs one, by symbol number (-1 if none)
+    int* slot_of = malloc((unit->symbol_count + 1) * sizeof(int));
+    if (!slot_of) out_of_memory();
+    int slot_count = 0;
+    for (int i = 0; i < unit->symbol_count; i++) slot_of[i] = -1;
+    for (int i = 0; i < unit->reloc_count; i++) {
+        const AsmReloc* r = &unit->relocs[i];
+        const AsmSymbol* s = &unit->symbols[r->symbol];
+        if (slot_of[r->symbol] >= 0 || (s->section >= 0 && r->type != ASM_RELOC_GOTPCREL)) {
+            continue;
+        }
+        if (s->section < 0 && (r->type == ASM_RELOC_PC32 || !lookup(s->name, symbols, symbol_count))) {
+            snprintf(error, error_size, "undefined symbol %s", s->name);
+            free(slot_of);
+            return 0;
+        }
+        slot_of[r->symbol] = slot_count++;
+    }
+
+    // Layout: code, stubs | read-only data, slots | (page) writable data
+    size_t page = page_size();
+    size_t stubs = round_up(unit->size[ASM_TEXT], 16);
+    size_t rodata = round_up(stubs + STUB_SIZE * slot_count, 16);
+    size_t slots = round_up(rodata + unit->size[ASM_RODATA], 8);
+    size_t code_end = round_up(slots + 8 * slot_count, page);
+    size_t size = code_end + round_up(unit->size[ASM_BSS] + 1, page);
+    code->section_base[ASM_TEXT] = 0;
+    code->section_base[ASM_RODATA] = rodata;
+    code->section_base[ASM_BSS] = code_end;
+
+    unsigned char* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        snprintf(error, error_size, "cannot map memory for code");
+        free(slot_of);
+        return 0;
+    }
+    for (int section = ASM_TEXT; section <= ASM_RODATA; section++) {
+        if (unit->size[section]) memcpy(memory + code->section_base[section], unit->bytes[section], unit->size[section]);
+    }
+    for (int i = 0; i < unit->symbol_count; i++) {
+        if (slot_of[i] < 0) continue;
+        const AsmSymbol* s = &unit->symbols[i];
+        unsigned char* stub = memory + stubs + STUB_SIZE * slot_of[i];
+        unsigned char* slot = memory + slots + 8 * slot_of[i];
+        void* address = s->section >= 0 ? memory + code->section_base[s->section] + s->offset
+                                        : lookup(s->name, symbols, symbol_count);
+        stub[0] = 0xff;
+        stub[1] = 0x25;
+        write32(stub + 2, (int32_t)(slot - (stub + 6)));
+        stub[6] = stub[7] = 0xcc;
+        memcpy(slot, &address, sizeof(void*));
+    }
+
+    for (int i = 0; i < unit->reloc_count; i++) {
+        const AsmReloc* r = &unit->relocs[i];
+        const AsmSymbol* s = &unit->symbols[r->symbol];
+        unsigned char* target;
+        if (r->type == ASM_RELOC_GOTPCREL) {
+            target = memory + slots + 8 * slot_of[r->symbol];
+        } else if (s->section >= 0) {
+            target = memory + code->section_base[s->section] + s->offset;
+        } else {
+            target = memory + stubs + STUB_SIZE * slot_of[r->symbol];
+        }
+        unsigned char* field = memory + code->section_base[r->section] + r->offset;
+        write32(field, (int32_t)(target + r->addend - field));
+    }
+    free(slot_of);
+
+    if (mprotect(memory, code_end, PROT_READ | PROT_EXEC) != 0) {
+        snprintf(error, error_size, "cannot make code executable");
+        munmap(memory, size);
+        return 0;
+    }
+    code->memory = memory;
+    code->size = size;
+    return 1;
+}
+
+void* jit_symbol_address(const JitCode* code, const AsmUnit* unit, const char* name) {
+    int i = asm_find_symbol(unit, name);
+    if (i < 0 || unit->symbols[i].section < 0) {
+        return NULL;
+    }
+    return code->memory + code->section_base[unit->symbols[i].section] + unit->symbols[i].offset;
+}
+
+void jit_unload(JitCode* code) {
+    if (code->memory) {
+        munmap(code->memory, code->size);
+    }
+    memset(code, 0, sizeof(*code));
+}
+#else
+int jit_load(const AsmUnit* unit, const JitSymbol* symbols, int symbol_count, JitCode* code, char* error,
+             int error_size) {
+    (void)unit;
+    (void)symbols;
+    (void)symbol_count;
+    memset(code, 0, sizeof(*code));
+    snprintf(error, error_size, "native code is not supported on this platform");
+    return 0;
+}
+
+void* jit_symbol_address(const JitCode* code, const AsmUnit* unit, const char* name) {
+    (void)code;
+    (void)unit;
+    (void)name;
+    return NULL;
+}
+
+void jit_unload(JitCode* code) {
+    memset(code, 0, sizeof(*code));
+}
+#endif
+
+// Bytes of stack one activation of 'function' can take (the frame the code
+// generator lays out, the return address and saved %rbp, and arguments it
+// pushes), with room to spare
+static size_t frame_bound(const IRProgram* program, const IRFunction* function) {
+    size_t pushed = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        const IRBlock* block = &function->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            const IRInstr* instr = block->code[i];
+            if (instr->op != IR_CALL || instr->index < 0) continue;
+            int count = instr->arg_count;
+            if (program->functions[instr->index]->param_count > count) {
+                count = program->functions[instr->index]->param_count;
+            }
+            if (count > 6 && (size_t)(count - 6 + 1) > pushed) pushed = count - 6 + 1;
+        }
+    }
+    return 16 + round_up(8 * (size_t)(function->value_count + function->param_count + RA_CALLEE_SAVED + 2), 16) +
+           8 * pushed;
+}
+
+size_t jit_stack_size(const IRProgram* program) {
+    size_t deepest = 0;
+    for (int f = 0; f < program->function_count; f++) {
+        size_t bound = frame_bound(program, program->functions[f]);
+        if (bound > deepest) deepest = bound;
+    }
+    // Runtime calls (printf) run on top of the deepest frame
+    return round_up(deepest * (VM_MAX_FRAMES + 2) + (1 << 20), page_size());
+}
+
+#if JIT_NATIVE
+// The generated code as text, through the native backend
+static char* generate(IRProgram* program, char* error, int error_size) {
+    char* text = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    if (!out) out_of_memory();
+    CodegenOptions options = {VM_MAX_FRAMES, NULL, 0, 0};
+    int ok = emit_assembly(program, &options, out);
+    fclose(out);
+    if (!ok) {
+        snprintf(error, error_size, "the native backend cannot translate this program");
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+int jit_compile(IRProgram* program, JitProgram* jit, char* error, int error_size) {
+    memset(jit, 0, sizeof(*jit));
+    char* text = generate(program, error, error_size);
+    if (!text) {
+        return 0;
+    }
+    AsmUnit unit;
+    int assembled = assemble(text, &unit);
+    free(text);
+    if (!assembled) {
+        snprintf(error, error_size, "cannot assemble generated code (%s)", unit.error);
+        free_asm_unit(&unit);
+        return 0;
+    }
+    if (!jit_load(&unit, NULL, 0, &jit->code, error, error_size)) {
+        free_asm_unit(&unit);
+        return 0;
+    }
+    void* address = jit_symbol_address(&jit->code, &unit, "main");
+    free_asm_unit(&unit);
+    if (!address) {
+        snprintf(error, error_size, "no entry point");
+        jit_unload(&jit->code);
+        return 0;
+    }
+    memcpy(&jit->entry, &address, sizeof(address));
+    jit->stack_size = jit_stack_size(program);
+    return 1;
+}
+
+typedef struct {
+    int (*function)(void*);
+    void* argument;
+    int result;
+} JitCall;
+
+static void* call_thread(void* arg) {
+    JitCall* call = arg;
+    call->result = call->function(call->argument);
+    return NULL;
+}
+
+int jit_call(size_t stack_size, int (*function)(void*), void* argument) {
+    // The stack is reserved, not committed, so only what the calls touch
+    // costs memory; a guard page below it catches anything unaccounted for
+    size_t page = page_size();
+    size_t size = stack_size + page;
+    unsigned char* stack = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                -1, 0);
+    JitCall call = {function, argument, 0};
+    pthread_attr_t attr;
+    pthread_t thread;
+    if (stack == MAP_FAILED || pthread_attr_init(&attr) != 0) {
+        fprintf(stderr, "Error: Cannot reserve a stack for native code\n");
+        exit(1);
+    }
+    mprotect(stack, page, PROT_NONE);
+    pthread_attr_setstack(&attr, stack + page, stack_size);
+    if (pthread_create(&thread, &attr, call_thread, &call) != 0) {
+        fprintf(stderr, "Error: Cannot start native code\n");
+        exit(1);
+    }
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    munmap(stack, size);
+    return call.result;
+}
+#else
+int jit_compile(IRProgram* program, JitProgram* jit, char* error, int error_size) {
+    (void)program;
+    memset(jit, 0, sizeof(*jit));
+    snprintf(error, error_size, "native code is not supported on this platform");
+    return 0;
+}
+
+// Nothing native runs, so the caller's stack will do
+int jit_call(size_t stack_size, int (*function)(void*), void* argument) {
+    (void)stack_size;
+    return function(argument);
+}
+#endif
+
+static int run_entry(void* jit) {
+    return ((const JitProgram*)jit)->entry();
+}
+
+int jit_run(const JitProgram* jit) {
+    return jit_call(jit->stack_size, run_entry, (void*)jit);
+}
+
+void jit_free(JitProgram* jit) {
+    jit_unload(&jit->code);
+    memset(jit, 0, sizeof(*jit));
+}
+
+static int run_in_vm(const IRProgram* ir) {
+    BCProgram* program = compile_bytecode(ir);
+    int result = 0;
+    int ok = vm_run(program, 0, NULL, &result);
+    fflush(stdout);
+    free_bytecode(program);
+    return ok ? result : 1;
+}
+
+int proc_execute_file(const char* filename) {
+    if (engine == ENGINE_VM) {
+        return proc_run_file(filename);
+    }
+    if (engine == ENGINE_TIERED) {
+        return proc_tiered_file(filename);
+    }
+    PassManager manager;
+    if (!pass_manager_init(&manager, get_pass_pipeline())) {
+        return 1;
+    }
+    IRProgram* ir = compile_file_to_ir(filename, &manager);
+    pass_manager_free(&manager);
+    if (!ir) {
+        return 1;
+    }
+
+    JitProgram jit;
+    char error[256];
+    int result;
+    if (jit_compile(ir, &jit, error, sizeof(error))) {
+        result = jit_run(&jit);
+        fflush(stdout);
+        jit_free(&jit);
+    } else {
+        fprintf(stderr, "Note: %s; running %s in the interpreter\n", error, filename);
+        result = run_in_vm(ir);
+    }
+    free_ir_program(ir);
+    return result;
+}
@@ -6,12 +6,16 @@
 
 #include "../../include/tokens.h"
 #include "../../include/lexer.h"
+#include "../../include/diagnostics.h"
+#include "../../include/dump.h"
 
 // All global variables must be reset between files
 static int current_line = 1;
 static int current_column = 1; 
 static char last_token_type = 'x'; // For checking consecutive operators
 static int in_error_recovery = 0; // Flag for error recovery mode 
+static int defer_error_reports = 0; // Leave stored errors for the consumer to report
+static int token_start = 0; // Byte offset where the token being scanned begins
 
 // Add variables to track stored errors
 #define MAX_STORED_ERRORS 50000
@@ -84,20 +88,34 @@ static void store_error(ErrorType error, int line, int column, const char *lexem
     stored_errors[num_stored_errors].lexeme[sizeof(stored_errors[0].lexeme) - 1] = '\0';
     num_stored_errors++;
     
-    // Report the error immediately
-    printf("Lexical Error at line %d, column %d: ", line, column);
-    switch(error) {
+    // Report the error immediately unless the consumer replays it later
+    if (!defer_error_reports) {
+        Token token = {TOKEN_ERROR, "", line, column, error, RECOVERY_NONE};
+        strcpy(token.lexeme, stored_errors[num_stored_errors - 1].lexeme);
+        report_lexical_error(token);
+    }
+}
+
+// Report an error token produced by store_error
+void report_lexical_error(Token token) {
+    diag_printf("Lexical Error at line %d, column %d: ", token.line, token.column);
+    switch(token.error) {
         case ERROR_CONSECUTIVE_OPERATORS:
-            printf("Consecutive operators not allowed\n");
+            diag_printf("Consecutive operators not allowed\n");
             break;
         case ERROR_INVALID_CHAR:
-            printf("Invalid token '%s'\n", lexeme);
+            diag_printf("Invalid token '%s'\n", token.lexeme);
             break;
         default:
-            printf("Unknown error\n");
+            diag_printf("Unknown error\n");
     }
 }
 
+// Choose whether stored errors are printed as they are found
+void defer_lexical_errors(int defer) {
+    defer_error_reports = defer;
+}
+
 // Keywords table
 static struct {
     const char* word;
@@ -154,239 +172,17 @@ static int is_keyword(const char* word) {
 
 // Print error messages for lexical errors 
 void print_error(ErrorType error, int line, const char* lexeme) {
-    printf("Lexical Error at line %d: ", line);
-    switch(error) {
-        case ERROR_INVALID_CHAR:
-            printf("Invalid character '%s'\n", lexeme);
-            break;
-        case ERROR_INVALID_NUMBER:
-            printf("Invalid number format\n");
-            break;
-        case ERROR_CONSECUTIVE_OPERATORS:
-            printf("Consecutive operators not allowed\n");
-            break;
-        case ERROR_UNTERMINATED_STRING:
-            printf("Unterminated string literal\n");
-            break;
-        case ERROR_UNTERMINATED_CHAR:
-            printf("Unterminated character literal\n");
-            break;
-        case ERROR_INVALID_IDENTIFIER:
-            printf("Invalid identifier\n");
-            break;
-        case ERROR_STRING_TOO_LONG:
-            printf("String literal too long\n");
-            break;
-        case ERROR_INVALID_ESCAPE_SEQUENCE:
-            printf("Invalid escape sequence\n");
-            break;
-        case ERROR_EMPTY_CHAR_LITERAL:
-            printf("Empty character literal\n");
-            break;
-        case ERROR_MULTI_CHAR_LITERAL:
-            printf("Multi-character literal not allowed\n");
-            break;
-        case ERROR_INVALID_FLOAT:
-            printf("Invalid float format\n");
-            break;
-        case ERROR_RECOVERY_MODE: 
-            printf("Skipping invalid input \n");
-            break; 
-        case ERROR_UNEXPECTED_TOKEN:
-            printf("Unexpected token '%s'\n", lexeme);
-            break;
-        default:
-            printf("Unknown error\n");
-    }
+    DiagBuffer out = {NULL, 0, 0, NULL};
+    dump_lexical_error(&out, error, line, lexeme);
+    diag_buffer_flush(&out);
+    diag_buffer_free(&out);
 }
 
 void print_token(Token token) {
-    if(token.type == TOKEN_SKIP){
-        return; 
-    }
-
-    if (token.error != ERROR_NONE) {
-        print_error(token.error, token.line, token.lexeme);
-        return;
-    }
-
-    printf("Token: ");
-    switch(token.type) {
-        case TOKEN_NUMBER:    
-            printf("NUMBER"); 
-            break;
-        case TOKEN_FLOAT:
-            printf("FLOATING POINT NUMBER");
-            break;
-        case TOKEN_OPERATOR:
-            printf("OPERATOR");
-            break;
-        case TOKEN_EQUALS_EQUALS:
-            printf("EQUALS_EQUALS");
-            break;
-        case TOKEN_NOT_EQUALS:
-            printf("NOT_EQUALS");
-            break;
-        case TOKEN_LOGICAL_AND:
-            printf("LOGICAL_AND");
-            break;
-        case TOKEN_LOGICAL_OR:
-            printf("LOGICAL_OR");
-            break;
-        case TOKEN_GREATER_EQUALS:
-            printf("GREATER_EQUALS");
-            break;
-        case TOKEN_LESS_EQUALS:
-            printf("LESS_EQUALS");
-            break;
-        case TOKEN_IDENTIFIER:
-            printf("IDENTIFIER");
-            break;
-        case TOKEN_STRING:
-            printf("STRING");
-            break;
-        case TOKEN_CHAR_LITERAL:
-            printf("CHARACTER");
-            break;
-        case TOKEN_POINTER: 
-            printf("POINTER");
-            break;
-        case TOKEN_COMMENT:
-            printf("COMMENT");
-            break; 
-        case TOKEN_EQUALS:     
-            printf("EQUALS"); 
-            break;
-        case TOKEN_SEMICOLON:  
-            printf("SEMICOLON"); 
-            break;
-        case TOKEN_LPAREN:     
-            printf("LPAREN"); 
-            break;
-        case TOKEN_RPAREN:     
-            printf("RPAREN"); 
-            break;
-        case TOKEN_LBRACE:     
-            printf("LBRACE"); 
-            break;
-        case TOKEN_RBRACE:     
-            printf("RBRACE"); 
-            break;
-        case TOKEN_COMMA:
-            printf("COMMA");
-            break;
-        case TOKEN_IF:         
-            printf("IF"); 
-            break;
-        case TOKEN_INT:        
-            printf("INT"); 
-            break;
-        case TOKEN_CHAR:
-            printf("CHAR");
-            break; 
-        case TOKEN_VOID:
-            printf("VOID");
-            break; 
-        case TOKEN_RETURN: 
-            printf("RETURN");
-            break;
-        case TOKEN_FOR:
-            printf("FOR");
-            break; 
-        case TOKEN_WHILE:
-            printf("WHILE");
-            break; 
-        case TOKEN_DO:
-            printf("DO");
-            break; 
-        case TOKEN_BREAK:
-            printf("BREAK");
-            break; 
-        case TOKEN_CONTINUE:
-            printf("CONTINUE");
-            break; 
-        case TOKEN_SWITCH:
-            printf("SWITCH");
-            break; 
-        case TOKEN_CASE:
-            printf("CASE");
-            break; 
-        case TOKEN_DEFAULT:
-            printf("DEFAULT");
-            break; 
-        case TOKEN_GOTO:
-            printf("GOTO");
-            break; 
-        case TOKEN_SIZEOF:
-            printf("SIZEOF");
-            break; 
-        case TOKEN_STATIC:
-            printf("STATIC");
-            break; 
-        case TOKEN_EXTERN:
-            printf("EXTERN");
-            break; 
-        case TOKEN_CONST:
-            printf("CONST");
-            break; 
-        case TOKEN_VOLATILE:
-            printf("VOLATILE");
-            break; 
-        case TOKEN_STRUCT: 
-            printf("STRUCT");
-            break; 
-        case TOKEN_UNION:
-            printf("UNION");
-            break; 
-        case TOKEN_ENUM: 
-            printf("ENUM");
-            break; 
-        case TOKEN_TYPEDEF:
-            printf("TYPEDEF");
-            break; 
-        case TOKEN_UNSIGNED:
-            printf("UNSIGNED");
-            break; 
-        case TOKEN_SHORT:
-            printf("SHORT");
-            break; 
-        case TOKEN_LONG:
-            printf("LONG");
-            break; 
-        case TOKEN_FLOAT_KEY:
-            printf("FLOAT"); 
-            break; 
-        case TOKEN_DOUBLE: 
-            printf("DOUBLE");
-            break; 
-        case TOKEN_ELSE:
-            printf("ELSE");
-            break; 
-        case TOKEN_VOID_STAR:
-            printf("VOID*");
-            break; 
-        case TOKEN_INT_STAR:
-            printf("INT*");
-            break;
-        case TOKEN_PRINT:      
-            printf("PRINT"); 
-            break;
-        case TOKEN_REPEAT:
-            printf("REPEAT");
-            break;
-        case TOKEN_UNTIL:
-            printf("UNTIL");
-            break;
-        case TOKEN_FACTORIAL:
-            printf("FACTORIAL");
-            break;
-        case TOKEN_EOF:        
-            printf("EOF"); 
-            break;
-        default:              
-            printf("UNKNOWN");
-    }
-    printf(" | Lexeme: '%s' | Line: %d | Column: %d\n", token.lexeme, token.line, token.column);
+    DiagBuffer out = {NULL, 0, 0, NULL};
+    dump_token(&out, &token, DUMP_TEXT);
+    diag_buffer_flush(&out);
+    diag_buffer_free(&out);
 }
 
 /* Handle the escape sequences in strings and chars */
@@ -555,8 +351,8 @@ static Token handle_number(const char *input, int *pos) {
     return token;
 }
 
-// Get next token from input 
-Token get_next_token(const char* input, int* pos) {
+// Scan the next token from input 
+static Token scan_token(const char* input, int* pos) {
     Token token = {TOKEN_ERROR, "", current_line, current_column, ERROR_NONE, RECOVERY_NONE};
     char c;
 
@@ -572,6 +368,7 @@ Token get_next_token(const char* input, int* pos) {
         }
         (*pos)++;
     }
+    token_start = *pos;
 
     if (input[*pos] == '\0') {
         token.type = TOKEN_EOF;
@@ -780,6 +577,13 @@ Token get_next_token(const char* input, int* pos) {
     return token;
 }
 
+// Get next token from input, recording where it starts
+Token get_next_token(const char* input, int* pos) {
+    Token token = scan_token(input, pos);
+    token.offset = token_start;
+    return token;
+}
+
 /* Process test files */
 void process_test_file(const char *filename) {
     FILE *file = fopen(filename, "r");
@@ -2,21 +2,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "../../include/parser.h"
 #include "../../include/lexer.h"
 #include "../../include/tokens.h"
+#include "../../include/diagnostics.h"
+#include "../../include/dump.h"
 
-// Current token being processed
-static Token current_token;
-static int position = 0;
-static int pos2 = 0;
+// Tokens of the current source, lexed once by parser_init
+static TokenBuffer token_buffer = {NULL, 0, 0};
 static const char *source;
 
+// Number of threads parse() may use for top-level functions
+static int parser_threads = 1;
+
+// Parser context (one per thread so workers can parse chunks side by side)
+static _Thread_local Token current_token;
+static _Thread_local int position = 0;        // Index of the next buffered token
+static _Thread_local int token_limit = 0;     // Reads at or past this index see EOF
+static _Thread_local int reported_until = 0;  // Lexical errors before this index are reported
+static _Thread_local int pos2 = 0;
+
 // Error reporting control
-static int error_reporting_enabled = 1;
-static int last_reported_line = 0;
-static int last_reported_column = 0;
-static int error_count = 0;
+static _Thread_local int error_reporting_enabled = 1;
+static _Thread_local int last_reported_line = 0;
+static _Thread_local int last_reported_column = 0;
+static _Thread_local int error_count = 0;
+static _Thread_local int error_attempts = 0;  // parse_error calls, including suppressed ones
 
 // Forward declarations for utility functions
 void parse_error(ParseError error, Token token);
@@ -62,6 +75,8 @@ static void reset_parser_state(void) {
 }
 
 void parse_error(ParseError error, Token token) {
+    error_attempts++;
+
     // Only report errors if reporting is enabled
     if (!error_reporting_enabled) {
         return;
@@ -82,52 +97,73 @@ void parse_error(ParseError error, Token token) {
     last_reported_column = token.column;
     error_count++;
     
-    printf("Parse Error at line %d, column %d: ", token.line, token.column);
+    diag_printf("Parse Error at line %d, column %d: ", token.line, token.column);
     switch (error) {
         case PARSE_ERROR_UNEXPECTED_TOKEN:
-            printf("Unexpected token '%s'\n", token.lexeme);
+            diag_printf("Unexpected token '%s'\n", token.lexeme);
             break;
         case PARSE_ERROR_MISSING_SEMICOLON:
-            printf("Missing semicolon after '%s'\n", token.lexeme);
+            diag_printf("Missing semicolon after '%s'\n", token.lexeme);
             break;
         case PARSE_ERROR_MISSING_IDENTIFIER:
-            printf("Expected identifier after '%s'\n", token.lexeme);
+            diag_printf("Expected identifier after '%s'\n", token.lexeme);
             break;
         case PARSE_ERROR_MISSING_EQUALS:
-            printf("Expected '=' after '%s'\n", token.lexeme);
+            diag_printf("Expected '=' after '%s'\n", token.lexeme);
             break;
         case PARSE_ERROR_MISSING_PARENTHESES:
-            printf("Missing parenthesis in expression\n");
+            diag_printf("Missing parenthesis in expression\n");
             break;
         case PARSE_ERROR_MISSING_CONDITION:
-            printf("Expected condition after '%s'\n", token.lexeme);
+            diag_printf("Expected condition after '%s'\n", token.lexeme);
             break;
         case PARSE_ERROR_BLOCK_BRACES:
-            printf("Missing brace for block statement\n");
+            diag_printf("Missing brace for block statement\n");
             break;
         case PARSE_ERROR_INVALID_OPERATOR:
-            printf("Invalid operator '%s'\n", token.lexeme);
+            diag_printf("Invalid operator '%s'\n", token.lexeme);
             break;
         case PARSE_ERROR_INVALID_FUNCTION_CALL:
-            printf("Invalid function call to '%s'\n", token.lexeme);
+            diag_printf("Invalid function call to '%s'\n", token.lexeme);
             break;
         case PARSE_ERROR_INVALID_EXPRESSION:
-            printf("Invalid expression after '%s'\n", token.lexeme);
+            diag_printf("Invalid expression after '%s'\n", token.lexeme);
             break;
         default:
-            printf("Unknown error\n");
+            diag_printf("Unknown error\n");
+    }
+}
+
+// Read the next buffered token, replaying lexical errors the first time they are passed
+static Token read_token(void) {
+    if (position >= token_limit) {
+        // End of this parse range; the token at the limit stands in for EOF
+        Token eof = token_buffer.tokens[token_limit];
+        eof.type = TOKEN_EOF;
+        strcpy(eof.lexeme, "EOF");
+        return eof;
+    }
+
+    Token token = token_buffer.tokens[position];
+    if (position >= reported_until) {
+        if (token.type == TOKEN_ERROR && token.error != ERROR_NONE) {
+            report_lexical_error(token);
+        }
+        reported_until = position + 1;
     }
+    position++;
+    return token;
 }
 
 // Get next token
 static void advance(void) {
     // Get the next token
-    current_token = get_next_token(source, &position);
+    current_token = read_token();
     
     // Skip comments and error tokens during error recovery
     while (current_token.type == TOKEN_ERROR || current_token.type == TOKEN_SKIP || current_token.type == TOKEN_COMMENT) {
-        // The error reporting is now handled by the lexer not here
-        current_token = get_next_token(source, &position);
+        // The lexer stored these errors; read_token reports them in source order
+        current_token = read_token();
     }
 }
 
@@ -139,6 +175,9 @@ static ASTNode *create_node(ASTNodeType type) {
         node->token = current_token;
         node->left = NULL;
         node->right = NULL;
+        node->slot = -1;
+        node->static_type = TOKEN_ERROR;
+        node->scope_depth = -1;
     } else {
         fprintf(stderr, "Error: Memory allocation failed for AST node\n");
         exit(1);
@@ -184,7 +223,7 @@ static void synchronize(void) {
 static ASTNode *parse_primary_expression(void) {
     ASTNode *node;
 
-    if (match(TOKEN_NUMBER)) {
+    if (match(TOKEN_NUMBER) || match(TOKEN_FLOAT)) {
         node = create_node(AST_NUMBER);
         advance();
     } else if (match(TOKEN_IDENTIFIER)) {
@@ -974,104 +1013,614 @@ static ASTNode *parse_program(void) {
     return program;
 }
 
-// Initialize parser
-void parser_init(const char *input) {
-    source = input;
+// Append a token to the token buffer
+static void buffer_token(TokenBuffer *buffer, Token token) {
+    if (buffer->count == buffer->capacity) {
+        int capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        Token *tokens = realloc(buffer->tokens, capacity * sizeof(Token));
+        if (!tokens) {
+            fprintf(stderr, "Error: Memory allocation failed for token buffer\n");
+            exit(1);
+        }
+        buffer->tokens = tokens;
+        buffer->capacity = capacity;
+    }
+    buffer->tokens[buffer->count++] = token;
+}
+
+// Lex the whole input into a token buffer (always ends with an EOF token)
+static void fill_token_buffer(TokenBuffer *buffer, const char *input) {
+    int pos = 0;
+    Token token;
+
+    buffer->count = 0;
+    defer_lexical_errors(1);
+    do {
+        token = get_next_token(input, &pos);
+        buffer_token(buffer, token);
+    } while (token.type != TOKEN_EOF);
+    defer_lexical_errors(0);
+}
+
+// Reset the parser context to the start of the token buffer
+static void start_parse(void) {
     position = 0;
+    token_limit = token_buffer.count - 1;
+    reported_until = 0;
     pos2 = 0;
     last_reported_line = 0;
     last_reported_column = 0;
     error_reporting_enabled = 1;
     error_count = 0;
+    error_attempts = 0;
     advance(); // Get first token
 }
 
+// Initialize parser
+void parser_init(const char *input) {
+    source = input;
+    fill_token_buffer(&token_buffer, input);
+    start_parse();
+}
+
+// Set how many threads parse() may use (1 parses serially)
+void set_parser_threads(int count) {
+    parser_threads = count > 0 ? count : 1;
+}
+
+// Number of parse errors reported by the last parse
+int get_parse_error_count(void) {
+    return error_count;
+}
+
+// Tokens lexed by the last parser_init call
+const TokenBuffer *get_token_buffer(void) {
+    return &token_buffer;
+}
+
+// Is the token a type keyword that can start a top-level function?
+static int is_function_type(TokenType type) {
+    return type == TOKEN_INT || type == TOKEN_VOID || type == TOKEN_CHAR ||
+           type == TOKEN_FLOAT_KEY || type == TOKEN_LONG || type == TOKEN_SHORT ||
+           type == TOKEN_DOUBLE;
+}
+
+// Index of the next significant token at or after 'index' (the EOF index if none)
+static int next_significant(int index, int limit) {
+    while (index < limit) {
+        TokenType type = token_buffer.tokens[index].type;
+        if (type != TOKEN_ERROR && type != TOKEN_SKIP && type != TOKEN_COMMENT) {
+            break;
+        }
+        index++;
+    }
+    return index;
+}
+
+// Brace-matching pre-scan: split [start, limit) before every top-level
+// "type name (" that follows a statement boundary. Returns the chunk count.
+static int split_top_level_functions(int start, int limit, int **chunk_starts) {
+    int capacity = 16;
+    int count = 0;
+    int *starts = malloc(capacity * sizeof(int));
+    int depth = 0;
+    TokenType previous = TOKEN_SEMICOLON;
+
+    if (!starts) {
+        fprintf(stderr, "Error: Memory allocation failed for parse chunks\n");
+        exit(1);
+    }
+    starts[count++] = start;
+
+    for (int i = next_significant(start, limit); i < limit; i = next_significant(i + 1, limit)) {
+        TokenType type = token_buffer.tokens[i].type;
+
+        if (depth == 0 && i > start && is_function_type(type) &&
+            (previous == TOKEN_SEMICOLON || previous == TOKEN_RBRACE)) {
+            int name = next_significant(i + 1, limit);
+            int paren = next_significant(name + 1, limit);
+            if (paren < limit && token_buffer.tokens[name].type == TOKEN_IDENTIFIER &&
+                token_buffer.tokens[paren].type == TOKEN_LPAREN) {
+                if (count == capacity) {
+                    capacity *= 2;
+                    starts = realloc(starts, capacity * sizeof(int));
+                    if (!starts) {
+                        fprintf(stderr, "Error: Memory allocation failed for parse chunks\n");
+                        exit(1);
+                    }
+                }
+                starts[count++] = i;
+            }
+        }
+
+        if (type == TOKEN_LBRACE) {
+            depth++;
+        } else if (type == TOKEN_RBRACE && depth > 0) {
+            depth--;
+        }
+        previous = type;
+    }
+
+    *chunk_starts = starts;
+    return count;
+}
+
+// One top-level chunk handed to a parse worker
+typedef struct {
+    int start;               // First token of the chunk
+    int limit;               // First token of the next chunk
+    ASTNode *program;        // Program chain parsed from the chunk
+    DiagBuffer diagnostics;  // Messages the chunk produced, in order
+    int error_count;         // Parse errors reported in the chunk
+    int clean;               // No parse_error calls, so the serial parse agrees
+} ParseChunk;
+
+typedef struct {
+    ParseChunk *chunks;
+    int count;
+    atomic_int next;         // Next chunk to hand out
+} ParseJob;
+
+// Parse one chunk with this thread's parser context
+static void parse_chunk(ParseChunk *chunk) {
+    position = chunk->start;
+    token_limit = chunk->limit;
+    reported_until = chunk->start;
+    last_reported_line = 0;
+    last_reported_column = 0;
+    error_reporting_enabled = 1;
+    error_count = 0;
+    error_attempts = 0;
+
+    diag_capture_begin(&chunk->diagnostics);
+    advance(); // Get the chunk's first token
+    chunk->program = parse_program();
+    diag_capture_end();
+
+    chunk->error_count = error_count;
+    chunk->clean = error_attempts == 0;
+}
+
+// Worker thread: keep taking chunks until none are left
+static void *parse_worker(void *arg) {
+    ParseJob *job = arg;
+    int index;
+
+    while ((index = atomic_fetch_add(&job->next, 1)) < job->count) {
+        parse_chunk(&job->chunks[index]);
+    }
+    return NULL;
+}
+
+// Last Program node of a chain
+static ASTNode *program_tail(ASTNode *program) {
+    while (program->right) {
+        program = program->right;
+    }
+    return program;
+}
+
+// Parse top-level functions on worker threads and stitch the chunks together.
+// A chunk that needed error recovery may have parsed differently than the
+// serial parser would, so everything from it onwards is parsed serially.
+static ASTNode *parse_parallel(void) {
+    int start = position - 1;  // current_token came from here
+    int limit = token_limit;
+    int *starts;
+    int count = split_top_level_functions(start, limit, &starts);
+
+    if (count < 2) {
+        free(starts);
+        return parse_program();
+    }
+
+    ParseChunk *chunks = calloc(count, sizeof(ParseChunk));
+    if (!chunks) {
+        fprintf(stderr, "Error: Memory allocation failed for parse chunks\n");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++) {
+        chunks[i].start = starts[i];
+        chunks[i].limit = i + 1 < count ? starts[i + 1] : limit;
+    }
+    free(starts);
+
+    // The calling thread parses chunks too, which overwrites its error
+    // state; the serial parse carries on from what it was here
+    int saved_error_count = error_count;
+    int saved_error_attempts = error_attempts;
+    int saved_line = last_reported_line;
+    int saved_column = last_reported_column;
+    int saved_reporting = error_reporting_enabled;
+
+    ParseJob job = {chunks, count, 0};
+    int threads = parser_threads < count ? parser_threads : count;
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    if (workers) {
+        for (; started < threads; started++) {
+            if (pthread_create(&workers[started], NULL, parse_worker, &job) != 0) {
+                break;
+            }
+        }
+    }
+    parse_worker(&job); // The calling thread helps too
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    error_count = saved_error_count;
+    error_attempts = saved_error_attempts;
+    last_reported_line = saved_line;
+    last_reported_column = saved_column;
+    error_reporting_enabled = saved_reporting;
+
+    // Emit diagnostics in source order and stitch the clean prefix
+    ASTNode *program = NULL;
+    ASTNode *tail = NULL;
+    int resume = -1;
+    for (int i = 0; i < count; i++) {
+        if (resume < 0 && !chunks[i].clean) {
+            resume = i;
+        }
+        if (resume >= 0) {
+            free_ast(chunks[i].program);
+        } else {
+            diag_buffer_flush(&chunks[i].diagnostics);
+            error_count += chunks[i].error_count;
+            if (tail) {
+                tail->right = chunks[i].program;
+            } else {
+                program = chunks[i].program;
+            }
+            tail = program_tail(chunks[i].program);
+        }
+        diag_buffer_free(&chunks[i].diagnostics);
+    }
+
+    // Restore the serial parser context where the clean prefix stopped
+    token_limit = limit;
+    if (resume >= 0) {
+        position = chunks[resume].start;
+        reported_until = chunks[resume].start;
+        advance();
+        ASTNode *rest = parse_program();
+        if (tail) {
+            tail->right = rest;
+        } else {
+            program = rest;
+        }
+    } else {
+        position = limit;
+        reported_until = limit;
+        advance(); // Leaves current_token at EOF
+    }
+
+    free(chunks);
+    return program;
+}
+
+// Index of the first token starting at or after byte 'offset'
+static int token_at_offset(const TokenBuffer *buffer, int offset) {
+    int low = 0;
+    int high = buffer->count - 1;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (buffer->tokens[mid].offset < offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Do two tokens have the same kind and text?
+static int same_token_text(const Token *a, const Token *b) {
+    return a->type == b->type && a->error == b->error && strcmp(a->lexeme, b->lexeme) == 0;
+}
+
+// Do old tokens [old_start, end) reappear from new_start on, moved by the
+// edit's byte delta and one constant line delta, in the same columns?
+static int suffix_matches(const TokenBuffer *old_tokens, int old_start, const TokenBuffer *new_tokens,
+                          int new_start, int byte_delta, int *line_delta) {
+    if (old_tokens->count - old_start != new_tokens->count - new_start) {
+        return 0;
+    }
+
+    *line_delta = new_tokens->tokens[new_start].line - old_tokens->tokens[old_start].line;
+    for (int i = old_start, j = new_start; i < old_tokens->count; i++, j++) {
+        const Token *a = &old_tokens->tokens[i];
+        const Token *b = &new_tokens->tokens[j];
+        if (!same_token_text(a, b) || a->offset + byte_delta != b->offset ||
+            a->line + *line_delta != b->line || a->column != b->column) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Move every token of a reused subtree to its position in the new source
+static void shift_subtree(ASTNode *node, int byte_delta, int line_delta) {
+    while (node) {
+        node->token.offset += byte_delta;
+        node->token.line += line_delta;
+        shift_subtree(node->left, byte_delta, line_delta);
+        node = node->right;
+    }
+}
+
+// Free the Program nodes [first, stop) of a chain and the items they hold
+static void free_items(ASTNode **items, int first, int stop) {
+    for (int k = first; k < stop; k++) {
+        free_ast(items[k]->left);
+        free(items[k]);
+    }
+}
+
+// Reparse after an edit, reusing the subtrees of top-level items the edit
+// did not touch. 'old_ast' and 'old_tokens' must come from the previous parse;
+// old_ast is consumed. Untouched items keep their node addresses; only the
+// edited items (plus any neighbour whose tokens changed) are reparsed. Falls
+// back to a full parse when the reparsed region needs error recovery.
+ASTNode *reparse_incremental(ASTNode *old_ast, const TokenBuffer *old_tokens, const char *new_source,
+                             TextEdit edit, ReparseStats *stats) {
+    ReparseStats local = {0, 0, 0};
+    TokenBuffer fresh = {NULL, 0, 0};
+    ASTNode **items = NULL;
+    int *starts = NULL;
+    int count = 0;
+
+    reset_lexer();
+    fill_token_buffer(&fresh, new_source);
+
+    // Collect the top-level items and the token each one starts at
+    for (ASTNode *p = old_ast; p && p->type == AST_PROGRAM && p->left; p = p->right) {
+        count++;
+    }
+    int usable = count > 0;
+    for (ASTNode *p = old_ast; usable && p; p = p->right) {
+        usable = p->type == AST_PROGRAM && p->left;
+    }
+    if (usable) {
+        items = malloc(count * sizeof(ASTNode *));
+        starts = malloc(count * sizeof(int));
+        if (!items || !starts) {
+            fprintf(stderr, "Error: Memory allocation failed for reparse\n");
+            exit(1);
+        }
+        int k = 0;
+        for (ASTNode *p = old_ast; p; p = p->right, k++) {
+            items[k] = p;
+            starts[k] = token_at_offset(old_tokens, p->token.offset);
+            usable = usable && old_tokens->tokens[starts[k]].offset == p->token.offset &&
+                     (k == 0 || starts[k] > starts[k - 1]);
+        }
+    }
+
+    int first = 0;
+    int reuse = count;
+    int start_token = 0;
+    int end_token = fresh.count - 1;
+    int byte_delta = edit.new_end - edit.old_end;
+    int line_delta = 0;
+
+    if (usable) {
+        // Items overlapping the edit; an edit reaching an item's first token
+        // can also change how the item before it ends (e.g. a trailing esle)
+        int last = 0;
+        for (int k = 0; k < count; k++) {
+            if (items[k]->token.offset <= edit.start) first = k;
+            if (items[k]->token.offset <= edit.old_end) last = k;
+        }
+        if (first > 0 && edit.start < old_tokens->tokens[starts[first] + 1].offset) {
+            first--;
+        }
+        start_token = starts[first];
+
+        // Tokens before the region must be unchanged
+        for (int i = 0; usable && i <= start_token; i++) {
+            usable = i < fresh.count && same_token_text(&old_tokens->tokens[i], &fresh.tokens[i]) &&
+                     old_tokens->tokens[i].offset == fresh.tokens[i].offset;
+        }
+
+        // First later item whose tokens survive intact (an esle item could
+        // still attach to a reparsed fi, so it is reparsed too)
+        for (reuse = last + 1; usable && reuse < count; reuse++) {
+            int new_start = token_at_offset(&fresh, items[reuse]->token.offset + byte_delta);
+            if (items[reuse]->token.type != TOKEN_ELSE &&
+                suffix_matches(old_tokens, starts[reuse], &fresh, new_start, byte_delta, &line_delta)) {
+                end_token = new_start;
+                break;
+            }
+        }
+    }
+
+    ASTNode *region = NULL;
+    DiagBuffer diagnostics = {NULL, 0, 0, NULL};
+    int clean = 0;
+
+    // From here on the new tokens are the parser's tokens
+    free(token_buffer.tokens);
+    token_buffer = fresh;
+
+    if (usable) {
+        position = start_token;
+        token_limit = end_token;
+        reported_until = start_token;
+        last_reported_line = 0;
+        last_reported_column = 0;
+        error_reporting_enabled = 1;
+        error_count = 0;
+        error_attempts = 0;
+
+        diag_capture_begin(&diagnostics);
+        advance();
+        region = parse_program();
+        diag_capture_end();
+
+        // Errors are only safe when nothing after the region is reused
+        clean = error_attempts == 0 || reuse == count;
+    }
+
+    if (!clean) {
+        // Full parse of the new source
+        diag_buffer_free(&diagnostics);
+        free_ast(region);
+        free_ast(old_ast);
+        free(items);
+        free(starts);
+
+        start_parse();
+        ASTNode *result = parse();
+        local.reparsed_items = 0;
+        for (ASTNode *p = result; p && p->left; p = p->right) local.reparsed_items++;
+        local.full_reparse = 1;
+        if (stats) *stats = local;
+        return result;
+    }
+
+    diag_buffer_flush(&diagnostics);
+    diag_buffer_free(&diagnostics);
+
+    // An empty region parses to a bare Program node
+    if (region && !region->left) {
+        free_ast(region);
+        region = NULL;
+    }
+
+    // Splice: prefix items, fresh region, shifted suffix items
+    free_items(items, first, reuse);
+    ASTNode *next = reuse < count ? items[reuse] : NULL;
+    ASTNode *head = region ? region : next;
+    if (region) {
+        program_tail(region)->right = next;
+        for (ASTNode *p = region; p != next; p = p->right) local.reparsed_items++;
+    }
+    if (first > 0) {
+        items[first - 1]->right = head;
+        head = items[0];
+    }
+    for (int k = reuse; k < count; k++) {
+        items[k]->token.offset += byte_delta;
+        items[k]->token.line += line_delta;
+        shift_subtree(items[k]->left, byte_delta, line_delta);
+    }
+    local.reused_items = first + (count - reuse);
+
+    // Leave the parser context at EOF, as parse() would
+    token_limit = token_buffer.count - 1;
+    position = token_limit;
+    reported_until = token_limit;
+    advance();
+
+    free(items);
+    free(starts);
+    if (stats) *stats = local;
+    return head ? head : create_node(AST_PROGRAM);
+}
+
+// Length of the common prefix and suffix of two sources, as an edit
+static TextEdit diff_sources(const char *old_source, const char *new_source) {
+    int old_length = (int)strlen(old_source);
+    int new_length = (int)strlen(new_source);
+    int start = 0;
+
+    while (start < old_length && start < new_length && old_source[start] == new_source[start]) {
+        start++;
+    }
+    int old_end = old_length;
+    int new_end = new_length;
+    while (old_end > start && new_end > start && old_source[old_end - 1] == new_source[new_end - 1]) {
+        old_end--;
+        new_end--;
+    }
+
+    TextEdit edit = {start, old_end, new_end};
+    return edit;
+}
+
+// Parse one version of a file, then incrementally reparse the edited version
+void proc_reparse_files(const char *old_file, const char *new_file) {
+    char *old_source = read_source_file(old_file);
+    char *new_source = read_source_file(new_file);
+    if (!old_source || !new_source) {
+        printf("Error: Could not open file %s\n", old_source ? new_file : old_file);
+        free(old_source);
+        free(new_source);
+        return;
+    }
+
+    reset_parser_state();
+    parser_init(old_source);
+    ASTNode *ast = parse();
+
+    TextEdit edit = diff_sources(old_source, new_source);
+    ReparseStats stats;
+    ast = reparse_incremental(ast, get_token_buffer(), new_source, edit, &stats);
+
+    printf("\nINCREMENTAL REPARSE: bytes %d-%d replaced by %d byte(s)\n",
+           edit.start, edit.old_end, edit.new_end - edit.start);
+    if (stats.full_reparse) {
+        printf("Full reparse of %d top-level item(s)\n", stats.reparsed_items);
+    } else {
+        printf("Reparsed %d top-level item(s), reused %d\n", stats.reparsed_items, stats.reused_items);
+    }
+    printf("\nABSTRACT SYNTAX TREE:\n");
+    print_ast(ast, 0);
+
+    free_ast(ast);
+    free(old_source);
+    free(new_source);
+}
+
 // Main parse function
 ASTNode *parse(void) {
     // Enable error reporting for all parsing
     error_reporting_enabled = 1;
+    if (parser_threads > 1) {
+        return parse_parallel();
+    }
     ASTNode *result = parse_program();
     return result;
 }
 
+// Print the one-line description of an AST node
+void print_ast_label(ASTNodeType type, const char *lexeme) {
+    DiagBuffer out = {NULL, 0, 0, NULL};
+    dump_ast_label(&out, type, lexeme);
+    diag_buffer_flush(&out);
+    diag_buffer_free(&out);
+}
+
 // Print AST
 void print_ast(ASTNode *node, int level) {
-    if (!node) return;
-
-    // Indent based on level
-    for (int i = 0; i < level; i++) printf("  ");
-
-    // Print node info
-    switch (node->type) {
-        case AST_PROGRAM:
-            printf("Program\n");
-            break;
-        case AST_VARDECL:
-            printf("VarDecl: %s\n", node->token.lexeme);
-            break;
-        case AST_ASSIGN:
-            printf("Assign\n");
-            break;
-        case AST_NUMBER:
-            printf("Number: %s\n", node->token.lexeme);
-            break;
-        case AST_STRING:
-            printf("String: \"%s\"\n", node->token.lexeme);
-            break;
-        case AST_IDENTIFIER:
-            printf("Identifier: %s\n", node->token.lexeme);
-            break;
-        case AST_IF:
-            printf("If Statement\n");
-            break;
-        case AST_ELSE:
-            printf("Else Statement\n");
-            break;
-        case AST_WHILE:
-            printf("While Loop\n");
-            break;
-        case AST_FOR:
-            printf("Repeat-Until Loop\n");
-            break;
-        case AST_BLOCK:
-            printf("Block\n");
-            break;
-        case AST_BINOP:
-            printf("BinaryOp: %s\n", node->token.lexeme);
-            break;
-        case AST_PRINT:
-            printf("Print Statement\n");
-            break;
-        case AST_FACTORIAL:
-            printf("Factorial Function\n");
-            break;
-        case AST_FUNCTION_CALL:
-            printf("Function Call: %s\n", node->token.lexeme);
-            break;
-        case AST_RETURN:
-            printf("Return Statement\n");
-            break;
-        case AST_FUNCTION_DECL:
-            printf("Function Declaration: %s\n", node->token.lexeme);
-            break;
-        default:
-            printf("Unknown node type: %d\n", node->type);
-    }
-
-    // Print children
-    print_ast(node->left, level + 1);
-    print_ast(node->right, level + 1);
+    DiagBuffer out = {NULL, 0, 0, NULL};
+    dump_ast(&out, node, level, DUMP_TEXT);
+    diag_buffer_flush(&out);
+    diag_buffer_free(&out);
 }
 
 // Print the token input stream
 void print_token_stream(const char* input) {
+    DiagBuffer out = {NULL, 0, 0, NULL};
     Token token;
     int temp_pos = 0;
     
+    // Lexical errors land in the same buffer, in order with the tokens
+    diag_capture_begin(&out);
     do {
         token = get_next_token(input, &temp_pos);
-        print_token(token);
+        dump_token(&out, &token, DUMP_TEXT);
+        if (out.length >= DUMP_FLUSH_BYTES) {
+            diag_buffer_flush(&out);
+        }
     } while (token.type != TOKEN_EOF);
+    diag_capture_end();
+    
+    diag_buffer_flush(&out);
+    diag_buffer_free(&out);
 }
 
 // Free AST memory
@@ -1082,10 +1631,40 @@ void free_ast(ASTNode *node) {
     free(node);
 }
 
-/* Process test files */
-void proc_test_file(const char *filename) {
+// Read a whole source file into a NUL-terminated buffer (caller frees)
+char *read_source_file(const char *filename) {
     FILE *file = fopen(filename, "r");
     if (!file) {
+        return NULL;
+    }
+
+    size_t capacity = 4096;
+    size_t len = 0;
+    char *buffer = malloc(capacity);
+    while (buffer) {
+        len += fread(buffer + len, 1, capacity - len - 1, file);
+        if (len < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = realloc(buffer, capacity);
+        if (!grown) {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+    fclose(file);
+
+    if (buffer) {
+        buffer[len] = '\0';
+    }
+    return buffer;
+}
+
+/* Process test files */
+void proc_test_file(const char *filename) {
+    char *buffer = read_source_file(filename);
+    if (!buffer) {
         printf("Error: Could not open file %s\n", filename);
         return;
     }
@@ -1093,11 +1672,6 @@ void proc_test_file(const char *filename) {
     // Reset everything for each file
     reset_parser_state();
     
-    char buffer[2048];
-    size_t len = fread(buffer, 1, sizeof(buffer) - 1, file);
-    buffer[len] = '\0';
-    fclose(file);
-    
     printf("\n==============================\n");
     printf("PARSING FILE: %s\n", filename);
     printf("==============================\n");
@@ -1131,4 +1705,5 @@ void proc_test_file(const char *filename) {
     printf("==============================\n");
 
     free_ast(ast);
+    free(buffer);
 }
@@ -0,0 +1,356 @@
+/* pass.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../../include/pass.h"
+#include "../../include/ir.h"
+#include "../../include/sccp.h"
+#include "../../include/gvn.h"
+#include "../../include/lexer.h"
+#include "../../include/parser.h"
+#include "../../include/semantic.h"
+#include "../../include/diagnostics.h"
+
+static const char* pass_pipeline = NULL;
+
+// Replace phis whose operands are all one value (or the phi itself), and copies
+static int simplify_pass(IRFunction* function, int* changes) {
+    int changed = 1;
+    int total = 0;
+    while (changed) {
+        changed = 0;
+        for (int b = 0; b < function->block_count; b++) {
+            IRBlock* block = &function->blocks[b];
+            for (int i = 0; i < block->count; i++) {
+                IRInstr* instr = block->code[i];
+                if (instr->replacement) {
+                    continue;
+                }
+                if (instr->op == IR_COPY) {
+                    instr->replacement = ir_resolve(instr->args[0]);
+                    changed = 1;
+                    total++;
+                    continue;
+                }
+                if (instr->op != IR_PHI) {
+                    continue;
+                }
+                IRInstr* same = NULL;
+                int trivial = 1;
+                for (int a = 0; a < instr->arg_count; a++) {
+                    IRInstr* arg = ir_resolve(instr->args[a]);
+                    if (arg == instr || arg == same) {
+                        continue;
+                    }
+                    if (same) {
+                        trivial = 0;
+                        break;
+                    }
+                    same = arg;
+                }
+                if (trivial && same) {
+                    instr->replacement = same;
+                    changed = 1;
+                    total++;
+                }
+            }
+        }
+    }
+
+    ir_apply_replacements(function);
+    *changes += total;
+    return IR_ANALYSIS_DOMINATORS;
+}
+
+// Remove instructions whose values nothing needs
+static int dce_pass(IRFunction* function, int* changes) {
+    char* live = calloc(function->value_count + 1, 1);
+    IRInstr** work = malloc((function->value_count + 1) * sizeof(IRInstr*));
+    if (!live || !work) {
+        fprintf(stderr, "Error: Memory allocation failed for dead code elimination\n");
+        exit(1);
+    }
+
+    int count = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        IRBlock* block = &function->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            if (ir_has_side_effects(block->code[i])) {
+                live[block->code[i]->id] = 1;
+                work[count++] = block->code[i];
+            }
+        }
+    }
+    while (count > 0) {
+        IRInstr* instr = work[--count];
+        for (int a = 0; a < instr->arg_count; a++) {
+            if (!live[instr->args[a]->id]) {
+                live[instr->args[a]->id] = 1;
+                work[count++] = instr->args[a];
+            }
+        }
+    }
+
+    int removed = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        IRBlock* block = &function->blocks[b];
+        int kept = 0;
+        for (int i = 0; i < block->count; i++) {
+            if (live[block->code[i]->id]) {
+                block->code[kept++] = block->code[i];
+            } else {
+                removed++;
+            }
+        }
+        block->count = kept;
+    }
+
+    free(live);
+    free(work);
+    *changes += removed;
+    return removed ? IR_ANALYSIS_DOMINATORS : IR_ANALYSIS_ALL;
+}
+
+// Every pass the pipeline can name
+static const IRPass passes[] = {
+    {"simplify", "fold trivial phis and copies", simplify_pass},
+    {"sccp", "propagate constants, delete dead branches and blocks", sccp_pass},
+    {"gvn", "reuse values computed in dominating blocks", gvn_pass},
+    {"dce", "remove instructions whose values are unused", dce_pass}
+};
+
+#define PASS_COUNT ((int)(sizeof(passes) / sizeof(passes[0])))
+
+const IRPass* find_pass(const char* name) {
+    for (int i = 0; i < PASS_COUNT; i++) {
+        if (strcmp(passes[i].name, name) == 0) {
+            return &passes[i];
+        }
+    }
+    return NULL;
+}
+
+// Set up a comma-separated pipeline
+int pass_manager_init(PassManager* manager, const char* pipeline) {
+    memset(manager, 0, sizeof(*manager));
+    if (!pipeline) {
+        pipeline = DEFAULT_PASS_PIPELINE;
+    }
+    if (strcmp(pipeline, "none") == 0 || pipeline[0] == '\0') {
+        return 1;
+    }
+
+    char* names = malloc(strlen(pipeline) + 1);
+    manager->steps = calloc(strlen(pipeline) / 2 + 1, sizeof(PassStep));
+    if (!names || !manager->steps) {
+        fprintf(stderr, "Error: Memory allocation failed for pass manager\n");
+        exit(1);
+    }
+    strcpy(names, pipeline);
+
+    for (char* name = strtok(names, ","); name; name = strtok(NULL, ",")) {
+        const IRPass* pass = find_pass(name);
+        if (!pass) {
+            fprintf(stderr, "Error: Unknown pass '%s' (available:", name);
+            for (int i = 0; i < PASS_COUNT; i++) {
+                fprintf(stderr, " %s", passes[i].name);
+            }
+            fprintf(stderr, ")\n");
+            free(names);
+            pass_manager_free(manager);
+            return 0;
+        }
+        manager->steps[manager->count++].pass = pass;
+    }
+    free(names);
+    return 1;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Make room for one more function's row of per-step changes
+static long* add_function_row(PassManager* manager, const char* name) {
+    if (manager->function_count == manager->function_capacity) {
+        manager->function_capacity = manager->function_capacity ? manager->function_capacity * 2 : 16;
+        manager->function_names = realloc(manager->function_names,
+                                          manager->function_capacity * sizeof(char*));
+        manager->function_changes = realloc(manager->function_changes,
+                                            manager->function_capacity * (manager->count + 1) * sizeof(long));
+        if (!manager->function_names || !manager->function_changes) {
+            fprintf(stderr, "Error: Memory allocation failed for pass manager\n");
+            exit(1);
+        }
+    }
+    char* copy = malloc(strlen(name) + 1);
+    if (!copy) {
+        fprintf(stderr, "Error: Memory allocation failed for pass manager\n");
+        exit(1);
+    }
+    strcpy(copy, name);
+    manager->function_names[manager->function_count] = copy;
+    long* row = &manager->function_changes[manager->function_count * manager->count];
+    memset(row, 0, manager->count * sizeof(long));
+    manager->function_count++;
+    return row;
+}
+
+// Run every step over every function; a step that changed nothing keeps
+// the analyses it was given
+void pass_manager_run(PassManager* manager, IRProgram* program) {
+    for (int f = 0; f < program->function_count; f++) {
+        IRFunction* function = program->functions[f];
+        long* row = add_function_row(manager, function->name);
+        for (int i = 0; i < manager->count; i++) {
+            PassStep* step = &manager->steps[i];
+            int changes = 0;
+            double start = now();
+            int kept = step->pass->run(function, &changes);
+            step->seconds += now() - start;
+            step->changes += changes;
+            row[i] += changes;
+            if (changes) {
+                ir_invalidate(function, kept);
+            }
+        }
+    }
+}
+
+void pass_manager_report(const PassManager* manager) {
+    const FoldStats* folding = &manager->folding;
+    printf("\nConstant folding: %d expression(s) folded, %d use(s) propagated, %d node(s) removed",
+           folding->folded, folding->propagated, folding->removed);
+    if (folding->division_by_zero) {
+        printf(", %d division(s) by zero left to run time", folding->division_by_zero);
+    }
+    printf(".\n");
+
+    double total = 0;
+    printf("\nPass timing:\n");
+    for (int i = 0; i < manager->count; i++) {
+        const PassStep* step = &manager->steps[i];
+        printf("  %-10s %6ld change(s) %10.3f ms  %s\n", step->pass->name, step->changes,
+               step->seconds * 1000, step->pass->description);
+        total += step->seconds;
+    }
+    printf("  %-10s %17s %10.3f ms\n", "total", "", total * 1000);
+
+    if (manager->count == 0 || manager->function_count == 0) {
+        return;
+    }
+    // Functions no step changed are left out
+    printf("\nChanges per function:\n  %-20s", "function");
+    for (int i = 0; i < manager->count; i++) {
+        printf(" %9s", manager->steps[i].pass->name);
+    }
+    printf("\n");
+    for (int f = 0; f < manager->function_count; f++) {
+        const long* row = &manager->function_changes[f * manager->count];
+        int changed = 0;
+        for (int i = 0; i < manager->count; i++) {
+            changed |= row[i] != 0;
+        }
+        if (!changed) {
+            continue;
+        }
+        printf("  %-20s", manager->function_names[f]);
+        for (int i = 0; i < manager->count; i++) {
+            printf(" %9ld", row[i]);
+        }
+        printf("\n");
+    }
+}
+
+void pass_manager_free(PassManager* manager) {
+    for (int f = 0; f < manager->function_count; f++) {
+        free(manager->function_names[f]);
+    }
+    free(manager->function_names);
+    free(manager->function_changes);
+    manager->function_names = NULL;
+    manager->function_changes = NULL;
+    manager->function_count = 0;
+    manager->function_capacity = 0;
+    free(manager->steps);
+    manager->steps = NULL;
+    manager->count = 0;
+}
+
+void set_pass_pipeline(const char* pipeline) {
+    pass_pipeline = pipeline;
+}
+
+const char* get_pass_pipeline(void) {
+    return pass_pipeline;
+}
+
+// Parse, check and lower a file, then run the manager's pipeline over it.
+// Diagnostics go to stderr; returns NULL if the file has any errors.
+IRProgram* compile_file_to_ir(const char* filename, PassManager* manager) {
+    char* buffer = read_source_file(filename);
+    if (!buffer) {
+        fprintf(stderr, "Error: Could not open file %s\n", filename);
+        return NULL;
+    }
+
+    DiagBuffer diagnostics = {NULL, 0, 0, NULL};
+    reset_lexer();
+    diag_capture_begin(&diagnostics);
+    parser_init(buffer);
+    ASTNode* ast = parse();
+    int errors = get_parse_error_count();
+    const TokenBuffer* tokens = get_token_buffer();
+    for (int i = 0; i < tokens->count; i++) {
+        if (tokens->tokens[i].error != ERROR_NONE && tokens->tokens[i].error != ERROR_RECOVERY_MODE) {
+            errors++;
+        }
+    }
+    set_semantic_verbose(0);
+    if (!analyze_semantics(ast)) {
+        errors++;
+    }
+    set_semantic_verbose(1);
+    diag_capture_end();
+
+    if (diagnostics.length > 0) {
+        fwrite(diagnostics.data, 1, diagnostics.length, stderr);
+    }
+    diag_buffer_free(&diagnostics);
+
+    IRProgram* program = NULL;
+    if (errors) {
+        fprintf(stderr, "Error: %s has errors; not compiling it\n", filename);
+    } else {
+        FoldStats folding;
+        fold_constants(ast, &folding);
+        program = lower_program(ast);
+        if (manager) {
+            manager->folding = folding;
+            pass_manager_run(manager, program);
+        }
+    }
+
+    free_ast(ast);
+    free(buffer);
+    return program;
+}
+
+// Compile a file to IR with the selected pipeline and print it
+void proc_ir_file(const char* filename) {
+    PassManager manager;
+    if (!pass_manager_init(&manager, pass_pipeline)) {
+        return;
+    }
+
+    IRProgram* program = compile_file_to_ir(filename, &manager);
+    if (program) {
+        print_ir_program(program);
+        pass_manager_report(&manager);
+        free_ir_program(program);
+    }
+    pass_manager_free(&manager);
+}
@@ -0,0 +1,446 @@
+/* peephole.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/peephole.h"
+#include "../../include/bytecode.h"
+#include "../../include/vm.h"
+
+// Instruction classes a pattern may match besides a single opcode
+enum {
+    MATCH_ANY = BC_OPCODE_COUNT,
+    MATCH_NONE,                // Window of one instruction
+    MATCH_BRANCH,              // Any jump or branch
+    MATCH_CONDITIONAL,         // A branch that may fall through
+    MATCH_END,                 // Never falls through: jump or return
+    MATCH_PURE,                // Writes a register and nothing else, and cannot fail
+    MATCH_WRITER               // Writes a register
+};
+
+// Rewrite state for one function. Counts are kept exact as instructions
+// change, so every pattern sees the current code.
+typedef struct {
+    BCFunction* function;
+    const BCProgram* program;
+    char* removed;             // Dropped, pending compaction
+    int* reads;                // Instructions reading each register
+    int* writes;               // Instructions writing each register
+    int* entries;              // Jumps targeting each instruction
+} Peephole;
+
+typedef int (*RewriteFn)(Peephole* peep, int pc, int next);
+
+// A pattern: the opcode or class of the instruction and of the next one kept,
+// and the rewrite, which checks the rest and returns 1 if it applied
+typedef struct {
+    const char* name;
+    int first;
+    int second;
+    RewriteFn rewrite;
+} PatternRule;
+
+static int enabled = 1;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for peephole optimizer\n");
+    exit(1);
+}
+
+void set_peephole(int on) {
+    enabled = on;
+}
+
+int peephole_enabled(void) {
+    return enabled;
+}
+
+static int is_conditional(int op) {
+    return op == BC_JUMPIF || op == BC_JUMPIFNOT || BC_IS_FUSED_BRANCH(op);
+}
+
+static int is_pure(int op) {
+    if (op == BC_DIVI || op == BC_DIVIK || op == BC_CALL || op == BC_STOREG) {
+        return 0;
+    }
+    return op <= BC_FACT || (op >= BC_ADDIK && op <= BC_DIVFK);
+}
+
+static int matches(const BCInstr* instr, int match) {
+    switch (match) {
+        case MATCH_ANY: return 1;
+        case MATCH_BRANCH: return instr->op == BC_JUMP || is_conditional(instr->op);
+        case MATCH_CONDITIONAL: return is_conditional(instr->op);
+        case MATCH_END: return instr->op == BC_JUMP || instr->op == BC_RETURN;
+        case MATCH_PURE: return is_pure(instr->op);
+        case MATCH_WRITER: return bc_writes(instr) >= 0;
+        default: return instr->op == match;
+    }
+}
+
+// Add (delta 1) or withdraw (-1) an instruction's register uses and jump
+static void account(Peephole* peep, const BCInstr* instr, int delta) {
+    int reads[2];
+    int range;
+    int count = bc_reads(peep->program, instr, reads, &range);
+    for (int i = 0; i < count; i++) peep->reads[reads[i]] += delta;
+    for (int i = 0; i < range; i++) peep->reads[instr->c + i] += delta;
+    int written = bc_writes(instr);
+    if (written >= 0) peep->writes[written] += delta;
+    int target = bc_jump_target(instr);
+    if (target >= 0) peep->entries[target] += delta;
+}
+
+static void replace(Peephole* peep, int pc, BCInstr instr) {
+    account(peep, &peep->function->code[pc], -1);
+    peep->function->code[pc] = instr;
+    account(peep, &instr, 1);
+}
+
+static void drop(Peephole* peep, int pc) {
+    account(peep, &peep->function->code[pc], -1);
+    peep->removed[pc] = 1;
+}
+
+static int next_kept(const Peephole* peep, int pc) {
+    do {
+        pc++;
+    } while (pc < peep->function->code_count && peep->removed[pc]);
+    return pc;
+}
+
+// Where a jump to 'target' lands once dropped instructions are gone
+static int landing(const Peephole* peep, int target) {
+    return peep->removed[target] ? next_kept(peep, target) : target;
+}
+
+// Whether a jump lands on pc, directly or through dropped instructions
+static int is_entry(const Peephole* peep, int pc) {
+    if (peep->entries[pc]) {
+        return 1;
+    }
+    for (int p = pc - 1; p >= 0 && peep->removed[p]; p--) {
+        if (peep->entries[p]) return 1;
+    }
+    return 0;
+}
+
+// Branch testing the opposite condition
+static int inverted(int op) {
+    if (op == BC_JUMPIF) return BC_JUMPIFNOT;
+    if (op == BC_JUMPIFNOT) return BC_JUMPIF;
+    int base = op >= BC_JEQIK ? BC_JEQIK : BC_JEQI;
+    static const int opposite[] = {1, 0, 5, 4, 3, 2};  // eq ne lt le gt ge
+    return base + opposite[op - base];
+}
+
+static int set_target(BCInstr* instr, int target) {
+    if (BC_IS_FUSED_BRANCH(instr->op) && target > BC_MAX_OPERAND) {
+        return 0;
+    }
+    bc_set_jump_target(instr, target);
+    return 1;
+}
+
+static int drop_self_move(Peephole* peep, int pc, int next) {
+    const BCInstr* instr = &peep->function->code[pc];
+    if (instr->a != instr->b) {
+        return 0;
+    }
+    drop(peep, pc);
+    return 1;
+}
+
+static int drop_dead_temporary(Peephole* peep, int pc, int next) {
+    if (peep->reads[peep->function->code[pc].a] != 0) {
+        return 0;
+    }
+    drop(peep, pc);
+    return 1;
+}
+
+// Follow a chain of unconditional jumps; a jump ending at a return becomes one
+static int thread_jump(Peephole* peep, int pc, int next) {
+    BCFunction* function = peep->function;
+    BCInstr instr = function->code[pc];
+    int start = landing(peep, bc_jump_target(&instr));
+    int to = start;
+    for (int hops = 0; hops < function->code_count && to < function->code_count &&
+                       function->code[to].op == BC_JUMP && to != pc; hops++) {
+        to = landing(peep, bc_jump_target(&function->code[to]));
+    }
+    if (instr.op == BC_JUMP && to < function->code_count && function->code[to].op == BC_RETURN) {
+        replace(peep, pc, function->code[to]);
+        function->lines[pc] = function->lines[to];
+        return 1;
+    }
+    if (to == start || !set_target(&instr, to)) {
+        return 0;
+    }
+    replace(peep, pc, instr);
+    return 1;
+}
+
+static int drop_jump_to_next(Peephole* peep, int pc, int next) {
+    if (landing(peep, bc_jump_target(&peep->function->code[pc])) != next) {
+        return 0;
+    }
+    drop(peep, pc);
+    return 1;
+}
+
+// "if c goto L1; goto L2; L1:" is "if not c goto L2; L1:"
+static int invert_over_jump(Peephole* peep, int pc, int next) {
+    BCInstr instr = peep->function->code[pc];
+    if (landing(peep, bc_jump_target(&instr)) != next_kept(peep, next)) {
+        return 0;
+    }
+    instr.op = (uint16_t)inverted(instr.op);
+    if (!set_target(&instr, bc_jump_target(&peep->function->code[next]))) {
+        return 0;
+    }
+    drop(peep, next);
+    replace(peep, pc, instr);
+    return 1;
+}
+
+// "goto L; M: ... L: if c goto M" is "if not c goto L+1; M:", rotating loops
+// so each iteration runs one branch instead of a jump and a branch
+static int copy_branch(Peephole* peep, int pc, int next) {
+    BCFunction* function = peep->function;
+    int to = landing(peep, bc_jump_target(&function->code[pc]));
+    if (to >= function->code_count || !is_conditional(function->code[to].op) ||
+        landing(peep, bc_jump_target(&function->code[to])) != next) {
+        return 0;
+    }
+    BCInstr instr = function->code[to];
+    instr.op = (uint16_t)inverted(instr.op);
+    if (!set_target(&instr, next_kept(peep, to))) {
+        return 0;
+    }
+    replace(peep, pc, instr);
+    return 1;
+}
+
+static int drop_unreachable(Peephole* peep, int pc, int next) {
+    drop(peep, next);
+    return 1;
+}
+
+static int forward_store(Peephole* peep, int pc, int next) {
+    const BCInstr* store = &peep->function->code[pc];
+    const BCInstr* load = &peep->function->code[next];
+    if (store->b != load->b) {
+        return 0;
+    }
+    replace(peep, next, (BCInstr){BC_MOVE, load->a, store->a, 0});
+    return 1;
+}
+
+static int forward_load(Peephole* peep, int pc, int next) {
+    const BCInstr* first = &peep->function->code[pc];
+    const BCInstr* second = &peep->function->code[next];
+    if (first->b != second->b) {
+        return 0;
+    }
+    replace(peep, next, (BCInstr){BC_MOVE, second->a, first->a, 0});
+    return 1;
+}
+
+static int drop_store_back(Peephole* peep, int pc, int next) {
+    const BCInstr* load = &peep->function->code[pc];
+    const BCInstr* store = &peep->function->code[next];
+    if (load->b != store->b || load->a != store->a) {
+        return 0;
+    }
+    drop(peep, next);
+    return 1;
+}
+
+static int drop_overwritten_store(Peephole* peep, int pc, int next) {
+    if (peep->function->code[pc].b != peep->function->code[next].b) {
+        return 0;
+    }
+    drop(peep, pc);
+    return 1;
+}
+
+// Whether an instruction can run after a write to 'reg' it used to precede:
+// straight-line code that neither reads nor writes reg
+static int independent(Peephole* peep, const BCInstr* instr, int reg) {
+    if (instr->op == BC_CALL || instr->op == BC_RETURN || bc_jump_target(instr) >= 0 ||
+        bc_writes(instr) == reg) {
+        return 0;
+    }
+    int reads[2];
+    int range;
+    int count = bc_reads(peep->program, instr, reads, &range);
+    for (int i = 0; i < count; i++) {
+        if (reads[i] == reg) return 0;
+    }
+    return 1;
+}
+
+// "op rT, ...; move rX, rT" is "op rX, ..." when nothing else uses rT. One
+// instruction independent of rX may sit between them, as when several loop
+// variables are updated together.
+static int coalesce_move(Peephole* peep, int pc, int next) {
+    BCFunction* function = peep->function;
+    BCInstr instr = function->code[pc];
+    int temporary = bc_writes(&instr);
+    int move = next;
+    if (function->code[next].op != BC_MOVE || function->code[next].b != temporary) {
+        move = next_kept(peep, next);
+        if (move >= function->code_count || function->code[move].op != BC_MOVE ||
+            is_entry(peep, move) || function->code[move].b != temporary ||
+            !independent(peep, &function->code[next], function->code[move].a) ||
+            bc_writes(&function->code[next]) == temporary) {
+            return 0;
+        }
+    }
+    int dest = function->code[move].a;
+    if (dest == temporary || peep->reads[temporary] != 1 || peep->writes[temporary] != 1) {
+        return 0;
+    }
+    instr.a = (uint16_t)dest;
+    drop(peep, move);
+    replace(peep, pc, instr);
+    return 1;
+}
+
+// Tried in order at each instruction; a second opcode of MATCH_NONE makes a
+// one-instruction window, otherwise the next instruction kept must not be a
+// jump target
+static const PatternRule patterns[PEEP_PATTERN_COUNT] = {
+    [PEEP_SELF_MOVE]      = {"self-move",        BC_MOVE,           MATCH_NONE,  drop_self_move},
+    [PEEP_DEAD_TEMPORARY] = {"dead temporary",   MATCH_PURE,        MATCH_NONE,  drop_dead_temporary},
+    [PEEP_JUMP_THREAD]    = {"jump threading",   MATCH_BRANCH,      MATCH_NONE,  thread_jump},
+    [PEEP_JUMP_TO_NEXT]   = {"jump to next",     MATCH_BRANCH,      MATCH_ANY,   drop_jump_to_next},
+    [PEEP_JUMP_OVER_JUMP] = {"jump over jump",   MATCH_CONDITIONAL, BC_JUMP,     invert_over_jump},
+    [PEEP_JUMP_TO_BRANCH] = {"jump to branch",   BC_JUMP,           MATCH_ANY,   copy_branch},
+    [PEEP_UNREACHABLE]    = {"unreachable",      MATCH_END,         MATCH_ANY,   drop_unreachable},
+    [PEEP_STORE_LOAD]     = {"store/load",       BC_STOREG,         BC_LOADG,    forward_store},
+    [PEEP_LOAD_LOAD]      = {"load/load",        BC_LOADG,          BC_LOADG,    forward_load},
+    [PEEP_LOAD_STORE]     = {"load/store",       BC_LOADG,          BC_STOREG,   drop_store_back},
+    [PEEP_STORE_STORE]    = {"store/store",      BC_STOREG,         BC_STOREG,   drop_overwritten_store},
+    [PEEP_COALESCE_MOVE]  = {"move coalescing",  MATCH_WRITER,      MATCH_ANY,   coalesce_move},
+};
+
+// Jumps are rewritten whether or not the next instruction is a jump target
+static int needs_plain_successor(int pattern) {
+    return patterns[pattern].second != MATCH_NONE && pattern != PEEP_JUMP_TO_NEXT &&
+           pattern != PEEP_JUMP_TO_BRANCH;
+}
+
+// One pass of the window over the function; returns the rewrites applied
+static int sweep(Peephole* peep, int hits[PEEP_PATTERN_COUNT]) {
+    BCFunction* function = peep->function;
+    int applied = 0;
+    for (int pc = 0; pc < function->code_count; pc++) {
+        int rewritten = 1;
+        while (rewritten && !peep->removed[pc]) {
+            rewritten = 0;
+            int next = next_kept(peep, pc);
+            for (int p = 0; p < PEEP_PATTERN_COUNT && !rewritten; p++) {
+                const PatternRule* rule = &patterns[p];
+                if (!matches(&function->code[pc], rule->first)) {
+                    continue;
+                }
+                if (rule->second != MATCH_NONE &&
+                    (next >= function->code_count || !matches(&function->code[next], rule->second))) {
+                    continue;
+                }
+                if (needs_plain_successor(p) && is_entry(peep, next)) {
+                    continue;
+                }
+                if (rule->rewrite(peep, pc, next)) {
+                    rewritten = 1;
+                    applied++;
+                    if (hits) hits[p]++;
+                }
+            }
+        }
+    }
+    return applied;
+}
+
+static int optimize_function(const BCProgram* program, BCFunction* function, int hits[PEEP_PATTERN_COUNT]) {
+    int before = function->code_count;
+    Peephole peep;
+    peep.function = function;
+    peep.program = program;
+    for (;;) {
+        int count = function->code_count;
+        peep.removed = calloc(count + 1, 1);
+        peep.reads = calloc(function->register_count + 1, sizeof(int));
+        peep.writes = calloc(function->register_count + 1, sizeof(int));
+        peep.entries = calloc(count + 1, sizeof(int));
+        if (!peep.removed || !peep.reads || !peep.writes || !peep.entries) out_of_memory();
+        for (int pc = 0; pc < count; pc++) {
+            account(&peep, &function->code[pc], 1);
+        }
+
+        int applied = sweep(&peep, hits);
+        int dropped = 0;
+        for (int pc = 0; pc < count; pc++) dropped += peep.removed[pc];
+        if (dropped) {
+            bc_remove_instructions(function, peep.removed);
+        }
+        free(peep.removed);
+        free(peep.reads);
+        free(peep.writes);
+        free(peep.entries);
+        if (!applied) {
+            break;
+        }
+    }
+    return before - function->code_count;
+}
+
+int peephole_program(BCProgram* program, int hits[PEEP_PATTERN_COUNT]) {
+    int removed = 0;
+    for (int f = 0; f < program->function_count; f++) {
+        removed += optimize_function(program, &program->functions[f], hits);
+    }
+    return removed;
+}
+
+static int program_size(const BCProgram* program) {
+    int size = 0;
+    for (int f = 0; f < program->function_count; f++) size += program->functions[f].code_count;
+    return size;
+}
+
+void proc_peephole_files(int count, char* filenames[]) {
+    int hits[PEEP_PATTERN_COUNT];
+    memset(hits, 0, sizeof(hits));
+    int was_enabled = enabled;
+    enabled = 0;
+    printf("%-32s %8s %8s %14s %14s %7s\n", "program", "size", "after", "executed", "after", "saved");
+    for (int i = 0; i < count; i++) {
+        BCProgram* program = compile_file_to_bytecode(filenames[i]);
+        if (!program) {
+            continue;
+        }
+        int result;
+        VMStats before = {0, 0};
+        VMStats after = {0, 0};
+        int size = program_size(program);
+        int ok = vm_run(program, 1, &before, &result);
+        peephole_program(program, hits);
+        ok = ok && vm_run(program, 1, &after, &result);
+        if (ok) {
+            printf("%-32s %8d %8d %14lld %14lld %6.1f%%\n", filenames[i], size, program_size(program),
+                   before.executed, after.executed,
+                   before.executed ? 100.0 * (before.executed - after.executed) / before.executed : 0.0);
+        } else {
+            printf("%-32s %8d %8d %14s %14s\n", filenames[i], size, program_size(program), "error", "error");
+        }
+        free_bytecode(program);
+    }
+    enabled = was_enabled;
+
+    printf("\nPattern applications:\n");
+    for (int p = 0; p < PEEP_PATTERN_COUNT; p++) {
+        printf("  %-18s %8d\n", patterns[p].name, hits[p]);
+    }
+}
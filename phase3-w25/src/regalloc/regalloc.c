@@ -0,0 +1,419 @@
+/* regalloc.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../../include/regalloc.h"
+#include "../../include/ir.h"
+#include "../../include/cfg.h"
+#include "../../include/pass.h"
+
+static const char* names64[RA_REGISTER_COUNT] = {"%rbx", "%r12", "%r13", "%r14", "%r15", "%r10", "%r11"};
+static const char* names32[RA_REGISTER_COUNT] = {"%ebx", "%r12d", "%r13d", "%r14d", "%r15d", "%r10d", "%r11d"};
+
+// Deepest loop nesting that still raises a spill cost
+#define MAX_WEIGHTED_DEPTH 6
+
+// The live range of one value, as the hull of the positions where it is live
+typedef struct {
+    int value;
+    int start;
+    int end;
+    int def;                   // Position of the definition
+    double cost;               // Spill cost: uses and definitions, weighted by loop depth
+    int crosses_call;          // Live across a call, so it needs a callee-saved register
+    int reg;
+} Interval;
+
+// Per-function analysis state
+typedef struct {
+    IRFunction* function;
+    int words;                 // 64-bit words in a value set
+    uint64_t* live_in;         // By block: words per set
+    uint64_t* live_out;
+    int* block_start;          // Positions in the linear order (two per instruction)
+    int* block_end;
+    double* block_weight;      // 10 to the block's loop depth
+    int* calls;                // Positions of calls, ascending
+    int call_count;
+    int* interval_of;          // By value number: index into intervals, or -1
+    Interval* intervals;
+    int interval_count;
+} Allocator;
+
+static int enabled = 1;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for register allocation\n");
+    exit(1);
+}
+
+void set_regalloc(int on) {
+    enabled = on;
+}
+
+int regalloc_enabled(void) {
+    return enabled;
+}
+
+const char* ra_register_name(int reg, int bits) {
+    return bits == 32 ? names32[reg] : names64[reg];
+}
+
+static int is_candidate(const IRInstr* instr) {
+    return instr->type == IR_INT || instr->type == IR_STR;
+}
+
+// Calls, including those into the runtime library, clobber the caller-saved registers
+static int is_call(const IRInstr* instr) {
+    return instr->op == IR_CALL || instr->op == IR_PRINT || instr->op == IR_FTOI || instr->op == IR_FACT;
+}
+
+static int set_has(const uint64_t* set, int v) {
+    return (set[v / 64] >> (v % 64)) & 1;
+}
+
+static void set_add(uint64_t* set, int v) {
+    set[v / 64] |= (uint64_t)1 << (v % 64);
+}
+
+// Number instructions in layout order: the code generator emits live blocks
+// by index, each instruction at an even position, edge moves just after a
+// block's last instruction
+static void number_positions(Allocator* ra) {
+    IRFunction* function = ra->function;
+    CFG* dom = ir_dominators(function);
+    int k = 0;
+    int calls = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        const IRBlock* block = &function->blocks[b];
+        ra->block_start[b] = 2 * k;
+        ra->block_end[b] = 2 * k;
+        if (block->dead) {
+            continue;
+        }
+        int depth = dom->blocks[b].loop_depth;
+        if (depth > MAX_WEIGHTED_DEPTH) depth = MAX_WEIGHTED_DEPTH;
+        ra->block_weight[b] = 1;
+        while (depth-- > 0) ra->block_weight[b] *= 10;
+        for (int i = 0; i < block->count; i++) {
+            if (is_call(block->code[i])) {
+                ra->calls[calls++] = 2 * k;
+            }
+            k++;
+        }
+        if (block->count == 0) k++;
+        ra->block_end[b] = 2 * k - 1;
+    }
+    ra->call_count = calls;
+}
+
+// Index of block 'from' among the predecessors of 'to' (-1 if not one)
+static int pred_index(const IRBlock* to, int from) {
+    for (int p = 0; p < to->pred_count; p++) {
+        if (to->preds[p] == from) return p;
+    }
+    return -1;
+}
+
+// Backward liveness over values. A phi's operand is live out of its
+// predecessor (the edge move reads it there), not into the phi's block.
+static void compute_liveness(Allocator* ra) {
+    IRFunction* function = ra->function;
+    int words = ra->words;
+    uint64_t* uses = calloc((size_t)function->block_count * words + 1, sizeof(uint64_t));
+    uint64_t* defs = calloc((size_t)function->block_count * words + 1, sizeof(uint64_t));
+    if (!uses || !defs) out_of_memory();
+
+    for (int b = 0; b < function->block_count; b++) {
+        const IRBlock* block = &function->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        uint64_t* use = uses + (size_t)b * words;
+        uint64_t* def = defs + (size_t)b * words;
+        for (int i = 0; i < block->count; i++) {
+            const IRInstr* instr = block->code[i];
+            if (instr->op != IR_PHI) {
+                for (int a = 0; a < instr->arg_count; a++) {
+                    int v = ir_resolve(instr->args[a])->id;
+                    if (!set_has(def, v)) set_add(use, v);
+                }
+            }
+            if (instr->type != IR_VOID) {
+                set_add(def, instr->id);
+            }
+        }
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int b = function->block_count - 1; b >= 0; b--) {
+            const IRBlock* block = &function->blocks[b];
+            if (block->dead) {
+                continue;
+            }
+            uint64_t* in = ra->live_in + (size_t)b * words;
+            uint64_t* out = ra->live_out + (size_t)b * words;
+            for (int s = 0; s < block->succ_count; s++) {
+                const IRBlock* succ = &function->blocks[block->succ[s]];
+                const uint64_t* succ_in = ra->live_in + (size_t)block->succ[s] * words;
+                for (int w = 0; w < words; w++) {
+                    if (succ_in[w] & ~out[w]) {
+                        out[w] |= succ_in[w];
+                        changed = 1;
+                    }
+                }
+                int p = pred_index(succ, b);
+                for (int i = 0; p >= 0 && i < succ->count && succ->code[i]->op == IR_PHI; i++) {
+                    int v = ir_resolve(succ->code[i]->args[p])->id;
+                    if (!set_has(out, v)) {
+                        set_add(out, v);
+                        changed = 1;
+                    }
+                }
+            }
+            const uint64_t* use = uses + (size_t)b * words;
+            const uint64_t* def = defs + (size_t)b * words;
+            for (int w = 0; w < words; w++) {
+                uint64_t live = use[w] | (out[w] & ~def[w]);
+                if (live & ~in[w]) {
+                    in[w] |= live;
+                    changed = 1;
+                }
+            }
+        }
+    }
+    free(uses);
+    free(defs);
+}
+
+static void extend(Interval* interval, int position) {
+    if (position < interval->start) interval->start = position;
+    if (position > interval->end) interval->end = position;
+}
+
+static Interval* interval_for(Allocator* ra, const IRInstr* value) {
+    int index = ra->interval_of[value->id];
+    return index >= 0 ? &ra->intervals[index] : NULL;
+}
+
+static void build_intervals(Allocator* ra) {
+    IRFunction* function = ra->function;
+    for (int v = 0; v <= function->value_count; v++) ra->interval_of[v] = -1;
+
+    // Definitions; parameters arrive before any instruction runs
+    for (int b = 0; b < function->block_count; b++) {
+        const IRBlock* block = &function->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        for (int i = 0; i < block->count; i++) {
+            const IRInstr* instr = block->code[i];
+            if (!is_candidate(instr)) {
+                continue;
+            }
+            int position = instr->op == IR_PARAM ? 0 : instr->op == IR_PHI ? ra->block_start[b] : ra->block_start[b] + 2 * i;
+            Interval* interval = &ra->intervals[ra->interval_count];
+            interval->value = instr->id;
+            interval->start = interval->end = interval->def = position;
+            interval->cost = ra->block_weight[b];
+            interval->crosses_call = 0;
+            interval->reg = -1;
+            ra->interval_of[instr->id] = ra->interval_count++;
+        }
+    }
+
+    // Uses, and the blocks each value is live into or out of
+    for (int b = 0; b < function->block_count; b++) {
+        const IRBlock* block = &function->blocks[b];
+        if (block->dead) {
+            continue;
+        }
+        for (int i = 0; i < block->count; i++) {
+            const IRInstr* instr = block->code[i];
+            for (int a = 0; a < instr->arg_count; a++) {
+                Interval* interval = interval_for(ra, ir_resolve(instr->args[a]));
+                if (!interval) {
+                    continue;
+                }
+                int site = b;
+                int position = ra->block_start[b] + 2 * i;
+                if (instr->op == IR_PHI) {
+                    site = block->preds[a];
+                    position = ra->block_end[site];
+                }
+                extend(interval, position);
+                interval->cost += ra->block_weight[site];
+            }
+        }
+        const uint64_t* in = ra->live_in + (size_t)b * ra->words;
+        const uint64_t* out = ra->live_out + (size_t)b * ra->words;
+        for (int v = 0; v < function->value_count; v++) {
+            if (ra->interval_of[v] < 0) {
+                continue;
+            }
+            if (set_has(in, v)) extend(&ra->intervals[ra->interval_of[v]], ra->block_start[b]);
+            if (set_has(out, v)) extend(&ra->intervals[ra->interval_of[v]], ra->block_end[b]);
+        }
+    }
+
+    // A value read after a call it was live before needs a callee-saved
+    // register. That includes a call at the interval's start when the value
+    // is live into the call's block rather than defined by the call.
+    for (int n = 0; n < ra->interval_count; n++) {
+        Interval* interval = &ra->intervals[n];
+        for (int c = 0; c < ra->call_count && ra->calls[c] < interval->end; c++) {
+            if (ra->calls[c] >= interval->start && ra->calls[c] != interval->def) {
+                interval->crosses_call = 1;
+                break;
+            }
+        }
+    }
+}
+
+static int by_start(const void* a, const void* b) {
+    const Interval* x = a;
+    const Interval* y = b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->value - y->value;
+}
+
+// Registers to try: caller-saved ones first for values no call interrupts,
+// so callee-saved ones (which cost a save and restore) are left for the rest
+static const int try_order[RA_REGISTER_COUNT] = {5, 6, 0, 1, 2, 3, 4};
+
+static void linear_scan(Allocator* ra) {
+    int owner[RA_REGISTER_COUNT];
+    for (int r = 0; r < RA_REGISTER_COUNT; r++) owner[r] = -1;
+    qsort(ra->intervals, ra->interval_count, sizeof(Interval), by_start);
+
+    for (int n = 0; n < ra->interval_count; n++) {
+        Interval* current = &ra->intervals[n];
+
+        // Expire intervals that ended before this one starts
+        for (int r = 0; r < RA_REGISTER_COUNT; r++) {
+            if (owner[r] >= 0 && ra->intervals[owner[r]].end < current->start) owner[r] = -1;
+        }
+
+        int chosen = -1;
+        for (int t = 0; t < RA_REGISTER_COUNT && chosen < 0; t++) {
+            int r = try_order[t];
+            if (owner[r] < 0 && (r < RA_CALLEE_SAVED || !current->crosses_call)) chosen = r;
+        }
+        if (chosen < 0) {
+            // Take the register of the cheapest interval in the way, if it is cheaper
+            int victim = -1;
+            for (int r = 0; r < RA_REGISTER_COUNT; r++) {
+                if (r >= RA_CALLEE_SAVED && current->crosses_call) {
+                    continue;
+                }
+                if (victim < 0 || ra->intervals[owner[r]].cost < ra->intervals[owner[victim]].cost) victim = r;
+            }
+            if (victim >= 0 && ra->intervals[owner[victim]].cost < current->cost) {
+                ra->intervals[owner[victim]].reg = -1;
+                chosen = victim;
+            }
+        }
+        if (chosen >= 0) {
+            current->reg = chosen;
+            owner[chosen] = n;
+        }
+    }
+}
+
+void allocate_registers(IRFunction* function, RegAllocation* allocation) {
+    int values = function->value_count + 1;
+    allocation->registers = malloc(values * sizeof(int));
+    if (!allocation->registers) out_of_memory();
+    for (int v = 0; v < values; v++) allocation->registers[v] = -1;
+    allocation->candidates = 0;
+    allocation->spilled = 0;
+    allocation->used = 0;
+
+    Allocator ra;
+    memset(&ra, 0, sizeof(ra));
+    ra.function = function;
+    ra.words = (values + 63) / 64;
+    int instructions = 0;
+    for (int b = 0; b < function->block_count; b++) instructions += function->blocks[b].count;
+    ra.live_in = calloc((size_t)function->block_count * ra.words + 1, sizeof(uint64_t));
+    ra.live_out = calloc((size_t)function->block_count * ra.words + 1, sizeof(uint64_t));
+    ra.block_start = malloc((function->block_count + 1) * sizeof(int));
+    ra.block_end = malloc((function->block_count + 1) * sizeof(int));
+    ra.block_weight = malloc((function->block_count + 1) * sizeof(double));
+    ra.calls = malloc((instructions + 1) * sizeof(int));
+    ra.interval_of = malloc(values * sizeof(int));
+    ra.intervals = malloc(values * sizeof(Interval));
+    if (!ra.live_in || !ra.live_out || !ra.block_start || !ra.block_end || !ra.block_weight ||
+        !ra.calls || !ra.interval_of || !ra.intervals) out_of_memory();
+
+    number_positions(&ra);
+    compute_liveness(&ra);
+    build_intervals(&ra);
+    if (enabled) {
+        linear_scan(&ra);
+    }
+
+    allocation->candidates = ra.interval_count;
+    for (int n = 0; n < ra.interval_count; n++) {
+        const Interval* interval = &ra.intervals[n];
+        allocation->registers[interval->value] = interval->reg;
+        if (interval->reg >= 0) {
+            allocation->used |= 1 << interval->reg;
+        } else {
+            allocation->spilled++;
+        }
+    }
+
+    allocation->live_in = ra.live_in;
+    allocation->words = ra.words;
+    free(ra.live_out);
+    free(ra.block_start);
+    free(ra.block_end);
+    free(ra.block_weight);
+    free(ra.calls);
+    free(ra.interval_of);
+    free(ra.intervals);
+}
+
+void free_allocation(RegAllocation* allocation) {
+    free(allocation->registers);
+    free(allocation->live_in);
+    allocation->registers = NULL;
+    allocation->live_in = NULL;
+}
+
+void proc_regalloc_files(int count, char* filenames[]) {
+    for (int i = 0; i < count; i++) {
+        PassManager manager;
+        if (!pass_manager_init(&manager, get_pass_pipeline())) {
+            return;
+        }
+        IRProgram* ir = compile_file_to_ir(filenames[i], &manager);
+        pass_manager_free(&manager);
+        if (!ir) {
+            continue;
+        }
+        printf("%s\n", filenames[i]);
+        printf("  %-24s %10s %10s %8s  %s\n", "function", "candidates", "registers", "spilled", "registers used");
+        int candidates = 0;
+        int spilled = 0;
+        for (int f = 0; f < ir->function_count; f++) {
+            RegAllocation allocation;
+            allocate_registers(ir->functions[f], &allocation);
+            candidates += allocation.candidates;
+            spilled += allocation.spilled;
+            printf("  %-24s %10d %10d %8d ", ir->functions[f]->name, allocation.candidates,
+                   allocation.candidates - allocation.spilled, allocation.spilled);
+            for (int r = 0; r < RA_REGISTER_COUNT; r++) {
+                if (allocation.used & (1 << r)) printf(" %s", names64[r]);
+            }
+            printf("\n");
+            free_allocation(&allocation);
+        }
+        printf("  %-24s %10d %10d %8d\n", "total", candidates, candidates - spilled, spilled);
+        free_ir_program(ir);
+    }
+}
@@ -0,0 +1,403 @@
+/* sccp.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "../../include/sccp.h"
+#include "../../include/ir.h"
+
+// Lattice: unknown yet (top), one constant, or not constant (bottom)
+typedef enum {
+    LATTICE_TOP,
+    LATTICE_CONST,
+    LATTICE_BOTTOM
+} LatticeState;
+
+typedef struct {
+    LatticeState state;
+    int i;
+    double f;
+} Lattice;
+
+// Solver state
+typedef struct {
+    IRFunction* function;
+    Lattice* values;           // By value number
+    char* visited;             // Block has been reached
+    char** executable;         // executable[b][p]: edge from predecessor p of b
+    int* user_start;           // Users of value v: users[user_start[v]..user_start[v + 1])
+    IRInstr** users;
+    int* block_work;
+    int block_count;
+    IRInstr** value_work;
+    int value_count;
+    int value_capacity;
+} Solver;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for constant propagation\n");
+    exit(1);
+}
+
+// Index every instruction under the values it reads
+static void build_users(Solver* solver) {
+    IRFunction* function = solver->function;
+    int values = function->value_count;
+    solver->user_start = calloc(values + 2, sizeof(int));
+    if (!solver->user_start) out_of_memory();
+
+    int total = 0;
+    for (int b = 0; b < function->block_count; b++) {
+        IRBlock* block = &function->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            for (int a = 0; a < block->code[i]->arg_count; a++) {
+                solver->user_start[block->code[i]->args[a]->id + 1]++;
+                total++;
+            }
+        }
+    }
+    for (int v = 0; v < values; v++) {
+        solver->user_start[v + 1] += solver->user_start[v];
+    }
+    solver->users = malloc((total + 1) * sizeof(IRInstr*));
+    int* fill = malloc((values + 1) * sizeof(int));
+    if (!solver->users || !fill) out_of_memory();
+    memcpy(fill, solver->user_start, values * sizeof(int));
+    for (int b = 0; b < function->block_count; b++) {
+        IRBlock* block = &function->blocks[b];
+        for (int i = 0; i < block->count; i++) {
+            for (int a = 0; a < block->code[i]->arg_count; a++) {
+                solver->users[fill[block->code[i]->args[a]->id]++] = block->code[i];
+            }
+        }
+    }
+    free(fill);
+}
+
+static void push_value(Solver* solver, IRInstr* instr) {
+    if (solver->value_count == solver->value_capacity) {
+        solver->value_capacity = solver->value_capacity ? solver->value_capacity * 2 : 64;
+        solver->value_work = realloc(solver->value_work, solver->value_capacity * sizeof(IRInstr*));
+        if (!solver->value_work) out_of_memory();
+    }
+    solver->value_work[solver->value_count++] = instr;
+}
+
+// Mark the edges from 'from' into 'to' executable
+static void mark_edge(Solver* solver, int from, int to) {
+    IRBlock* target = &solver->function->blocks[to];
+    int added = 0;
+    for (int p = 0; p < target->pred_count; p++) {
+        if (target->preds[p] == from && !solver->executable[to][p]) {
+            solver->executable[to][p] = 1;
+            added = 1;
+        }
+    }
+    if (added) {
+        solver->block_work[solver->block_count++] = to;
+    }
+}
+
+// Lower a value's lattice entry; queue its users if it changed
+static void set_value(Solver* solver, IRInstr* instr, Lattice value) {
+    Lattice* old = &solver->values[instr->id];
+    if (old->state == LATTICE_BOTTOM || value.state == LATTICE_TOP) {
+        return;
+    }
+    if (old->state == LATTICE_CONST && value.state == LATTICE_CONST &&
+        old->i == value.i && (old->f == value.f || (isnan(old->f) && isnan(value.f)))) {
+        return;
+    }
+    if (old->state == LATTICE_CONST && value.state == LATTICE_CONST) {
+        value.state = LATTICE_BOTTOM; // Two different constants meet
+    }
+    *old = value;
+    for (int u = solver->user_start[instr->id]; u < solver->user_start[instr->id + 1]; u++) {
+        push_value(solver, solver->users[u]);
+    }
+}
+
+static Lattice bottom(void) {
+    Lattice value = {LATTICE_BOTTOM, 0, 0};
+    return value;
+}
+
+static Lattice int_value(int i) {
+    Lattice value = {LATTICE_CONST, i, i};
+    return value;
+}
+
+static Lattice float_value(double f) {
+    Lattice value = {LATTICE_CONST, 0, f};
+    if (!isfinite(f)) {
+        value.state = LATTICE_BOTTOM;
+    }
+    return value;
+}
+
+// Fold an operation over constant operands
+static Lattice evaluate_constant(const IRInstr* instr, const Lattice* a, const Lattice* b) {
+    if (instr->op >= IR_EQ && instr->op <= IR_GE) {
+        int is_float = instr->args[0]->type == IR_FLOAT;
+        double x = is_float ? a->f : a->i;
+        double y = is_float ? b->f : b->i;
+        switch (instr->op) {
+            case IR_EQ: return int_value(x == y);
+            case IR_NE: return int_value(x != y);
+            case IR_LT: return int_value(x < y);
+            case IR_LE: return int_value(x <= y);
+            case IR_GT: return int_value(x > y);
+            default: return int_value(x >= y);
+        }
+    }
+
+    if (instr->type == IR_FLOAT && instr->op >= IR_ADD && instr->op <= IR_DIV) {
+        switch (instr->op) {
+            case IR_ADD: return float_value(a->f + b->f);
+            case IR_SUB: return float_value(a->f - b->f);
+            case IR_MUL: return float_value(a->f * b->f);
+            default: return b->f == 0 ? bottom() : float_value(a->f / b->f);
+        }
+    }
+
+    // Ints wrap like 32-bit values
+    unsigned int x = (unsigned int)a->i;
+    unsigned int y = b ? (unsigned int)b->i : 0;
+    switch (instr->op) {
+        case IR_ADD: return int_value((int)(x + y));
+        case IR_SUB: return int_value((int)(x - y));
+        case IR_MUL: return int_value((int)(x * y));
+        case IR_DIV:
+            if (b->i == 0 || (a->i == INT_MIN && b->i == -1)) {
+                return bottom(); // Left for the program to fail on at run time
+            }
+            return int_value(a->i / b->i);
+        case IR_AND: return int_value(a->i != 0 && b->i != 0);
+        case IR_OR: return int_value(a->i != 0 || b->i != 0);
+        case IR_ITOF: return float_value(a->i);
+        case IR_FTOI:
+            if (!(a->f > (double)INT_MIN - 1 && a->f < (double)INT_MAX + 1)) {
+                return bottom();
+            }
+            return int_value((int)a->f);
+        case IR_FACT: {
+            if (a->i < 0 || a->i > 12) {
+                return bottom();
+            }
+            int result = 1;
+            for (int k = 2; k <= a->i; k++) result *= k;
+            return int_value(result);
+        }
+        default:
+            return bottom();
+    }
+}
+
+// Evaluate one instruction over the current lattice
+static void visit_instr(Solver* solver, IRInstr* instr) {
+    int block = instr->block;
+    IRBlock* b = &solver->function->blocks[block];
+
+    switch (instr->op) {
+        case IR_CONST:
+            if (instr->type == IR_FLOAT) set_value(solver, instr, float_value(instr->imm.f));
+            else if (instr->type == IR_INT) set_value(solver, instr, int_value(instr->imm.i));
+            else set_value(solver, instr, bottom());
+            break;
+
+        case IR_PHI: {
+            Lattice result = {LATTICE_TOP, 0, 0};
+            for (int a = 0; a < instr->arg_count && result.state != LATTICE_BOTTOM; a++) {
+                if (!solver->executable[block][a]) {
+                    continue;
+                }
+                Lattice* arg = &solver->values[instr->args[a]->id];
+                if (arg->state == LATTICE_TOP) {
+                    continue;
+                }
+                if (result.state == LATTICE_TOP) {
+                    result = *arg;
+                } else if (arg->state == LATTICE_BOTTOM || arg->i != result.i || arg->f != result.f) {
+                    result = bottom();
+                }
+            }
+            set_value(solver, instr, result);
+            break;
+        }
+
+        case IR_JUMP:
+            mark_edge(solver, block, b->succ[0]);
+            break;
+
+        case IR_BRANCH: {
+            Lattice* condition = &solver->values[instr->args[0]->id];
+            if (condition->state == LATTICE_BOTTOM) {
+                mark_edge(solver, block, b->succ[0]);
+                mark_edge(solver, block, b->succ[1]);
+            } else if (condition->state == LATTICE_CONST) {
+                mark_edge(solver, block, b->succ[condition->i != 0 ? 0 : 1]);
+            }
+            break;
+        }
+
+        case IR_ADD: case IR_SUB: case IR_MUL: case IR_DIV:
+        case IR_EQ: case IR_NE: case IR_LT: case IR_LE: case IR_GT: case IR_GE:
+        case IR_AND: case IR_OR:
+        case IR_ITOF: case IR_FTOI: case IR_FACT: case IR_COPY: {
+            Lattice* a = &solver->values[instr->args[0]->id];
+            Lattice* c = instr->arg_count > 1 ? &solver->values[instr->args[1]->id] : NULL;
+            if (a->state == LATTICE_BOTTOM || (c && c->state == LATTICE_BOTTOM)) {
+                set_value(solver, instr, bottom());
+            } else if (a->state == LATTICE_TOP || (c && c->state == LATTICE_TOP)) {
+                // Wait for the operands
+            } else if (instr->op == IR_COPY) {
+                set_value(solver, instr, *a);
+            } else {
+                set_value(solver, instr, evaluate_constant(instr, a, c));
+            }
+            break;
+        }
+
+        default:
+            // Parameters, loads, calls: anything at run time
+            if (instr->type != IR_VOID) {
+                set_value(solver, instr, bottom());
+            }
+            break;
+    }
+}
+
+static void solve(Solver* solver) {
+    IRFunction* function = solver->function;
+    solver->visited[0] = 1;
+    for (int i = 0; i < function->blocks[0].count; i++) {
+        visit_instr(solver, function->blocks[0].code[i]);
+    }
+
+    while (solver->block_count > 0 || solver->value_count > 0) {
+        while (solver->block_count > 0) {
+            int b = solver->block_work[--solver->block_count];
+            IRBlock* block = &function->blocks[b];
+            if (solver->visited[b]) {
+                // Another edge in: only the phis can change
+                for (int i = 0; i < block->count && block->code[i]->op == IR_PHI; i++) {
+                    visit_instr(solver, block->code[i]);
+                }
+                continue;
+            }
+            solver->visited[b] = 1;
+            for (int i = 0; i < block->count; i++) {
+                visit_instr(solver, block->code[i]);
+            }
+        }
+        while (solver->value_count > 0) {
+            IRInstr* instr = solver->value_work[--solver->value_count];
+            if (solver->visited[instr->block]) {
+                visit_instr(solver, instr);
+            }
+        }
+    }
+}
+
+// Sparse conditional constant propagation over one function
+int sccp_pass(IRFunction* function, int* changes) {
+    Solver solver;
+    memset(&solver, 0, sizeof(solver));
+    solver.function = function;
+    int blocks = function->block_count;
+    int value_count = function->value_count; // Values the solver has a lattice cell for
+    solver.values = calloc(value_count + 1, sizeof(Lattice));
+    solver.visited = calloc(blocks + 1, 1);
+    solver.executable = calloc(blocks + 1, sizeof(char*));
+    // Every edge can be queued once, plus the entry
+    int edges = 1;
+    for (int b = 0; b < blocks; b++) edges += function->blocks[b].pred_count;
+    solver.block_work = malloc(edges * sizeof(int));
+    if (!solver.values || !solver.visited || !solver.executable || !solver.block_work) out_of_memory();
+    for (int b = 0; b < blocks; b++) {
+        solver.executable[b] = calloc(function->blocks[b].pred_count + 1, 1);
+        if (!solver.executable[b]) out_of_memory();
+    }
+    build_users(&solver);
+    solve(&solver);
+
+    int eliminated = 0;
+    int graph_changed = 0;
+
+    for (int b = 0; b < blocks; b++) {
+        IRBlock* block = &function->blocks[b];
+        if (block->dead || !solver.visited[b]) {
+            continue;
+        }
+
+        // Computations with a constant result become that constant
+        int first_plain = 0;
+        while (first_plain < block->count && block->code[first_plain]->op == IR_PHI) first_plain++;
+        for (int i = 0; i < block->count; i++) {
+            IRInstr* instr = block->code[i];
+            // (Constants, including the ones inserted below, stay as they are)
+            if (instr->op == IR_CONST || instr->id >= value_count) {
+                continue;
+            }
+            Lattice* value = &solver.values[instr->id];
+            // (A division only got a constant if its divisor was a non-zero one)
+            if (value->state != LATTICE_CONST ||
+                (ir_has_side_effects(instr) && instr->op != IR_DIV)) {
+                continue;
+            }
+            IRInstr* constant = instr->type == IR_FLOAT ? ir_const_float(function, value->f)
+                                                        : ir_const_int(function, value->i);
+            constant->line = instr->line;
+            instr->replacement = constant;
+            int position = instr->op == IR_PHI ? first_plain : i;
+            ir_insert(function, b, position, constant);
+            if (position <= i) i++;
+            if (instr->op == IR_PHI) first_plain++;
+            eliminated++;
+        }
+
+        // A branch with one executable edge becomes a jump
+        IRInstr* last = block->count ? block->code[block->count - 1] : NULL;
+        if (last && last->op == IR_BRANCH && block->succ_count == 2) {
+            Lattice* condition = &solver.values[last->args[0]->id];
+            if (condition->state == LATTICE_CONST) {
+                int dead = block->succ[condition->i != 0 ? 1 : 0];
+                IRInstr* jump = ir_new_instr(function, IR_JUMP, IR_VOID, 0);
+                jump->line = last->line;
+                block->code[block->count - 1] = jump;
+                jump->block = b;
+                if (block->succ[0] != block->succ[1]) {
+                    ir_remove_edge(function, b, dead);
+                } else {
+                    block->succ_count = 1;
+                }
+                eliminated++;
+                graph_changed = 1;
+            }
+        }
+    }
+
+    // Blocks no executable edge reaches
+    for (int b = 0; b < blocks; b++) {
+        if (!solver.visited[b] && !function->blocks[b].dead) {
+            eliminated += function->blocks[b].count;
+            ir_remove_block(function, b);
+            graph_changed = 1;
+        }
+    }
+
+    ir_apply_replacements(function);
+
+    for (int b = 0; b < blocks; b++) free(solver.executable[b]);
+    free(solver.executable);
+    free(solver.values);
+    free(solver.visited);
+    free(solver.block_work);
+    free(solver.value_work);
+    free(solver.user_start);
+    free(solver.users);
+
+    *changes += eliminated;
+    return graph_changed ? 0 : IR_ANALYSIS_DOMINATORS;
+}
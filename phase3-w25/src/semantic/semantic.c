@@ -2,13 +2,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "../../include/semantic.h"
 #include "../../include/parser.h"
 #include "../../include/tokens.h"
 #include "../../include/lexer.h"
+#include "../../include/diagnostics.h"
 
 // Global variable for semantic analyzer
-static int semantic_error_count = 0;
+static _Thread_local int semantic_error_count = 0;
+static int semantic_verbose = 1; // Print the symbol table and summary
+static int semantic_threads = 1; // Threads that may check function bodies
 
 // Symbol Table Management Functions
 
@@ -18,111 +23,168 @@ SymbolTable* init_symbol_table() {
     if (table) {
         table->head = NULL;
         table->current_scope = 0;
+        table->names = intern_create();
+        table->innermost = NULL;
+        table->name_capacity = 0;
+        table->scope_marks = NULL;
+        table->mark_capacity = 0;
+        table->slabs = NULL;
+        table->slab_used = SYMBOL_SLAB_SIZE;
+        table->free_symbols = NULL;
+        table->global_slots = 0;
+        table->local_slots = 0;
+        table->globals = NULL;
+        table->visible_globals = 0;
     }
     return table;
 }
 
+// Take a symbol slot from the free list, or from the newest slab
+static Symbol* alloc_symbol(SymbolTable* table) {
+    if (table->free_symbols) {
+        Symbol* symbol = table->free_symbols;
+        table->free_symbols = symbol->next;
+        return symbol;
+    }
+    
+    if (table->slab_used == SYMBOL_SLAB_SIZE) {
+        SymbolSlab* slab = malloc(sizeof(SymbolSlab));
+        if (!slab) {
+            return NULL;
+        }
+        slab->next = table->slabs;
+        table->slabs = slab;
+        table->slab_used = 0;
+    }
+    return &table->slabs->symbols[table->slab_used++];
+}
+
 // Add symbol to table
 void add_symbol(SymbolTable* table, const char* name, int type, int line) {
-    Symbol* symbol = malloc(sizeof(Symbol));
+    Symbol* symbol = alloc_symbol(table);
     if (symbol) {
-        strcpy(symbol->name, name);
         symbol->type = type;
         symbol->scope_level = table->current_scope;
         symbol->line_declared = line;
         symbol->is_initialized = 0;
+        symbol->slot = table->current_scope == 0 ? table->global_slots++ : table->local_slots++;
+        symbol->name_id = intern_string(table->names, name);
         
-        // Add to beginning of list
+        // Grow the per-name stacks to cover the new id
+        if (symbol->name_id >= table->name_capacity) {
+            int capacity = table->name_capacity ? table->name_capacity * 2 : 64;
+            while (capacity <= symbol->name_id) capacity *= 2;
+            Symbol** grown = realloc(table->innermost, capacity * sizeof(Symbol*));
+            if (!grown) {
+                fprintf(stderr, "Error: Memory allocation failed for symbol table\n");
+                exit(1);
+            }
+            memset(grown + table->name_capacity, 0, (capacity - table->name_capacity) * sizeof(Symbol*));
+            table->innermost = grown;
+            table->name_capacity = capacity;
+        }
+        
+        // Push onto the scope stack and the name's stack
         symbol->next = table->head;
         table->head = symbol;
+        symbol->shadowed = table->innermost[symbol->name_id];
+        table->innermost[symbol->name_id] = symbol;
     }
 }
 
 // Look up symbol by name, most recent scope first
 Symbol* lookup_symbol(SymbolTable* table, const char* name) {
-    Symbol* current = table->head;
-    Symbol* found = NULL;
-    int max_scope = -1;
+    int id = intern_find(table->names, name);
+    if (id >= 0 && table->innermost[id]) {
+        return table->innermost[id];
+    }
     
-    // Find the symbol with matching name at the most recent scope
-    while (current) {
-        if (strcmp(current->name, name) == 0 && current->scope_level <= table->current_scope) {
-            if (current->scope_level > max_scope) {
-                found = current;
-                max_scope = current->scope_level;
-            }
+    // Fall back to the frozen globals declared so far
+    const SymbolTable* globals = table->globals;
+    if (globals) {
+        id = intern_find(globals->names, name);
+        if (id >= 0 && globals->innermost[id] && globals->innermost[id]->slot < table->visible_globals) {
+            return globals->innermost[id];
         }
-        current = current->next;
     }
-    
-    return found;
+    return NULL;
 }
 
 // Look up symbol in current scope only
 Symbol* lookup_symbol_current_scope(SymbolTable* table, const char* name) {
-    Symbol* current = table->head;
-    while (current) {
-        if (strcmp(current->name, name) == 0 && 
-            current->scope_level == table->current_scope) {
-            return current;
-        }
-        current = current->next;
+    Symbol* symbol = lookup_symbol(table, name);
+    if (symbol && symbol->scope_level == table->current_scope) {
+        return symbol;
     }
     return NULL;
 }
 
-// Enter a new scope level
+// Enter a new scope level, remembering where its symbols will start
 void enter_scope(SymbolTable* table) {
+    if (table->current_scope >= table->mark_capacity) {
+        int capacity = table->mark_capacity ? table->mark_capacity * 2 : 16;
+        Symbol** grown = realloc(table->scope_marks, capacity * sizeof(Symbol*));
+        if (!grown) {
+            fprintf(stderr, "Error: Memory allocation failed for symbol table\n");
+            exit(1);
+        }
+        table->scope_marks = grown;
+        table->mark_capacity = capacity;
+    }
+    table->scope_marks[table->current_scope] = table->head;
     table->current_scope++;
 }
 
 // Exit the current scope level
 void exit_scope(SymbolTable* table) {
     if (table->current_scope > 0) {
+        remove_symbols_in_current_scope(table);
         table->current_scope--;
+        
+        // Leaving a function: the next one numbers its locals from 0
+        if (table->current_scope == 0) {
+            table->local_slots = 0;
+        }
     }
 }
 
-// Remove symbols from the current scope
+// Remove symbols from the current scope: pop and free everything added
+// since the scope was entered, in time proportional to those symbols
 void remove_symbols_in_current_scope(SymbolTable* table) {
-    Symbol* current = table->head;
-    Symbol* prev = NULL;
-    
-    while (current) {
-        if (current->scope_level == table->current_scope) {
-            Symbol* to_remove = current;
-            
-            if (prev) {
-                prev->next = current->next;
-                current = current->next;
-            } else {
-                table->head = current->next;
-                current = table->head;
-            }
-            
-            free(to_remove);
-        } else {
-            prev = current;
-            current = current->next;
-        }
+    Symbol* mark = table->current_scope > 0 ? table->scope_marks[table->current_scope - 1] : NULL;
+    
+    while (table->head != mark) {
+        Symbol* symbol = table->head;
+        table->innermost[symbol->name_id] = symbol->shadowed;
+        table->head = symbol->next;
+        symbol->next = table->free_symbols;
+        table->free_symbols = symbol;
     }
 }
 
-// Free the symbol table
+// Free the symbol table; symbols go with their slabs
 void free_symbol_table(SymbolTable* table) {
-    Symbol* current = table->head;
+    SymbolSlab* slab = table->slabs;
     
-    while (current) {
-        Symbol* next = current->next;
-        free(current);
-        current = next;
+    while (slab) {
+        SymbolSlab* next = slab->next;
+        free(slab);
+        slab = next;
     }
     
+    intern_free(table->names);
+    free(table->innermost);
+    free(table->scope_marks);
     free(table);
 }
 
 // Utility Functions
 
+// Name of a symbol
+const char* symbol_name(SymbolTable* table, Symbol* symbol) {
+    return intern_name(table->names, symbol->name_id);
+}
+
 // Helper to count symbols in table
 static int get_symbol_count(SymbolTable* table) {
     int count = 0;
@@ -146,7 +208,7 @@ void print_symbol_table(SymbolTable* table) {
     int i = 0;
     while (current) {
         printf("Symbol[%d]:\n", i++);
-        printf("  Name: %s\n", current->name);
+        printf("  Name: %s\n", symbol_name(table, current));
         
         // Print type name instead of enum value
         printf("  Type: ");
@@ -199,26 +261,26 @@ int are_types_compatible(int type1, int type2) {
 // Report semantic errors
 void semantic_error(SemanticErrorType error, const char* name, int line) {
     semantic_error_count++;
-    printf("Semantic Error at line %d: ", line);
+    diag_printf("Semantic Error at line %d: ", line);
     
     switch (error) {
         case SEM_ERROR_UNDECLARED_VARIABLE:
-            printf("Undeclared variable '%s'\n", name);
+            diag_printf("Undeclared variable '%s'\n", name);
             break;
         case SEM_ERROR_REDECLARED_VARIABLE:
-            printf("Variable '%s' already declared in this scope\n", name);
+            diag_printf("Variable '%s' already declared in this scope\n", name);
             break;
         case SEM_ERROR_TYPE_MISMATCH:
-            printf("Type mismatch involving '%s'\n", name);
+            diag_printf("Type mismatch involving '%s'\n", name);
             break;
         case SEM_ERROR_UNINITIALIZED_VARIABLE:
-            printf("Variable '%s' may be used uninitialized\n", name);
+            diag_printf("Variable '%s' may be used uninitialized\n", name);
             break;
         case SEM_ERROR_INVALID_OPERATION:
-            printf("Invalid operation involving '%s'\n", name);
+            diag_printf("Invalid operation involving '%s'\n", name);
             break;
         default:
-            printf("Unknown semantic error with '%s'\n", name);
+            diag_printf("Unknown semantic error with '%s'\n", name);
     }
 }
 
@@ -249,8 +311,15 @@ int check_factorial(ASTNode* node, SymbolTable* table) {
     return valid;
 }
 
-// Check semantic correctness of an expression
-int check_expression(ASTNode* node, SymbolTable* table, int* result_type) {
+// Record a resolved symbol on the node that refers to it
+static void bind_symbol(ASTNode* node, Symbol* symbol) {
+    node->slot = symbol->slot;
+    node->scope_depth = symbol->scope_level;
+    node->static_type = symbol->type;
+}
+
+// Check an expression and work out its type
+static int check_expression_type(ASTNode* node, SymbolTable* table, int* result_type) {
     if (!node) {
         *result_type = TOKEN_ERROR;
         return 0;
@@ -258,8 +327,8 @@ int check_expression(ASTNode* node, SymbolTable* table, int* result_type) {
     
     switch (node->type) {
         case AST_NUMBER:
-            // Assume all numeric literals are ints for now
-            *result_type = TOKEN_INT;
+            // Numeric literals are ints unless written with a decimal point
+            *result_type = node->token.type == TOKEN_FLOAT ? TOKEN_FLOAT_KEY : TOKEN_INT;
             return 1;
             
         case AST_STRING:
@@ -275,6 +344,7 @@ int check_expression(ASTNode* node, SymbolTable* table, int* result_type) {
                 *result_type = TOKEN_ERROR;
                 return 0;
             }
+            bind_symbol(node, symbol);
             
             // Check if initialized
             if (!symbol->is_initialized) {
@@ -302,7 +372,7 @@ int check_expression(ASTNode* node, SymbolTable* table, int* result_type) {
             // Check for division by zero in constant expressions
             if (node->token.lexeme[0] == '/' && 
                 node->right->type == AST_NUMBER &&
-                atoi(node->right->token.lexeme) == 0) {
+                strtod(node->right->token.lexeme, NULL) == 0) {
                 semantic_error(SEM_ERROR_INVALID_OPERATION, "division by zero", node->token.line);
                 *result_type = TOKEN_ERROR;
                 return 0;
@@ -360,7 +430,14 @@ int check_expression(ASTNode* node, SymbolTable* table, int* result_type) {
                 return 0;
             }
             
+            bind_symbol(node, func);
             *result_type = func->type; // Return type of the function
+            
+            // Check the argument, if any
+            if (node->left) {
+                int arg_type;
+                return check_expression(node->left, table, &arg_type);
+            }
             return 1;
         }
             
@@ -370,6 +447,15 @@ int check_expression(ASTNode* node, SymbolTable* table, int* result_type) {
     }
 }
 
+// Check semantic correctness of an expression, annotating the node with its type
+int check_expression(ASTNode* node, SymbolTable* table, int* result_type) {
+    int valid = check_expression_type(node, table, result_type);
+    if (node) {
+        node->static_type = *result_type;
+    }
+    return valid;
+}
+
 // Check semantic correctness of a declaration
 int check_declaration(ASTNode* node, SymbolTable* table) {
     if (!node || node->type != AST_VARDECL) {
@@ -390,6 +476,10 @@ int check_declaration(ASTNode* node, SymbolTable* table) {
     
     // Add to symbol table
     add_symbol(table, var_name, var_type, node->token.line);
+    Symbol* declared = lookup_symbol_current_scope(table, var_name);
+    if (declared) {
+        bind_symbol(node, declared);
+    }
     
     // If there's an initialization, check it
     if (node->right) {
@@ -438,6 +528,7 @@ int check_assignment(ASTNode* node, SymbolTable* table) {
         semantic_error(SEM_ERROR_UNDECLARED_VARIABLE, var_name, node->token.line);
         return 0;
     }
+    bind_symbol(node->left, symbol);
     
     // Check expression
     int expr_type;
@@ -453,8 +544,10 @@ int check_assignment(ASTNode* node, SymbolTable* table) {
             return 0;
         }
         
-        // Mark as initialized
-        symbol->is_initialized = 1;
+        // Mark as initialized (only if needed: globals may be shared between threads)
+        if (!symbol->is_initialized) {
+            symbol->is_initialized = 1;
+        }
     }
     
     return expr_valid;
@@ -581,8 +674,14 @@ int check_function_declaration(ASTNode* node, SymbolTable* table) {
     Symbol* func_symbol = lookup_symbol_current_scope(table, func_name);
     if (func_symbol) {
         func_symbol->is_initialized = 1; // Functions are always "initialized"
+        bind_symbol(node, func_symbol);
     }
     
+    return check_function_body(node, table);
+}
+
+// Check the parameters and body of a function whose name is already declared
+int check_function_body(ASTNode* node, SymbolTable* table) {
     // Enter a new scope for parameters and body
     enter_scope(table);
     
@@ -595,6 +694,7 @@ int check_function_declaration(ASTNode* node, SymbolTable* table) {
             Symbol* param_symbol = lookup_symbol_current_scope(table, param->token.lexeme);
             if (param_symbol) {
                 param_symbol->is_initialized = 1; // Parameters are initialized
+                bind_symbol(param, param_symbol);
             }
         }
         
@@ -720,6 +820,134 @@ int check_program(ASTNode* node, SymbolTable* table) {
     return valid;
 }
 
+// One top-level function for the parallel checker
+typedef struct {
+    ASTNode* node;
+    int declared;                  // Signature passed phase 1; body still to check
+    int valid;
+    int error_count;
+    DiagBuffer diagnostics;        // Everything reported for this function
+} FunctionJob;
+
+// Work shared by the semantic worker threads
+typedef struct {
+    FunctionJob* jobs;
+    int count;
+    atomic_int next;               // Next job to hand out
+    SymbolTable* globals;          // Frozen after phase 1
+} SemanticWork;
+
+// Worker thread: check function bodies, each in a private local scope stack
+static void* semantic_worker(void* arg) {
+    SemanticWork* work = arg;
+    SymbolTable* table = init_symbol_table();
+    int index;
+    
+    table->globals = work->globals;
+    while ((index = atomic_fetch_add(&work->next, 1)) < work->count) {
+        FunctionJob* job = &work->jobs[index];
+        if (!job->declared) {
+            continue;
+        }
+        
+        // A body sees the functions declared up to and including its own
+        table->visible_globals = job->node->slot + 1;
+        semantic_error_count = 0;
+        diag_capture_begin(&job->diagnostics);
+        job->valid = check_function_body(job->node, table);
+        diag_capture_end();
+        job->error_count += semantic_error_count;
+    }
+    
+    free_symbol_table(table);
+    return NULL;
+}
+
+// Check a program of top-level functions in two phases. Phase 1 declares
+// the signatures in source order; phase 2 checks the bodies on worker threads
+// against that frozen global scope. Returns -1 (nothing done) when the
+// program has other top-level statements, which could change globals
+// between functions.
+static int check_program_parallel(ASTNode* ast, SymbolTable* table) {
+    int count = 0;
+    for (ASTNode* item = ast; item; item = item->right) {
+        if (item->type != AST_PROGRAM || !item->left || item->left->type != AST_FUNCTION_DECL) {
+            return -1;
+        }
+        count++;
+    }
+    if (count < 2) {
+        return -1;
+    }
+    
+    FunctionJob* jobs = calloc(count, sizeof(FunctionJob));
+    if (!jobs) {
+        return -1;
+    }
+    
+    // Phase 1: declare every function, in order, on this thread
+    int index = 0;
+    for (ASTNode* item = ast; item; item = item->right, index++) {
+        FunctionJob* job = &jobs[index];
+        ASTNode* node = item->left;
+        const char* func_name = node->token.lexeme;
+        
+        job->node = node;
+        semantic_error_count = 0;
+        diag_capture_begin(&job->diagnostics);
+        if (lookup_symbol_current_scope(table, func_name)) {
+            semantic_error(SEM_ERROR_REDECLARED_VARIABLE, func_name, node->token.line);
+        } else {
+            add_symbol(table, func_name, TOKEN_INT, node->token.line);
+            Symbol* func_symbol = lookup_symbol_current_scope(table, func_name);
+            if (func_symbol) {
+                func_symbol->is_initialized = 1; // Functions are always "initialized"
+                bind_symbol(node, func_symbol);
+                job->declared = 1;
+            }
+        }
+        diag_capture_end();
+        job->error_count = semantic_error_count;
+    }
+    
+    // Phase 2: check the bodies
+    SemanticWork work = {jobs, count, 0, table};
+    int threads = semantic_threads < count ? semantic_threads : count;
+    pthread_t* workers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    if (workers) {
+        for (; started < threads - 1; started++) {
+            if (pthread_create(&workers[started], NULL, semantic_worker, &work) != 0) {
+                break;
+            }
+        }
+    }
+    semantic_worker(&work); // The calling thread helps too
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    
+    // Report in source order
+    int valid = 1;
+    int errors = 0;
+    for (int i = 0; i < count; i++) {
+        diag_buffer_flush(&jobs[i].diagnostics);
+        diag_buffer_free(&jobs[i].diagnostics);
+        valid = valid && jobs[i].declared && jobs[i].valid;
+        errors += jobs[i].error_count;
+    }
+    semantic_error_count = errors;
+    
+    free(jobs);
+    return valid;
+}
+
+// Set how many threads analyze_semantics may use
+void set_semantic_threads(int threads) {
+    semantic_threads = threads > 0 ? threads : 1;
+}
+
 // Main semantic analysis function
 int analyze_semantics(ASTNode* ast) {
     // Reset error count
@@ -729,15 +957,23 @@ int analyze_semantics(ASTNode* ast) {
     SymbolTable* table = init_symbol_table();
     
     // Perform semantic analysis
-    int valid = check_program(ast, table);
-    
-    // Print symbol table for debugging
-    print_symbol_table(table);
+    int valid = -1;
+    if (semantic_threads > 1) {
+        valid = check_program_parallel(ast, table);
+    }
+    if (valid < 0) {
+        valid = check_program(ast, table);
+    }
     
-    // Print summary
-    printf("\nSemantic analysis %s. Found %d error(s).\n", 
-           semantic_error_count == 0 ? "successful" : "failed",
-           semantic_error_count);
+    if (semantic_verbose) {
+        // Print symbol table for debugging
+        print_symbol_table(table);
+        
+        // Print summary
+        printf("\nSemantic analysis %s. Found %d error(s).\n", 
+               semantic_error_count == 0 ? "successful" : "failed",
+               semantic_error_count);
+    }
     
     // Free symbol table
     free_symbol_table(table);
@@ -745,19 +981,24 @@ int analyze_semantics(ASTNode* ast) {
     return valid && (semantic_error_count == 0);
 }
 
+// Choose whether analyze_semantics prints the symbol table and summary
+void set_semantic_verbose(int verbose) {
+    semantic_verbose = verbose;
+}
+
+// Number of semantic errors reported by the last analyze_semantics call
+int get_semantic_error_count(void) {
+    return semantic_error_count;
+}
+
 // Process semantic analysis on a file
 void proc_semantic_file(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
+    char *buffer = read_source_file(filename);
+    if (!buffer) {
         printf("Error: Could not open file %s\n", filename);
         return;
     }
     
-    char buffer[2048];
-    size_t len = fread(buffer, 1, sizeof(buffer) - 1, file);
-    buffer[len] = '\0';
-    fclose(file);
-    
     printf("\n==============================\n");
     printf("SEMANTIC ANALYSIS OF FILE: %s\n", filename);
     printf("==============================\n");
@@ -784,4 +1025,5 @@ void proc_semantic_file(const char *filename) {
 
     // Free AST memory
     free_ast(ast);
+    free(buffer);
 }
@@ -0,0 +1,303 @@
+/* serialize.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/serialize.h"
+#include "../../include/parser.h"
+#include "../../include/lexer.h"
+#include "../../include/intern.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Round a section offset up to 8 bytes
+static uint32_t align_offset(uint32_t offset) {
+    return (offset + 7u) & ~7u;
+}
+
+// Fill a token record, interning its lexeme
+static void pack_token(AstFileToken *record, const Token *token, StringTable *strings) {
+    record->type = token->type;
+    record->lexeme = intern_string(strings, token->lexeme);
+    record->line = token->line;
+    record->column = token->column;
+    record->error = token->error;
+    record->recovery = token->recovery;
+}
+
+// Count the nodes of a tree
+static int count_nodes(ASTNode *node) {
+    if (!node) return 0;
+    return 1 + count_nodes(node->left) + count_nodes(node->right);
+}
+
+// Store a tree in preorder; returns the node's index
+static int32_t pack_nodes(ASTNode *node, AstFileNode *nodes, int32_t *next, StringTable *strings) {
+    if (!node) return AST_FILE_NONE;
+
+    int32_t index = (*next)++;
+    nodes[index].type = node->type;
+    pack_token(&nodes[index].token, &node->token, strings);
+    nodes[index].left = pack_nodes(node->left, nodes, next, strings);
+    nodes[index].right = pack_nodes(node->right, nodes, next, strings);
+    return index;
+}
+
+// Write zero bytes until the file reaches 'offset'
+static int pad_to(FILE *file, long offset) {
+    while (ftell(file) < offset) {
+        if (fputc(0, file) == EOF) return 0;
+    }
+    return 1;
+}
+
+// Write the token buffer and AST to 'path'. Returns 1 on success.
+int write_ast_file(const char *path, const TokenBuffer *tokens, ASTNode *root) {
+    StringTable *strings = intern_create();
+    int token_count = tokens ? tokens->count : 0;
+    int node_count = count_nodes(root);
+
+    AstFileToken *token_records = calloc(token_count ? token_count : 1, sizeof(AstFileToken));
+    AstFileNode *node_records = calloc(node_count ? node_count : 1, sizeof(AstFileNode));
+    if (!token_records || !node_records) {
+        fprintf(stderr, "Error: Memory allocation failed for AST file\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < token_count; i++) {
+        pack_token(&token_records[i], &tokens->tokens[i], strings);
+    }
+    int32_t next = 0;
+    int32_t root_index = pack_nodes(root, node_records, &next, strings);
+
+    // Lay out the sections
+    AstFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AST_FILE_MAGIC, sizeof(header.magic));
+    header.version = AST_FILE_VERSION;
+    header.byte_order = AST_FILE_BYTE_ORDER;
+    header.token_count = token_count;
+    header.token_offset = align_offset(sizeof(AstFileHeader));
+    header.node_count = node_count;
+    header.node_offset = align_offset(header.token_offset + token_count * sizeof(AstFileToken));
+    header.string_count = strings->count;
+    header.string_offset = align_offset(header.node_offset + node_count * sizeof(AstFileNode));
+    header.string_data_offset = align_offset(header.string_offset + strings->count * sizeof(uint32_t));
+    header.string_data_size = strings->chars_used;
+    header.file_size = header.string_data_offset + header.string_data_size;
+    header.root = root_index;
+
+    int ok = 0;
+    FILE *file = fopen(path, "wb");
+    if (file) {
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             pad_to(file, header.token_offset) &&
+             fwrite(token_records, sizeof(AstFileToken), token_count, file) == (size_t)token_count &&
+             pad_to(file, header.node_offset) &&
+             fwrite(node_records, sizeof(AstFileNode), node_count, file) == (size_t)node_count &&
+             pad_to(file, header.string_offset);
+        for (int i = 0; ok && i < strings->count; i++) {
+            uint32_t offset = strings->offsets[i];
+            ok = fwrite(&offset, sizeof(offset), 1, file) == 1;
+        }
+        ok = ok && pad_to(file, header.string_data_offset) &&
+             fwrite(strings->chars, 1, strings->chars_used, file) == (size_t)strings->chars_used;
+        ok = fclose(file) == 0 && ok;
+    }
+
+    free(token_records);
+    free(node_records);
+    intern_free(strings);
+    return ok;
+}
+
+// Does [offset, offset + count * size) lie inside the image?
+static int section_fits(size_t image_size, uint32_t offset, uint32_t count, size_t size) {
+    return offset % 4 == 0 && offset <= image_size &&
+           (size_t)count <= (image_size - offset) / size;
+}
+
+// Check every header field and reference so readers never leave the image
+static int validate_ast_file(const AstFile *file) {
+    const AstFileHeader *header = file->header;
+
+    if (file->size < sizeof(AstFileHeader) ||
+        memcmp(header->magic, AST_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != AST_FILE_VERSION ||
+        header->byte_order != AST_FILE_BYTE_ORDER ||
+        header->file_size != file->size) {
+        return 0;
+    }
+
+    if (!section_fits(file->size, header->token_offset, header->token_count, sizeof(AstFileToken)) ||
+        !section_fits(file->size, header->node_offset, header->node_count, sizeof(AstFileNode)) ||
+        !section_fits(file->size, header->string_offset, header->string_count, sizeof(uint32_t)) ||
+        header->string_data_offset > file->size ||
+        header->string_data_size > file->size - header->string_data_offset) {
+        return 0;
+    }
+
+    // Strings must start inside the data and be NUL-terminated
+    const uint32_t *offsets = (const uint32_t *)((const char *)file->base + header->string_offset);
+    const char *data = (const char *)file->base + header->string_data_offset;
+    if (header->string_data_size > 0 && data[header->string_data_size - 1] != '\0') {
+        return 0;
+    }
+    for (uint32_t i = 0; i < header->string_count; i++) {
+        if (offsets[i] >= header->string_data_size) return 0;
+    }
+
+    // Lexemes must name a string; children must come later in preorder,
+    // which also rules out cycles
+    const AstFileToken *tokens = (const AstFileToken *)((const char *)file->base + header->token_offset);
+    for (uint32_t i = 0; i < header->token_count; i++) {
+        if (tokens[i].lexeme < 0 || (uint32_t)tokens[i].lexeme >= header->string_count) return 0;
+    }
+    const AstFileNode *nodes = (const AstFileNode *)((const char *)file->base + header->node_offset);
+    for (uint32_t i = 0; i < header->node_count; i++) {
+        if (nodes[i].token.lexeme < 0 || (uint32_t)nodes[i].token.lexeme >= header->string_count) return 0;
+        if (nodes[i].left != AST_FILE_NONE &&
+            (nodes[i].left <= (int32_t)i || (uint32_t)nodes[i].left >= header->node_count)) return 0;
+        if (nodes[i].right != AST_FILE_NONE &&
+            (nodes[i].right <= (int32_t)i || (uint32_t)nodes[i].right >= header->node_count)) return 0;
+    }
+    if (header->root != AST_FILE_NONE &&
+        (header->root < 0 || (uint32_t)header->root >= header->node_count)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Map (or on Windows, read) an AST file and check it. Returns NULL on failure.
+AstFile *load_ast_file(const char *path) {
+    AstFile *file = calloc(1, sizeof(AstFile));
+    if (!file) return NULL;
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(file);
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        free(file);
+        return NULL;
+    }
+    file->size = (size_t)info.st_size;
+    file->base = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->base == MAP_FAILED) {
+        free(file);
+        return NULL;
+    }
+    file->mapped = 1;
+#else
+    FILE *stream = fopen(path, "rb");
+    if (!stream) {
+        free(file);
+        return NULL;
+    }
+    fseek(stream, 0, SEEK_END);
+    long size = ftell(stream);
+    fseek(stream, 0, SEEK_SET);
+    file->base = size > 0 ? malloc((size_t)size) : NULL;
+    if (!file->base || fread(file->base, 1, (size_t)size, stream) != (size_t)size) {
+        fclose(stream);
+        free(file->base);
+        free(file);
+        return NULL;
+    }
+    fclose(stream);
+    file->size = (size_t)size;
+    file->mapped = 0;
+#endif
+
+    const char *base = file->base;
+    file->header = (const AstFileHeader *)base;
+    if (!validate_ast_file(file)) {
+        close_ast_file(file);
+        return NULL;
+    }
+    file->tokens = (const AstFileToken *)(base + file->header->token_offset);
+    file->nodes = (const AstFileNode *)(base + file->header->node_offset);
+    file->string_offsets = (const uint32_t *)(base + file->header->string_offset);
+    file->strings = base + file->header->string_data_offset;
+    return file;
+}
+
+// Unmap and release a loaded file
+void close_ast_file(AstFile *file) {
+    if (!file) return;
+#ifndef _WIN32
+    if (file->mapped) {
+        munmap(file->base, file->size);
+    } else {
+        free(file->base);
+    }
+#else
+    free(file->base);
+#endif
+    free(file);
+}
+
+// String for an id stored in the file
+const char *ast_file_string(const AstFile *file, int32_t id) {
+    if (id < 0 || (uint32_t)id >= file->header->string_count) return "";
+    return file->strings + file->string_offsets[id];
+}
+
+// Print a stored tree exactly like print_ast prints the live one
+void print_ast_file(const AstFile *file, int32_t node, int level) {
+    if (node == AST_FILE_NONE) return;
+
+    const AstFileNode *record = &file->nodes[node];
+    for (int i = 0; i < level; i++) printf("  ");
+    print_ast_label(record->type, ast_file_string(file, record->token.lexeme));
+
+    print_ast_file(file, record->left, level + 1);
+    print_ast_file(file, record->right, level + 1);
+}
+
+// Parse a source file and write its tokens and AST to 'output_file'
+int emit_ast_file(const char *source_file, const char *output_file) {
+    char *buffer = read_source_file(source_file);
+    if (!buffer) {
+        printf("Error: Could not open file %s\n", source_file);
+        return 0;
+    }
+
+    reset_lexer();
+    parser_init(buffer);
+    ASTNode *ast = parse();
+
+    const TokenBuffer *tokens = get_token_buffer();
+    int written = write_ast_file(output_file, tokens, ast);
+    if (written) {
+        printf("Wrote %d tokens and %d AST nodes to %s\n", tokens->count, count_nodes(ast), output_file);
+    } else {
+        printf("Error: Could not write AST file %s\n", output_file);
+    }
+
+    free_ast(ast);
+    free(buffer);
+    return written;
+}
+
+// Load an AST file and print its tree
+int dump_ast_file(const char *filename) {
+    AstFile *file = load_ast_file(filename);
+    if (!file) {
+        printf("Error: %s is not a valid AST file (expected version %d)\n", filename, AST_FILE_VERSION);
+        return 0;
+    }
+
+    print_ast_file(file, file->header->root, 0);
+    close_ast_file(file);
+    return 1;
+}
@@ -0,0 +1,368 @@
+/* super.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../include/super.h"
+#include "../../include/bytecode.h"
+#include "../../include/vm.h"
+
+// Superinstructions chosen by the last --gen-super run
+static const BCOpcode generated[] = {
+#define SUPER(op, saved) op,
+#include "../../include/superinstructions.h"
+#undef SUPER
+    BC_OPCODE_COUNT
+};
+
+#define SUPER_FIRST BC_ADDIK
+#define SUPER_LIMIT 12         // Most superinstructions --gen-super keeps
+#define PROFILE_SHOWN 15       // Pairs and triples --profile lists
+
+static SuperMode super_mode = SUPER_SELECTED;
+
+// When set, overrides the mode with exactly these (for --gen-super)
+static const unsigned char* super_override;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for superinstructions\n");
+    exit(1);
+}
+
+int set_super_mode(const char* name) {
+    if (strcmp(name, "selected") == 0) super_mode = SUPER_SELECTED;
+    else if (strcmp(name, "none") == 0) super_mode = SUPER_NONE;
+    else if (strcmp(name, "all") == 0) super_mode = SUPER_ALL;
+    else return 0;
+    return 1;
+}
+
+static void enabled_set(unsigned char* enabled) {
+    memset(enabled, 0, BC_OPCODE_COUNT);
+    if (super_override) {
+        memcpy(enabled, super_override, BC_OPCODE_COUNT);
+    } else if (super_mode == SUPER_ALL) {
+        memset(enabled + SUPER_FIRST, 1, BC_OPCODE_COUNT - SUPER_FIRST);
+    } else if (super_mode == SUPER_SELECTED) {
+        for (int i = 0; generated[i] != BC_OPCODE_COUNT; i++) {
+            enabled[generated[i]] = 1;
+        }
+    }
+}
+
+// Comparison with its operands swapped (a < b is b > a)
+static BCOpcode mirrored(BCOpcode op) {
+    switch (op) {
+        case BC_LTI: return BC_GTI;
+        case BC_LEI: return BC_GEI;
+        case BC_GTI: return BC_LTI;
+        case BC_GEI: return BC_LEI;
+        default: return op;
+    }
+}
+
+// Comparison testing the opposite (not (a < b) is a >= b; exact for ints)
+static BCOpcode negated(BCOpcode op) {
+    switch (op) {
+        case BC_EQI: return BC_NEI;
+        case BC_NEI: return BC_EQI;
+        case BC_LTI: return BC_GEI;
+        case BC_LEI: return BC_GTI;
+        case BC_GTI: return BC_LEI;
+        default: return BC_LTI;
+    }
+}
+
+// Register use counts for one function
+typedef struct {
+    int* reads;
+    int* writes;
+    int* writer;               // The instruction writing the register, if only one does
+} RegisterUse;
+
+static void count_uses(const BCProgram* program, const BCFunction* function, RegisterUse* use) {
+    memset(use->reads, 0, function->register_count * sizeof(int));
+    memset(use->writes, 0, function->register_count * sizeof(int));
+    for (int pc = 0; pc < function->code_count; pc++) {
+        const BCInstr* instr = &function->code[pc];
+        int reads[2];
+        int range;
+        int count = bc_reads(program, instr, reads, &range);
+        for (int i = 0; i < count; i++) use->reads[reads[i]]++;
+        for (int i = 0; i < range; i++) use->reads[instr->c + i]++;
+        int written = bc_writes(instr);
+        if (written >= 0) {
+            use->writes[written]++;
+            use->writer[written] = pc;
+        }
+    }
+}
+
+// Constant pool index a register always holds, or -1
+static int constant_register(const BCFunction* function, const RegisterUse* use, int reg) {
+    if (use->writes[reg] != 1 || function->code[use->writer[reg]].op != BC_LOADK) {
+        return -1;
+    }
+    return function->code[use->writer[reg]].b;
+}
+
+static int select_function(const BCProgram* program, BCFunction* function, const unsigned char* enabled) {
+    int registers = function->register_count + 1;
+    RegisterUse use;
+    use.reads = malloc(registers * sizeof(int));
+    use.writes = malloc(registers * sizeof(int));
+    use.writer = malloc(registers * sizeof(int));
+    char* removed = calloc(function->code_count + 1, 1);
+    char* target = calloc(function->code_count + 1, 1);
+    if (!use.reads || !use.writes || !use.writer || !removed || !target) out_of_memory();
+    count_uses(program, function, &use);
+    for (int pc = 0; pc < function->code_count; pc++) {
+        int to = bc_jump_target(&function->code[pc]);
+        if (to >= 0) target[to] = 1;
+    }
+
+    for (int pc = 0; pc < function->code_count; pc++) {
+        BCInstr* instr = &function->code[pc];
+
+        // Arithmetic on a constant: the constant is read from the pool
+        if ((instr->op >= BC_ADDI && instr->op <= BC_DIVI) || (instr->op >= BC_ADDF && instr->op <= BC_DIVF)) {
+            int is_float = instr->op >= BC_ADDF;
+            int offset = instr->op - (is_float ? BC_ADDF : BC_ADDI);
+            BCOpcode fused = (is_float ? BC_ADDFK : BC_ADDIK) + offset;
+            int commutative = offset == 0 || offset == 2;
+            int left = instr->b;
+            int right = instr->c;
+            int k = constant_register(function, &use, right);
+            if (k < 0 && commutative) {
+                k = constant_register(function, &use, left);
+                left = instr->c;
+                right = instr->b;
+            }
+            if (k >= 0 && enabled[fused]) {
+                use.reads[right]--;
+                instr->op = fused;
+                instr->b = (uint16_t)left;
+                instr->c = (uint16_t)k;
+            }
+            continue;
+        }
+
+        // Comparison feeding only the branch right after it
+        if (instr->op < BC_EQI || instr->op > BC_GEI || pc + 1 >= function->code_count || target[pc + 1]) {
+            continue;
+        }
+        BCInstr* branch = &function->code[pc + 1];
+        int destination = (int)BC_TARGET(*branch);
+        if ((branch->op != BC_JUMPIF && branch->op != BC_JUMPIFNOT) || branch->a != instr->a ||
+            use.reads[instr->a] != 1 || use.writes[instr->a] != 1 || destination > BC_MAX_OPERAND) {
+            continue;
+        }
+        BCOpcode compare = branch->op == BC_JUMPIF ? instr->op : negated(instr->op);
+        int left = instr->b;
+        int right = instr->c;
+        int k = constant_register(function, &use, right);
+        if (k < 0 && constant_register(function, &use, left) >= 0) {
+            k = constant_register(function, &use, left);
+            compare = mirrored(compare);
+            left = right;
+            right = instr->b;
+        }
+        BCInstr fused;
+        if (k >= 0 && enabled[BC_JEQIK + (compare - BC_EQI)]) {
+            fused.op = BC_JEQIK + (compare - BC_EQI);
+            fused.a = (uint16_t)left;
+            fused.b = (uint16_t)k;
+            use.reads[right]--;
+        } else if (enabled[BC_JEQI + (compare - BC_EQI)]) {
+            fused.op = BC_JEQI + (compare - BC_EQI);
+            fused.a = (uint16_t)left;
+            fused.b = (uint16_t)right;
+        } else {
+            continue;
+        }
+        fused.c = (uint16_t)destination;
+        *branch = fused;
+        removed[pc] = 1;
+        use.reads[instr->a] = 0;
+    }
+
+    // Constant loads nothing reads any more
+    int fused_away = 0;
+    for (int pc = 0; pc < function->code_count; pc++) {
+        if (removed[pc]) {
+            fused_away++;
+        } else if (function->code[pc].op == BC_LOADK && use.reads[function->code[pc].a] == 0 &&
+                   use.writes[function->code[pc].a] == 1) {
+            removed[pc] = 1;
+            fused_away++;
+        }
+    }
+    if (fused_away) {
+        bc_remove_instructions(function, removed);
+    }
+
+    free(use.reads);
+    free(use.writes);
+    free(use.writer);
+    free(removed);
+    free(target);
+    return fused_away;
+}
+
+int select_superinstructions(BCProgram* program) {
+    unsigned char enabled[BC_OPCODE_COUNT];
+    enabled_set(enabled);
+    int any = 0;
+    for (int op = SUPER_FIRST; op < BC_OPCODE_COUNT; op++) any |= enabled[op];
+    if (!any) {
+        return 0;
+    }
+    int fused = 0;
+    for (int f = 0; f < program->function_count; f++) {
+        fused += select_function(program, &program->functions[f], enabled);
+    }
+    return fused;
+}
+
+// Profile every file once; returns the dispatches executed (-1 if one fails)
+static long long profile_corpus(int count, char* filenames[], VMProfile* profile) {
+    long long total = 0;
+    for (int i = 0; i < count; i++) {
+        BCProgram* program = compile_file_to_bytecode(filenames[i]);
+        if (!program) {
+            return -1;
+        }
+        VMStats stats = {0, 0};
+        int ok = vm_profile(program, profile, &stats);
+        free_bytecode(program);
+        if (!ok) {
+            return -1;
+        }
+        total += stats.executed;
+    }
+    return total;
+}
+
+static VMProfile* new_profile(void) {
+    VMProfile* profile = calloc(1, sizeof(VMProfile));
+    if (!profile) out_of_memory();
+    return profile;
+}
+
+// Print the hottest entries of a count table of n-opcode sequences
+static void print_hottest(const long long* counts, int entries, int length, long long total) {
+    char* shown = calloc(entries, 1);
+    if (!shown) out_of_memory();
+    for (int rank = 0; rank < PROFILE_SHOWN; rank++) {
+        int best = -1;
+        for (int e = 0; e < entries; e++) {
+            if (!shown[e] && counts[e] > 0 && (best < 0 || counts[e] > counts[best])) best = e;
+        }
+        if (best < 0) {
+            break;
+        }
+        shown[best] = 1;
+        int ops[3];
+        for (int k = length - 1, rest = best; k >= 0; k--, rest /= BC_OPCODE_COUNT) {
+            ops[k] = rest % BC_OPCODE_COUNT;
+        }
+        char name[64] = "";
+        for (int k = 0; k < length; k++) {
+            strcat(name, k ? " -> " : "");
+            strcat(name, bc_op_name(ops[k]));
+        }
+        printf("  %-36s %14lld %6.1f%%\n", name, counts[best], total ? 100.0 * counts[best] / total : 0.0);
+    }
+    free(shown);
+}
+
+void proc_profile_files(int count, char* filenames[]) {
+    SuperMode mode = super_mode;
+
+    // Sequences are counted over plain opcodes, before any fusion
+    super_mode = SUPER_NONE;
+    VMProfile* profile = new_profile();
+    printf("%-32s %14s %14s %8s\n", "program", "without", "with", "saved");
+    long long before_total = 0;
+    long long after_total = 0;
+    for (int i = 0; i < count; i++) {
+        super_mode = SUPER_NONE;
+        long long before = profile_corpus(1, &filenames[i], profile);
+        super_mode = mode == SUPER_NONE ? SUPER_SELECTED : mode;
+        VMProfile* scratch = new_profile();
+        long long after = profile_corpus(1, &filenames[i], scratch);
+        free(scratch);
+        if (before < 0 || after < 0) {
+            continue;
+        }
+        before_total += before;
+        after_total += after;
+        printf("%-32s %14lld %14lld %7.1f%%\n", filenames[i], before, after,
+               before ? 100.0 * (before - after) / before : 0.0);
+    }
+    printf("%-32s %14lld %14lld %7.1f%%\n", "total", before_total, after_total,
+           before_total ? 100.0 * (before_total - after_total) / before_total : 0.0);
+
+    printf("\nHottest opcode pairs:\n");
+    print_hottest(profile->pairs, BC_OPCODE_COUNT * BC_OPCODE_COUNT, 2, before_total);
+    printf("\nHottest opcode triples:\n");
+    print_hottest(profile->triples, BC_OPCODE_COUNT * BC_OPCODE_COUNT * BC_OPCODE_COUNT, 3, before_total);
+    free(profile);
+    super_mode = mode;
+}
+
+int proc_gen_super(const char* output, int count, char* filenames[]) {
+    unsigned char only[BC_OPCODE_COUNT];
+    long long saved[BC_OPCODE_COUNT];
+    memset(saved, 0, sizeof(saved));
+
+    VMProfile* profile = new_profile();
+    memset(only, 0, sizeof(only));
+    super_override = only;
+    long long base = profile_corpus(count, filenames, profile);
+    for (int op = SUPER_FIRST; op < BC_OPCODE_COUNT && base >= 0; op++) {
+        only[op] = 1;
+        long long with = profile_corpus(count, filenames, profile);
+        only[op] = 0;
+        if (with >= 0) {
+            saved[op] = base - with;
+        }
+    }
+    super_override = NULL;
+    free(profile);
+    if (base < 0) {
+        fprintf(stderr, "Error: the profiling corpus does not run\n");
+        return 0;
+    }
+
+    FILE* file = fopen(output, "w");
+    if (!file) {
+        fprintf(stderr, "Error: Could not write %s\n", output);
+        return 0;
+    }
+    fprintf(file, "/* superinstructions.h */\n");
+    fprintf(file, "// Generated by \"compiler.exe --gen-super\"; regenerate with \"make superinstructions\".\n");
+    fprintf(file, "// Superinstructions the bytecode compiler selects, hottest first, with the\n");
+    fprintf(file, "// dispatches each saved on its own over a %lld-dispatch corpus:\n", base);
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "//   %s\n", filenames[i]);
+    }
+    for (int rank = 0; rank < SUPER_LIMIT; rank++) {
+        int best = -1;
+        for (int op = SUPER_FIRST; op < BC_OPCODE_COUNT; op++) {
+            if (saved[op] > 0 && (best < 0 || saved[op] > saved[best])) best = op;
+        }
+        if (best < 0) {
+            break;
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%s", bc_op_name(best));
+        for (char* c = name; *c; c++) {
+            if (*c >= 'a' && *c <= 'z') *c -= 'a' - 'A';
+        }
+        fprintf(file, "SUPER(BC_%s, %lld)\n", name, saved[best]);
+        printf("%-8s saves %lld dispatches\n", bc_op_name(best), saved[best]);
+        saved[best] = 0;
+    }
+    fclose(file);
+    return 1;
+}
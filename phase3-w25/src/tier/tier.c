@@ -0,0 +1,316 @@
+/* tier.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../../include/tier.h"
+#include "../../include/jit.h"
+#include "../../include/asm.h"
+#include "../../include/codegen.h"
+#include "../../include/bytecode.h"
+#include "../../include/peephole.h"
+#include "../../include/vm.h"
+#include "../../include/ir.h"
+#include "../../include/pass.h"
+
+static int call_threshold = TIER_DEFAULT_CALLS;
+static int loop_threshold = TIER_DEFAULT_LOOPS;
+static int log_enabled = 0;
+
+// Where a function runs
+typedef enum {
+    TIER_INTERPRETED,
+    TIER_NATIVE,
+    TIER_FAILED                // The backend could not compile it; it stays interpreted
+} TierState;
+
+typedef int (*CallEntry)(const Value* args);
+typedef int (*LoopEntry)(Value* frame);
+
+typedef struct {
+    IRProgram* ir;             // Kept for compiling later
+    BCProgram* program;
+    Value* globals;            // Shared by the interpreter and native code
+    int depth;                 // Native calls in progress (bc_depth)
+    int* calls;                // By function: interpreted calls so far
+    int* loops;                // By function: backward jumps taken in the interpreter
+    TierState* state;
+    void** code;               // By function: bc_fN once native
+    CallEntry* enter;          // By function: bc_enter_N once native
+    LoopEntry** osr;           // By function, then block: bc_osr_N_B (NULL if none)
+    JitCode* units;            // Everything loaded so far
+    int unit_count;
+    int unit_capacity;
+} Tier;
+
+void set_tier_thresholds(int calls, int loops) {
+    call_threshold = calls;
+    loop_threshold = loops;
+}
+
+int tier_call_threshold(void) {
+    return call_threshold;
+}
+
+int tier_loop_threshold(void) {
+    return loop_threshold;
+}
+
+void set_tier_log(int enabled) {
+    log_enabled = enabled;
+}
+
+#if JIT_NATIVE
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for tiered execution\n");
+    exit(1);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Flag 'function' and what it may call, short of functions already native
+static int mark_callees(Tier* tier, int function, char* flags) {
+    if (flags[function] || tier->state[function] == TIER_NATIVE) {
+        return 0;
+    }
+    flags[function] = 1;
+    int count = 1;
+    const IRFunction* ir = tier->ir->functions[function];
+    for (int b = 0; b < ir->block_count; b++) {
+        for (int i = 0; !ir->blocks[b].dead && i < ir->blocks[b].count; i++) {
+            const IRInstr* instr = ir->blocks[b].code[i];
+            if (instr->op == IR_CALL && instr->index >= 0) {
+                count += mark_callees(tier, instr->index, flags);
+            }
+        }
+    }
+    return count;
+}
+
+// Translate, assemble and load the flagged functions, linked against the
+// shared data and the functions compiled before
+static int compile_unit(Tier* tier, const char* flags, AsmUnit* unit, JitCode* code, char* error,
+                        int error_size) {
+    char* text = NULL;
+    size_t length = 0;
+    FILE* out = open_memstream(&text, &length);
+    if (!out) out_of_memory();
+    CodegenOptions options = {VM_MAX_FRAMES, flags, 1, 1};
+    int ok = emit_assembly(tier->ir, &options, out);
+    fclose(out);
+    if (!ok) {
+        snprintf(error, error_size, "the native backend cannot translate it");
+        free(text);
+        return 0;
+    }
+    ok = assemble(text, unit);
+    free(text);
+    if (!ok) {
+        snprintf(error, error_size, "cannot assemble generated code (%s)", unit->error);
+        free_asm_unit(unit);
+        return 0;
+    }
+
+    int function_count = tier->ir->function_count;
+    JitSymbol* symbols = malloc((function_count + 2) * sizeof(JitSymbol));
+    char (*names)[32] = malloc((function_count + 1) * sizeof(*names));
+    if (!symbols || !names) out_of_memory();
+    int count = 0;
+    symbols[count++] = (JitSymbol){"bc_globals", tier->globals};
+    symbols[count++] = (JitSymbol){"bc_depth", &tier->depth};
+    for (int f = 0; f < function_count; f++) {
+        if (tier->state[f] == TIER_NATIVE) {
+            snprintf(names[f], sizeof(names[f]), "bc_f%d", f);
+            symbols[count++] = (JitSymbol){names[f], tier->code[f]};
+        }
+    }
+    ok = jit_load(unit, symbols, count, code, error, error_size);
+    free(symbols);
+    free(names);
+    if (!ok) {
+        free_asm_unit(unit);
+    }
+    return ok;
+}
+
+// Compile 'function' and the functions it may call that are not native yet
+static int tier_up(Tier* tier, int function, const char* reason, int count) {
+    const char* name = tier->ir->functions[function]->name;
+    char* flags = calloc(tier->ir->function_count + 1, 1);
+    if (!flags) out_of_memory();
+    int functions = mark_callees(tier, function, flags);
+    double start = now();
+
+    char error[256] = "";
+    for (int f = 0; f < tier->ir->function_count && !error[0]; f++) {
+        if (flags[f] && tier->state[f] == TIER_FAILED) {
+            snprintf(error, sizeof(error), "%s cannot be compiled", tier->ir->functions[f]->name);
+        }
+    }
+    AsmUnit unit;
+    JitCode code;
+    if (error[0] || !compile_unit(tier, flags, &unit, &code, error, sizeof(error))) {
+        if (log_enabled) {
+            fprintf(stderr, "Tier: cannot compile %s (%s); it stays in the interpreter\n", name, error);
+        }
+        tier->state[function] = TIER_FAILED;
+        free(flags);
+        return 0;
+    }
+
+    for (int f = 0; f < tier->ir->function_count; f++) {
+        if (!flags[f]) {
+            continue;
+        }
+        char symbol[64];
+        snprintf(symbol, sizeof(symbol), "bc_f%d", f);
+        tier->code[f] = jit_symbol_address(&code, &unit, symbol);
+        snprintf(symbol, sizeof(symbol), "bc_enter_%d", f);
+        void* address = jit_symbol_address(&code, &unit, symbol);
+        memcpy(&tier->enter[f], &address, sizeof(address));
+        int block_count = tier->program->functions[f].block_count;
+        tier->osr[f] = calloc(block_count + 1, sizeof(LoopEntry));
+        if (!tier->osr[f]) out_of_memory();
+        for (int b = 0; b < block_count; b++) {
+            snprintf(symbol, sizeof(symbol), "bc_osr_%d_%d", f, b);
+            address = jit_symbol_address(&code, &unit, symbol);
+            memcpy(&tier->osr[f][b], &address, sizeof(address));
+        }
+        tier->state[f] = TIER_NATIVE;
+    }
+    if (tier->unit_count == tier->unit_capacity) {
+        tier->unit_capacity = tier->unit_capacity ? tier->unit_capacity * 2 : 8;
+        tier->units = realloc(tier->units, tier->unit_capacity * sizeof(JitCode));
+        if (!tier->units) out_of_memory();
+    }
+    tier->units[tier->unit_count++] = code;
+    if (log_enabled) {
+        fprintf(stderr, "Tier: compiled %s after %d %s (%d function%s, %d bytes of code) in %.2f ms\n", name, count,
+                reason, functions, functions == 1 ? "" : "s", unit.size[ASM_TEXT], (now() - start) * 1000);
+    }
+    free_asm_unit(&unit);
+    free(flags);
+    return 1;
+}
+
+// Native code counts its calls in bc_depth from the interpreter frames
+// already under it, so both hit VM_MAX_FRAMES at the same call
+static int on_call(void* context, int function, int depth, Value* args, Value* result) {
+    Tier* tier = context;
+    if (tier->state[function] != TIER_NATIVE) {
+        if (tier->state[function] == TIER_FAILED || ++tier->calls[function] < call_threshold ||
+            !tier_up(tier, function, "calls", tier->calls[function])) {
+            return 0;
+        }
+    }
+    int saved = tier->depth;
+    tier->depth = depth;
+    result->i = tier->enter[function](args);
+    tier->depth = saved;
+    return 1;
+}
+
+static int on_back_edge(void* context, int function, int depth, int target, Value* frame, Value* result) {
+    Tier* tier = context;
+    if (tier->state[function] != TIER_NATIVE) {
+        if (tier->state[function] == TIER_FAILED || ++tier->loops[function] < loop_threshold ||
+            !tier_up(tier, function, "loop iterations", tier->loops[function])) {
+            return 0;
+        }
+    }
+    const BCFunction* code = &tier->program->functions[function];
+    for (int b = 0; b < code->block_count; b++) {
+        if (code->block_start[b] == target && tier->osr[function][b]) {
+            if (log_enabled) {
+                fprintf(stderr, "Tier: %s enters native code at the loop at line %d\n", code->name,
+                        code->lines[target]);
+            }
+            int saved = tier->depth;
+            tier->depth = depth;
+            result->i = tier->osr[function][b](frame);
+            tier->depth = saved;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_tiered(void* context) {
+    Tier* tier = context;
+    VMTierHooks hooks = {tier, on_call, on_back_edge};
+    int result = 0;
+    int ok = vm_run_tiered(tier->program, tier->globals, &hooks, &result);
+    return ok ? result : 1;
+}
+
+int proc_tiered_file(const char* filename) {
+    PassManager manager;
+    if (!pass_manager_init(&manager, get_pass_pipeline())) {
+        return 1;
+    }
+    IRProgram* ir = compile_file_to_ir(filename, &manager);
+    pass_manager_free(&manager);
+    if (!ir) {
+        return 1;
+    }
+    // On-stack replacement finds each value in the register the bytecode
+    // compiler gave it, which the peephole optimizer's coalescing would undo
+    int peephole = peephole_enabled();
+    set_peephole(0);
+    BCProgram* program = compile_bytecode(ir);
+    set_peephole(peephole);
+    if (!program) {
+        free_ir_program(ir);
+        return 1;
+    }
+
+    Tier tier;
+    memset(&tier, 0, sizeof(tier));
+    int count = ir->function_count + 1;
+    tier.ir = ir;
+    tier.program = program;
+    tier.globals = calloc(ir->global_count + 1, sizeof(Value));
+    tier.calls = calloc(count, sizeof(int));
+    tier.loops = calloc(count, sizeof(int));
+    tier.state = calloc(count, sizeof(TierState));
+    tier.code = calloc(count, sizeof(void*));
+    tier.enter = calloc(count, sizeof(CallEntry));
+    tier.osr = calloc(count, sizeof(LoopEntry*));
+    if (!tier.globals || !tier.calls || !tier.loops || !tier.state || !tier.code || !tier.enter || !tier.osr) {
+        out_of_memory();
+    }
+
+    // Native code runs on the interpreter's thread, so that one gets the stack
+    int result = jit_call(jit_stack_size(ir), run_tiered, &tier);
+    fflush(stdout);
+
+    for (int u = 0; u < tier.unit_count; u++) {
+        jit_unload(&tier.units[u]);
+    }
+    for (int f = 0; f < ir->function_count; f++) {
+        free(tier.osr[f]);
+    }
+    free(tier.units);
+    free(tier.globals);
+    free(tier.calls);
+    free(tier.loops);
+    free(tier.state);
+    free(tier.code);
+    free(tier.enter);
+    free(tier.osr);
+    free_bytecode(program);
+    free_ir_program(ir);
+    return result;
+}
+#else
+// Without native code (jit.h) everything stays in the interpreter
+int proc_tiered_file(const char* filename) {
+    fprintf(stderr, "Note: native code is not supported on this platform; running %s in the interpreter\n",
+            filename);
+    return proc_run_file(filename);
+}
+#endif
@@ -0,0 +1,380 @@
+/* vm.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+#include "../../include/vm.h"
+#include "../../include/bytecode.h"
+#include "../../include/ir.h"
+#include "../../include/pass.h"
+
+// A suspended caller: where it resumes and where the result goes
+typedef struct {
+    const BCFunction* function;
+    const BCInstr* pc;
+    Value* base;
+    int dest;
+} Frame;
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Error: Memory allocation failed for the virtual machine\n");
+    exit(1);
+}
+
+// Float to int, truncating; out-of-range values saturate and NaN is 0
+static int float_to_int(double f) {
+    if (f != f) return 0;
+    if (f >= 2147483647.0) return INT_MAX;
+    if (f <= -2147483648.0) return INT_MIN;
+    return (int)f;
+}
+
+static int factorial(int n) {
+    unsigned int result = 1;
+    for (int k = 2; k <= n; k++) result *= (unsigned int)k;
+    return (int)result;
+}
+
+static void runtime_error(const BCFunction* function, const BCInstr* pc, const char* message) {
+    int line = function->lines[pc - function->code];
+    fflush(stdout);
+    fprintf(stderr, "Runtime error at line %d in %s: %s\n", line, function->name, message);
+}
+
+// Only the tiered loop (below) hooks calls and backward jumps
+#define VM_ON_CALL(callee, args)
+#define VM_ON_BACK_EDGE()
+
+// Handlers end by fetching the next instruction. The switch build funnels
+// every handler back through one indirect jump; the threaded build (GCC's
+// labels as values) gives each handler its own, so the branch predictor
+// learns which handler tends to follow which.
+#define VM_EXECUTE execute_switch
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+#define VM_LOOP_BEGIN                                                                \
+    for (;;) {                                                                       \
+        instr = pc++;                                                                \
+        executed++;                                                                  \
+        switch (instr->op) {
+#define VM_LOOP_END                                                                  \
+            default:                                                                 \
+                runtime_error(function, instr, "invalid instruction");               \
+                ok = 0;                                                              \
+                goto done;                                                           \
+        }                                                                            \
+    }
+#include "vm_loop.inc"
+#undef VM_EXECUTE
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_LOOP_BEGIN
+#undef VM_LOOP_END
+
+#if VM_HAS_THREADED
+#define VM_EXECUTE execute_threaded
+#define VM_CASE(op) L_##op:
+#define VM_NEXT()                                                                    \
+    do {                                                                             \
+        instr = pc++;                                                                \
+        executed++;                                                                  \
+        goto *dispatch_table[instr->op];                                             \
+    } while (0)
+#define VM_LOOP_BEGIN                                                                \
+    static const void* const dispatch_table[BC_OPCODE_COUNT] = {                     \
+        [BC_LOADK] = &&L_BC_LOADK, [BC_MOVE] = &&L_BC_MOVE,                          \
+        [BC_LOADG] = &&L_BC_LOADG, [BC_STOREG] = &&L_BC_STOREG,                      \
+        [BC_ADDI] = &&L_BC_ADDI, [BC_SUBI] = &&L_BC_SUBI,                            \
+        [BC_MULI] = &&L_BC_MULI, [BC_DIVI] = &&L_BC_DIVI,                            \
+        [BC_ADDF] = &&L_BC_ADDF, [BC_SUBF] = &&L_BC_SUBF,                            \
+        [BC_MULF] = &&L_BC_MULF, [BC_DIVF] = &&L_BC_DIVF,                            \
+        [BC_EQI] = &&L_BC_EQI, [BC_NEI] = &&L_BC_NEI, [BC_LTI] = &&L_BC_LTI,         \
+        [BC_LEI] = &&L_BC_LEI, [BC_GTI] = &&L_BC_GTI, [BC_GEI] = &&L_BC_GEI,         \
+        [BC_EQF] = &&L_BC_EQF, [BC_NEF] = &&L_BC_NEF, [BC_LTF] = &&L_BC_LTF,         \
+        [BC_LEF] = &&L_BC_LEF, [BC_GTF] = &&L_BC_GTF, [BC_GEF] = &&L_BC_GEF,         \
+        [BC_AND] = &&L_BC_AND, [BC_OR] = &&L_BC_OR,                                  \
+        [BC_ITOF] = &&L_BC_ITOF, [BC_FTOI] = &&L_BC_FTOI,                            \
+        [BC_FACT] = &&L_BC_FACT, [BC_CALL] = &&L_BC_CALL,                            \
+        [BC_PRINTI] = &&L_BC_PRINTI, [BC_PRINTF] = &&L_BC_PRINTF,                    \
+        [BC_PRINTS] = &&L_BC_PRINTS, [BC_JUMP] = &&L_BC_JUMP,                        \
+        [BC_JUMPIF] = &&L_BC_JUMPIF, [BC_JUMPIFNOT] = &&L_BC_JUMPIFNOT,              \
+        [BC_RETURN] = &&L_BC_RETURN,                                                 \
+        [BC_ADDIK] = &&L_BC_ADDIK, [BC_SUBIK] = &&L_BC_SUBIK,                        \
+        [BC_MULIK] = &&L_BC_MULIK, [BC_DIVIK] = &&L_BC_DIVIK,                        \
+        [BC_ADDFK] = &&L_BC_ADDFK, [BC_SUBFK] = &&L_BC_SUBFK,                        \
+        [BC_MULFK] = &&L_BC_MULFK, [BC_DIVFK] = &&L_BC_DIVFK,                        \
+        [BC_JEQI] = &&L_BC_JEQI, [BC_JNEI] = &&L_BC_JNEI, [BC_JLTI] = &&L_BC_JLTI,   \
+        [BC_JLEI] = &&L_BC_JLEI, [BC_JGTI] = &&L_BC_JGTI, [BC_JGEI] = &&L_BC_JGEI,   \
+        [BC_JEQIK] = &&L_BC_JEQIK, [BC_JNEIK] = &&L_BC_JNEIK,                        \
+        [BC_JLTIK] = &&L_BC_JLTIK, [BC_JLEIK] = &&L_BC_JLEIK,                        \
+        [BC_JGTIK] = &&L_BC_JGTIK, [BC_JGEIK] = &&L_BC_JGEIK                         \
+    };                                                                               \
+    VM_NEXT();
+#define VM_LOOP_END
+#include "vm_loop.inc"
+#undef VM_EXECUTE
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_LOOP_BEGIN
+#undef VM_LOOP_END
+#endif
+
+// The profiling loop: the switch loop, recording each opcode it dispatches
+static VMProfile* active_profile;
+static int profile_history[2];
+
+static void profile_op(int op) {
+    VMProfile* profile = active_profile;
+    int first = profile_history[0];
+    int second = profile_history[1];
+    profile->ops[op]++;
+    if (second >= 0) {
+        profile->pairs[second * BC_OPCODE_COUNT + op]++;
+        if (first >= 0) {
+            profile->triples[(first * BC_OPCODE_COUNT + second) * BC_OPCODE_COUNT + op]++;
+        }
+    }
+    profile_history[0] = second;
+    profile_history[1] = op;
+}
+
+#define VM_EXECUTE execute_profile
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+#define VM_LOOP_BEGIN                                                                \
+    for (;;) {                                                                       \
+        instr = pc++;                                                                \
+        executed++;                                                                  \
+        profile_op(instr->op);                                                       \
+        switch (instr->op) {
+#define VM_LOOP_END                                                                  \
+            default:                                                                 \
+                runtime_error(function, instr, "invalid instruction");               \
+                ok = 0;                                                              \
+                goto done;                                                           \
+        }                                                                            \
+    }
+#include "vm_loop.inc"
+#undef VM_EXECUTE
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_LOOP_BEGIN
+#undef VM_LOOP_END
+
+#undef VM_ON_CALL
+#undef VM_ON_BACK_EDGE
+
+// The tiered loop: the switch loop, offering each call and each backward
+// jump to the tiering hooks, which may run native code in its place
+static const VMTierHooks* active_hooks;
+
+#define VM_EXECUTE execute_tiered
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+#define VM_LOOP_BEGIN                                                                \
+    for (;;) {                                                                       \
+        instr = pc++;                                                                \
+        executed++;                                                                  \
+        switch (instr->op) {
+#define VM_LOOP_END                                                                  \
+            default:                                                                 \
+                runtime_error(function, instr, "invalid instruction");               \
+                ok = 0;                                                              \
+                goto done;                                                           \
+        }                                                                            \
+    }
+#define VM_ON_CALL(callee, args)                                                     \
+    if (active_hooks->call(active_hooks->context, callee, depth + 1, args, &r[instr->a])) { \
+        VM_NEXT();                                                                   \
+    }
+#define VM_ON_BACK_EDGE()                                                            \
+    if (pc <= instr) {                                                               \
+        Value native;                                                                \
+        if (active_hooks->back_edge(active_hooks->context, (int)(function - program->functions), \
+                                    depth, (int)(pc - function->code), r, &native)) { \
+            VM_RETURN(native)                                                        \
+        }                                                                            \
+    }
+#include "vm_loop.inc"
+#undef VM_EXECUTE
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_LOOP_BEGIN
+#undef VM_LOOP_END
+#undef VM_ON_CALL
+#undef VM_ON_BACK_EDGE
+
+static VMDispatch dispatch = VM_HAS_THREADED ? VM_DISPATCH_THREADED : VM_DISPATCH_SWITCH;
+
+int set_vm_dispatch(const char* name) {
+    if (strcmp(name, "switch") == 0) {
+        dispatch = VM_DISPATCH_SWITCH;
+        return 1;
+    }
+    if (strcmp(name, "threaded") == 0 && VM_HAS_THREADED) {
+        dispatch = VM_DISPATCH_THREADED;
+        return 1;
+    }
+    return 0;
+}
+
+// Which loop runs: a dispatch method, the profiler or the tiered loop
+#define VM_PROFILING (-1)
+#define VM_TIERED (-2)
+
+static int execute(const BCProgram* program, int method, int entry, Value* globals, Value* stack,
+                   Frame* frames, int quiet, VMStats* stats, Value* result) {
+    if (method == VM_PROFILING) {
+        return execute_profile(program, entry, globals, stack, frames, quiet, stats, result);
+    }
+    if (method == VM_TIERED) {
+        return execute_tiered(program, entry, globals, stack, frames, quiet, stats, result);
+    }
+#if VM_HAS_THREADED
+    if (method == VM_DISPATCH_THREADED) {
+        return execute_threaded(program, entry, globals, stack, frames, quiet, stats, result);
+    }
+#endif
+    return execute_switch(program, entry, globals, stack, frames, quiet, stats, result);
+}
+
+// Run the top-level statements, then niam, with the globals given (or fresh ones)
+static int run_with(const BCProgram* program, int method, Value* shared_globals, int quiet, VMStats* stats,
+                    int* result) {
+    Value* globals = shared_globals ? shared_globals : calloc(program->global_count + 1, sizeof(Value));
+    Value* stack = malloc(VM_STACK_SIZE * sizeof(Value));
+    Frame* frames = malloc(VM_MAX_FRAMES * sizeof(Frame));
+    if (!globals || !stack || !frames) out_of_memory();
+
+    Value value;
+    memset(&value, 0, sizeof(value));
+    int ok = 1;
+    if (program->init_function >= 0) {
+        ok = execute(program, method, program->init_function, globals, stack, frames, quiet, stats, &value);
+    }
+    value.i = 0;
+    if (ok && program->main_function >= 0) {
+        ok = execute(program, method, program->main_function, globals, stack, frames, quiet, stats, &value);
+    }
+    *result = value.i;
+
+    if (!shared_globals) {
+        free(globals);
+    }
+    free(stack);
+    free(frames);
+    return ok;
+}
+
+int vm_run(const BCProgram* program, int quiet, VMStats* stats, int* result) {
+    return run_with(program, dispatch, NULL, quiet, stats, result);
+}
+
+int vm_run_tiered(const BCProgram* program, Value* globals, const VMTierHooks* hooks, int* result) {
+    active_hooks = hooks;
+    int ok = run_with(program, VM_TIERED, globals, 0, NULL, result);
+    active_hooks = NULL;
+    return ok;
+}
+
+int vm_profile(const BCProgram* program, VMProfile* profile, VMStats* stats) {
+    int result;
+    active_profile = profile;
+    profile_history[0] = profile_history[1] = -1;
+    int ok = run_with(program, VM_PROFILING, NULL, 1, stats, &result);
+    active_profile = NULL;
+    return ok;
+}
+
+// Parse, check, optimize and compile a file to bytecode (NULL on errors)
+BCProgram* compile_file_to_bytecode(const char* filename) {
+    PassManager manager;
+    if (!pass_manager_init(&manager, get_pass_pipeline())) {
+        return NULL;
+    }
+    IRProgram* ir = compile_file_to_ir(filename, &manager);
+    pass_manager_free(&manager);
+    if (!ir) {
+        return NULL;
+    }
+    BCProgram* program = compile_bytecode(ir);
+    free_ir_program(ir);
+    return program;
+}
+
+int proc_run_file(const char* filename) {
+    BCProgram* program = compile_file_to_bytecode(filename);
+    if (!program) {
+        return 1;
+    }
+    int result = 0;
+    int ok = vm_run(program, 0, NULL, &result);
+    fflush(stdout);
+    free_bytecode(program);
+    return ok ? result : 1;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Time-stamp counter, where the target has one
+static unsigned long long cycles(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Minimum time spent running each benchmark
+#define BENCH_SECONDS 0.25
+
+static const char* dispatch_names[] = {"switch", "threaded"};
+
+void proc_bench_files(int count, char* filenames[]) {
+    printf("%-32s %-9s %14s %6s %12s %10s %10s\n", "program", "dispatch", "instructions", "runs",
+           "ms/run", "Mops/s", "cycles/op");
+    for (int i = 0; i < count; i++) {
+        BCProgram* program = compile_file_to_bytecode(filenames[i]);
+        if (!program) {
+            continue;
+        }
+
+        for (int method = VM_DISPATCH_SWITCH; method <= (VM_HAS_THREADED ? VM_DISPATCH_THREADED : VM_DISPATCH_SWITCH);
+             method++) {
+            VMStats stats = {0, 0};
+            int runs = 0;
+            int ok = 1;
+            int result;
+            double start = now();
+            unsigned long long first_cycle = cycles();
+            double elapsed = 0;
+            while (ok && (runs == 0 || elapsed < BENCH_SECONDS)) {
+                ok = run_with(program, method, NULL, 1, &stats, &result);
+                runs++;
+                elapsed = now() - start;
+            }
+            unsigned long long spent = cycles() - first_cycle;
+            if (!ok) {
+                break;
+            }
+
+            printf("%-32s %-9s %14lld %6d %12.3f %10.1f", filenames[i], dispatch_names[method],
+                   stats.executed / runs, runs, elapsed * 1000 / runs,
+                   elapsed > 0 ? stats.executed / elapsed / 1e6 : 0.0);
+            if (spent && stats.executed) {
+                printf(" %10.2f\n", (double)spent / stats.executed);
+            } else {
+                printf(" %10s\n", "-");
+            }
+        }
+        free_bytecode(program);
+    }
+}